@@ -141,7 +141,10 @@ static struct corosync_api_v1 apidef_corosync_api_v1 = {
 	.state_dump = corosync_state_dump,
 	.poll_handle_get = cs_poll_handle_get,
 	.poll_dispatch_add = cs_poll_dispatch_add,
-	.poll_dispatch_delete = cs_poll_dispatch_delete
+	.poll_dispatch_delete = cs_poll_dispatch_delete,
+	.ipc_dispatch_buf_create = cs_ipcs_dispatch_buf_create,
+	.ipc_dispatch_buf_send = cs_ipcs_dispatch_buf_send,
+	.ipc_dispatch_buf_release = cs_ipcs_dispatch_buf_release
 };
 
 struct corosync_api_v1 *apidef_get (void)
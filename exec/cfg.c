@@ -563,101 +563,318 @@ static int nullcheck_strcmp(const char* left, const char *right)
 }
 
 /*
- * If a key has changed value in the new file, then warn the user and remove it from the temp_map
+ * Keys that cannot be changed at run time. A log message will be issued for each
+ * entry that the user wants to change but they cannot.
+ *
+ * Add more here as needed.
+ */
+static const char *reload_ro_keys[] = {
+	"totem.secauth",
+	"totem.crypto_hash",
+	"totem.crypto_cipher",
+	"totem.version",
+	"totem.threads",
+	"totem.ip_version",
+	"totem.rrp_mode",
+	"totem.netmtu",
+	"totem.interface.ringnumber",
+	"totem.interface.bindnetaddr",
+	"totem.interface.mcastaddr",
+	"totem.interface.broadcast",
+	"totem.interface.mcastport",
+	"totem.interface.ttl",
+	"totem.vsftype",
+	"totem.transport",
+	"totem.cluster_name",
+	"quorum.provider",
+	"qb.ipc_type",
+};
+
+/*
+ * Prefixes of keys which are removed from the live config when they are
+ * no longer in corosync.conf
+ */
+static const char *reload_prefixes[] = {
+	"logging.",
+	"totem.",
+	"nodelist.",
+	"quorum.",
+	"uidgid.config.",
+};
+
+enum reload_diff_op {
+	RELOAD_DIFF_ADD,
+	RELOAD_DIFF_CHANGE,
+	RELOAD_DIFF_DELETE,
+};
+
+struct reload_diff_entry {
+	char *key_name;
+	enum reload_diff_op op;
+};
+
+/*
+ * Difference between live config and newly parsed config, ordered by key name
+ * within every prefix
  */
-static void delete_and_notify_if_changed(icmap_map_t temp_map, const char *key_name)
+struct reload_diff {
+	struct reload_diff_entry *entries;
+	size_t size;
+	size_t allocated;
+	unsigned int no_ops[RELOAD_DIFF_DELETE + 1];
+};
+
+static int is_reload_ro_key(const char *key_name)
 {
-	if (!(icmap_key_value_eq(temp_map, key_name, icmap_get_global_map(), key_name))) {
-		if (icmap_delete_r(temp_map, key_name) == CS_OK) {
-			log_printf(LOGSYS_LEVEL_NOTICE, "Modified entry '%s' in corosync.conf cannot be changed at run-time", key_name);
+	size_t i;
+
+	for (i = 0; i < sizeof(reload_ro_keys) / sizeof(reload_ro_keys[0]); i++) {
+		if (strcmp(key_name, reload_ro_keys[i]) == 0) {
+			return (1);
 		}
 	}
+
+	return (0);
 }
-/*
- * Remove any keys from the new config file that in the new corosync.conf but that
- * cannot be changed at run time. A log message will be issued for each
- * entry that the user wants to change but they cannot.
- *
- * Add more here as needed.
- */
-static void remove_ro_entries(icmap_map_t temp_map)
+
+static int is_reload_prefix_key(const char *key_name)
 {
-	delete_and_notify_if_changed(temp_map, "totem.secauth");
-	delete_and_notify_if_changed(temp_map, "totem.crypto_hash");
-	delete_and_notify_if_changed(temp_map, "totem.crypto_cipher");
-	delete_and_notify_if_changed(temp_map, "totem.version");
-	delete_and_notify_if_changed(temp_map, "totem.threads");
-	delete_and_notify_if_changed(temp_map, "totem.ip_version");
-	delete_and_notify_if_changed(temp_map, "totem.rrp_mode");
-	delete_and_notify_if_changed(temp_map, "totem.netmtu");
-	delete_and_notify_if_changed(temp_map, "totem.interface.ringnumber");
-	delete_and_notify_if_changed(temp_map, "totem.interface.bindnetaddr");
-	delete_and_notify_if_changed(temp_map, "totem.interface.mcastaddr");
-	delete_and_notify_if_changed(temp_map, "totem.interface.broadcast");
-	delete_and_notify_if_changed(temp_map, "totem.interface.mcastport");
-	delete_and_notify_if_changed(temp_map, "totem.interface.ttl");
-	delete_and_notify_if_changed(temp_map, "totem.vsftype");
-	delete_and_notify_if_changed(temp_map, "totem.transport");
-	delete_and_notify_if_changed(temp_map, "totem.cluster_name");
-	delete_and_notify_if_changed(temp_map, "quorum.provider");
-	delete_and_notify_if_changed(temp_map, "qb.ipc_type");
+	size_t i;
+
+	for (i = 0; i < sizeof(reload_prefixes) / sizeof(reload_prefixes[0]); i++) {
+		if (strncmp(key_name, reload_prefixes[i], strlen(reload_prefixes[i])) == 0) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+static void reload_diff_free(struct reload_diff *diff)
+{
+	size_t i;
+
+	for (i = 0; i < diff->size; i++) {
+		free(diff->entries[i].key_name);
+	}
+	free(diff->entries);
+	memset(diff, 0, sizeof(*diff));
+}
+
+static cs_error_t reload_diff_add(struct reload_diff *diff, const char *key_name,
+	enum reload_diff_op op)
+{
+	struct reload_diff_entry *new_entries;
+	size_t new_allocated;
+
+	/*
+	 * Read-only keys are never added or changed, only deleted
+	 */
+	if (op != RELOAD_DIFF_DELETE && is_reload_ro_key(key_name)) {
+		log_printf(LOGSYS_LEVEL_NOTICE, "Modified entry '%s' in corosync.conf cannot be changed at run-time", key_name);
+		return (CS_OK);
+	}
+
+	if (diff->size == diff->allocated) {
+		new_allocated = (diff->allocated == 0 ? 64 : diff->allocated * 2);
+		new_entries = realloc(diff->entries, new_allocated * sizeof(*new_entries));
+		if (new_entries == NULL) {
+			return (CS_ERR_NO_MEMORY);
+		}
+		diff->entries = new_entries;
+		diff->allocated = new_allocated;
+	}
+
+	/*
+	 * Tracker callbacks may modify the live map while the diff is applied,
+	 * so don't keep pointers to its keys
+	 */
+	diff->entries[diff->size].key_name = strdup(key_name);
+	if (diff->entries[diff->size].key_name == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+	diff->entries[diff->size].op = op;
+	diff->size++;
+	diff->no_ops[op]++;
+
+	return (CS_OK);
 }
 
 /*
- * Remove entries that exist in the global map, but not in the temp_map, this will
- * cause delete notifications to be sent to any listeners.
+ * Walk both maps in alpha-sorted order of keys with given prefix and record
+ * added, changed and deleted keys.
  *
  * NOTE: This routine depends entirely on the keys returned by the iterators
  * being in alpha-sorted order.
  */
-static void remove_deleted_entries(icmap_map_t temp_map, const char *prefix)
+static cs_error_t reload_diff_prefix(struct reload_diff *diff, icmap_map_t temp_map,
+	const char *prefix)
 {
 	icmap_iter_t old_iter;
 	icmap_iter_t new_iter;
 	const char *old_key, *new_key;
+	cs_error_t err;
 	int ret;
 
 	old_iter = icmap_iter_init(prefix);
 	new_iter = icmap_iter_init_r(temp_map, prefix);
+	if (old_iter == NULL || new_iter == NULL) {
+		err = CS_ERR_NO_MEMORY;
+		goto exit_iter_finalize;
+	}
+
+	err = CS_OK;
 
 	old_key = icmap_iter_next(old_iter, NULL, NULL);
 	new_key = icmap_iter_next(new_iter, NULL, NULL);
 
-	while (old_key || new_key) {
+	while (err == CS_OK && (old_key || new_key)) {
 		ret = nullcheck_strcmp(old_key, new_key);
 		if ((ret < 0 && old_key) || !new_key) {
 			/*
-			 * new_key is greater, a line (or more) has been deleted
-			 * Continue until old is >= new
+			 * new_key is greater, old_key has been deleted
 			 */
-			do {
-				/* Remove it from icmap & send notifications */
-				icmap_delete(old_key);
-
-				old_key = icmap_iter_next(old_iter, NULL, NULL);
-				ret = nullcheck_strcmp(old_key, new_key);
-			} while (ret < 0 && old_key);
-		}
-		else if ((ret > 0 && new_key) || !old_key) {
+			err = reload_diff_add(diff, old_key, RELOAD_DIFF_DELETE);
+			old_key = icmap_iter_next(old_iter, NULL, NULL);
+		} else if ((ret > 0 && new_key) || !old_key) {
 			/*
-			 * old_key is greater, a line (or more) has been added
-			 * Continue until new is >= old
-			 *
-			 * we don't need to do anything special with this like tell
-			 * icmap. That will happen when we copy the values over
+			 * old_key is greater, new_key has been added
 			 */
-			do {
-				new_key = icmap_iter_next(new_iter, NULL, NULL);
-				ret = nullcheck_strcmp(old_key, new_key);
-			} while (ret > 0 && new_key);
-		}
-		if (ret == 0) {
+			err = reload_diff_add(diff, new_key, RELOAD_DIFF_ADD);
+			new_key = icmap_iter_next(new_iter, NULL, NULL);
+		} else {
+			if (!icmap_key_value_eq(temp_map, new_key, icmap_get_global_map(), old_key)) {
+				err = reload_diff_add(diff, new_key, RELOAD_DIFF_CHANGE);
+			}
 			new_key = icmap_iter_next(new_iter, NULL, NULL);
 			old_key = icmap_iter_next(old_iter, NULL, NULL);
 		}
 	}
-	icmap_iter_finalize(new_iter);
-	icmap_iter_finalize(old_iter);
+
+exit_iter_finalize:
+	if (new_iter != NULL) {
+		icmap_iter_finalize(new_iter);
+	}
+	if (old_iter != NULL) {
+		icmap_iter_finalize(old_iter);
+	}
+
+	return (err);
+}
+
+/*
+ * Record keys of temp_map outside of reload_prefixes. These are never deleted from
+ * the live config, only added or changed.
+ */
+static cs_error_t reload_diff_other(struct reload_diff *diff, icmap_map_t temp_map)
+{
+	icmap_iter_t iter;
+	const char *key_name;
+	cs_error_t err;
+
+	iter = icmap_iter_init_r(temp_map, NULL);
+	if (iter == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	err = CS_OK;
+
+	while (err == CS_OK && (key_name = icmap_iter_next(iter, NULL, NULL)) != NULL) {
+		if (is_reload_prefix_key(key_name)) {
+			continue;
+		}
+
+		if (icmap_get(key_name, NULL, NULL, NULL) != CS_OK) {
+			err = reload_diff_add(diff, key_name, RELOAD_DIFF_ADD);
+		} else if (!icmap_key_value_eq(temp_map, key_name, icmap_get_global_map(), key_name)) {
+			err = reload_diff_add(diff, key_name, RELOAD_DIFF_CHANGE);
+		}
+	}
+
+	icmap_iter_finalize(iter);
+
+	return (err);
+}
+
+static cs_error_t reload_diff_create(struct reload_diff *diff, icmap_map_t temp_map)
+{
+	cs_error_t err;
+	size_t i;
+
+	memset(diff, 0, sizeof(*diff));
+
+	for (i = 0; i < sizeof(reload_prefixes) / sizeof(reload_prefixes[0]); i++) {
+		err = reload_diff_prefix(diff, temp_map, reload_prefixes[i]);
+		if (err != CS_OK) {
+			goto error_free;
+		}
+	}
+
+	err = reload_diff_other(diff, temp_map);
+	if (err != CS_OK) {
+		goto error_free;
+	}
+
+	return (CS_OK);
+
+error_free:
+	reload_diff_free(diff);
+
+	return (err);
+}
+
+static cs_error_t reload_diff_copy_key(icmap_map_t temp_map, const char *key_name)
+{
+	void *value;
+	size_t value_len;
+	icmap_value_types_t type;
+	cs_error_t err;
+
+	err = icmap_get_r(temp_map, key_name, NULL, &value_len, &type);
+	if (err != CS_OK) {
+		return (err);
+	}
+
+	value = malloc(value_len);
+	if (value == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	err = icmap_get_r(temp_map, key_name, value, &value_len, &type);
+	if (err == CS_OK) {
+		err = icmap_set(key_name, value, value_len, type);
+	}
+
+	free(value);
+
+	return (err);
+}
+
+/*
+ * Apply diff to the live config. Deleted keys are removed first, then added and
+ * changed keys are copied from temp_map, so trackers only see keys which really changed.
+ */
+static cs_error_t reload_diff_apply(const struct reload_diff *diff, icmap_map_t temp_map)
+{
+	cs_error_t err;
+	size_t i;
+
+	for (i = 0; i < diff->size; i++) {
+		if (diff->entries[i].op == RELOAD_DIFF_DELETE) {
+			icmap_delete(diff->entries[i].key_name);
+		}
+	}
+
+	for (i = 0; i < diff->size; i++) {
+		if (diff->entries[i].op != RELOAD_DIFF_DELETE) {
+			err = reload_diff_copy_key(temp_map, diff->entries[i].key_name);
+			if (err != CS_OK) {
+				return (err);
+			}
+		}
+	}
+
+	return (CS_OK);
 }
 
 /*
@@ -670,6 +887,7 @@ static void message_handler_req_exec_cfg_reload_config (
 	const struct req_exec_cfg_reload_config *req_exec_cfg_reload_config = message;
 	struct res_lib_cfg_reload_config res_lib_cfg_reload_config;
 	icmap_map_t temp_map;
+	struct reload_diff diff;
 	const char *error_string;
 	int res = CS_OK;
 
@@ -695,31 +913,39 @@ static void message_handler_req_exec_cfg_reload_config (
 		goto reload_return;
 	}
 
-	/* Tell interested listeners that we have started a reload */
-	icmap_set_uint8("config.reload_in_progress", 1);
+	/*
+	 * Compute the whole difference before touching the live config, so a failure
+	 * here leaves it untouched.
+	 */
+	if ((res = reload_diff_create(&diff, temp_map)) != CS_OK) {
+		log_printf(LOGSYS_LEVEL_ERROR, "Unable to compare new config with the live one. config file reload cancelled\n");
+		goto reload_fini;
+	}
 
-	/* Detect deleted entries and remove them from the main icmap hashtable */
-	remove_deleted_entries(temp_map, "logging.");
-	remove_deleted_entries(temp_map, "totem.");
-	remove_deleted_entries(temp_map, "nodelist.");
-	remove_deleted_entries(temp_map, "quorum.");
-	remove_deleted_entries(temp_map, "uidgid.config.");
+	log_printf(LOGSYS_LEVEL_DEBUG, "Config reload: %u keys added, %u changed, %u deleted",
+		diff.no_ops[RELOAD_DIFF_ADD], diff.no_ops[RELOAD_DIFF_CHANGE],
+		diff.no_ops[RELOAD_DIFF_DELETE]);
 
-	/* Remove entries that cannot be changed */
-	remove_ro_entries(temp_map);
+	/* Tell interested listeners that we have started a reload */
+	icmap_set_uint8("config.reload_in_progress", 1);
 
 	/*
-	 * Copy new keys into live config.
+	 * Copy changed keys into live config. Changes are notified together when
+	 * the transaction is committed.
 	 * If this fails we will have a partially loaded config because some keys (above) might
 	 * have been reset to defaults - I'm not sure what to do here, we might have to quit.
 	 */
-	if ( (res = icmap_copy_map(icmap_get_global_map(), temp_map)) != CS_OK) {
+	(void)icmap_transaction_begin();
+	if ( (res = reload_diff_apply(&diff, temp_map)) != CS_OK) {
 		log_printf (LOGSYS_LEVEL_ERROR, "Error making new config live. cmap database may be inconsistent\n");
 	}
+	(void)icmap_transaction_commit();
 
 	/* All done - let clients know */
 	icmap_set_uint8("config.reload_in_progress", 0);
 
+	reload_diff_free(&diff);
+
 reload_fini:
 	/* Finished with the temporary storage */
 	icmap_fini_r(temp_map);
@@ -65,6 +65,17 @@ LOGSYS_DECLARE_SUBSYS ("CMAP");
 struct cmap_conn_info {
 	struct hdb_handle_database iter_db;
 	struct hdb_handle_database track_db;
+	struct hdb_handle_database dump_db;
+};
+
+/*
+ * State of dump_prefix between requests. pending_key is key which didn't fit
+ * into previous response.
+ */
+struct cmap_dump_state {
+	icmap_iter_t iter;
+	int pending;
+	char pending_key[ICMAP_KEYNAME_MAXLEN + 1];
 };
 
 typedef uint64_t cmap_iter_handle_t;
@@ -100,6 +111,7 @@ static void message_handler_req_lib_cmap_adjust_int(void *conn, const void *mess
 static void message_handler_req_lib_cmap_iter_init(void *conn, const void *message);
 static void message_handler_req_lib_cmap_iter_next(void *conn, const void *message);
 static void message_handler_req_lib_cmap_iter_finalize(void *conn, const void *message);
+static void message_handler_req_lib_cmap_dump_prefix(void *conn, const void *message);
 static void message_handler_req_lib_cmap_track_add(void *conn, const void *message);
 static void message_handler_req_lib_cmap_track_delete(void *conn, const void *message);
 
@@ -109,6 +121,10 @@ static void cmap_notify_fn(int32_t event,
 		struct icmap_notify_value old_val,
 		void *user_data);
 
+static void cmap_notify_batch_fn(const struct icmap_notify_change *changes,
+		size_t no_changes,
+		void *user_data);
+
 static void message_handler_req_exec_cmap_mcast(
 		const void *message,
 		unsigned int nodeid);
@@ -183,6 +199,10 @@ static struct corosync_lib_handler cmap_lib_engine[] =
 		.lib_handler_fn				= message_handler_req_lib_cmap_track_delete,
 		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
 	},
+	{ /* 9 */
+		.lib_handler_fn				= message_handler_req_lib_cmap_dump_prefix,
+		.flow_control				= CS_LIB_FLOW_CONTROL_NOT_REQUIRED
+	},
 };
 
 static struct corosync_exec_handler cmap_exec_engine[] =
@@ -296,6 +316,8 @@ static char *cmap_exec_init_fn (
 		return ((char *)"Can't add config_version icmap tracker");
 	}
 
+	icmap_set_uint8(CMAP_DUMP_PREFIX_SUPPORTED_KEY, 1);
+
 	return (NULL);
 }
 
@@ -310,6 +332,7 @@ static int cmap_lib_init_fn (void *conn)
 	memset(conn_info, 0, sizeof(*conn_info));
 	hdb_create(&conn_info->iter_db);
 	hdb_create(&conn_info->track_db);
+	hdb_create(&conn_info->dump_db);
 
 	return (0);
 }
@@ -321,6 +344,8 @@ static int cmap_lib_exit_fn (void *conn)
 	icmap_iter_t *iter;
 	hdb_handle_t track_handle = 0;
 	icmap_track_t *track;
+	hdb_handle_t dump_handle = 0;
+	struct cmap_dump_state *dump_state;
 
 	log_printf(LOGSYS_LEVEL_DEBUG, "exit_fn for conn=%p", conn);
 
@@ -347,6 +372,16 @@ static int cmap_lib_exit_fn (void *conn)
         }
 	hdb_destroy(&conn_info->track_db);
 
+	hdb_iterator_reset(&conn_info->dump_db);
+        while (hdb_iterator_next(&conn_info->dump_db,
+                (void*)&dump_state, &dump_handle) == 0) {
+
+		icmap_iter_finalize(dump_state->iter);
+
+		(void)hdb_handle_put (&conn_info->dump_db, dump_handle);
+        }
+	hdb_destroy(&conn_info->dump_db);
+
 	api->ipc_refcnt_dec(conn);
 
 	return (0);
@@ -661,6 +696,159 @@ reply_send:
 	api->ipc_response_send(conn, &res_lib_cmap_iter_finalize, sizeof(res_lib_cmap_iter_finalize));
 }
 
+/*
+ * Pack as many keys as fit into res. Sets *finished when iterator is exhausted.
+ */
+static cs_error_t cmap_dump_prefix_fill(
+	struct cmap_dump_state *dump_state,
+	struct res_lib_cmap_dump_prefix *res,
+	size_t *res_size,
+	int *finished)
+{
+	struct res_lib_cmap_dump_prefix_item *item;
+	const char *key_name;
+	size_t key_len;
+	size_t value_len;
+	size_t item_size;
+	icmap_value_types_t type;
+	cs_error_t err;
+
+	*finished = 0;
+
+	while (1) {
+		if (dump_state->pending) {
+			key_name = dump_state->pending_key;
+			dump_state->pending = 0;
+
+			if (icmap_get(key_name, NULL, &value_len, &type) != CS_OK) {
+				/*
+				 * Key was deleted in the meantime
+				 */
+				continue;
+			}
+		} else {
+			key_name = icmap_iter_next(dump_state->iter, &value_len, &type);
+			if (key_name == NULL) {
+				*finished = 1;
+				break;
+			}
+		}
+
+		key_len = strlen(key_name);
+		item_size = CMAP_DUMP_PREFIX_ITEM_SIZE(key_len, value_len);
+
+		if (*res_size + item_size > CMAP_DUMP_PREFIX_RES_MAX_SIZE) {
+			if (res->no_items == 0) {
+				return (CS_ERR_TOO_BIG);
+			}
+
+			if (key_name != dump_state->pending_key) {
+				strcpy(dump_state->pending_key, key_name);
+			}
+			dump_state->pending = 1;
+			break;
+		}
+
+		item = (struct res_lib_cmap_dump_prefix_item *)((char *)res + *res_size);
+		memset(item, 0, item_size);
+		item->key_len = key_len;
+		item->type = type;
+		memcpy(item->data, key_name, key_len);
+
+		err = icmap_get(key_name, item->data + CMAP_DUMP_PREFIX_VALUE_OFFSET(key_len), &value_len, NULL);
+		if (err != CS_OK) {
+			return (err);
+		}
+		item->value_len = value_len;
+
+		*res_size += item_size;
+		res->no_items++;
+	}
+
+	return (CS_OK);
+}
+
+static void message_handler_req_lib_cmap_dump_prefix(void *conn, const void *message)
+{
+	const struct req_lib_cmap_dump_prefix *req_lib_cmap_dump_prefix = message;
+	struct res_lib_cmap_dump_prefix *res_lib_cmap_dump_prefix;
+	struct res_lib_cmap_dump_prefix res_lib_cmap_dump_prefix_error;
+	struct cmap_dump_state *dump_state;
+	uint64_t dump_handle = req_lib_cmap_dump_prefix->dump_handle;
+	size_t res_size = sizeof(*res_lib_cmap_dump_prefix);
+	char *prefix = NULL;
+	int finished = 0;
+	cs_error_t ret;
+	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
+
+	if (dump_handle == 0) {
+		if (req_lib_cmap_dump_prefix->prefix.length > 0) {
+			prefix = (char *)req_lib_cmap_dump_prefix->prefix.value;
+		}
+
+		ret = hdb_error_to_cs(hdb_handle_create(&conn_info->dump_db, sizeof(*dump_state), &dump_handle));
+		if (ret != CS_OK) {
+			goto reply_send;
+		}
+
+		ret = hdb_error_to_cs(hdb_handle_get(&conn_info->dump_db, dump_handle, (void *)&dump_state));
+		if (ret != CS_OK) {
+			(void)hdb_handle_destroy(&conn_info->dump_db, dump_handle);
+			goto reply_send;
+		}
+
+		dump_state->pending = 0;
+		dump_state->iter = icmap_iter_init(prefix);
+		if (dump_state->iter == NULL) {
+			(void)hdb_handle_destroy(&conn_info->dump_db, dump_handle);
+			(void)hdb_handle_put (&conn_info->dump_db, dump_handle);
+			ret = CS_ERR_NO_SECTIONS;
+			goto reply_send;
+		}
+	} else {
+		ret = hdb_error_to_cs(hdb_handle_get(&conn_info->dump_db, dump_handle, (void *)&dump_state));
+		if (ret != CS_OK) {
+			goto reply_send;
+		}
+	}
+
+	res_lib_cmap_dump_prefix = malloc(CMAP_DUMP_PREFIX_RES_MAX_SIZE);
+	if (res_lib_cmap_dump_prefix == NULL) {
+		ret = CS_ERR_NO_MEMORY;
+	} else {
+		memset(res_lib_cmap_dump_prefix, 0, sizeof(*res_lib_cmap_dump_prefix));
+		ret = cmap_dump_prefix_fill(dump_state, res_lib_cmap_dump_prefix, &res_size, &finished);
+	}
+
+	if (ret == CS_OK) {
+		res_lib_cmap_dump_prefix->header.size = res_size;
+		res_lib_cmap_dump_prefix->header.id = MESSAGE_RES_CMAP_DUMP_PREFIX;
+		res_lib_cmap_dump_prefix->header.error = CS_OK;
+		res_lib_cmap_dump_prefix->dump_handle = (finished ? 0 : dump_handle);
+
+		api->ipc_response_send(conn, res_lib_cmap_dump_prefix, res_size);
+	}
+	free(res_lib_cmap_dump_prefix);
+
+	if (ret != CS_OK || finished) {
+		icmap_iter_finalize(dump_state->iter);
+		(void)hdb_handle_destroy(&conn_info->dump_db, dump_handle);
+	}
+	(void)hdb_handle_put (&conn_info->dump_db, dump_handle);
+
+	if (ret == CS_OK) {
+		return ;
+	}
+
+reply_send:
+	memset(&res_lib_cmap_dump_prefix_error, 0, sizeof(res_lib_cmap_dump_prefix_error));
+	res_lib_cmap_dump_prefix_error.header.size = sizeof(res_lib_cmap_dump_prefix_error);
+	res_lib_cmap_dump_prefix_error.header.id = MESSAGE_RES_CMAP_DUMP_PREFIX;
+	res_lib_cmap_dump_prefix_error.header.error = ret;
+
+	api->ipc_response_send(conn, &res_lib_cmap_dump_prefix_error, sizeof(res_lib_cmap_dump_prefix_error));
+}
+
 static void cmap_notify_fn(int32_t event,
 		const char *key_name,
 		struct icmap_notify_value new_val,
@@ -697,6 +885,93 @@ static void cmap_notify_fn(int32_t event,
 	api->ipc_dispatch_iov_send(cmap_track_user_data->conn, iov, 3);
 }
 
+static void cmap_notify_batch_send(struct cmap_track_user_data *cmap_track_user_data,
+		struct res_lib_cmap_notify_batch_callback *res,
+		size_t res_size)
+{
+
+	res->header.size = res_size;
+	res->header.id = MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK;
+	res->header.error = CS_OK;
+	res->track_inst_handle = cmap_track_user_data->track_inst_handle;
+
+	api->ipc_dispatch_send(cmap_track_user_data->conn, res, res_size);
+}
+
+/*
+ * Send changes of one icmap transaction packed into as few messages as possible
+ */
+static void cmap_notify_batch_fn(const struct icmap_notify_change *changes,
+		size_t no_changes,
+		void *user_data)
+{
+	struct cmap_track_user_data *cmap_track_user_data = (struct cmap_track_user_data *)user_data;
+	struct res_lib_cmap_notify_batch_callback *res;
+	struct res_lib_cmap_notify_batch_item *item;
+	size_t res_size;
+	size_t item_size;
+	size_t key_len;
+	size_t i;
+
+	res = malloc(CMAP_NOTIFY_BATCH_RES_MAX_SIZE);
+	if (res == NULL) {
+		for (i = 0; i < no_changes; i++) {
+			cmap_notify_fn(changes[i].event, changes[i].key_name,
+			    changes[i].new_value, changes[i].old_value, user_data);
+		}
+
+		return ;
+	}
+
+	memset(res, 0, sizeof(*res));
+	res_size = sizeof(*res);
+
+	for (i = 0; i < no_changes; i++) {
+		key_len = strlen(changes[i].key_name);
+		item_size = CMAP_NOTIFY_BATCH_ITEM_SIZE(key_len, changes[i].new_value.len,
+		    changes[i].old_value.len);
+
+		if (res_size + item_size > CMAP_NOTIFY_BATCH_RES_MAX_SIZE) {
+			if (res->no_items > 0) {
+				cmap_notify_batch_send(cmap_track_user_data, res, res_size);
+
+				memset(res, 0, sizeof(*res));
+				res_size = sizeof(*res);
+			}
+
+			if (res_size + item_size > CMAP_NOTIFY_BATCH_RES_MAX_SIZE) {
+				cmap_notify_fn(changes[i].event, changes[i].key_name,
+				    changes[i].new_value, changes[i].old_value, user_data);
+
+				continue;
+			}
+		}
+
+		item = (struct res_lib_cmap_notify_batch_item *)((char *)res + res_size);
+		memset(item, 0, item_size);
+		item->event = changes[i].event;
+		item->key_len = key_len;
+		item->new_value_type = changes[i].new_value.type;
+		item->old_value_type = changes[i].old_value.type;
+		item->new_value_len = changes[i].new_value.len;
+		item->old_value_len = changes[i].old_value.len;
+		memcpy(item->data, changes[i].key_name, key_len);
+		memcpy(item->data + CMAP_NOTIFY_BATCH_NEW_VALUE_OFFSET(key_len),
+		    changes[i].new_value.data, changes[i].new_value.len);
+		memcpy(item->data + CMAP_NOTIFY_BATCH_OLD_VALUE_OFFSET(key_len, changes[i].new_value.len),
+		    changes[i].old_value.data, changes[i].old_value.len);
+
+		res_size += item_size;
+		res->no_items++;
+	}
+
+	if (res->no_items > 0) {
+		cmap_notify_batch_send(cmap_track_user_data, res, res_size);
+	}
+
+	free(res);
+}
+
 static void message_handler_req_lib_cmap_track_add(void *conn, const void *message)
 {
 	const struct req_lib_cmap_track_add *req_lib_cmap_track_add = message;
@@ -707,6 +982,7 @@ static void message_handler_req_lib_cmap_track_add(void *conn, const void *messa
 	icmap_track_t *hdb_track;
 	struct cmap_track_user_data *cmap_track_user_data;
 	const char *key_name;
+	int32_t track_type;
 
 	struct cmap_conn_info *conn_info = (struct cmap_conn_info *)api->ipc_private_data_get (conn);
 
@@ -724,8 +1000,10 @@ static void message_handler_req_lib_cmap_track_add(void *conn, const void *messa
 		key_name = NULL;
 	}
 
+	track_type = req_lib_cmap_track_add->track_type & ~CMAP_TRACK_NOTIFY_BATCH;
+
 	ret = icmap_track_add(key_name,
-			req_lib_cmap_track_add->track_type,
+			track_type,
 			cmap_notify_fn,
 			cmap_track_user_data,
 			&track);
@@ -735,6 +1013,10 @@ static void message_handler_req_lib_cmap_track_add(void *conn, const void *messa
 		goto reply_send;
 	}
 
+	if (req_lib_cmap_track_add->track_type & CMAP_TRACK_NOTIFY_BATCH) {
+		(void)icmap_track_set_batch_fn(track, cmap_notify_batch_fn);
+	}
+
 	ret = hdb_error_to_cs(hdb_handle_create(&conn_info->track_db, sizeof(track), &handle));
 	if (ret != CS_OK) {
 		free(cmap_track_user_data);
@@ -649,7 +649,9 @@ static int main_config_parser_cb(const char *path,
 				    (strcmp(value, "aes256") != 0) &&
 				    (strcmp(value, "aes192") != 0) &&
 				    (strcmp(value, "aes128") != 0) &&
-				    (strcmp(value, "3des") != 0)) {
+				    (strcmp(value, "3des") != 0) &&
+				    (strcmp(value, "aes256-gcm") != 0) &&
+				    (strcmp(value, "aes128-gcm") != 0)) {
 					*error_string = "Invalid cipher type";
 
 					return (0);
@@ -679,6 +681,23 @@ static int main_config_parser_cb(const char *path,
 					return (0);
 				}
 			}
+			if (strcmp(path, "qb.ipc_outq_max_size") == 0) {
+				val_type = ICMAP_VALUETYPE_UINT32;
+				if (safe_atoq(value, &val, val_type) != 0) {
+					goto atoi_error;
+				}
+				icmap_set_uint32_r(config_map, path, val);
+				add_as_string = 0;
+			}
+			if (strcmp(path, "qb.ipc_outq_overflow") == 0) {
+				if ((strcmp(value, "disconnect") != 0) &&
+				    (strcmp(value, "drop_oldest") != 0) &&
+				    (strcmp(value, "flow_control") != 0)) {
+					*error_string = "Invalid qb ipc_outq_overflow";
+
+					return (0);
+				}
+			}
 			break;
 
 		case MAIN_CP_CB_DATA_STATE_INTERFACE:
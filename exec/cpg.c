@@ -75,7 +75,7 @@
 
 LOGSYS_DECLARE_SUBSYS ("CPG");
 
-#define GROUP_HASH_SIZE 32
+#define GROUP_HASH_SIZE 1024
 
 enum cpg_message_req_types {
 	MESSAGE_REQ_EXEC_CPG_PROCJOIN = 0,
@@ -159,9 +159,12 @@ struct cpg_pd {
 	int initial_totem_conf_sent;
 	uint64_t transition_counter; /* These two are used when sending fragmented messages */
 	uint64_t initial_transition_counter;
+	cs_error_t partial_error; /* First error of the fragmented message being sent */
 	struct list_head list;
 	struct list_head iteration_instance_list_head;
 	struct list_head zcb_mapped_list_head;
+	struct group_info *group_info; /* set while on the group subscribers list */
+	struct list_head group_list;
 };
 
 struct cpg_iteration_instance {
@@ -193,10 +196,27 @@ struct process_info {
 	unsigned int nodeid;
 	uint32_t pid;
 	mar_cpg_name_t group;
-	struct list_head list; /* on the group_info members list */
+	struct list_head list; /* on process_info_list_head */
+	struct group_info *group_info;
+	struct list_head group_list; /* on the group_info members list */
 };
 DECLARE_LIST_INIT(process_info_list_head);
 
+/*
+ * Index of local subscribers (cpg_pd) and known members (process_info)
+ * of one group, so per group operations don't have to walk every
+ * connection and process.  Members are kept in the same (nodeid, pid)
+ * order as process_info_list_head.
+ */
+struct group_info {
+	mar_cpg_name_t group;
+	struct list_head members_head;
+	struct list_head subscribers_head;
+	struct list_head list; /* on the group_hash bucket */
+};
+
+static struct list_head group_hash[GROUP_HASH_SIZE];
+
 struct join_list_entry {
 	uint32_t pid;
 	mar_cpg_name_t group_name;
@@ -261,6 +281,10 @@ static void message_handler_req_lib_cpg_mcast (void *conn, const void *message);
 
 static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *message);
 
+static void message_handler_req_lib_cpg_partial_mcast_stream (void *conn, const void *message);
+
+static void cpg_partial_mcast_drop (void *conn, const void *message, cs_error_t error);
+
 static void message_handler_req_lib_cpg_membership (void *conn,
 						    const void *message);
 
@@ -396,7 +420,13 @@ static struct corosync_lib_handler cpg_lib_engine[] =
 	},
 	{ /* 12 */
 		.lib_handler_fn				= message_handler_req_lib_cpg_partial_mcast,
-		.flow_control				= CS_LIB_FLOW_CONTROL_REQUIRED
+		.flow_control				= CS_LIB_FLOW_CONTROL_REQUIRED,
+		.lib_drop_fn				= cpg_partial_mcast_drop
+	},
+	{ /* 13 */
+		.lib_handler_fn				= message_handler_req_lib_cpg_partial_mcast_stream,
+		.flow_control				= CS_LIB_FLOW_CONTROL_REQUIRED,
+		.lib_drop_fn				= cpg_partial_mcast_drop
 	},
 
 };
@@ -548,6 +578,109 @@ static char *cpg_print_group_name(const mar_cpg_name_t *group)
 	return (res);
 }
 
+static unsigned int group_hash_fn (const mar_cpg_name_t *group)
+{
+	unsigned int hash = 2166136261U;
+	unsigned int length;
+	unsigned int i;
+
+	length = group->length;
+	if (length > CPG_MAX_NAME_LENGTH) {
+		length = CPG_MAX_NAME_LENGTH;
+	}
+
+	for (i = 0; i < length; i++) {
+		hash = (hash ^ (unsigned char)group->value[i]) * 16777619U;
+	}
+
+	return (hash % GROUP_HASH_SIZE);
+}
+
+static struct group_info *group_info_find (const mar_cpg_name_t *group)
+{
+	struct list_head *bucket = &group_hash[group_hash_fn (group)];
+	struct list_head *iter;
+
+	for (iter = bucket->next; iter != bucket; iter = iter->next) {
+		struct group_info *gi = list_entry (iter, struct group_info, list);
+
+		if (mar_name_compare (&gi->group, group) == 0) {
+			return (gi);
+		}
+	}
+
+	return (NULL);
+}
+
+static struct group_info *group_info_get (const mar_cpg_name_t *group)
+{
+	struct group_info *gi;
+
+	gi = group_info_find (group);
+	if (gi != NULL) {
+		return (gi);
+	}
+
+	gi = malloc (sizeof (struct group_info));
+	if (gi == NULL) {
+		log_printf(LOGSYS_LEVEL_WARNING, "Unable to allocate group_info struct");
+		return (NULL);
+	}
+	memcpy (&gi->group, group, sizeof (mar_cpg_name_t));
+	list_init (&gi->members_head);
+	list_init (&gi->subscribers_head);
+	list_init (&gi->list);
+	list_add (&gi->list, &group_hash[group_hash_fn (group)]);
+
+	return (gi);
+}
+
+/*
+ * Free group_info once nobody references it
+ */
+static void group_info_release (struct group_info *gi)
+{
+	if (list_empty (&gi->members_head) && list_empty (&gi->subscribers_head)) {
+		list_del (&gi->list);
+		free (gi);
+	}
+}
+
+static int cpd_group_subscribe (struct cpg_pd *cpd)
+{
+	struct group_info *gi;
+
+	gi = group_info_get (&cpd->group_name);
+	if (gi == NULL) {
+		return (-1);
+	}
+	cpd->group_info = gi;
+	list_add_tail (&cpd->group_list, &gi->subscribers_head);
+
+	return (0);
+}
+
+static void cpd_group_unsubscribe (struct cpg_pd *cpd)
+{
+	struct group_info *gi = cpd->group_info;
+
+	if (gi == NULL) {
+		return;
+	}
+	list_del (&cpd->group_list);
+	list_init (&cpd->group_list);
+	cpd->group_info = NULL;
+	group_info_release (gi);
+}
+
+static void process_info_remove (struct process_info *pi)
+{
+	list_del (&pi->list);
+	list_del (&pi->group_list);
+	group_info_release (pi->group_info);
+	free (pi);
+}
+
 static void cpg_sync_init (
 	const unsigned int *trans_list,
 	size_t trans_list_entries,
@@ -681,16 +814,19 @@ static int notify_lib_joinlist(
 {
 	int size;
 	char *buf;
-	struct list_head *iter;
+	struct list_head *iter, *iter_next;
 	int count;
 	struct res_lib_cpg_confchg_callback *res;
 	mar_cpg_address_t *retgi;
+	struct group_info *gi;
 
 	count = 0;
 
-	for (iter = process_info_list_head.next; iter != &process_info_list_head; iter = iter->next) {
-		struct process_info *pi = list_entry (iter, struct process_info, list);
-		if (mar_name_compare (&pi->group, group_name) == 0) {
+	gi = group_info_find (group_name);
+
+	if (gi != NULL) {
+		for (iter = gi->members_head.next; iter != &gi->members_head; iter = iter->next) {
+			struct process_info *pi = list_entry (iter, struct process_info, group_list);
 			int i;
 			int founded = 0;
 
@@ -721,10 +857,9 @@ static int notify_lib_joinlist(
 	res->header.error = CS_OK;
 	memcpy(&res->group_name, group_name, sizeof(mar_cpg_name_t));
 
-	for (iter = process_info_list_head.next; iter != &process_info_list_head; iter = iter->next) {
-		struct process_info *pi=list_entry (iter, struct process_info, list);
-
-		if (mar_name_compare (&pi->group, group_name) == 0) {
+	if (gi != NULL) {
+		for (iter = gi->members_head.next; iter != &gi->members_head; iter = iter->next) {
+			struct process_info *pi = list_entry (iter, struct process_info, group_list);
 			int i;
 			int founded = 0;
 
@@ -754,35 +889,45 @@ static int notify_lib_joinlist(
 
 	if (conn) {
 		api->ipc_dispatch_send (conn, buf, size);
-	} else {
-		for (iter = cpg_pd_list_head.next; iter != &cpg_pd_list_head; iter = iter->next) {
-			struct cpg_pd *cpd = list_entry (iter, struct cpg_pd, list);
-			if (mar_name_compare (&cpd->group_name, group_name) == 0) {
-				assert (joined_list_entries <= 1);
-				if (joined_list_entries) {
-					if (joined_list[0].pid == cpd->pid &&
-						joined_list[0].nodeid == api->totem_nodeid_get()) {
-						cpd->cpd_state = CPD_STATE_JOIN_COMPLETED;
-					}
-				}
-				if (cpd->cpd_state == CPD_STATE_JOIN_COMPLETED ||
-					cpd->cpd_state == CPD_STATE_LEAVE_STARTED) {
+	} else if (gi != NULL) {
+		for (iter = gi->subscribers_head.next; iter != &gi->subscribers_head; iter = iter_next) {
+			struct cpg_pd *cpd = list_entry (iter, struct cpg_pd, group_list);
+
+			iter_next = iter->next;
 
-					api->ipc_dispatch_send (cpd->conn, buf, size);
-					cpd->transition_counter++;
+			assert (joined_list_entries <= 1);
+			if (joined_list_entries) {
+				if (joined_list[0].pid == cpd->pid &&
+					joined_list[0].nodeid == api->totem_nodeid_get()) {
+					cpd->cpd_state = CPD_STATE_JOIN_COMPLETED;
 				}
-				if (left_list_entries) {
-					if (left_list[0].pid == cpd->pid &&
-						left_list[0].nodeid == api->totem_nodeid_get() &&
-						left_list[0].reason == CONFCHG_CPG_REASON_LEAVE) {
-
-						cpd->pid = 0;
-						memset (&cpd->group_name, 0, sizeof(cpd->group_name));
-						cpd->cpd_state = CPD_STATE_UNJOINED;
-					}
+			}
+			if (cpd->cpd_state == CPD_STATE_JOIN_COMPLETED ||
+				cpd->cpd_state == CPD_STATE_LEAVE_STARTED) {
+
+				api->ipc_dispatch_send (cpd->conn, buf, size);
+				cpd->transition_counter++;
+			}
+			if (left_list_entries) {
+				if (left_list[0].pid == cpd->pid &&
+					left_list[0].nodeid == api->totem_nodeid_get() &&
+					left_list[0].reason == CONFCHG_CPG_REASON_LEAVE) {
+
+					/*
+					 * gi is released below, it must stay valid
+					 * while we iterate its subscribers
+					 */
+					list_del (&cpd->group_list);
+					list_init (&cpd->group_list);
+					cpd->group_info = NULL;
+
+					cpd->pid = 0;
+					memset (&cpd->group_name, 0, sizeof(cpd->group_name));
+					cpd->cpd_state = CPD_STATE_UNJOINED;
 				}
 			}
 		}
+		group_info_release (gi);
 	}
 
 
@@ -930,8 +1075,7 @@ static void downlist_master_choose_and_send (void)
 			pcd->left_list[size].pid = left_pi->pid;
 			pcd->left_list[size].reason = CONFCHG_CPG_REASON_NODEDOWN;
 			pcd->left_list_entries++;
-			list_del (&left_pi->list);
-			free (left_pi);
+			process_info_remove (left_pi);
 		}
 	}
 
@@ -1078,8 +1222,13 @@ static void joinlist_messages_delete (void)
 
 static char *cpg_exec_init_fn (struct corosync_api_v1 *corosync_api)
 {
+	int i;
+
 	list_init (&downlist_messages_head);
 	list_init (&joinlist_messages_head);
+	for (i = 0; i < GROUP_HASH_SIZE; i++) {
+		list_init (&group_hash[i]);
+	}
 	api = corosync_api;
 	return (NULL);
 }
@@ -1122,6 +1271,7 @@ static void cpg_pd_finalize (struct cpg_pd *cpd)
 	}
 
 	list_del (&cpd->list);
+	cpd_group_unsubscribe (cpd);
 }
 
 static int cpg_lib_exit_fn (void *conn)
@@ -1230,14 +1380,18 @@ static void exec_cpg_partial_mcast_endian_convert (void *msg)
 }
 
 static struct process_info *process_info_find(const mar_cpg_name_t *group_name, uint32_t pid, unsigned int nodeid) {
+	struct group_info *gi;
 	struct list_head *iter;
 
-	for (iter = process_info_list_head.next; iter != &process_info_list_head; ) {
-		struct process_info *pi = list_entry (iter, struct process_info, list);
-		iter = iter->next;
+	gi = group_info_find (group_name);
+	if (gi == NULL) {
+		return NULL;
+	}
+
+	for (iter = gi->members_head.next; iter != &gi->members_head; iter = iter->next) {
+		struct process_info *pi = list_entry (iter, struct process_info, group_list);
 
-		if (pi->pid == pid && pi->nodeid == nodeid &&
-			mar_name_compare (&pi->group, group_name) == 0) {
+		if (pi->pid == pid && pi->nodeid == nodeid) {
 				return pi;
 		}
 	}
@@ -1245,6 +1399,24 @@ static struct process_info *process_info_find(const mar_cpg_name_t *group_name,
 	return NULL;
 }
 
+/*
+ * Is any process of nodeid a member of the group?
+ */
+static int group_info_node_known (const struct group_info *gi, unsigned int nodeid)
+{
+	struct list_head *iter;
+
+	for (iter = gi->members_head.next; iter != &gi->members_head; iter = iter->next) {
+		struct process_info *pi = list_entry (iter, struct process_info, group_list);
+
+		if (pi->nodeid == nodeid) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
 static void do_proc_join(
 	const mar_cpg_name_t *name,
 	uint32_t pid,
@@ -1253,6 +1425,7 @@ static void do_proc_join(
 {
 	struct process_info *pi;
 	struct process_info *pi_entry;
+	struct group_info *gi;
 	mar_cpg_address_t notify_info;
 	struct list_head *list;
 	struct list_head *list_to_add = NULL;
@@ -1260,15 +1433,22 @@ static void do_proc_join(
 	if (process_info_find (name, pid, nodeid) != NULL) {
 		return ;
  	}
+	gi = group_info_get (name);
+	if (gi == NULL) {
+		return;
+	}
 	pi = malloc (sizeof (struct process_info));
 	if (!pi) {
 		log_printf(LOGSYS_LEVEL_WARNING, "Unable to allocate process_info struct");
+		group_info_release (gi);
 		return;
 	}
 	pi->nodeid = nodeid;
 	pi->pid = pid;
 	memcpy(&pi->group, name, sizeof(*name));
 	list_init(&pi->list);
+	list_init(&pi->group_list);
+	pi->group_info = gi;
 
 	/*
 	 * Insert new process in sorted order so synchronization works properly
@@ -1286,6 +1466,19 @@ static void do_proc_join(
 	}
 	list_add (&pi->list, list_to_add);
 
+	list_to_add = &gi->members_head;
+	for (list = gi->members_head.next; list != &gi->members_head; list = list->next) {
+
+		pi_entry = list_entry(list, struct process_info, group_list);
+		if (pi_entry->nodeid > pi->nodeid ||
+			(pi_entry->nodeid == pi->nodeid && pi_entry->pid > pi->pid)) {
+
+			break;
+		}
+		list_to_add = list;
+	}
+	list_add (&pi->group_list, list_to_add);
+
 	notify_info.pid = pi->pid;
 	notify_info.nodeid = nodeid;
 	notify_info.reason = reason;
@@ -1303,7 +1496,6 @@ static void do_proc_leave(
 	int reason)
 {
 	struct process_info *pi;
-	struct list_head *iter;
 	mar_cpg_address_t notify_info;
 
 	notify_info.pid = pid;
@@ -1315,15 +1507,13 @@ static void do_proc_leave(
 		1, &notify_info,
 		MESSAGE_RES_CPG_CONFCHG_CALLBACK);
 
-	for (iter = process_info_list_head.next; iter != &process_info_list_head; ) {
-		pi = list_entry(iter, struct process_info, list);
-		iter = iter->next;
-
-		if (pi->pid == pid && pi->nodeid == nodeid &&
-			mar_name_compare (&pi->group, name)==0) {
-			list_del (&pi->list);
-			free (pi);
-		}
+	/*
+	 * do_proc_join never adds duplicates, so there is at most one entry.
+	 * name may point into it, so don't use name after removing it.
+	 */
+	pi = process_info_find (name, pid, nodeid);
+	if (pi != NULL) {
+		process_info_remove (pi);
 	}
 }
 
@@ -1445,10 +1635,12 @@ static void message_handler_req_exec_cpg_mcast (
 	const struct req_exec_cpg_mcast *req_exec_cpg_mcast = message;
 	struct res_lib_cpg_deliver_callback res_lib_cpg_mcast;
 	int msglen = req_exec_cpg_mcast->msglen;
-	struct list_head *iter, *pi_iter;
+	struct list_head *iter;
+	struct group_info *gi;
 	struct cpg_pd *cpd;
 	struct iovec iovec[2];
 	int known_node = 0;
+	void *dispatch_buf = NULL;
 
 	res_lib_cpg_mcast.header.id = MESSAGE_RES_CPG_DELIVER_CALLBACK;
 	res_lib_cpg_mcast.header.size = sizeof(res_lib_cpg_mcast) + msglen;
@@ -1464,36 +1656,44 @@ static void message_handler_req_exec_cpg_mcast (
 	iovec[1].iov_base = (char*)message+sizeof(*req_exec_cpg_mcast);
 	iovec[1].iov_len = msglen;
 
-	for (iter = cpg_pd_list_head.next; iter != &cpg_pd_list_head; ) {
-		cpd = list_entry(iter, struct cpg_pd, list);
+	gi = group_info_find (&req_exec_cpg_mcast->group_name);
+	if (gi == NULL) {
+		return ;
+	}
+
+	for (iter = gi->subscribers_head.next; iter != &gi->subscribers_head; ) {
+		cpd = list_entry(iter, struct cpg_pd, group_list);
 		iter = iter->next;
 
-		if ((cpd->cpd_state == CPD_STATE_LEAVE_STARTED || cpd->cpd_state == CPD_STATE_JOIN_COMPLETED)
-			&& (mar_name_compare (&cpd->group_name, &req_exec_cpg_mcast->group_name) == 0)) {
+		if (cpd->cpd_state == CPD_STATE_LEAVE_STARTED || cpd->cpd_state == CPD_STATE_JOIN_COMPLETED) {
 
 			if (!known_node) {
 				/* Try to find, if we know the node */
-				for (pi_iter = process_info_list_head.next;
-					pi_iter != &process_info_list_head; pi_iter = pi_iter->next) {
-
-					struct process_info *pi = list_entry (pi_iter, struct process_info, list);
-
-					if (pi->nodeid == nodeid &&
-						mar_name_compare (&pi->group, &req_exec_cpg_mcast->group_name) == 0) {
-						known_node = 1;
-						break;
-					}
-				}
+				known_node = group_info_node_known (gi, nodeid);
 			}
 
 			if (!known_node) {
 				log_printf(LOGSYS_LEVEL_WARNING, "Unknown node -> we will not deliver message");
-				return ;
+				break;
 			}
 
-			api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			/*
+			 * Slow subscribers share one queued copy of the message
+			 */
+			if (dispatch_buf == NULL) {
+				dispatch_buf = api->ipc_dispatch_buf_create (iovec, 2);
+			}
+			if (dispatch_buf != NULL) {
+				api->ipc_dispatch_buf_send (cpd->conn, dispatch_buf);
+			} else {
+				api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			}
 		}
 	}
+
+	if (dispatch_buf != NULL) {
+		api->ipc_dispatch_buf_release (dispatch_buf);
+	}
 }
 
 static void message_handler_req_exec_cpg_partial_mcast (
@@ -1503,10 +1703,12 @@ static void message_handler_req_exec_cpg_partial_mcast (
 	const struct req_exec_cpg_partial_mcast *req_exec_cpg_mcast = message;
 	struct res_lib_cpg_partial_deliver_callback res_lib_cpg_mcast;
 	int msglen = req_exec_cpg_mcast->fraglen;
-	struct list_head *iter, *pi_iter;
+	struct list_head *iter;
+	struct group_info *gi;
 	struct cpg_pd *cpd;
 	struct iovec iovec[2];
 	int known_node = 0;
+	void *dispatch_buf = NULL;
 
 	log_printf(LOGSYS_LEVEL_DEBUG, "Got fragmented message from node %d, size = %d bytes\n", nodeid, msglen);
 
@@ -1526,36 +1728,41 @@ static void message_handler_req_exec_cpg_partial_mcast (
 	iovec[1].iov_base = (char*)message+sizeof(*req_exec_cpg_mcast);
 	iovec[1].iov_len = msglen;
 
-	for (iter = cpg_pd_list_head.next; iter != &cpg_pd_list_head; ) {
-		cpd = list_entry(iter, struct cpg_pd, list);
+	gi = group_info_find (&req_exec_cpg_mcast->group_name);
+	if (gi == NULL) {
+		return ;
+	}
+
+	for (iter = gi->subscribers_head.next; iter != &gi->subscribers_head; ) {
+		cpd = list_entry(iter, struct cpg_pd, group_list);
 		iter = iter->next;
 
-		if ((cpd->cpd_state == CPD_STATE_LEAVE_STARTED || cpd->cpd_state == CPD_STATE_JOIN_COMPLETED)
-		    && (mar_name_compare (&cpd->group_name, &req_exec_cpg_mcast->group_name) == 0)) {
+		if (cpd->cpd_state == CPD_STATE_LEAVE_STARTED || cpd->cpd_state == CPD_STATE_JOIN_COMPLETED) {
 
 			if (!known_node) {
 				/* Try to find, if we know the node */
-				for (pi_iter = process_info_list_head.next;
-				     pi_iter != &process_info_list_head; pi_iter = pi_iter->next) {
-
-					struct process_info *pi = list_entry (pi_iter, struct process_info, list);
-
-					if (pi->nodeid == nodeid &&
-					    mar_name_compare (&pi->group, &req_exec_cpg_mcast->group_name) == 0) {
-						known_node = 1;
-						break;
-					}
-				}
+				known_node = group_info_node_known (gi, nodeid);
 			}
 
 			if (!known_node) {
 				log_printf(LOGSYS_LEVEL_WARNING, "Unknown node -> we will not deliver message");
-				return ;
+				break;
 			}
 
-			api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			if (dispatch_buf == NULL) {
+				dispatch_buf = api->ipc_dispatch_buf_create (iovec, 2);
+			}
+			if (dispatch_buf != NULL) {
+				api->ipc_dispatch_buf_send (cpd->conn, dispatch_buf);
+			} else {
+				api->ipc_dispatch_iov_send (cpd->conn, iovec, 2);
+			}
 		}
 	}
+
+	if (dispatch_buf != NULL) {
+		api->ipc_dispatch_buf_release (dispatch_buf);
+	}
 }
 
 
@@ -1628,7 +1835,9 @@ static int cpg_lib_init_fn (void *conn)
 	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
 	memset (cpd, 0, sizeof(struct cpg_pd));
 	cpd->conn = conn;
+	cpd->partial_error = CS_OK;
 	list_add (&cpd->list, &cpg_pd_list_head);
+	list_init (&cpd->group_list);
 
 	list_init (&cpd->iteration_instance_list_head);
 	list_init (&cpd->zcb_mapped_list_head);
@@ -1646,17 +1855,19 @@ static void message_handler_req_lib_cpg_join (void *conn, const void *message)
 	struct res_lib_cpg_join res_lib_cpg_join;
 	cs_error_t error = CS_OK;
 	struct list_head *iter;
+	struct group_info *gi;
 
 	/* Test, if we don't have same pid and group name joined */
-	for (iter = cpg_pd_list_head.next; iter != &cpg_pd_list_head; iter = iter->next) {
-		struct cpg_pd *cpd_item = list_entry (iter, struct cpg_pd, list);
-
-		if (cpd_item->pid == req_lib_cpg_join->pid &&
-			mar_name_compare(&req_lib_cpg_join->group_name, &cpd_item->group_name) == 0) {
-
-			/* We have same pid and group name joined -> return error */
-			error = CS_ERR_EXIST;
-			goto response_send;
+	gi = group_info_find (&req_lib_cpg_join->group_name);
+	if (gi != NULL) {
+		for (iter = gi->subscribers_head.next; iter != &gi->subscribers_head; iter = iter->next) {
+			struct cpg_pd *cpd_item = list_entry (iter, struct cpg_pd, group_list);
+
+			if (cpd_item->pid == req_lib_cpg_join->pid) {
+				/* We have same pid and group name joined -> return error */
+				error = CS_ERR_EXIST;
+				goto response_send;
+			}
 		}
 	}
 
@@ -1664,15 +1875,11 @@ static void message_handler_req_lib_cpg_join (void *conn, const void *message)
 	 * Same check must be done in process info list, because there may be not yet delivered
 	 * leave of client.
 	 */
-	for (iter = process_info_list_head.next; iter != &process_info_list_head; iter = iter->next) {
-		struct process_info *pi = list_entry (iter, struct process_info, list);
-
-		if (pi->nodeid == api->totem_nodeid_get () && pi->pid == req_lib_cpg_join->pid &&
-		    mar_name_compare(&req_lib_cpg_join->group_name, &pi->group) == 0) {
-			/* We have same pid and group name joined -> return error */
-			error = CS_ERR_TRY_AGAIN;
-			goto response_send;
-		}
+	if (process_info_find (&req_lib_cpg_join->group_name, req_lib_cpg_join->pid,
+		api->totem_nodeid_get ()) != NULL) {
+		/* We have same pid and group name joined -> return error */
+		error = CS_ERR_TRY_AGAIN;
+		goto response_send;
 	}
 
 	if (req_lib_cpg_join->group_name.length > CPG_MAX_NAME_LENGTH) {
@@ -1689,6 +1896,14 @@ static void message_handler_req_lib_cpg_join (void *conn, const void *message)
 		memcpy (&cpd->group_name, &req_lib_cpg_join->group_name,
 			sizeof (cpd->group_name));
 
+		if (cpd_group_subscribe (cpd) != 0) {
+			error = CS_ERR_NO_MEMORY;
+			cpd->cpd_state = CPD_STATE_UNJOINED;
+			cpd->pid = 0;
+			memset (&cpd->group_name, 0, sizeof (cpd->group_name));
+			break;
+		}
+
 		cpg_node_joinleave_send (req_lib_cpg_join->pid,
 			&req_lib_cpg_join->group_name,
 			MESSAGE_REQ_EXEC_CPG_PROCJOIN, CONFCHG_CPG_REASON_JOIN);
@@ -1765,6 +1980,7 @@ static void message_handler_req_lib_cpg_finalize (
 	 */
 	list_del (&cpd->list);
 	list_init (&cpd->list);
+	cpd_group_unsubscribe (cpd);
 
 	res_lib_cpg_finalize.header.size = sizeof (res_lib_cpg_finalize);
 	res_lib_cpg_finalize.header.id = MESSAGE_RES_CPG_FINALIZE;
@@ -1970,10 +2186,16 @@ static void message_handler_req_lib_cpg_zc_free (
 		res_header.size);
 }
 
-/* Fragmented mcast message from the library */
-static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *message)
+/*
+ * Fragmented mcast message from the library. Only fragments with ack set
+ * are answered, the answer carries the first error seen since the
+ * first fragment of the message. Once a fragment has failed, the rest of
+ * the message is dropped.
+ */
+static void cpg_partial_mcast (void *conn,
+	const struct req_lib_cpg_partial_mcast *req_lib_cpg_mcast,
+	int ack)
 {
-	const struct req_lib_cpg_partial_mcast *req_lib_cpg_mcast = message;
 	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
 	mar_cpg_name_t group_name = cpd->group_name;
 
@@ -2002,15 +2224,16 @@ static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *m
 		break;
 	}
 
-	res_lib_cpg_partial_send.header.size = sizeof(res_lib_cpg_partial_send);
-	res_lib_cpg_partial_send.header.id = MESSAGE_RES_CPG_PARTIAL_SEND;
-
 	if (req_lib_cpg_mcast->type == LIBCPG_PARTIAL_FIRST) {
 		cpd->initial_transition_counter = cpd->transition_counter;
+		cpd->partial_error = CS_OK;
 	}
 	if (cpd->transition_counter != cpd->initial_transition_counter) {
 		error = CS_ERR_INTERRUPT;
 	}
+	if (cpd->partial_error != CS_OK) {
+		error = cpd->partial_error;
+	}
 
 	if (error == CS_OK) {
 		req_exec_cpg_mcast.header.size = sizeof(req_exec_cpg_mcast) + msglen;
@@ -2031,14 +2254,51 @@ static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *m
 
 		result = api->totem_mcast (req_exec_cpg_iovec, 2, TOTEM_AGREED);
 		assert(result == 0);
-	} else {
+	} else if (cpd->partial_error == CS_OK) {
 		log_printf(LOGSYS_LEVEL_ERROR, "*** %p can't mcast to group %s state:%d, error:%d",
 			   conn, group_name.value, cpd->cpd_state, error);
+		cpd->partial_error = error;
+	}
+
+	if (ack) {
+		res_lib_cpg_partial_send.header.size = sizeof(res_lib_cpg_partial_send);
+		res_lib_cpg_partial_send.header.id = MESSAGE_RES_CPG_PARTIAL_SEND;
+		res_lib_cpg_partial_send.header.error = error;
+		api->ipc_response_send (conn, &res_lib_cpg_partial_send,
+					sizeof (res_lib_cpg_partial_send));
+	}
+}
+
+static void message_handler_req_lib_cpg_partial_mcast (void *conn, const void *message)
+{
+	cpg_partial_mcast (conn, message, 1);
+}
+
+/* Fragmented mcast message from the library, not answered */
+static void message_handler_req_lib_cpg_partial_mcast_stream (void *conn, const void *message)
+{
+	cpg_partial_mcast (conn, message, 0);
+}
+
+/*
+ * Fragment was rejected before reaching the handler. Remember the error, so
+ * the rest of the message is dropped and the next answered fragment reports it.
+ */
+static void cpg_partial_mcast_drop (void *conn, const void *message, cs_error_t error)
+{
+	const struct req_lib_cpg_partial_mcast *req_lib_cpg_mcast = message;
+	struct cpg_pd *cpd = (struct cpg_pd *)api->ipc_private_data_get (conn);
+
+	if (req_lib_cpg_mcast->type == LIBCPG_PARTIAL_FIRST) {
+		cpd->initial_transition_counter = cpd->transition_counter;
+		cpd->partial_error = CS_OK;
 	}
 
-	res_lib_cpg_partial_send.header.error = error;
-	api->ipc_response_send (conn, &res_lib_cpg_partial_send,
-				sizeof (res_lib_cpg_partial_send));
+	if (cpd->partial_error == CS_OK) {
+		log_printf(LOGSYS_LEVEL_DEBUG, "%p fragment of mcast to group %s dropped, error:%d",
+			   conn, cpd->group_name.value, error);
+		cpd->partial_error = error;
+	}
 }
 
 /* Mcast message from the library */
@@ -2167,6 +2427,7 @@ static void message_handler_req_lib_cpg_membership (void *conn,
 		(struct req_lib_cpg_membership_get *)message;
 	struct res_lib_cpg_membership_get res_lib_cpg_membership_get;
 	struct list_head *iter;
+	struct group_info *gi;
 	int member_count = 0;
 
 	res_lib_cpg_membership_get.header.id = MESSAGE_RES_CPG_MEMBERSHIP;
@@ -2174,11 +2435,11 @@ static void message_handler_req_lib_cpg_membership (void *conn,
 	res_lib_cpg_membership_get.header.size =
 		sizeof (struct res_lib_cpg_membership_get);
 
-	for (iter = process_info_list_head.next;
-		iter != &process_info_list_head; iter = iter->next) {
+	gi = group_info_find (&req_lib_cpg_membership_get->group_name);
+	if (gi != NULL) {
+		for (iter = gi->members_head.next; iter != &gi->members_head; iter = iter->next) {
+			struct process_info *pi = list_entry (iter, struct process_info, group_list);
 
-		struct process_info *pi = list_entry (iter, struct process_info, list);
-		if (mar_name_compare (&pi->group, &req_lib_cpg_membership_get->group_name) == 0) {
 			res_lib_cpg_membership_get.member_list[member_count].nodeid = pi->nodeid;
 			res_lib_cpg_membership_get.member_list[member_count].pid = pi->pid;
 			member_count += 1;
@@ -2193,7 +2454,24 @@ static void message_handler_req_lib_cpg_membership (void *conn,
 static void message_handler_req_lib_cpg_local_get (void *conn,
 						   const void *message)
 {
+	const struct qb_ipc_request_header *header = message;
 	struct res_lib_cpg_local_get res_lib_cpg_local_get;
+	struct res_lib_cpg_local_get_features res_lib_cpg_local_get_features;
+
+	if (header->size >= sizeof (struct req_lib_cpg_local_get_features)) {
+		/*
+		 * Newer library asks for features as well
+		 */
+		res_lib_cpg_local_get_features.header.size = sizeof (res_lib_cpg_local_get_features);
+		res_lib_cpg_local_get_features.header.id = MESSAGE_RES_CPG_LOCAL_GET;
+		res_lib_cpg_local_get_features.header.error = CS_OK;
+		res_lib_cpg_local_get_features.local_nodeid = api->totem_nodeid_get ();
+		res_lib_cpg_local_get_features.features = CPG_FEATURE_PARTIAL_MCAST_STREAM;
+
+		api->ipc_response_send (conn, &res_lib_cpg_local_get_features,
+			sizeof (res_lib_cpg_local_get_features));
+		return;
+	}
 
 	res_lib_cpg_local_get.header.size = sizeof (res_lib_cpg_local_get);
 	res_lib_cpg_local_get.header.id = MESSAGE_RES_CPG_LOCAL_GET;
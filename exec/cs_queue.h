@@ -41,23 +41,83 @@
 #include <errno.h>
 #include "assert.h"
 
+/*
+ * Values of threaded_mode_enabled passed to cs_queue_init
+ *
+ * CS_QUEUE_THREADED_MODE_NONE - queue is used only by one thread
+ * CS_QUEUE_THREADED_MODE_MUTEX - every operation takes queue mutex
+ * CS_QUEUE_THREADED_MODE_SPSC - lock-free, only one thread may add items
+ *	(is_full, item_add, items_add, avail) and only one thread may remove
+ *	them (is_empty, item_get, item_remove, items_remove, iterator). Multiple
+ *	producers are fine as long as they are serialized by caller.
+ */
+#define CS_QUEUE_THREADED_MODE_NONE	0
+#define CS_QUEUE_THREADED_MODE_MUTEX	1
+#define CS_QUEUE_THREADED_MODE_SPSC	2
+
+#define CS_QUEUE_CACHELINE_SIZE		64
+
 struct cs_queue {
-	int head;
-	int tail;
-	int used;
-	int usedhw;
 	int size;
 	void *items;
 	int size_per_item;
-	int iterator;
 	pthread_mutex_t mutex;
 	int threaded_mode_enabled;
+	/*
+	 * Producer side, head is position of next item to add
+	 */
+	int head __attribute__((aligned(CS_QUEUE_CACHELINE_SIZE)));
+	int usedhw;
+	/*
+	 * Consumer side, tail is position before first item
+	 */
+	int tail __attribute__((aligned(CS_QUEUE_CACHELINE_SIZE)));
+	int iterator;
 };
 
+/*
+ * head and tail are always accessed with acquire/release semantics, so other
+ * side of SPSC queue sees item data before index change. With mutex or
+ * without threads it costs nothing more than plain access on common archs.
+ */
+static inline int cs_queue_index_load (const int *index)
+{
+	return (__atomic_load_n (index, __ATOMIC_ACQUIRE));
+}
+
+static inline void cs_queue_index_store (int *index, int value)
+{
+	__atomic_store_n (index, value, __ATOMIC_RELEASE);
+}
+
+static inline void cs_queue_lock (struct cs_queue *cs_queue)
+{
+	if (cs_queue->threaded_mode_enabled == CS_QUEUE_THREADED_MODE_MUTEX) {
+		pthread_mutex_lock (&cs_queue->mutex);
+	}
+}
+
+static inline void cs_queue_unlock (struct cs_queue *cs_queue)
+{
+	if (cs_queue->threaded_mode_enabled == CS_QUEUE_THREADED_MODE_MUTEX) {
+		pthread_mutex_unlock (&cs_queue->mutex);
+	}
+}
+
+/*
+ * Number of items in queue. Must be called with lock held.
+ */
+static inline int cs_queue_used_get (struct cs_queue *cs_queue)
+{
+	int head = cs_queue_index_load (&cs_queue->head);
+	int tail = cs_queue_index_load (&cs_queue->tail);
+
+	return ((head - tail - 1 + cs_queue->size) % cs_queue->size);
+}
+
 static inline int cs_queue_init (struct cs_queue *cs_queue, int cs_queue_items, int size_per_item, int threaded_mode_enabled) {
 	cs_queue->head = 0;
 	cs_queue->tail = cs_queue_items - 1;
-	cs_queue->used = 0;
 	cs_queue->usedhw = 0;
 	cs_queue->size = cs_queue_items;
 	cs_queue->size_per_item = size_per_item;
@@ -68,31 +128,47 @@ static inline int cs_queue_init (struct cs_queue *cs_queue, int cs_queue_items,
 		return (-ENOMEM);
 	}
 	memset (cs_queue->items, 0, cs_queue_items * size_per_item);
-	if (cs_queue->threaded_mode_enabled) {
+	if (cs_queue->threaded_mode_enabled == CS_QUEUE_THREADED_MODE_MUTEX) {
 		pthread_mutex_init (&cs_queue->mutex, NULL);
 	}
 	return (0);
 }
 
-static inline int cs_queue_reinit (struct cs_queue *cs_queue)
+/*
+ * Change threaded mode of queue. Must not be called while other thread uses the queue.
+ */
+static inline void cs_queue_threaded_mode_set (struct cs_queue *cs_queue, int threaded_mode_enabled)
 {
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
+	if (cs_queue->threaded_mode_enabled == threaded_mode_enabled) {
+		return ;
 	}
-	cs_queue->head = 0;
-	cs_queue->tail = cs_queue->size - 1;
-	cs_queue->used = 0;
+
+	if (cs_queue->threaded_mode_enabled == CS_QUEUE_THREADED_MODE_MUTEX) {
+		pthread_mutex_destroy (&cs_queue->mutex);
+	}
+	if (threaded_mode_enabled == CS_QUEUE_THREADED_MODE_MUTEX) {
+		pthread_mutex_init (&cs_queue->mutex, NULL);
+	}
+	cs_queue->threaded_mode_enabled = threaded_mode_enabled;
+}
+
+/*
+ * Must not be called in SPSC mode while other thread uses the queue
+ */
+static inline int cs_queue_reinit (struct cs_queue *cs_queue)
+{
+	cs_queue_lock (cs_queue);
+	cs_queue_index_store (&cs_queue->head, 0);
+	cs_queue_index_store (&cs_queue->tail, cs_queue->size - 1);
 	cs_queue->usedhw = 0;
 
 	memset (cs_queue->items, 0, cs_queue->size * cs_queue->size_per_item);
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_unlock (cs_queue);
 	return (0);
 }
 
 static inline void cs_queue_free (struct cs_queue *cs_queue) {
-	if (cs_queue->threaded_mode_enabled) {
+	if (cs_queue->threaded_mode_enabled == CS_QUEUE_THREADED_MODE_MUTEX) {
 		pthread_mutex_destroy (&cs_queue->mutex);
 	}
 	free (cs_queue->items);
@@ -101,52 +177,70 @@ static inline void cs_queue_free (struct cs_queue *cs_queue) {
 static inline int cs_queue_is_full (struct cs_queue *cs_queue) {
 	int full;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	full = ((cs_queue->size - 1) == cs_queue->used);
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
+	full = ((cs_queue->size - 1) == cs_queue_used_get (cs_queue));
+	cs_queue_unlock (cs_queue);
 	return (full);
 }
 
 static inline int cs_queue_is_empty (struct cs_queue *cs_queue) {
 	int empty;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	empty = (cs_queue->used == 0);
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
+	empty = (cs_queue_used_get (cs_queue) == 0);
+	cs_queue_unlock (cs_queue);
 	return (empty);
 }
 
-static inline void cs_queue_item_add (struct cs_queue *cs_queue, void *item)
+/*
+ * Add one item. Must be called with lock held.
+ */
+static inline void cs_queue_item_add_locked (struct cs_queue *cs_queue, const void *item, int *used)
 {
 	char *cs_queue_item;
-	int cs_queue_position;
+	int head;
+
+	head = cs_queue->head;
+	assert (cs_queue_index_load (&cs_queue->tail) != head);
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	cs_queue_position = cs_queue->head;
 	cs_queue_item = cs_queue->items;
-	cs_queue_item += cs_queue_position * cs_queue->size_per_item;
+	cs_queue_item += head * cs_queue->size_per_item;
 	memcpy (cs_queue_item, item, cs_queue->size_per_item);
 
-	assert (cs_queue->tail != cs_queue->head);
-
-	cs_queue->head = (cs_queue->head + 1) % cs_queue->size;
-	cs_queue->used++;
-	if (cs_queue->used > cs_queue->usedhw) {
-		cs_queue->usedhw = cs_queue->used;
+	cs_queue_index_store (&cs_queue->head, (head + 1) % cs_queue->size);
+	*used += 1;
+	if (*used > cs_queue->usedhw) {
+		cs_queue->usedhw = *used;
 	}
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
+}
+
+static inline void cs_queue_item_add (struct cs_queue *cs_queue, void *item)
+{
+	int used;
+
+	cs_queue_lock (cs_queue);
+	used = cs_queue_used_get (cs_queue);
+	cs_queue_item_add_locked (cs_queue, item, &used);
+	cs_queue_unlock (cs_queue);
+}
+
+/*
+ * Add count items stored one after another in items. Caller must make sure
+ * there is enough room (cs_queue_avail).
+ */
+static inline void cs_queue_items_add (struct cs_queue *cs_queue, const void *items, int count)
+{
+	const char *item = items;
+	int used;
+	int i;
+
+	cs_queue_lock (cs_queue);
+	used = cs_queue_used_get (cs_queue);
+	for (i = 0; i < count; i++) {
+		cs_queue_item_add_locked (cs_queue, item, &used);
+		item += cs_queue->size_per_item;
 	}
+	cs_queue_unlock (cs_queue);
 }
 
 static inline void *cs_queue_item_get (struct cs_queue *cs_queue)
@@ -154,58 +248,45 @@ static inline void *cs_queue_item_get (struct cs_queue *cs_queue)
 	char *cs_queue_item;
 	int cs_queue_position;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
 	cs_queue_position = (cs_queue->tail + 1) % cs_queue->size;
 	cs_queue_item = cs_queue->items;
 	cs_queue_item += cs_queue_position * cs_queue->size_per_item;
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_unlock (cs_queue);
 	return ((void *)cs_queue_item);
 }
 
 static inline void cs_queue_item_remove (struct cs_queue *cs_queue) {
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	cs_queue->tail = (cs_queue->tail + 1) % cs_queue->size;
+	int tail;
 
-	assert (cs_queue->tail != cs_queue->head);
+	cs_queue_lock (cs_queue);
+	tail = (cs_queue->tail + 1) % cs_queue->size;
 
-	cs_queue->used--;
-	assert (cs_queue->used >= 0);
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	assert (tail != cs_queue_index_load (&cs_queue->head));
+
+	cs_queue_index_store (&cs_queue->tail, tail);
+	cs_queue_unlock (cs_queue);
 }
 
 static inline void cs_queue_items_remove (struct cs_queue *cs_queue, int rel_count)
 {
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	cs_queue->tail = (cs_queue->tail + rel_count) % cs_queue->size;
+	int tail;
 
-	assert (cs_queue->tail != cs_queue->head);
+	cs_queue_lock (cs_queue);
+	tail = (cs_queue->tail + rel_count) % cs_queue->size;
 
-	cs_queue->used -= rel_count;
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	assert (tail != cs_queue_index_load (&cs_queue->head));
+
+	cs_queue_index_store (&cs_queue->tail, tail);
+	cs_queue_unlock (cs_queue);
 }
 
 
 static inline void cs_queue_item_iterator_init (struct cs_queue *cs_queue)
 {
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
 	cs_queue->iterator = (cs_queue->tail + 1) % cs_queue->size;
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_unlock (cs_queue);
 }
 
 static inline void *cs_queue_item_iterator_get (struct cs_queue *cs_queue)
@@ -213,21 +294,15 @@ static inline void *cs_queue_item_iterator_get (struct cs_queue *cs_queue)
 	char *cs_queue_item;
 	int cs_queue_position;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
 	cs_queue_position = (cs_queue->iterator) % cs_queue->size;
-	if (cs_queue->iterator == cs_queue->head) {
-		if (cs_queue->threaded_mode_enabled) {
-			pthread_mutex_unlock (&cs_queue->mutex);
-		}
+	if (cs_queue->iterator == cs_queue_index_load (&cs_queue->head)) {
+		cs_queue_unlock (cs_queue);
 		return (0);
 	}
 	cs_queue_item = cs_queue->items;
 	cs_queue_item += cs_queue_position * cs_queue->size_per_item;
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_unlock (cs_queue);
 	return ((void *)cs_queue_item);
 }
 
@@ -235,40 +310,28 @@ static inline int cs_queue_item_iterator_next (struct cs_queue *cs_queue)
 {
 	int next_res;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
 	cs_queue->iterator = (cs_queue->iterator + 1) % cs_queue->size;
 
-	next_res = cs_queue->iterator == cs_queue->head;
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	next_res = cs_queue->iterator == cs_queue_index_load (&cs_queue->head);
+	cs_queue_unlock (cs_queue);
 	return (next_res);
 }
 
 static inline void cs_queue_avail (struct cs_queue *cs_queue, int *avail)
 {
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	*avail = cs_queue->size - cs_queue->used - 2;
+	cs_queue_lock (cs_queue);
+	*avail = cs_queue->size - cs_queue_used_get (cs_queue) - 2;
 	assert (*avail >= 0);
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_unlock (cs_queue);
 }
 
 static inline int cs_queue_used (struct cs_queue *cs_queue) {
 	int used;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
-	used = cs_queue->used;
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
+	used = cs_queue_used_get (cs_queue);
+	cs_queue_unlock (cs_queue);
 
 	return (used);
 }
@@ -276,15 +339,11 @@ static inline int cs_queue_used (struct cs_queue *cs_queue) {
 static inline int cs_queue_usedhw (struct cs_queue *cs_queue) {
 	int usedhw;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_lock (&cs_queue->mutex);
-	}
+	cs_queue_lock (cs_queue);
 
 	usedhw = cs_queue->usedhw;
 
-	if (cs_queue->threaded_mode_enabled) {
-		pthread_mutex_unlock (&cs_queue->mutex);
-	}
+	cs_queue_unlock (cs_queue);
 
 	return (usedhw);
 }
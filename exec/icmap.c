@@ -49,11 +49,13 @@ struct icmap_item {
 	char *key_name;
 	icmap_value_types_t type;
 	size_t value_len;
+	unsigned int counter_refs;
 	char value[];
 };
 
 struct icmap_map {
 	qb_map_t *qb_map;
+	struct list_head counter_list_head;
 };
 
 static icmap_map_t icmap_global_map;
@@ -62,19 +64,74 @@ struct icmap_track {
 	char *key_name;
 	int32_t track_type;
 	icmap_notify_fn_t notify_fn;
+	icmap_notify_batch_fn_t batch_fn;
 	void *user_data;
+	/*
+	 * Track was deleted while transaction notifications were delivered. It's
+	 * kept in the list (so delivery can continue) and freed afterwards.
+	 */
+	int deleted;
 	struct list_head list;
 };
 
+/*
+ * Change of one key done inside of transaction. old_item is copy of value before
+ * the first change, NULL if key didn't exist (existed is 0). new_item is filled
+ * on commit.
+ */
+struct icmap_trans_change {
+	char *key_name;
+	int existed;
+	struct icmap_item *old_item;
+	struct icmap_item *new_item;
+};
+
 struct icmap_ro_access_item {
 	char *key_name;
 	int prefix;
 	struct list_head list;
 };
 
+struct icmap_counter {
+	icmap_map_t map;
+	char *key_name;
+	/*
+	 * Resolved item, NULL if key has to be looked up again
+	 */
+	struct icmap_item *item;
+	/*
+	 * Is there MODIFY tracker interested in key? Valid while track_generation
+	 * matches icmap_track_generation.
+	 */
+	int tracked;
+	unsigned int track_generation;
+	struct list_head list;
+};
+
 DECLARE_LIST_INIT(icmap_ro_access_item_list_head);
 DECLARE_LIST_INIT(icmap_track_list_head);
 
+/*
+ * Increased on every track add/delete so counters know when to recheck trackers
+ */
+static unsigned int icmap_track_generation = 1;
+
+/*
+ * Transaction nesting level. While nonzero, changes of global map are collected
+ * in icmap_trans_changes (in order of first change, indexed by key name in
+ * icmap_trans_change_map) instead of being notified.
+ */
+static unsigned int icmap_trans_level;
+static qb_map_t *icmap_trans_change_map;
+static struct icmap_trans_change **icmap_trans_changes;
+static size_t icmap_trans_no_changes;
+static size_t icmap_trans_allocated;
+
+/*
+ * Nonzero while transaction notifications are delivered
+ */
+static unsigned int icmap_trans_delivering;
+
 /*
  * Static functions declarations
  */
@@ -136,6 +193,18 @@ static cs_error_t icmap_get_ref_r(
 	size_t *value_len,
 	icmap_value_types_t *type);
 
+/*
+ * Add step to integer value of item in place. Returns CS_ERR_INVALID_PARAM for
+ * non integer types.
+ */
+static cs_error_t icmap_item_adjust_int(struct icmap_item *item, int32_t step);
+
+/*
+ * Store value of item about to be changed in place inside of transaction, so
+ * commit can report it as old value
+ */
+static void icmap_trans_in_place_change(const icmap_map_t map, const struct icmap_item *item);
+
 /*
  * Function implementation
  */
@@ -190,11 +259,27 @@ static void icmap_map_free_cb(uint32_t event,
 		void* value, void* user_data)
 {
 	struct icmap_item *item = (struct icmap_item *)old_value;
+	icmap_map_t map = (icmap_map_t)user_data;
+	struct list_head *iter;
+	struct icmap_counter *counter;
 
 	/*
 	 * value == old_value -> fast_adjust_int was used, don't free data
 	 */
 	if (item != NULL && value != old_value) {
+		/*
+		 * Counters pointing to item must look key up again
+		 */
+		for (iter = map->counter_list_head.next;
+		    item->counter_refs > 0 && iter != &map->counter_list_head; iter = iter->next) {
+			counter = list_entry(iter, struct icmap_counter, list);
+
+			if (counter->item == item) {
+				counter->item = NULL;
+				item->counter_refs--;
+			}
+		}
+
 		free(item->key_name);
 		free(item);
 	}
@@ -213,7 +298,9 @@ cs_error_t icmap_init_r(icmap_map_t *result)
 	if ((*result)->qb_map == NULL)
 		return (CS_ERR_INIT);
 
-	err = qb_map_notify_add((*result)->qb_map, NULL, icmap_map_free_cb, QB_MAP_NOTIFY_FREE, NULL);
+	list_init(&(*result)->counter_list_head);
+
+	err = qb_map_notify_add((*result)->qb_map, NULL, icmap_map_free_cb, QB_MAP_NOTIFY_FREE, *result);
 
 	return (qb_to_cs_error(err));
 }
@@ -251,8 +338,20 @@ static void icmap_del_all_track(void)
 
 void icmap_fini_r(const icmap_map_t map)
 {
+	struct icmap_counter *counter;
 
 	qb_map_destroy(map->qb_map);
+
+	/*
+	 * All items are gone, so counters only have to be freed
+	 */
+	while (!list_empty(&map->counter_list_head)) {
+		counter = list_entry(map->counter_list_head.next, struct icmap_counter, list);
+		list_del(&counter->list);
+		free(counter->key_name);
+		free(counter);
+	}
+
 	free(map);
 
 	return;
@@ -992,23 +1091,10 @@ cs_error_t icmap_adjust_int(
 	return (icmap_adjust_int_r(icmap_global_map, key_name, step));
 }
 
-cs_error_t icmap_fast_adjust_int_r(
-	const icmap_map_t map,
-	const char *key_name,
-	int32_t step)
+static cs_error_t icmap_item_adjust_int(struct icmap_item *item, int32_t step)
 {
-	struct icmap_item *item;
 	cs_error_t err = CS_OK;
 
-	if (key_name == NULL) {
-		return (CS_ERR_INVALID_PARAM);
-	}
-
-	item = qb_map_get(map->qb_map, key_name);
-	if (item == NULL) {
-		return (CS_ERR_NOT_EXIST);
-	}
-
 	switch (item->type) {
 	case ICMAP_VALUETYPE_INT8:
 	case ICMAP_VALUETYPE_UINT8:
@@ -1034,6 +1120,30 @@ cs_error_t icmap_fast_adjust_int_r(
 		break;
 	}
 
+	return (err);
+}
+
+cs_error_t icmap_fast_adjust_int_r(
+	const icmap_map_t map,
+	const char *key_name,
+	int32_t step)
+{
+	struct icmap_item *item;
+	cs_error_t err;
+
+	if (key_name == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	item = qb_map_get(map->qb_map, key_name);
+	if (item == NULL) {
+		return (CS_ERR_NOT_EXIST);
+	}
+
+	icmap_trans_in_place_change(map, item);
+
+	err = icmap_item_adjust_int(item, step);
+
 	if (err == CS_OK) {
 		qb_map_put(map->qb_map, item->key_name, item);
 	}
@@ -1089,6 +1199,139 @@ cs_error_t icmap_fast_dec(const char *key_name)
 	return (icmap_fast_dec_r(icmap_global_map, key_name));
 }
 
+cs_error_t icmap_counter_create_r(const icmap_map_t map, const char *key_name, icmap_counter_t *counter)
+{
+
+	if (key_name == NULL || counter == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	*counter = malloc(sizeof(**counter));
+	if (*counter == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+	memset(*counter, 0, sizeof(**counter));
+
+	(*counter)->key_name = strdup(key_name);
+	if ((*counter)->key_name == NULL) {
+		free(*counter);
+		return (CS_ERR_NO_MEMORY);
+	}
+	(*counter)->map = map;
+
+	list_init(&(*counter)->list);
+	list_add(&(*counter)->list, &map->counter_list_head);
+
+	return (CS_OK);
+}
+
+cs_error_t icmap_counter_create(const char *key_name, icmap_counter_t *counter)
+{
+	return (icmap_counter_create_r(icmap_global_map, key_name, counter));
+}
+
+void icmap_counter_destroy(icmap_counter_t counter)
+{
+
+	if (counter == NULL) {
+		return ;
+	}
+
+	if (counter->item != NULL) {
+		counter->item->counter_refs--;
+	}
+
+	list_del(&counter->list);
+	free(counter->key_name);
+	free(counter);
+}
+
+/*
+ * Returns !0 if key_name is tracked by icmap_track (regardless of track type)
+ */
+static int icmap_track_is_key_tracked(const struct icmap_track *icmap_track, const char *key_name)
+{
+
+	if (icmap_track->key_name == NULL) {
+		return (1);
+	}
+
+	if (icmap_track->track_type & ICMAP_TRACK_PREFIX) {
+		return (strncmp(key_name, icmap_track->key_name, strlen(icmap_track->key_name)) == 0);
+	}
+
+	return (strcmp(key_name, icmap_track->key_name) == 0);
+}
+
+/*
+ * Returns !0 if some tracker wants to know about modification of key_name
+ */
+static int icmap_counter_is_tracked(const char *key_name)
+{
+	struct list_head *iter;
+	struct icmap_track *icmap_track;
+
+	for (iter = icmap_track_list_head.next; iter != &icmap_track_list_head; iter = iter->next) {
+		icmap_track = list_entry(iter, struct icmap_track, list);
+
+		if (icmap_track->deleted || !(icmap_track->track_type & ICMAP_TRACK_MODIFY)) {
+			continue;
+		}
+
+		if (icmap_track_is_key_tracked(icmap_track, key_name)) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+cs_error_t icmap_counter_adjust(icmap_counter_t counter, int32_t step)
+{
+	cs_error_t err;
+
+	if (counter == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	if (counter->item == NULL) {
+		counter->item = qb_map_get(counter->map->qb_map, counter->key_name);
+		if (counter->item == NULL) {
+			return (CS_ERR_NOT_EXIST);
+		}
+		counter->item->counter_refs++;
+	}
+
+	/*
+	 * Trackers can be only on global map
+	 */
+	if (counter->map == icmap_global_map &&
+	    counter->track_generation != icmap_track_generation) {
+		counter->tracked = icmap_counter_is_tracked(counter->key_name);
+		counter->track_generation = icmap_track_generation;
+	}
+
+	if (counter->map == icmap_global_map && counter->tracked) {
+		icmap_trans_in_place_change(counter->map, counter->item);
+	}
+
+	err = icmap_item_adjust_int(counter->item, step);
+	if (err != CS_OK) {
+		return (err);
+	}
+
+	if (counter->map == icmap_global_map && counter->tracked) {
+		qb_map_put(counter->map->qb_map, counter->item->key_name, counter->item);
+	}
+
+	return (CS_OK);
+}
+
+cs_error_t icmap_counter_inc(icmap_counter_t counter)
+{
+	return (icmap_counter_adjust(counter, 1));
+}
+
 icmap_iter_t icmap_iter_init_r(const icmap_map_t map, const char *prefix)
 {
 	return (qb_map_pref_iter_create(map->qb_map, prefix));
@@ -1138,6 +1381,13 @@ static void icmap_notify_fn(uint32_t event, char *key, void *old_value, void *va
 		return ;
 	}
 
+	if (icmap_trans_level > 0) {
+		/*
+		 * Change is recorded by icmap_trans_notify_fn and notified on commit
+		 */
+		return ;
+	}
+
 	if (new_item != NULL) {
 		new_val.type = new_item->type;
 		new_val.len = new_item->value_len;
@@ -1193,6 +1443,7 @@ cs_error_t icmap_track_add(
 
 	(*icmap_track)->track_type = track_type;
 	(*icmap_track)->notify_fn = notify_fn;
+	(*icmap_track)->batch_fn = NULL;
 	(*icmap_track)->user_data = user_data;
 
 	if ((err = qb_map_notify_add(icmap_global_map->qb_map, (*icmap_track)->key_name, icmap_notify_fn,
@@ -1205,6 +1456,7 @@ cs_error_t icmap_track_add(
 
 	list_init(&(*icmap_track)->list);
 	list_add (&(*icmap_track)->list, &icmap_track_list_head);
+	icmap_track_generation++;
 
 	return (CS_OK);
 }
@@ -1218,6 +1470,14 @@ cs_error_t icmap_track_delete(icmap_track_t icmap_track)
 		return (qb_to_cs_error(err));
 	}
 
+	icmap_track_generation++;
+
+	if (icmap_trans_delivering > 0) {
+		icmap_track->deleted = 1;
+
+		return (CS_OK);
+	}
+
 	list_del(&icmap_track->list);
 	free(icmap_track->key_name);
 	free(icmap_track);
@@ -1230,6 +1490,332 @@ void *icmap_track_get_user_data(icmap_track_t icmap_track)
 	return (icmap_track->user_data);
 }
 
+cs_error_t icmap_track_set_batch_fn(icmap_track_t icmap_track, icmap_notify_batch_fn_t batch_fn)
+{
+
+	if (icmap_track == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	icmap_track->batch_fn = batch_fn;
+
+	return (CS_OK);
+}
+
+/*
+ * Free tracks deleted during delivery of transaction notifications
+ */
+static void icmap_track_free_deleted(void)
+{
+	struct list_head *iter;
+	struct list_head *iter_next;
+	struct icmap_track *icmap_track;
+
+	for (iter = icmap_track_list_head.next; iter != &icmap_track_list_head; iter = iter_next) {
+		iter_next = iter->next;
+		icmap_track = list_entry(iter, struct icmap_track, list);
+
+		if (icmap_track->deleted) {
+			list_del(&icmap_track->list);
+			free(icmap_track->key_name);
+			free(icmap_track);
+		}
+	}
+}
+
+static struct icmap_item *icmap_item_dup(const struct icmap_item *item)
+{
+	struct icmap_item *new_item;
+
+	new_item = malloc(sizeof(*new_item) + item->value_len);
+	if (new_item == NULL) {
+		return (NULL);
+	}
+
+	memcpy(new_item, item, sizeof(*new_item) + item->value_len);
+	new_item->key_name = NULL;
+	new_item->counter_refs = 0;
+
+	return (new_item);
+}
+
+static void icmap_item_to_notify_value(const struct icmap_item *item, struct icmap_notify_value *val)
+{
+
+	if (item != NULL) {
+		val->type = item->type;
+		val->len = item->value_len;
+		val->data = item->value;
+	} else {
+		memset(val, 0, sizeof(*val));
+	}
+}
+
+static void icmap_trans_change_free(struct icmap_trans_change *change)
+{
+
+	free(change->key_name);
+	free(change->old_item);
+	free(change->new_item);
+	free(change);
+}
+
+/*
+ * Records first change of key inside of transaction. Only value before the
+ * change is stored, final value is taken from the map on commit.
+ */
+static void icmap_trans_change_add(const char *key, const struct icmap_item *old_item)
+{
+	struct icmap_trans_change *change;
+	struct icmap_trans_change **new_changes;
+	size_t new_allocated;
+
+	if (qb_map_get(icmap_trans_change_map, key) != NULL) {
+		return ;
+	}
+
+	if (icmap_trans_no_changes == icmap_trans_allocated) {
+		new_allocated = (icmap_trans_allocated == 0 ? 64 : icmap_trans_allocated * 2);
+		new_changes = realloc(icmap_trans_changes, new_allocated * sizeof(*new_changes));
+		if (new_changes == NULL) {
+			return ;
+		}
+		icmap_trans_changes = new_changes;
+		icmap_trans_allocated = new_allocated;
+	}
+
+	change = malloc(sizeof(*change));
+	if (change == NULL) {
+		return ;
+	}
+	memset(change, 0, sizeof(*change));
+
+	change->key_name = strdup(key);
+	if (change->key_name == NULL) {
+		free(change);
+		return ;
+	}
+
+	change->existed = (old_item != NULL);
+	if (old_item != NULL) {
+		change->old_item = icmap_item_dup(old_item);
+	}
+
+	icmap_trans_changes[icmap_trans_no_changes++] = change;
+	qb_map_put(icmap_trans_change_map, change->key_name, change);
+}
+
+static void icmap_trans_in_place_change(const icmap_map_t map, const struct icmap_item *item)
+{
+
+	if (icmap_trans_level == 0 || map != icmap_global_map) {
+		return ;
+	}
+
+	icmap_trans_change_add(item->key_name, item);
+}
+
+static void icmap_trans_notify_fn(uint32_t event, char *key, void *old_value, void *value, void *user_data)
+{
+
+	if (value == NULL && old_value == NULL) {
+		return ;
+	}
+
+	/*
+	 * Items changed in place (old_value == value) were already recorded by
+	 * icmap_trans_in_place_change
+	 */
+	if (old_value == value) {
+		return ;
+	}
+
+	icmap_trans_change_add(key, (struct icmap_item *)old_value);
+}
+
+cs_error_t icmap_transaction_begin(void)
+{
+	int32_t err;
+
+	if (icmap_trans_level > 0) {
+		icmap_trans_level++;
+
+		return (CS_OK);
+	}
+
+	icmap_trans_change_map = qb_skiplist_create();
+	if (icmap_trans_change_map == NULL) {
+		return (CS_ERR_NO_MEMORY);
+	}
+
+	if ((err = qb_map_notify_add(icmap_global_map->qb_map, NULL, icmap_trans_notify_fn,
+	    icmap_tt_to_qbtt(ICMAP_TRACK_ADD | ICMAP_TRACK_DELETE | ICMAP_TRACK_MODIFY | ICMAP_TRACK_PREFIX),
+	    NULL)) != 0) {
+		qb_map_destroy(icmap_trans_change_map);
+		icmap_trans_change_map = NULL;
+
+		return (qb_to_cs_error(err));
+	}
+
+	icmap_trans_level = 1;
+
+	return (CS_OK);
+}
+
+/*
+ * Pass changes to all interested tracks. Tracks with batch_fn get all their
+ * changes in one call, other tracks get one notify_fn call per change.
+ */
+static void icmap_trans_deliver(const struct icmap_notify_change *changes, size_t no_changes)
+{
+	struct icmap_notify_change *track_changes;
+	size_t no_track_changes;
+	struct list_head *iter;
+	struct icmap_track *icmap_track;
+	size_t i;
+
+	track_changes = malloc(no_changes * sizeof(*track_changes));
+	if (track_changes == NULL) {
+		return ;
+	}
+
+	icmap_trans_delivering++;
+
+	for (iter = icmap_track_list_head.next; iter != &icmap_track_list_head; iter = iter->next) {
+		icmap_track = list_entry(iter, struct icmap_track, list);
+		no_track_changes = 0;
+
+		for (i = 0; i < no_changes && !icmap_track->deleted; i++) {
+			if (!(icmap_track->track_type & changes[i].event) ||
+			    !icmap_track_is_key_tracked(icmap_track, changes[i].key_name)) {
+				continue;
+			}
+
+			if (icmap_track->batch_fn != NULL) {
+				track_changes[no_track_changes++] = changes[i];
+			} else {
+				icmap_track->notify_fn(changes[i].event, changes[i].key_name,
+				    changes[i].new_value, changes[i].old_value, icmap_track->user_data);
+			}
+		}
+
+		if (no_track_changes > 0 && !icmap_track->deleted) {
+			icmap_track->batch_fn(track_changes, no_track_changes, icmap_track->user_data);
+		}
+	}
+
+	icmap_trans_delivering--;
+	if (icmap_trans_delivering == 0) {
+		icmap_track_free_deleted();
+	}
+
+	free(track_changes);
+}
+
+cs_error_t icmap_transaction_commit(void)
+{
+	struct icmap_trans_change **trans_changes;
+	size_t trans_no_changes;
+	struct icmap_trans_change *change;
+	struct icmap_notify_change *changes;
+	size_t no_changes;
+	struct icmap_item *item;
+	cs_error_t err;
+	size_t i;
+
+	if (icmap_trans_level == 0) {
+		return (CS_ERR_BAD_OPERATION);
+	}
+
+	icmap_trans_level--;
+	if (icmap_trans_level > 0) {
+		return (CS_OK);
+	}
+
+	(void)qb_map_notify_del_2(icmap_global_map->qb_map, NULL, icmap_trans_notify_fn,
+	    icmap_tt_to_qbtt(ICMAP_TRACK_ADD | ICMAP_TRACK_DELETE | ICMAP_TRACK_MODIFY | ICMAP_TRACK_PREFIX),
+	    NULL);
+	qb_map_destroy(icmap_trans_change_map);
+	icmap_trans_change_map = NULL;
+
+	/*
+	 * Take the changes, so notify functions can start their own transaction
+	 */
+	trans_changes = icmap_trans_changes;
+	trans_no_changes = icmap_trans_no_changes;
+	icmap_trans_changes = NULL;
+	icmap_trans_no_changes = 0;
+	icmap_trans_allocated = 0;
+
+	err = CS_OK;
+
+	if (trans_no_changes == 0) {
+		goto free_changes;
+	}
+
+	changes = malloc(trans_no_changes * sizeof(*changes));
+	if (changes == NULL) {
+		err = CS_ERR_NO_MEMORY;
+		goto free_changes;
+	}
+
+	no_changes = 0;
+	for (i = 0; i < trans_no_changes; i++) {
+		change = trans_changes[i];
+
+		item = qb_map_get(icmap_global_map->qb_map, change->key_name);
+		if (item != NULL) {
+			change->new_item = icmap_item_dup(item);
+			if (change->new_item == NULL) {
+				err = CS_ERR_NO_MEMORY;
+				continue;
+			}
+		}
+
+		if (!change->existed && change->new_item == NULL) {
+			/*
+			 * Key was added and deleted again
+			 */
+			continue;
+		}
+
+		if (change->old_item != NULL && change->new_item != NULL &&
+		    icmap_item_eq(change->old_item, change->new_item->value,
+		    change->new_item->value_len, change->new_item->type)) {
+			/*
+			 * Key has its original value
+			 */
+			continue;
+		}
+
+		if (!change->existed) {
+			changes[no_changes].event = ICMAP_TRACK_ADD;
+		} else if (change->new_item == NULL) {
+			changes[no_changes].event = ICMAP_TRACK_DELETE;
+		} else {
+			changes[no_changes].event = ICMAP_TRACK_MODIFY;
+		}
+		changes[no_changes].key_name = change->key_name;
+		icmap_item_to_notify_value(change->new_item, &changes[no_changes].new_value);
+		icmap_item_to_notify_value(change->old_item, &changes[no_changes].old_value);
+		no_changes++;
+	}
+
+	if (no_changes > 0) {
+		icmap_trans_deliver(changes, no_changes);
+	}
+
+	free(changes);
+
+free_changes:
+	for (i = 0; i < trans_no_changes; i++) {
+		icmap_trans_change_free(trans_changes[i]);
+	}
+	free(trans_changes);
+
+	return (err);
+}
+
 cs_error_t icmap_set_ro_access(const char *key_name, int prefix, int ro_access)
 {
 	struct list_head *iter;
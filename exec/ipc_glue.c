@@ -40,6 +40,7 @@
 #include <assert.h>
 #include <sys/uio.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include <qb/qbdefs.h>
 #include <qb/qblist.h>
@@ -53,6 +54,8 @@
 #include <corosync/totem/totempg.h>
 #include <corosync/logsys.h>
 #include <corosync/icmap.h>
+#include <corosync/cpg.h>
+#include <corosync/ipc_cpg.h>
 
 #include "sync.h"
 #include "timer.h"
@@ -72,15 +75,47 @@ static int32_t ipc_allow_connections = 0; /* boolean */
 
 #define CS_IPCS_MAPPER_SERV_NAME		256
 
+enum cs_ipcs_outq_overflow {
+	CS_IPCS_OUTQ_OVERFLOW_DISCONNECT,
+	CS_IPCS_OUTQ_OVERFLOW_DROP_OLDEST,
+	CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL
+};
+
+static uint32_t ipc_outq_max_size = 0; /* bytes, 0 is unlimited */
+static enum cs_ipcs_outq_overflow ipc_outq_overflow = CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL;
+
 struct cs_ipcs_mapper {
 	int32_t id;
 	qb_ipcs_service_t *inst;
 	char name[CS_IPCS_MAPPER_SERV_NAME];
+	int32_t outq_overflow; /* connections over ipc_outq_max_size */
+	struct totem_histogram request_hist; /* lib_handler_fn run time in us */
+	struct totem_histogram request_hist_prev;
 };
 
-struct outq_item {
-	void *msg;
+/*
+ * Copy of a dispatched message, shared by all connections which had to
+ * queue it
+ */
+struct dispatch_msg {
+	uint32_t refcount;
 	size_t mlen;
+	char data[1];
+};
+
+/*
+ * Message being dispatched. The shared copy is made only when the first
+ * connection can't take the message immediately.
+ */
+struct cs_ipcs_dispatch_buf {
+	const struct iovec *iov;
+	unsigned int iov_len;
+	size_t mlen;
+	struct dispatch_msg *msg;
+};
+
+struct outq_item {
+	struct dispatch_msg *msg;
 	struct list_head list;
 };
 
@@ -93,6 +128,7 @@ static int32_t cs_ipcs_dispatch_mod(enum qb_loop_priority p, int32_t fd, int32_t
 	void *data, qb_ipcs_dispatch_fn_t fn);
 static int32_t cs_ipcs_dispatch_del(int32_t fd);
 static void outq_flush (void *data);
+static void cs_ipcs_check_for_flow_control(void);
 
 
 static struct qb_ipcs_poll_handlers corosync_poll_funcs = {
@@ -260,6 +296,9 @@ struct cs_ipcs_conn_context {
 	struct list_head outq_head;
 	int32_t queuing;
 	uint32_t queued;
+	uint64_t queued_bytes;
+	uint64_t queue_dropped;
+	int32_t outq_overflow;
 	uint64_t invalid_request;
 	uint64_t overload;
 	uint32_t sent;
@@ -365,6 +404,12 @@ static void cs_ipcs_connection_created(qb_ipcs_connection_t *c)
 	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.queue_size", context->icmap_path);
 	icmap_set_uint32(key_name, 0);
 
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.queue_bytes", context->icmap_path);
+	icmap_set_uint64(key_name, 0);
+
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.queue_dropped", context->icmap_path);
+	icmap_set_uint64(key_name, 0);
+
 	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.invalid_request", context->icmap_path);
 	icmap_set_uint64(key_name, 0);
 
@@ -389,6 +434,103 @@ void *cs_ipcs_private_data_get(void *conn)
 	return &cnx->data[0];
 }
 
+static struct dispatch_msg *dispatch_msg_get (struct cs_ipcs_dispatch_buf *buf)
+{
+	struct dispatch_msg *msg;
+	char *write_buf;
+	unsigned int i;
+
+	if (buf->msg == NULL) {
+		msg = malloc (sizeof (struct dispatch_msg) + buf->mlen);
+		if (msg == NULL) {
+			return (NULL);
+		}
+
+		write_buf = msg->data;
+		for (i = 0; i < buf->iov_len; i++) {
+			memcpy (write_buf, buf->iov[i].iov_base, buf->iov[i].iov_len);
+			write_buf += buf->iov[i].iov_len;
+		}
+		msg->mlen = buf->mlen;
+		/*
+		 * Reference held by buf itself
+		 */
+		msg->refcount = 1;
+		buf->msg = msg;
+	}
+
+	buf->msg->refcount++;
+
+	return (buf->msg);
+}
+
+static void dispatch_msg_put (struct dispatch_msg *msg)
+{
+	if (--msg->refcount == 0) {
+		free (msg);
+	}
+}
+
+static void dispatch_buf_init (
+	struct cs_ipcs_dispatch_buf *buf,
+	const struct iovec *iov,
+	unsigned int iov_len)
+{
+	unsigned int i;
+
+	buf->iov = iov;
+	buf->iov_len = iov_len;
+	buf->mlen = 0;
+	buf->msg = NULL;
+
+	for (i = 0; i < iov_len; i++) {
+		buf->mlen += iov[i].iov_len;
+	}
+}
+
+static void dispatch_buf_done (struct cs_ipcs_dispatch_buf *buf)
+{
+	if (buf->msg != NULL) {
+		dispatch_msg_put (buf->msg);
+		buf->msg = NULL;
+	}
+}
+
+static void outq_item_free (
+	struct cs_ipcs_conn_context *context,
+	struct outq_item *outq_item)
+{
+	list_del (&outq_item->list);
+	context->queued--;
+	context->queued_bytes -= outq_item->msg->mlen;
+	dispatch_msg_put (outq_item->msg);
+	free (outq_item);
+}
+
+static void outq_overflow_set (
+	qb_ipcs_connection_t *conn,
+	struct cs_ipcs_conn_context *context,
+	int32_t overflow)
+{
+	int32_t service;
+
+	if (context->outq_overflow == overflow) {
+		return;
+	}
+	context->outq_overflow = overflow;
+
+	service = qb_ipcs_service_id_get(conn);
+	if (overflow) {
+		ipcs_mapper[service].outq_overflow++;
+	} else {
+		ipcs_mapper[service].outq_overflow--;
+	}
+
+	if (ipc_outq_overflow == CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL) {
+		cs_ipcs_check_for_flow_control();
+	}
+}
+
 static void cs_ipcs_connection_destroyed (qb_ipcs_connection_t *c)
 {
 	struct cs_ipcs_conn_context *context;
@@ -405,10 +547,9 @@ static void cs_ipcs_connection_destroyed (qb_ipcs_connection_t *c)
 			list_next = list->next;
 			outq_item = list_entry (list, struct outq_item, list);
 
-			list_del (list);
-			free (outq_item->msg);
-			free (outq_item);
+			outq_item_free (context, outq_item);
 		}
+		outq_overflow_set (c, context, QB_FALSE);
 		free(context);
 	}
 }
@@ -480,7 +621,7 @@ static void outq_flush (void *data)
 		list_next = list->next;
 		outq_item = list_entry (list, struct outq_item, list);
 
-		rc = qb_ipcs_event_send(conn, outq_item->msg, outq_item->mlen);
+		rc = qb_ipcs_event_send(conn, outq_item->msg->data, outq_item->msg->mlen);
 		if (rc < 0 && rc != -EAGAIN) {
 			errno = -rc;
 			qb_perror(LOG_ERR, "qb_ipcs_event_send");
@@ -488,14 +629,23 @@ static void outq_flush (void *data)
 		} else if (rc == -EAGAIN) {
 			break;
 		}
-		assert(rc == outq_item->mlen);
+		assert(rc == (int32_t)outq_item->msg->mlen);
 		context->sent++;
-		context->queued--;
 
-		list_del (list);
-		free (outq_item->msg);
-		free (outq_item);
+		outq_item_free (context, outq_item);
+	}
+
+	/*
+	 * Leave the overflow state with some hysteresis, flow control
+	 * entered it at half the limit
+	 */
+	if (context->outq_overflow &&
+	    (ipc_outq_max_size == 0 ||
+	     context->queued_bytes <= ipc_outq_max_size /
+	     (ipc_outq_overflow == CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL ? 4 : 2))) {
+		outq_overflow_set (conn, context, QB_FALSE);
 	}
+
 	if (list_empty (&context->outq_head)) {
 		context->queuing = QB_FALSE;
 		log_printf(LOGSYS_LEVEL_INFO, "Q empty, queued:%d sent:%d.",
@@ -507,23 +657,77 @@ static void outq_flush (void *data)
 	}
 }
 
-static void msg_send_or_queue(qb_ipcs_connection_t *conn, const struct iovec *iov, uint32_t iov_len)
+/*
+ * Apply qb.ipc_outq_overflow policy when the queue would grow over
+ * qb.ipc_outq_max_size. Returns -1 if the message must not be queued.
+ *
+ * The limit is hard under every policy. flow_control can only slow down
+ * local requests, messages from other nodes keep coming, so it starts
+ * throttling at half the limit and a connection that still reaches the
+ * limit is disconnected.
+ */
+static int outq_limit_check (
+	qb_ipcs_connection_t *conn,
+	struct cs_ipcs_conn_context *context,
+	size_t mlen)
 {
-	int32_t rc = 0;
-	int32_t i;
-	int32_t bytes_msg = 0;
 	struct outq_item *outq_item;
-	char *write_buf = 0;
-	struct cs_ipcs_conn_context *context = qb_ipcs_context_get(conn);
 
-	for (i = 0; i < iov_len; i++) {
-		bytes_msg += iov[i].iov_len;
+	if (ipc_outq_max_size == 0) {
+		return (0);
+	}
+
+	if (ipc_outq_overflow == CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL &&
+	    !context->outq_overflow &&
+	    context->queued_bytes + mlen > ipc_outq_max_size / 2) {
+		log_printf(LOGSYS_LEVEL_WARNING,
+			"Dispatch queue of %s reached %"PRIu64" bytes (limit %u), "
+			"throttling requests",
+			context->icmap_path, context->queued_bytes, ipc_outq_max_size);
+		outq_overflow_set (conn, context, QB_TRUE);
+	}
+
+	if (context->queued_bytes + mlen <= ipc_outq_max_size) {
+		return (0);
 	}
 
+	if (!context->outq_overflow) {
+		log_printf(LOGSYS_LEVEL_WARNING,
+			"Dispatch queue of %s reached %"PRIu64" bytes (limit %u)",
+			context->icmap_path, context->queued_bytes, ipc_outq_max_size);
+	}
+
+	switch (ipc_outq_overflow) {
+	case CS_IPCS_OUTQ_OVERFLOW_DISCONNECT:
+	case CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL:
+		log_printf(LOGSYS_LEVEL_WARNING, "Disconnecting %s", context->icmap_path);
+		qb_ipcs_disconnect(conn);
+		return (-1);
+	case CS_IPCS_OUTQ_OVERFLOW_DROP_OLDEST:
+		while (!list_empty (&context->outq_head) &&
+		    context->queued_bytes + mlen > ipc_outq_max_size) {
+			outq_item = list_entry (context->outq_head.next, struct outq_item, list);
+			outq_item_free (context, outq_item);
+			context->queue_dropped++;
+		}
+		break;
+	}
+
+	outq_overflow_set (conn, context, QB_TRUE);
+
+	return (0);
+}
+
+static void msg_send_or_queue(qb_ipcs_connection_t *conn, struct cs_ipcs_dispatch_buf *buf)
+{
+	int32_t rc = 0;
+	struct outq_item *outq_item;
+	struct cs_ipcs_conn_context *context = qb_ipcs_context_get(conn);
+
 	if (!context->queuing) {
 		assert(list_empty (&context->outq_head));
-		rc = qb_ipcs_event_sendv(conn, iov, iov_len);
-		if (rc == bytes_msg) {
+		rc = qb_ipcs_event_sendv(conn, buf->iov, buf->iov_len);
+		if (rc == (int32_t)buf->mlen) {
 			context->sent++;
 			return;
 		}
@@ -533,39 +737,43 @@ static void msg_send_or_queue(qb_ipcs_connection_t *conn, const struct iovec *io
 			context->queuing = QB_TRUE;
 			qb_loop_job_add(cs_poll_handle_get(), QB_LOOP_HIGH, conn, outq_flush);
 		} else {
-			log_printf(LOGSYS_LEVEL_ERROR, "event_send retuned %d, expected %d!", rc, bytes_msg);
+			log_printf(LOGSYS_LEVEL_ERROR, "event_send retuned %d, expected %zu!", rc, buf->mlen);
 			return;
 		}
 	}
+
+	if (outq_limit_check (conn, context, buf->mlen) != 0) {
+		return;
+	}
+
 	outq_item = malloc (sizeof (struct outq_item));
 	if (outq_item == NULL) {
 		qb_ipcs_disconnect(conn);
 		return;
 	}
-	outq_item->msg = malloc (bytes_msg);
+	outq_item->msg = dispatch_msg_get (buf);
 	if (outq_item->msg == NULL) {
 		free (outq_item);
 		qb_ipcs_disconnect(conn);
 		return;
 	}
 
-	write_buf = outq_item->msg;
-	for (i = 0; i < iov_len; i++) {
-		memcpy (write_buf, iov[i].iov_base, iov[i].iov_len);
-		write_buf += iov[i].iov_len;
-	}
-	outq_item->mlen = bytes_msg;
 	list_init (&outq_item->list);
 	list_add_tail (&outq_item->list, &context->outq_head);
 	context->queued++;
+	context->queued_bytes += buf->mlen;
 }
 
 int cs_ipcs_dispatch_send(void *conn, const void *msg, size_t mlen)
 {
+	struct cs_ipcs_dispatch_buf buf;
 	struct iovec iov;
+
 	iov.iov_base = (void *)msg;
 	iov.iov_len = mlen;
-	msg_send_or_queue (conn, &iov, 1);
+	dispatch_buf_init (&buf, &iov, 1);
+	msg_send_or_queue (conn, &buf);
+	dispatch_buf_done (&buf);
 	return 0;
 }
 
@@ -573,10 +781,46 @@ int cs_ipcs_dispatch_iov_send (void *conn,
 	const struct iovec *iov,
 	unsigned int iov_len)
 {
-	msg_send_or_queue(conn, iov, iov_len);
+	struct cs_ipcs_dispatch_buf buf;
+
+	dispatch_buf_init (&buf, iov, iov_len);
+	msg_send_or_queue (conn, &buf);
+	dispatch_buf_done (&buf);
 	return 0;
 }
 
+/*
+ * Dispatch of one message to many connections. iov must stay valid until
+ * cs_ipcs_dispatch_buf_release. Connections which can't take the message
+ * immediately share a single copy of it.
+ */
+void *cs_ipcs_dispatch_buf_create (
+	const struct iovec *iov,
+	unsigned int iov_len)
+{
+	struct cs_ipcs_dispatch_buf *buf;
+
+	buf = malloc (sizeof (struct cs_ipcs_dispatch_buf));
+	if (buf == NULL) {
+		return (NULL);
+	}
+	dispatch_buf_init (buf, iov, iov_len);
+
+	return (buf);
+}
+
+int cs_ipcs_dispatch_buf_send (void *conn, void *buf)
+{
+	msg_send_or_queue (conn, (struct cs_ipcs_dispatch_buf *)buf);
+	return 0;
+}
+
+void cs_ipcs_dispatch_buf_release (void *buf)
+{
+	dispatch_buf_done ((struct cs_ipcs_dispatch_buf *)buf);
+	free (buf);
+}
+
 static int32_t cs_ipcs_msg_process(qb_ipcs_connection_t *c,
 		void *data, size_t size)
 {
@@ -588,13 +832,31 @@ static int32_t cs_ipcs_msg_process(qb_ipcs_connection_t *c,
 	ssize_t res = -1;
 	int sending_allowed_private_data;
 	struct cs_ipcs_conn_context *cnx;
+	unsigned long long start_time;
+
+	if (request_pt->id >= corosync_service[service]->lib_engine_count) {
+		/*
+		 * Request from a newer library
+		 */
+		response.size = sizeof (response);
+		response.id = 0;
+		response.error = CS_ERR_INVALID_PARAM;
+		qb_ipcs_response_send (c, &response, sizeof (response));
+
+		return -EINVAL;
+	}
 
 	send_ok = corosync_sending_allowed (service,
 			request_pt->id,
 			request_pt,
 			&sending_allowed_private_data);
 
-	is_async_call = (service == CPG_SERVICE && request_pt->id == 2);
+	/*
+	 * CPG mcast and streamed partial mcast are not answered
+	 */
+	is_async_call = (service == CPG_SERVICE &&
+	    (request_pt->id == MESSAGE_REQ_CPG_MCAST ||
+	     request_pt->id == MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM));
 
 	/*
 	 * This happens when the message contains some kind of invalid
@@ -610,6 +872,11 @@ static int32_t cs_ipcs_msg_process(qb_ipcs_connection_t *c,
 			cnx->invalid_request++;
 		}
 
+		if (corosync_service[service]->lib_engine[request_pt->id].lib_drop_fn != NULL) {
+			corosync_service[service]->lib_engine[request_pt->id].lib_drop_fn(c,
+			    request_pt, CS_ERR_INVALID_PARAM);
+		}
+
 		if (is_async_call) {
 			log_printf(LOGSYS_LEVEL_INFO, "*** %s() invalid message! size:%d error:%d",
 				__func__, response.size, response.error);
@@ -624,6 +891,11 @@ static int32_t cs_ipcs_msg_process(qb_ipcs_connection_t *c,
 		if (cnx) {
 			cnx->overload++;
 		}
+
+		if (corosync_service[service]->lib_engine[request_pt->id].lib_drop_fn != NULL) {
+			corosync_service[service]->lib_engine[request_pt->id].lib_drop_fn(c,
+			    request_pt, CS_ERR_TRY_AGAIN);
+		}
 		if (!is_async_call) {
 			/*
 			 * Overload, tell library to retry
@@ -644,7 +916,10 @@ static int32_t cs_ipcs_msg_process(qb_ipcs_connection_t *c,
 	}
 
 	if (send_ok >= 0) {
+		start_time = qb_util_nano_current_get();
 		corosync_service[service]->lib_engine[request_pt->id].lib_handler_fn(c, request_pt);
+		totem_histogram_record(&ipcs_mapper[service].request_hist,
+			(qb_util_nano_current_get() - start_time) / QB_TIME_NS_IN_USEC);
 		res = 0;
 	}
 	corosync_sending_allowed_release (&sending_allowed_private_data);
@@ -728,6 +1003,13 @@ static void cs_ipcs_check_for_flow_control(void)
 
 			qb_loop_timer_add(cs_poll_handle_get(), QB_LOOP_MED, 1*QB_TIME_NS_IN_MSEC,
 			       NULL, corosync_recheck_the_q_level, &ipcs_check_for_flow_control_timer);
+		} else if (ipcs_mapper[i].outq_overflow > 0 &&
+		    ipc_outq_overflow == CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL) {
+			/*
+			 * Local subscriber can't keep up, stop the senders
+			 * until its dispatch queue drains
+			 */
+			qb_ipcs_request_rate_limit(ipcs_mapper[i].inst, QB_IPCS_RATE_OFF);
 		} else if (ipc_fc_totem_queue_level == TOTEM_Q_LEVEL_LOW) {
 			qb_ipcs_request_rate_limit(ipcs_mapper[i].inst, QB_IPCS_RATE_FAST);
 		} else if (ipc_fc_totem_queue_level == TOTEM_Q_LEVEL_GOOD) {
@@ -771,6 +1053,11 @@ void cs_ipcs_stats_update(void)
 		}
 		qb_ipcs_stats_get(ipcs_mapper[i].inst, &srv_stats, QB_FALSE);
 
+		snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "runtime.services.%s.latency.request",
+			ipcs_mapper[i].name);
+		corosync_stats_histogram_publish(key_name,
+			&ipcs_mapper[i].request_hist, &ipcs_mapper[i].request_hist_prev);
+
 		for (c = qb_ipcs_connection_first_get(ipcs_mapper[i].inst);
 			 c;
 			 prev = c, c = qb_ipcs_connection_next_get(ipcs_mapper[i].inst, prev), qb_ipcs_connection_unref(prev)) {
@@ -807,6 +1094,12 @@ void cs_ipcs_stats_update(void)
 			snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.queue_size", cnx->icmap_path);
 			icmap_set_uint32(key_name, cnx->queued);
 
+			snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.queue_bytes", cnx->icmap_path);
+			icmap_set_uint64(key_name, cnx->queued_bytes);
+
+			snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.queue_dropped", cnx->icmap_path);
+			icmap_set_uint64(key_name, cnx->queue_dropped);
+
 			snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.invalid_request", cnx->icmap_path);
 			icmap_set_uint64(key_name, cnx->invalid_request);
 
@@ -893,8 +1186,47 @@ const char *cs_ipcs_service_init(struct corosync_service_engine *service)
 	return NULL;
 }
 
+static void cs_ipcs_outq_config_read (void)
+{
+	char *str;
+	uint32_t max_size;
+
+	if (icmap_get_uint32("qb.ipc_outq_max_size", &max_size) == CS_OK) {
+		ipc_outq_max_size = max_size;
+	} else {
+		ipc_outq_max_size = 0;
+	}
+
+	ipc_outq_overflow = CS_IPCS_OUTQ_OVERFLOW_FLOW_CONTROL;
+	if (icmap_get_string("qb.ipc_outq_overflow", &str) == CS_OK) {
+		if (strcmp(str, "disconnect") == 0) {
+			ipc_outq_overflow = CS_IPCS_OUTQ_OVERFLOW_DISCONNECT;
+		} else if (strcmp(str, "drop_oldest") == 0) {
+			ipc_outq_overflow = CS_IPCS_OUTQ_OVERFLOW_DROP_OLDEST;
+		} else if (strcmp(str, "flow_control") != 0) {
+			log_printf(LOGSYS_LEVEL_WARNING,
+				"Unknown qb.ipc_outq_overflow %s, using flow_control", str);
+		}
+		free(str);
+	}
+
+	cs_ipcs_check_for_flow_control();
+}
+
+static void cs_ipcs_outq_config_changed (
+	int32_t event,
+	const char *key_name,
+	struct icmap_notify_value new_val,
+	struct icmap_notify_value old_val,
+	void *user_data)
+{
+	cs_ipcs_outq_config_read();
+}
+
 void cs_ipcs_init(void)
 {
+	icmap_track_t track = NULL;
+
 	api = apidef_get ();
 
 	qb_loop_poll_low_fds_event_set(cs_poll_handle_get(), cs_ipcs_low_fds_event);
@@ -904,5 +1236,11 @@ void cs_ipcs_init(void)
 
 	icmap_set_uint64("runtime.connections.active", 0);
 	icmap_set_uint64("runtime.connections.closed", 0);
+
+	cs_ipcs_outq_config_read();
+	icmap_track_add("qb.ipc_outq_",
+		ICMAP_TRACK_ADD | ICMAP_TRACK_DELETE | ICMAP_TRACK_MODIFY | ICMAP_TRACK_PREFIX,
+		cs_ipcs_outq_config_changed,
+		NULL, &track);
 }
 
@@ -153,6 +153,12 @@ struct sched_param global_sched_param;
 
 static corosync_timer_handle_t corosync_stats_timer_handle;
 
+static struct totem_histogram stats_token_rotation_prev;
+
+static struct totem_histogram stats_token_hold_prev;
+
+static struct totem_histogram stats_mcast_latency_prev;
+
 static const char *corosync_lock_file = LOCALSTATEDIR"/run/corosync.pid";
 
 static int ip_version = AF_INET;
@@ -489,6 +495,37 @@ static void corosync_mlockall (void)
 }
 
 
+/*
+ * Publish count, mean, percentiles and max of the samples recorded into
+ * hist since the previous call. prev keeps the state between calls.
+ */
+void corosync_stats_histogram_publish (
+	const char *prefix,
+	const struct totem_histogram *hist,
+	struct totem_histogram *prev)
+{
+	struct totem_histogram diff;
+	char key_name[ICMAP_KEYNAME_MAXLEN];
+
+	totem_histogram_diff (&diff, hist, prev);
+	memcpy (prev, hist, sizeof (struct totem_histogram));
+
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.count", prefix);
+	icmap_set_uint64(key_name, diff.count);
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.mean", prefix);
+	icmap_set_uint64(key_name, diff.count ? diff.sum / diff.count : 0);
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.p50", prefix);
+	icmap_set_uint64(key_name, totem_histogram_percentile (&diff, 500));
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.p90", prefix);
+	icmap_set_uint64(key_name, totem_histogram_percentile (&diff, 900));
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.p99", prefix);
+	icmap_set_uint64(key_name, totem_histogram_percentile (&diff, 990));
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.p999", prefix);
+	icmap_set_uint64(key_name, totem_histogram_percentile (&diff, 999));
+	snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "%s.max", prefix);
+	icmap_set_uint64(key_name, diff.max);
+}
+
 static void corosync_totem_stats_updater (void *data)
 {
 	totempg_stats_t * stats;
@@ -501,6 +538,11 @@ static void corosync_totem_stats_updater (void *data)
 
 	stats = api->totem_get_stats();
 
+	/*
+	 * Trackers of runtime. get all changes of this tick at once
+	 */
+	(void)icmap_transaction_begin();
+
 	icmap_set_uint32("runtime.totem.pg.msg_reserved", stats->msg_reserved);
 	icmap_set_uint32("runtime.totem.pg.msg_queue_avail", stats->msg_queue_avail);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.orf_token_tx", stats->mrp->srp->orf_token_tx);
@@ -510,6 +552,7 @@ static void corosync_totem_stats_updater (void *data)
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.memb_join_tx", stats->mrp->srp->memb_join_tx);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.memb_join_rx", stats->mrp->srp->memb_join_rx);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.mcast_tx", stats->mrp->srp->mcast_tx);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.mcast_tx_control", stats->mrp->srp->mcast_tx_control);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.mcast_retx", stats->mrp->srp->mcast_retx);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.mcast_rx", stats->mrp->srp->mcast_rx);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.memb_commit_token_tx", stats->mrp->srp->memb_commit_token_tx);
@@ -526,9 +569,24 @@ static void corosync_totem_stats_updater (void *data)
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.recovery_token_lost", stats->mrp->srp->recovery_token_lost);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.consensus_timeouts", stats->mrp->srp->consensus_timeouts);
 	icmap_set_uint64("runtime.totem.pg.mrp.srp.rx_msg_dropped", stats->mrp->srp->rx_msg_dropped);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.tx_syscalls_saved", stats->mrp->srp->tx_syscalls_saved);
 	icmap_set_uint32("runtime.totem.pg.mrp.srp.continuous_gather", stats->mrp->srp->continuous_gather);
 	icmap_set_uint32("runtime.totem.pg.mrp.srp.continuous_sendmsg_failures",
 	    stats->mrp->srp->continuous_sendmsg_failures);
+	icmap_set_uint32("runtime.totem.pg.mrp.srp.fcc_window_size", stats->mrp->srp->fcc_window_size);
+	icmap_set_uint32("runtime.totem.pg.mrp.srp.fcc_max_messages", stats->mrp->srp->fcc_max_messages);
+	icmap_set_uint32("runtime.totem.pg.mrp.srp.fcc_token_rotation", stats->mrp->srp->fcc_token_rotation);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.fcc_decreases", stats->mrp->srp->fcc_decreases);
+	icmap_set_uint32("runtime.totem.pg.mrp.srp.frame_pool_size", stats->mrp->srp->frame_pool_size);
+	icmap_set_uint32("runtime.totem.pg.mrp.srp.frame_pool_in_use", stats->mrp->srp->frame_pool_in_use);
+	icmap_set_uint32("runtime.totem.pg.mrp.srp.frame_pool_in_use_max",
+	    stats->mrp->srp->frame_pool_in_use_max);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.frame_pool_overflow", stats->mrp->srp->frame_pool_overflow);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.frame_pool_bytes", stats->mrp->srp->frame_pool_bytes);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.frame_pool_bytes_in_use",
+	    stats->mrp->srp->frame_pool_bytes_in_use);
+	icmap_set_uint64("runtime.totem.pg.mrp.srp.frame_pool_bytes_in_use_max",
+	    stats->mrp->srp->frame_pool_bytes_in_use_max);
 
 	icmap_set_uint8("runtime.totem.pg.mrp.srp.firewall_enabled_or_nic_failure",
 		stats->mrp->srp->continuous_gather > MAX_NO_CONT_GATHER ? 1 : 0);
@@ -577,8 +635,17 @@ static void corosync_totem_stats_updater (void *data)
 		icmap_set_uint32("runtime.totem.pg.mrp.srp.avg_backlog_calc", (total_backlog_calc / token_count));
 	}
 
+	corosync_stats_histogram_publish ("runtime.totem.pg.mrp.srp.latency.token_rotation",
+		&stats->mrp->srp->token_rotation_hist, &stats_token_rotation_prev);
+	corosync_stats_histogram_publish ("runtime.totem.pg.mrp.srp.latency.token_hold",
+		&stats->mrp->srp->token_hold_hist, &stats_token_hold_prev);
+	corosync_stats_histogram_publish ("runtime.totem.pg.mrp.srp.latency.mcast_delivery",
+		&stats->mrp->srp->mcast_latency_hist, &stats_mcast_latency_prev);
+
 	cs_ipcs_stats_update();
 
+	(void)icmap_transaction_commit();
+
 	api->timer_add_duration (1500 * MILLI_2_NANO_SECONDS, NULL,
 		corosync_totem_stats_updater,
 		&corosync_stats_timer_handle);
@@ -629,7 +696,7 @@ static void deliver_fn (
 		return;
 	}
 
-	icmap_fast_inc(service_stats_rx[service][fn_id]);
+	icmap_counter_inc(service_stats_rx[service][fn_id]);
 
 	if (endian_conversion_required) {
 		assert(corosync_service[service]->exec_engine[fn_id].exec_endian_convert_fn != NULL);
@@ -654,7 +721,7 @@ int main_mcast (
 	fn_id = req->id & 0xffff;
 
 	if (corosync_service[service]) {
-		icmap_fast_inc(service_stats_tx[service][fn_id]);
+		icmap_counter_inc(service_stats_tx[service][fn_id]);
 	}
 
 	return (totempg_groups_mcast_joined (corosync_group_handle, iovec, iov_len, guarantee));
@@ -92,6 +92,11 @@ extern void corosync_sending_allowed_release (void *sending_allowed_private_data
 
 extern void corosync_recheck_the_q_level(void *data);
 
+extern void corosync_stats_histogram_publish (
+	const char *prefix,
+	const struct totem_histogram *hist,
+	struct totem_histogram *prev);
+
 extern void cs_ipcs_init(void);
 
 extern const char *cs_ipcs_service_init(struct corosync_service_engine *service);
@@ -107,6 +112,14 @@ extern int cs_ipcs_dispatch_iov_send (void *conn,
 	const struct iovec *iov,
 	unsigned int iov_len);
 
+extern void *cs_ipcs_dispatch_buf_create (
+	const struct iovec *iov,
+	unsigned int iov_len);
+
+extern int cs_ipcs_dispatch_buf_send (void *conn, void *buf);
+
+extern void cs_ipcs_dispatch_buf_release (void *buf);
+
 extern int cs_ipcs_response_send(void *conn, const void *msg, size_t mlen);
 extern int cs_ipcs_response_iov_send (void *conn,
 	const struct iovec *iov,
@@ -109,8 +109,8 @@ struct seus_handler_data {
 
 struct corosync_service_engine *corosync_service[SERVICES_COUNT_MAX];
 
-const char *service_stats_rx[SERVICES_COUNT_MAX][SERVICE_HANDLER_MAXIMUM_COUNT];
-const char *service_stats_tx[SERVICES_COUNT_MAX][SERVICE_HANDLER_MAXIMUM_COUNT];
+icmap_counter_t service_stats_rx[SERVICES_COUNT_MAX][SERVICE_HANDLER_MAXIMUM_COUNT];
+icmap_counter_t service_stats_tx[SERVICES_COUNT_MAX][SERVICE_HANDLER_MAXIMUM_COUNT];
 
 static void (*service_unlink_all_complete) (void) = NULL;
 
@@ -163,11 +163,11 @@ char *corosync_service_link_and_init (
 	for (fn = 0; fn < service_engine->exec_engine_count; fn++) {
 		snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "runtime.services.%s.%d.tx", name_sufix, fn);
 		icmap_set_uint64(key_name, 0);
-		service_stats_tx[service_engine->id][fn] = strdup(key_name);
+		icmap_counter_create(key_name, &service_stats_tx[service_engine->id][fn]);
 
 		snprintf(key_name, ICMAP_KEYNAME_MAXLEN, "runtime.services.%s.%d.rx", name_sufix, fn);
 		icmap_set_uint64(key_name, 0);
-		service_stats_rx[service_engine->id][fn] = strdup(key_name);
+		icmap_counter_create(key_name, &service_stats_rx[service_engine->id][fn]);
 	}
 
 	log_printf (LOGSYS_LEVEL_NOTICE,
@@ -180,6 +180,21 @@ char *corosync_service_link_and_init (
 	return NULL;
 }
 
+/*
+ * Release rx/tx counters of service. Keys are kept in cmap.
+ */
+static void service_stats_destroy (int service_id)
+{
+	int fn;
+
+	for (fn = 0; fn < corosync_service[service_id]->exec_engine_count; fn++) {
+		icmap_counter_destroy (service_stats_tx[service_id][fn]);
+		service_stats_tx[service_id][fn] = NULL;
+		icmap_counter_destroy (service_stats_rx[service_id][fn]);
+		service_stats_rx[service_id][fn] = NULL;
+	}
+}
+
 static int service_priority_max(void)
 {
 	int lpc = 0, max = 0;
@@ -239,6 +254,7 @@ corosync_service_unlink_and_exit_priority (
 				"Service engine unloaded: %s",
 				corosync_service[*current_service_engine]->name);
 
+			service_stats_destroy (*current_service_engine);
 			corosync_service[*current_service_engine] = NULL;
 
 			/*
@@ -318,6 +334,7 @@ static unsigned int service_unlink_and_exit (
 			"Service engine unloaded: %s",
 			   corosync_service[service_id]->name);
 
+		service_stats_destroy (service_id);
 		corosync_service[service_id] = NULL;
 
 		cs_ipcs_service_destroy (service_id);
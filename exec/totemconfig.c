@@ -380,6 +380,12 @@ static int totem_get_crypto(struct totem_config *totem_config)
 		if (strcmp(str, "3des") == 0) {
 			tmp_cipher = "3des";
 		}
+		if (strcmp(str, "aes256-gcm") == 0) {
+			tmp_cipher = "aes256-gcm";
+		}
+		if (strcmp(str, "aes128-gcm") == 0) {
+			tmp_cipher = "aes128-gcm";
+		}
 		free(str);
 	}
 
@@ -405,6 +411,13 @@ static int totem_get_crypto(struct totem_config *totem_config)
 		free(str);
 	}
 
+	/*
+	 * GCM ciphers authenticate messages themselves and don't use crypto_hash
+	 */
+	if (strcmp(tmp_cipher, "aes256-gcm") == 0 ||
+	    strcmp(tmp_cipher, "aes128-gcm") == 0) {
+		tmp_hash = "none";
+	} else
 	if ((strcmp(tmp_cipher, "none") != 0) &&
 	    (strcmp(tmp_hash, "none") == 0)) {
 		return -1;
@@ -1038,6 +1051,22 @@ extern int totem_config_read (
 		free(str);
 	}
 
+	totem_config->fcc_adaptive = 0;
+	if (icmap_get_string("totem.fcc_adaptive", &str) == CS_OK) {
+		if (strcmp (str, "yes") == 0) {
+			totem_config->fcc_adaptive = 1;
+		}
+		free(str);
+	}
+
+	totem_config->priority_lanes = 0;
+	if (icmap_get_string("totem.priority_lanes", &str) == CS_OK) {
+		if (strcmp (str, "yes") == 0) {
+			totem_config->priority_lanes = 1;
+		}
+		free(str);
+	}
+
 	icmap_get_uint32("totem.threads", &totem_config->threads);
 
 	icmap_get_uint32("totem.netmtu", &totem_config->net_mtu);
@@ -37,6 +37,9 @@
 
 #include "config.h"
 
+#include <pthread.h>
+#include <signal.h>
+
 #include <nss.h>
 #include <pk11pub.h>
 #include <pkcs11.h>
@@ -66,6 +69,19 @@ struct crypto_config_header {
 
 #define SALT_SIZE 16
 
+/*
+ * AES-GCM nonce and authentication tag sizes
+ */
+#define GCM_IV_SIZE 12
+#define GCM_TAG_SIZE 16
+
+/*
+ * NSS >= 3.52 can reuse one AEAD context for many messages
+ */
+#ifdef CKA_NSS_MESSAGE
+#define HAVE_NSS_AEAD 1
+#endif
+
 /*
  * This are defined in new NSS. For older one, we will define our own
  */
@@ -93,6 +109,8 @@ enum crypto_crypt_t {
 	CRYPTO_CIPHER_TYPE_AES192 = 2,
 	CRYPTO_CIPHER_TYPE_AES128 = 3,
 	CRYPTO_CIPHER_TYPE_3DES = 4,
+	CRYPTO_CIPHER_TYPE_AES256_GCM = 5,
+	CRYPTO_CIPHER_TYPE_AES128_GCM = 6,
 	CRYPTO_CIPHER_TYPE_2_3 = UINT8_MAX - 1,
 	CRYPTO_CIPHER_TYPE_2_2 = UINT8_MAX
 };
@@ -102,7 +120,9 @@ CK_MECHANISM_TYPE cipher_to_nss[] = {
 	CKM_AES_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_AES256 */
 	CKM_AES_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_AES192 */
 	CKM_AES_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_AES128 */
-	CKM_DES3_CBC_PAD		/* CRYPTO_CIPHER_TYPE_3DES */
+	CKM_DES3_CBC_PAD,		/* CRYPTO_CIPHER_TYPE_3DES */
+	CKM_AES_GCM,			/* CRYPTO_CIPHER_TYPE_AES256_GCM */
+	CKM_AES_GCM			/* CRYPTO_CIPHER_TYPE_AES128_GCM */
 };
 
 size_t cipher_key_len[] = {
@@ -110,7 +130,9 @@ size_t cipher_key_len[] = {
 	AES_256_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES256 */
 	AES_192_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES192 */
 	AES_128_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES128 */
-	24				/* CRYPTO_CIPHER_TYPE_3DES - no magic in nss headers */
+	24,				/* CRYPTO_CIPHER_TYPE_3DES - no magic in nss headers */
+	AES_256_KEY_LENGTH,		/* CRYPTO_CIPHER_TYPE_AES256_GCM */
+	AES_128_KEY_LENGTH		/* CRYPTO_CIPHER_TYPE_AES128_GCM */
 };
 
 size_t cypher_block_len[] = {
@@ -118,9 +140,15 @@ size_t cypher_block_len[] = {
 	AES_BLOCK_SIZE,			/* CRYPTO_CIPHER_TYPE_AES256 */
 	AES_BLOCK_SIZE,			/* CRYPTO_CIPHER_TYPE_AES192 */
 	AES_BLOCK_SIZE,			/* CRYPTO_CIPHER_TYPE_AES128 */
-	0				/* CRYPTO_CIPHER_TYPE_3DES */
+	0,				/* CRYPTO_CIPHER_TYPE_3DES */
+	0,				/* CRYPTO_CIPHER_TYPE_AES256_GCM - stream mode, no padding */
+	0				/* CRYPTO_CIPHER_TYPE_AES128_GCM - stream mode, no padding */
 };
 
+#define CRYPTO_CIPHER_IS_AEAD(type)					\
+	((type) == CRYPTO_CIPHER_TYPE_AES256_GCM ||			\
+	 (type) == CRYPTO_CIPHER_TYPE_AES128_GCM)
+
 /*
  * hash definitions and conversion tables
  */
@@ -169,10 +197,27 @@ size_t hash_block_len[] = {
 	SHA512_BLOCK_LENGTH		/* CRYPTO_HASH_TYPE_SHA512 */
 };
 
+/*
+ * NSS contexts cached per thread, so no context is created per packet.
+ * PK11Context is not safe to share between threads without locking.
+ */
+struct crypto_thread_ctx {
+	PK11Context *hash_context;
+	PK11Context *aead_encrypt_context;
+	PK11Context *aead_decrypt_context;
+};
+
+enum crypto_job_type {
+	CRYPTO_JOB_ENCRYPT,
+	CRYPTO_JOB_DECRYPT
+};
+
 struct crypto_instance {
 	PK11SymKey   *nss_sym_key;
 	PK11SymKey   *nss_sym_key_sign;
 
+	pthread_key_t thread_ctx_key;
+
 	unsigned char private_key[1024];
 
 	unsigned int private_key_len;
@@ -196,6 +241,35 @@ struct crypto_instance {
 	int log_level_notice;
 	int log_level_error;
 	int log_subsys_id;
+
+	/*
+	 * AES-GCM nonces are gcm_iv_base + gcm_iv_counter. The base is drawn
+	 * at random once per instance and the counter only grows, so one
+	 * instance never repeats a nonce and two instances collide only if
+	 * their ranges overlap, roughly (instances * frames) / 2^96, instead
+	 * of frames^2 / 2^97 for a random nonce per frame.
+	 */
+	unsigned char gcm_iv_base[GCM_IV_SIZE];
+	uint64_t gcm_iv_counter;
+
+	/*
+	 * Worker pool for the batch functions. A batch is split between
+	 * the workers and the calling thread, which waits until all items
+	 * are done, so results come back in order.
+	 */
+	pthread_t *workers;
+	unsigned int workers_count;
+	int workers_stop;
+	pthread_mutex_t workers_mutex;
+	pthread_cond_t workers_cond;
+	pthread_cond_t workers_done_cond;
+	unsigned int job_generation;
+	unsigned int job_active;
+	enum crypto_job_type job_type;
+	void *job_items;
+	unsigned int job_count;
+	unsigned int job_next;
+	unsigned int job_done;
 };
 
 #define log_printf(level, format, args...)				\
@@ -222,10 +296,58 @@ static int string_to_crypto_cipher_type(const char* crypto_cipher_type)
 		return CRYPTO_CIPHER_TYPE_AES128;
 	} else if (strcmp(crypto_cipher_type, "3des") == 0) {
 		return CRYPTO_CIPHER_TYPE_3DES;
+	} else if (strcmp(crypto_cipher_type, "aes256-gcm") == 0) {
+		return CRYPTO_CIPHER_TYPE_AES256_GCM;
+	} else if (strcmp(crypto_cipher_type, "aes128-gcm") == 0) {
+		return CRYPTO_CIPHER_TYPE_AES128_GCM;
 	}
 	return CRYPTO_CIPHER_TYPE_AES256;
 }
 
+/*
+ * per thread context cache
+ */
+
+static void crypto_thread_ctx_free(void *data)
+{
+	struct crypto_thread_ctx *ctx = (struct crypto_thread_ctx *)data;
+
+	if (ctx->hash_context) {
+		PK11_DestroyContext(ctx->hash_context, PR_TRUE);
+	}
+	if (ctx->aead_encrypt_context) {
+		PK11_DestroyContext(ctx->aead_encrypt_context, PR_TRUE);
+	}
+	if (ctx->aead_decrypt_context) {
+		PK11_DestroyContext(ctx->aead_decrypt_context, PR_TRUE);
+	}
+	free(ctx);
+}
+
+static struct crypto_thread_ctx *crypto_thread_ctx_get(struct crypto_instance *instance)
+{
+	struct crypto_thread_ctx *ctx;
+
+	ctx = pthread_getspecific(instance->thread_ctx_key);
+	if (ctx != NULL) {
+		return ctx;
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		log_printf(instance->log_level_security,
+			   "Unable to allocate crypto thread context");
+		return NULL;
+	}
+
+	if (pthread_setspecific(instance->thread_ctx_key, ctx) != 0) {
+		free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
 static int init_nss_crypto(struct crypto_instance *instance)
 {
 	PK11SlotInfo*	crypt_slot = NULL;
@@ -235,6 +357,14 @@ static int init_nss_crypto(struct crypto_instance *instance)
 		return 0;
 	}
 
+#ifndef HAVE_NSS_AEAD
+	if (CRYPTO_CIPHER_IS_AEAD(instance->crypto_cipher_type)) {
+		log_printf(instance->log_level_security,
+			   "AES-GCM ciphers require NSS with AEAD support (3.52 or newer)");
+		return -1;
+	}
+#endif
+
 	crypt_param.type = siBuffer;
 	crypt_param.data = instance->private_key;
 	crypt_param.len = cipher_key_len[instance->crypto_cipher_type];
@@ -258,6 +388,14 @@ static int init_nss_crypto(struct crypto_instance *instance)
 
 	PK11_FreeSlot(crypt_slot);
 
+	if (CRYPTO_CIPHER_IS_AEAD(instance->crypto_cipher_type) &&
+	    PK11_GenerateRandom (instance->gcm_iv_base, GCM_IV_SIZE) != SECSuccess) {
+		log_printf(instance->log_level_security,
+			"Failure to generate a random number %d",
+			PR_GetError());
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -421,6 +559,160 @@ out:
 	return err;
 }
 
+#ifdef HAVE_NSS_AEAD
+static PK11Context *aead_nss_context_get(
+	struct crypto_instance *instance,
+	CK_ATTRIBUTE_TYPE operation)
+{
+	struct crypto_thread_ctx *ctx;
+	PK11Context **context;
+	SECItem param;
+
+	ctx = crypto_thread_ctx_get(instance);
+	if (ctx == NULL) {
+		return NULL;
+	}
+
+	if (operation == CKA_ENCRYPT) {
+		context = &ctx->aead_encrypt_context;
+	} else {
+		context = &ctx->aead_decrypt_context;
+	}
+
+	if (*context == NULL) {
+		param.type = siBuffer;
+		param.data = NULL;
+		param.len = 0;
+
+		*context = PK11_CreateContextBySymKey(cipher_to_nss[instance->crypto_cipher_type],
+						      CKA_NSS_MESSAGE | operation,
+						      instance->nss_sym_key,
+						      &param);
+		if (*context == NULL) {
+			log_printf(instance->log_level_security,
+				   "PK11_CreateContext failed (aead) crypt_type=%d (err %d)",
+				   (int)cipher_to_nss[instance->crypto_cipher_type],
+				   PR_GetError());
+		}
+	}
+
+	return *context;
+}
+#endif
+
+#ifdef HAVE_NSS_AEAD
+/*
+ * Next nonce of the instance, safe to call from the worker threads
+ */
+static void aead_iv_next(
+	struct crypto_instance *instance,
+	unsigned char *iv)
+{
+	uint64_t counter;
+	unsigned int carry = 0;
+	int i;
+
+	counter = __sync_fetch_and_add(&instance->gcm_iv_counter, 1);
+
+	for (i = GCM_IV_SIZE - 1; i >= 0; i--) {
+		carry += instance->gcm_iv_base[i] + (unsigned int)(counter & 0xff);
+		iv[i] = carry & 0xff;
+		carry >>= 8;
+		counter >>= 8;
+	}
+}
+#endif
+
+/*
+ * AEAD packet format:
+ *   fake_crypto_cipher_type | fake_crypto_hash_type | __pad0 | __pad1 | iv | data | tag
+ *   data is encrypted, the config header is authenticated as additional data
+ *   so encryption and authentication is done in one pass without HMAC
+ */
+static int encrypt_and_sign_nss_aead (
+	struct crypto_instance *instance,
+	const unsigned char *buf_in,
+	const size_t buf_in_len,
+	unsigned char *buf_out,
+	size_t *buf_out_len)
+{
+#ifdef HAVE_NSS_AEAD
+	PK11Context	*aead_context;
+	unsigned char	*iv = buf_out + sizeof(struct crypto_config_header);
+	unsigned char	*data = iv + GCM_IV_SIZE;
+	int		outlen = 0;
+
+	aead_context = aead_nss_context_get(instance, CKA_ENCRYPT);
+	if (aead_context == NULL) {
+		return -1;
+	}
+
+	aead_iv_next(instance, iv);
+
+	if (PK11_AEADOp(aead_context, CKG_NO_GENERATE, 0,
+			iv, GCM_IV_SIZE,
+			buf_out, sizeof(struct crypto_config_header),
+			data, &outlen, FRAME_SIZE_MAX - instance->crypto_header_size,
+			data + buf_in_len, GCM_TAG_SIZE,
+			buf_in, buf_in_len) != SECSuccess) {
+		log_printf(instance->log_level_security,
+			   "PK11_AEADOp failed (encrypt) crypt_type=%d (err %d)",
+			   (int)cipher_to_nss[instance->crypto_cipher_type],
+			   PR_GetError());
+		return -1;
+	}
+
+	*buf_out_len = sizeof(struct crypto_config_header) + GCM_IV_SIZE +
+		outlen + GCM_TAG_SIZE;
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static int authenticate_and_decrypt_nss_aead (
+	struct crypto_instance *instance,
+	unsigned char *buf,
+	int *buf_len)
+{
+#ifdef HAVE_NSS_AEAD
+	PK11Context	*aead_context;
+	unsigned char	*iv = buf + sizeof(struct crypto_config_header);
+	unsigned char	*data = iv + GCM_IV_SIZE;
+	int		datalen = *buf_len - sizeof(struct crypto_config_header) -
+				  GCM_IV_SIZE - GCM_TAG_SIZE;
+	unsigned char	outbuf[FRAME_SIZE_MAX];
+	int		outbuf_len = 0;
+
+	if (datalen < 0) {
+		log_printf(instance->log_level_security, "Received message is too short");
+		return -1;
+	}
+
+	aead_context = aead_nss_context_get(instance, CKA_DECRYPT);
+	if (aead_context == NULL) {
+		return -1;
+	}
+
+	if (PK11_AEADOp(aead_context, CKG_NO_GENERATE, 0,
+			iv, GCM_IV_SIZE,
+			buf, sizeof(struct crypto_config_header),
+			outbuf, &outbuf_len, sizeof(outbuf),
+			data + datalen, GCM_TAG_SIZE,
+			data, datalen) != SECSuccess) {
+		log_printf(instance->log_level_error, "Digest does not match");
+		return -1;
+	}
+
+	memcpy(buf + sizeof(struct crypto_config_header), outbuf, outbuf_len);
+	*buf_len = outbuf_len + sizeof(struct crypto_config_header);
+
+	return 0;
+#else
+	return -1;
+#endif
+}
 
 /*
  * hash/hmac/digest functions
@@ -482,33 +774,46 @@ static int init_nss_hash(struct crypto_instance *instance)
 
 static int calculate_nss_hash(
 	struct crypto_instance *instance,
-	const unsigned char *buf,
-	const size_t buf_len,
+	const struct iovec *iov,
+	unsigned int iov_len,
 	unsigned char *hash)
 {
+	struct crypto_thread_ctx *ctx;
 	PK11Context*	hash_context = NULL;
 	SECItem		hash_param;
 	unsigned int	hash_tmp_outlen = 0;
 	unsigned char	hash_block[hash_block_len[instance->crypto_hash_type]];
+	unsigned int	i;
 	int		err = -1;
 
-	/* Now do the digest */
-	hash_param.type = siBuffer;
-	hash_param.data = 0;
-	hash_param.len = 0;
-
-	hash_context = PK11_CreateContextBySymKey(hash_to_nss[instance->crypto_hash_type],
-						 CKA_SIGN,
-						 instance->nss_sym_key_sign,
-						 &hash_param);
+	ctx = crypto_thread_ctx_get(instance);
+	if (ctx == NULL) {
+		return -1;
+	}
 
-	if (!hash_context) {
-		log_printf(instance->log_level_security,
-			   "PK11_CreateContext failed (hash) hash_type=%d (err %d)",
-			   (int)hash_to_nss[instance->crypto_hash_type],
-			   PR_GetError());
-		goto out;
+	/*
+	 * The context is created once per thread, PK11_DigestBegin
+	 * restarts it for every packet
+	 */
+	if (ctx->hash_context == NULL) {
+		hash_param.type = siBuffer;
+		hash_param.data = 0;
+		hash_param.len = 0;
+
+		ctx->hash_context = PK11_CreateContextBySymKey(hash_to_nss[instance->crypto_hash_type],
+							       CKA_SIGN,
+							       instance->nss_sym_key_sign,
+							       &hash_param);
+
+		if (!ctx->hash_context) {
+			log_printf(instance->log_level_security,
+				   "PK11_CreateContext failed (hash) hash_type=%d (err %d)",
+				   (int)hash_to_nss[instance->crypto_hash_type],
+				   PR_GetError());
+			return -1;
+		}
 	}
+	hash_context = ctx->hash_context;
 
 	if (PK11_DigestBegin(hash_context) != SECSuccess) {
 		log_printf(instance->log_level_security,
@@ -518,14 +823,16 @@ static int calculate_nss_hash(
 		goto out;
 	}
 
-	if (PK11_DigestOp(hash_context,
-			  buf,
-			  buf_len) != SECSuccess) {
-		log_printf(instance->log_level_security,
-			   "PK11_DigestOp failed (hash) hash_type=%d (err %d)",
-			   (int)hash_to_nss[instance->crypto_hash_type],
-			   PR_GetError());
-		goto out;
+	for (i = 0; i < iov_len; i++) {
+		if (PK11_DigestOp(hash_context,
+				  iov[i].iov_base,
+				  iov[i].iov_len) != SECSuccess) {
+			log_printf(instance->log_level_security,
+				   "PK11_DigestOp failed (hash) hash_type=%d (err %d)",
+				   (int)hash_to_nss[instance->crypto_hash_type],
+				   PR_GetError());
+			goto out;
+		}
 	}
 
 	if (PK11_DigestFinal(hash_context,
@@ -543,8 +850,12 @@ static int calculate_nss_hash(
 	err = 0;
 
 out:
-	if (hash_context) {
+	if (err) {
+		/*
+		 * Don't reuse a context left in unknown state
+		 */
 		PK11_DestroyContext(hash_context, PR_TRUE);
+		ctx->hash_context = NULL;
 	}
 
 	return err;
@@ -600,6 +911,8 @@ static int encrypt_and_sign_nss_2_3 (
 	unsigned char *buf_out,
 	size_t *buf_out_len)
 {
+	struct iovec iov;
+
 	if (encrypt_nss(instance,
 			buf_in, buf_in_len,
 			buf_out + sizeof(struct crypto_config_header), buf_out_len) < 0) {
@@ -609,7 +922,9 @@ static int encrypt_and_sign_nss_2_3 (
 	*buf_out_len += sizeof(struct crypto_config_header);
 
 	if (hash_to_nss[instance->crypto_hash_type]) {
-		if (calculate_nss_hash(instance, buf_out, *buf_out_len, buf_out + *buf_out_len) < 0) {
+		iov.iov_base = buf_out;
+		iov.iov_len = *buf_out_len;
+		if (calculate_nss_hash(instance, &iov, 1, buf_out + *buf_out_len) < 0) {
 			return -1;
 		}
 		*buf_out_len += hash_len[instance->crypto_hash_type];
@@ -626,8 +941,11 @@ static int authenticate_nss_2_3 (
 	if (hash_to_nss[instance->crypto_hash_type]) {
 		unsigned char	tmp_hash[hash_len[instance->crypto_hash_type]];
 		int             datalen = *buf_len - hash_len[instance->crypto_hash_type];
+		struct iovec	iov;
 
-		if (calculate_nss_hash(instance, buf, datalen, tmp_hash) < 0) {
+		iov.iov_base = buf;
+		iov.iov_len = datalen;
+		if (calculate_nss_hash(instance, &iov, 1, tmp_hash) < 0) {
 			return -1;
 		}
 
@@ -670,6 +988,10 @@ size_t crypto_sec_header_size(
 
 	hdr_size = sizeof(struct crypto_config_header);
 
+	if (CRYPTO_CIPHER_IS_AEAD(crypto_cipher)) {
+		return hdr_size + GCM_IV_SIZE + GCM_TAG_SIZE;
+	}
+
 	if (crypto_hash) {
 		hdr_size += hash_len[crypto_hash];
 	}
@@ -723,6 +1045,12 @@ int crypto_encrypt_and_sign (
 	cch->__pad0 = 0;
 	cch->__pad1 = 0;
 
+	if (CRYPTO_CIPHER_IS_AEAD(instance->crypto_cipher_type)) {
+		return encrypt_and_sign_nss_aead(instance,
+						 buf_in, buf_in_len,
+						 buf_out, buf_out_len);
+	}
+
 	err = encrypt_and_sign_nss_2_3(instance,
 				       buf_in, buf_in_len,
 				       buf_out, buf_out_len);
@@ -730,6 +1058,57 @@ int crypto_encrypt_and_sign (
 	return err;
 }
 
+/*
+ * Same packet as crypto_encrypt_and_sign, returned as up to 3 iovecs.
+ * Without a cipher the payload is referenced in place from buf_in and
+ * buf_out only holds the header and hash, so nothing is copied.
+ */
+int crypto_encrypt_and_sign_iov (
+	struct crypto_instance *instance,
+	const unsigned char *buf_in,
+	const size_t buf_in_len,
+	unsigned char *buf_out,
+	struct iovec *iov_out,
+	unsigned int *iov_out_len)
+{
+	struct crypto_config_header *cch = (struct crypto_config_header *)buf_out;
+	size_t buf_out_len;
+	int err;
+
+	if (cipher_to_nss[instance->crypto_cipher_type]) {
+		err = crypto_encrypt_and_sign(instance,
+					      buf_in, buf_in_len,
+					      buf_out, &buf_out_len);
+		iov_out[0].iov_base = buf_out;
+		iov_out[0].iov_len = buf_out_len;
+		*iov_out_len = 1;
+		return err;
+	}
+
+	cch->crypto_cipher_type = CRYPTO_CIPHER_TYPE_2_3;
+	cch->crypto_hash_type = CRYPTO_HASH_TYPE_2_3;
+	cch->__pad0 = 0;
+	cch->__pad1 = 0;
+
+	iov_out[0].iov_base = buf_out;
+	iov_out[0].iov_len = sizeof(struct crypto_config_header);
+	iov_out[1].iov_base = (void *)buf_in;
+	iov_out[1].iov_len = buf_in_len;
+	*iov_out_len = 2;
+
+	if (hash_to_nss[instance->crypto_hash_type]) {
+		if (calculate_nss_hash(instance, iov_out, 2,
+				       buf_out + sizeof(struct crypto_config_header)) < 0) {
+			return -1;
+		}
+		iov_out[2].iov_base = buf_out + sizeof(struct crypto_config_header);
+		iov_out[2].iov_len = hash_len[instance->crypto_hash_type];
+		*iov_out_len = 3;
+	}
+
+	return 0;
+}
+
 int crypto_authenticate_and_decrypt (struct crypto_instance *instance,
 	unsigned char *buf,
 	int *buf_len)
@@ -752,6 +1131,15 @@ int crypto_authenticate_and_decrypt (struct crypto_instance *instance,
 	 * authenticate packet first
 	 */
 
+	if (CRYPTO_CIPHER_IS_AEAD(instance->crypto_cipher_type)) {
+		/*
+		 * authentication and decryption is one operation,
+		 * plain text is left after the config header
+		 */
+		if (authenticate_and_decrypt_nss_aead(instance, buf, buf_len) != 0) {
+			return -1;
+		}
+	} else
 	if (authenticate_nss_2_3(instance, buf, buf_len) != 0) {
 		return -1;
 	}
@@ -770,6 +1158,9 @@ int crypto_authenticate_and_decrypt (struct crypto_instance *instance,
 	 * decrypt
 	 */
 
+	if (CRYPTO_CIPHER_IS_AEAD(instance->crypto_cipher_type)) {
+		*buf_len -= sizeof(struct crypto_config_header);
+	} else
 	if (decrypt_nss_2_3(instance, buf, buf_len) != 0) {
 		return -1;
 	}
@@ -783,6 +1174,221 @@ int crypto_authenticate_and_decrypt (struct crypto_instance *instance,
 	return 0;
 }
 
+/*
+ * worker pool
+ */
+
+static void crypto_job_run(struct crypto_instance *instance)
+{
+	struct crypto_send_item *send_item;
+	struct crypto_recv_item *recv_item;
+	unsigned int i;
+
+	while ((i = __sync_fetch_and_add(&instance->job_next, 1)) < instance->job_count) {
+		if (instance->job_type == CRYPTO_JOB_ENCRYPT) {
+			send_item = &((struct crypto_send_item *)instance->job_items)[i];
+			send_item->res = crypto_encrypt_and_sign_iov(instance,
+				send_item->buf_in, send_item->buf_in_len,
+				send_item->buf_out, send_item->iov_out, &send_item->iov_out_len);
+		} else {
+			recv_item = &((struct crypto_recv_item *)instance->job_items)[i];
+			recv_item->res = crypto_authenticate_and_decrypt(instance,
+				recv_item->buf, &recv_item->buf_len);
+		}
+		__sync_fetch_and_add(&instance->job_done, 1);
+	}
+}
+
+static void *crypto_worker_fn(void *data)
+{
+	struct crypto_instance *instance = (struct crypto_instance *)data;
+	unsigned int generation;
+
+	pthread_mutex_lock(&instance->workers_mutex);
+	generation = instance->job_generation;
+	for (;;) {
+		while (generation == instance->job_generation && !instance->workers_stop) {
+			pthread_cond_wait(&instance->workers_cond, &instance->workers_mutex);
+		}
+		if (instance->workers_stop) {
+			break;
+		}
+		generation = instance->job_generation;
+		instance->job_active++;
+		pthread_mutex_unlock(&instance->workers_mutex);
+
+		crypto_job_run(instance);
+
+		pthread_mutex_lock(&instance->workers_mutex);
+		instance->job_active--;
+		pthread_cond_signal(&instance->workers_done_cond);
+	}
+	pthread_mutex_unlock(&instance->workers_mutex);
+
+	return (NULL);
+}
+
+/*
+ * Run the current job on the workers and the calling thread
+ */
+static void crypto_job_execute(
+	struct crypto_instance *instance,
+	enum crypto_job_type type,
+	void *items,
+	unsigned int count)
+{
+	pthread_mutex_lock(&instance->workers_mutex);
+	/*
+	 * A worker which woke up too late for the previous job may still be
+	 * looking at it
+	 */
+	while (instance->job_active > 0) {
+		pthread_cond_wait(&instance->workers_done_cond, &instance->workers_mutex);
+	}
+	instance->job_type = type;
+	instance->job_items = items;
+	instance->job_count = count;
+	instance->job_next = 0;
+	instance->job_done = 0;
+	instance->job_generation++;
+	pthread_cond_broadcast(&instance->workers_cond);
+	pthread_mutex_unlock(&instance->workers_mutex);
+
+	crypto_job_run(instance);
+
+	pthread_mutex_lock(&instance->workers_mutex);
+	while (instance->job_done < count || instance->job_active > 0) {
+		pthread_cond_wait(&instance->workers_done_cond, &instance->workers_mutex);
+	}
+	pthread_mutex_unlock(&instance->workers_mutex);
+}
+
+static int crypto_batch_parallel(
+	struct crypto_instance *instance,
+	unsigned int count)
+{
+
+	return (instance->workers_count > 0 && count > 1 &&
+		(cipher_to_nss[instance->crypto_cipher_type] ||
+		 hash_to_nss[instance->crypto_hash_type]));
+}
+
+void crypto_encrypt_and_sign_iov_batch (
+	struct crypto_instance *instance,
+	struct crypto_send_item *items,
+	unsigned int count)
+{
+	unsigned int i;
+
+	if (crypto_batch_parallel(instance, count)) {
+		crypto_job_execute(instance, CRYPTO_JOB_ENCRYPT, items, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		items[i].res = crypto_encrypt_and_sign_iov(instance,
+			items[i].buf_in, items[i].buf_in_len,
+			items[i].buf_out, items[i].iov_out, &items[i].iov_out_len);
+	}
+}
+
+void crypto_authenticate_and_decrypt_batch (
+	struct crypto_instance *instance,
+	struct crypto_recv_item *items,
+	unsigned int count)
+{
+	unsigned int i;
+
+	if (crypto_batch_parallel(instance, count)) {
+		crypto_job_execute(instance, CRYPTO_JOB_DECRYPT, items, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		items[i].res = crypto_authenticate_and_decrypt(instance,
+			items[i].buf, &items[i].buf_len);
+	}
+}
+
+unsigned int crypto_workers_get (struct crypto_instance *instance)
+{
+
+	return (instance->workers_count);
+}
+
+int crypto_workers_start (
+	struct crypto_instance *instance,
+	unsigned int workers)
+{
+	sigset_t sigset;
+	sigset_t old_sigset;
+	unsigned int i;
+	int res = 0;
+
+	if (workers == 0 || instance->workers != NULL) {
+		return (0);
+	}
+
+	instance->workers = calloc(workers, sizeof(pthread_t));
+	if (instance->workers == NULL) {
+		return (-1);
+	}
+
+	pthread_mutex_init(&instance->workers_mutex, NULL);
+	pthread_cond_init(&instance->workers_cond, NULL);
+	pthread_cond_init(&instance->workers_done_cond, NULL);
+
+	/*
+	 * Signals stay with the main thread
+	 */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, &old_sigset);
+
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&instance->workers[i], NULL, crypto_worker_fn, instance) != 0) {
+			log_printf(instance->log_level_error,
+				"Unable to start crypto worker thread %u", i);
+			res = -1;
+			break;
+		}
+	}
+	instance->workers_count = i;
+
+	pthread_sigmask(SIG_SETMASK, &old_sigset, NULL);
+
+	log_printf(instance->log_level_notice,
+		"Started %u crypto worker threads", instance->workers_count);
+
+	return (res);
+}
+
+void crypto_workers_stop (struct crypto_instance *instance)
+{
+	unsigned int i;
+
+	if (instance->workers == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&instance->workers_mutex);
+	instance->workers_stop = 1;
+	pthread_cond_broadcast(&instance->workers_cond);
+	pthread_mutex_unlock(&instance->workers_mutex);
+
+	for (i = 0; i < instance->workers_count; i++) {
+		pthread_join(instance->workers[i], NULL);
+	}
+
+	free(instance->workers);
+	instance->workers = NULL;
+	instance->workers_count = 0;
+	instance->workers_stop = 0;
+
+	pthread_cond_destroy(&instance->workers_done_cond);
+	pthread_cond_destroy(&instance->workers_cond);
+	pthread_mutex_destroy(&instance->workers_mutex);
+}
+
 struct crypto_instance *crypto_init(
 	const unsigned char *private_key,
 	unsigned int private_key_len,
@@ -814,6 +1420,13 @@ struct crypto_instance *crypto_init(
 	instance->crypto_cipher_type = string_to_crypto_cipher_type(crypto_cipher_type);
 	instance->crypto_hash_type = string_to_crypto_hash_type(crypto_hash_type);
 
+	/*
+	 * AEAD ciphers authenticate the packet themselves
+	 */
+	if (CRYPTO_CIPHER_IS_AEAD(instance->crypto_cipher_type)) {
+		instance->crypto_hash_type = CRYPTO_HASH_TYPE_NONE;
+	}
+
 	instance->crypto_header_size = crypto_sec_header_size(crypto_cipher_type, crypto_hash_type);
 
 	instance->log_printf_func = log_printf_func;
@@ -822,7 +1435,13 @@ struct crypto_instance *crypto_init(
 	instance->log_level_error = log_level_error;
 	instance->log_subsys_id = log_subsys_id;
 
+	if (pthread_key_create(&instance->thread_ctx_key, crypto_thread_ctx_free) != 0) {
+		free(instance);
+		return(NULL);
+	}
+
 	if (init_nss(instance, crypto_cipher_type, crypto_hash_type) < 0) {
+		pthread_key_delete(instance->thread_ctx_key);
 		free(instance);
 		return(NULL);
 	}
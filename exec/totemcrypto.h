@@ -37,9 +37,29 @@
 #define TOTEMCRYPTO_H_DEFINED
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 struct crypto_instance;
 
+/*
+ * Batch items, res is set to the result of crypto_encrypt_and_sign_iov
+ * or crypto_authenticate_and_decrypt for every item
+ */
+struct crypto_send_item {
+	const unsigned char *buf_in;
+	size_t buf_in_len;
+	unsigned char *buf_out;
+	struct iovec *iov_out;
+	unsigned int iov_out_len;
+	int res;
+};
+
+struct crypto_recv_item {
+	unsigned char *buf;
+	int buf_len;
+	int res;
+};
+
 extern size_t crypto_sec_header_size(
 	const char *crypto_cipher_type,
 	const char *crypto_hash_type);
@@ -56,6 +76,37 @@ extern int crypto_encrypt_and_sign (
 	unsigned char *buf_out, 
 	size_t *buf_out_len);
 
+extern int crypto_encrypt_and_sign_iov (
+	struct crypto_instance *instance,
+	const unsigned char *buf_in,
+	const size_t buf_in_len,
+	unsigned char *buf_out,
+	struct iovec *iov_out,
+	unsigned int *iov_out_len);
+
+/*
+ * Batch versions process the items in parallel when worker threads are
+ * started and return when all of them are done. Only one thread may
+ * call them per instance.
+ */
+extern void crypto_encrypt_and_sign_iov_batch (
+	struct crypto_instance *instance,
+	struct crypto_send_item *items,
+	unsigned int count);
+
+extern void crypto_authenticate_and_decrypt_batch (
+	struct crypto_instance *instance,
+	struct crypto_recv_item *items,
+	unsigned int count);
+
+extern int crypto_workers_start (
+	struct crypto_instance *instance,
+	unsigned int workers);
+
+extern unsigned int crypto_workers_get (struct crypto_instance *instance);
+
+extern void crypto_workers_stop (struct crypto_instance *instance);
+
 extern struct crypto_instance *crypto_init(
 	const unsigned char *private_key,
 	unsigned int private_key_len,
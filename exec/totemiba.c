@@ -1410,7 +1410,7 @@ int totemiba_initialize (
 
 void *totemiba_buffer_alloc (void)
 {
-	return malloc (MAX_MTU_SIZE);
+	return malloc (FRAME_SIZE_MAX);
 }
 
 void totemiba_buffer_release (void *ptr)
@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+
+#include <corosync/list.h>
+#define LOGSYS_UTILS_ONLY 1
+#include <corosync/logsys.h>
+#include "totemloopback.h"
+
+#include "totemcrypto.h"
+
+#define NETIF_STATE_CHECK_TIMEOUT	100
+
+struct totemloopback_instance {
+	struct crypto_instance *crypto_inst;
+
+	qb_loop_t *totemloopback_poll_handle;
+
+	struct totem_interface *totem_interface;
+
+	void *context;
+
+	void (*totemloopback_deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len);
+
+	void (*totemloopback_iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address);
+
+	void (*totemloopback_target_set_completed) (void *context);
+
+	/*
+	 * Function and data used to log messages
+	 */
+	int totemloopback_log_level_security;
+
+	int totemloopback_log_level_error;
+
+	int totemloopback_log_level_warning;
+
+	int totemloopback_log_level_notice;
+
+	int totemloopback_log_level_debug;
+
+	int totemloopback_subsys_id;
+
+	void (*totemloopback_log_printf) (
+		int level,
+		int subsys,
+		const char *function,
+		const char *file,
+		int line,
+		const char *format,
+		...)__attribute__((format(printf, 6, 7)));
+
+	struct totem_ip_address my_id;
+
+	struct totem_ip_address token_target;
+
+	struct totem_config *totem_config;
+
+	totemsrp_stats_t *stats;
+
+	qb_loop_timer_handle timer_netif_check_timeout;
+
+	int active;
+
+	/*
+	 * Frames are delivered from a full sized buffer like the udp
+	 * transports do, totemsrp may read past a short token
+	 */
+	char iov_buffer[FRAME_SIZE_MAX];
+
+	/*
+	 * Entry in the network instance list
+	 */
+	struct list_head list;
+
+	/*
+	 * Frames in flight towards this instance
+	 */
+	struct list_head pending_list;
+};
+
+/*
+ * Frame in flight on the simulated network
+ */
+struct loopback_frame {
+	struct list_head list;
+	struct totemloopback_instance *target;
+	qb_loop_timer_handle timer;
+	int discard;
+	unsigned int len;
+	unsigned char data[0];
+};
+
+DECLARE_LIST_INIT(loopback_network_list);
+
+static struct totemloopback_network_config loopback_network_config;
+
+static struct totemloopback_network_stats loopback_network_stats;
+
+#define log_printf(level, format, args...)		\
+do {							\
+        instance->totemloopback_log_printf (		\
+		level, instance->totemloopback_subsys_id,	\
+                __FUNCTION__, __FILE__, __LINE__,	\
+		(const char *)format, ##args);		\
+} while (0);
+
+void totemloopback_network_config_set (
+	const struct totemloopback_network_config *config)
+{
+	memcpy (&loopback_network_config, config, sizeof (loopback_network_config));
+}
+
+void totemloopback_network_stats_get (
+	struct totemloopback_network_stats *stats)
+{
+	memcpy (stats, &loopback_network_stats, sizeof (loopback_network_stats));
+}
+
+static inline int network_chance (unsigned int ppm)
+{
+	return (ppm > 0 && (unsigned int)(random () % 1000000) < ppm);
+}
+
+static void frame_deliver_fn (void *data)
+{
+	struct loopback_frame *frame = (struct loopback_frame *)data;
+	struct totemloopback_instance *instance = frame->target;
+	int bytes_received = frame->len;
+	int res;
+
+	list_del (&frame->list);
+
+	if (frame->discard || instance->active == 0) {
+		free (frame);
+		return;
+	}
+
+	loopback_network_stats.frames_delivered++;
+	loopback_network_stats.bytes_delivered += frame->len;
+
+	memcpy (instance->iov_buffer, frame->data, frame->len);
+	free (frame);
+
+	/*
+	 * Authenticate and if authenticated, decrypt datagram
+	 */
+	res = crypto_authenticate_and_decrypt (instance->crypto_inst,
+		(unsigned char *)instance->iov_buffer, &bytes_received);
+	if (res == -1) {
+		log_printf (instance->totemloopback_log_level_security,
+			"Received message has invalid digest... ignoring.");
+		return;
+	}
+
+	instance->totemloopback_deliver_fn (
+		instance->context,
+		instance->iov_buffer,
+		bytes_received);
+}
+
+/*
+ * Put one copy of an encrypted frame on the wire towards target
+ */
+static void frame_send (
+	struct totemloopback_instance *target,
+	const unsigned char *buf,
+	unsigned int buf_len)
+{
+	struct loopback_frame *frame;
+	uint64_t delay_usec;
+
+	loopback_network_stats.frames_sent++;
+
+	if (target->active == 0) {
+		return;
+	}
+
+	if (network_chance (loopback_network_config.loss_ppm)) {
+		loopback_network_stats.frames_lost++;
+		return;
+	}
+
+	frame = malloc (sizeof (struct loopback_frame) + buf_len);
+	if (frame == NULL) {
+		loopback_network_stats.frames_lost++;
+		return;
+	}
+	frame->target = target;
+	frame->discard = 0;
+	frame->len = buf_len;
+	memcpy (frame->data, buf, buf_len);
+	list_add_tail (&frame->list, &target->pending_list);
+
+	delay_usec = loopback_network_config.latency_usec;
+	if (network_chance (loopback_network_config.reorder_ppm)) {
+		loopback_network_stats.frames_reordered++;
+		delay_usec += loopback_network_config.reorder_delay_usec;
+	}
+
+	/*
+	 * Jobs keep send order, timers are only needed to model delay
+	 */
+	if (delay_usec == 0) {
+		qb_loop_job_add (target->totemloopback_poll_handle,
+			QB_LOOP_MED, frame, frame_deliver_fn);
+	} else {
+		qb_loop_timer_add (target->totemloopback_poll_handle,
+			QB_LOOP_MED,
+			delay_usec * QB_TIME_NS_IN_USEC,
+			frame,
+			frame_deliver_fn,
+			&frame->timer);
+	}
+}
+
+static int loopback_encrypt (
+	struct totemloopback_instance *instance,
+	const void *msg,
+	unsigned int msg_len,
+	unsigned char *buf_out,
+	size_t *buf_out_len)
+{
+	if (crypto_encrypt_and_sign (
+		instance->crypto_inst,
+		(const unsigned char *)msg,
+		msg_len,
+		buf_out,
+		buf_out_len) != 0) {
+		log_printf(instance->totemloopback_log_level_security,
+			"Error encrypting/signing packet (non-critical)");
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void ucast_sendmsg (
+	struct totemloopback_instance *instance,
+	const struct totem_ip_address *system_to,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloopback_instance *target;
+	struct list_head *list;
+	unsigned char buf_out[FRAME_SIZE_MAX];
+	size_t buf_out_len;
+
+	if (loopback_encrypt (instance, msg, msg_len, buf_out, &buf_out_len) != 0) {
+		return;
+	}
+
+	for (list = loopback_network_list.next;
+		list != &loopback_network_list;
+		list = list->next) {
+
+		target = list_entry (list, struct totemloopback_instance, list);
+
+		if (totemip_equal (&target->my_id, system_to)) {
+			frame_send (target, buf_out, buf_out_len);
+			return;
+		}
+	}
+}
+
+static void mcast_sendmsg (
+	struct totemloopback_instance *instance,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloopback_instance *target;
+	struct list_head *list;
+	unsigned char buf_out[FRAME_SIZE_MAX];
+	size_t buf_out_len;
+
+	if (loopback_encrypt (instance, msg, msg_len, buf_out, &buf_out_len) != 0) {
+		return;
+	}
+
+	/*
+	 * Like IP multicast with loop enabled the sender gets a copy too
+	 */
+	for (list = loopback_network_list.next;
+		list != &loopback_network_list;
+		list = list->next) {
+
+		target = list_entry (list, struct totemloopback_instance, list);
+
+		frame_send (target, buf_out, buf_out_len);
+	}
+}
+
+/*
+ * The interface is always up, report it once the RRP layer is ready.
+ * Like an unbound socket, nothing is received before that.
+ */
+static void timer_function_netif_check_timeout (
+	void *data)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)data;
+
+	log_printf (instance->totemloopback_log_level_notice,
+		"The network interface [%s] is now up.",
+		totemip_print (&instance->my_id));
+
+	instance->active = 1;
+	instance->totemloopback_iface_change_fn (instance->context, &instance->my_id);
+}
+
+/*
+ * Create an instance
+ */
+int totemloopback_initialize (
+	qb_loop_t *poll_handle,
+	void **loopback_context,
+	struct totem_config *totem_config,
+	totemsrp_stats_t *stats,
+	int interface_no,
+	void *context,
+
+	void (*deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len),
+
+	void (*iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address),
+
+	void (*target_set_completed) (
+		void *context))
+{
+	struct totemloopback_instance *instance;
+
+	instance = malloc (sizeof (struct totemloopback_instance));
+	if (instance == NULL) {
+		return (-1);
+	}
+	memset (instance, 0, sizeof (struct totemloopback_instance));
+
+	instance->totem_config = totem_config;
+	instance->stats = stats;
+
+	/*
+	* Configure logging
+	*/
+	instance->totemloopback_log_level_security = totem_config->totem_logging_configuration.log_level_security;
+	instance->totemloopback_log_level_error = totem_config->totem_logging_configuration.log_level_error;
+	instance->totemloopback_log_level_warning = totem_config->totem_logging_configuration.log_level_warning;
+	instance->totemloopback_log_level_notice = totem_config->totem_logging_configuration.log_level_notice;
+	instance->totemloopback_log_level_debug = totem_config->totem_logging_configuration.log_level_debug;
+	instance->totemloopback_subsys_id = totem_config->totem_logging_configuration.log_subsys_id;
+	instance->totemloopback_log_printf = totem_config->totem_logging_configuration.log_printf;
+
+	instance->crypto_inst = crypto_init (totem_config->private_key,
+		totem_config->private_key_len,
+		totem_config->crypto_cipher_type,
+		totem_config->crypto_hash_type,
+		instance->totemloopback_log_printf,
+		instance->totemloopback_log_level_security,
+		instance->totemloopback_log_level_notice,
+		instance->totemloopback_log_level_error,
+		instance->totemloopback_subsys_id);
+	if (instance->crypto_inst == NULL) {
+		free(instance);
+		return (-1);
+	}
+
+	instance->totem_interface = &totem_config->interfaces[interface_no];
+
+	instance->totemloopback_poll_handle = poll_handle;
+
+	instance->totem_interface->bindnet.nodeid = instance->totem_config->node_id;
+	totemip_copy (&instance->totem_interface->boundto,
+		&instance->totem_interface->bindnet);
+	totemip_copy (&instance->my_id, &instance->totem_interface->boundto);
+
+	instance->context = context;
+	instance->totemloopback_deliver_fn = deliver_fn;
+
+	instance->totemloopback_iface_change_fn = iface_change_fn;
+
+	instance->totemloopback_target_set_completed = target_set_completed;
+
+	list_init (&instance->pending_list);
+	list_add_tail (&instance->list, &loopback_network_list);
+
+	/*
+	 * RRP layer isn't ready to receive message because it hasn't
+	 * initialized yet.  Add short timer to check the interfaces.
+	 */
+	qb_loop_timer_add (instance->totemloopback_poll_handle,
+		QB_LOOP_MED,
+		NETIF_STATE_CHECK_TIMEOUT*QB_TIME_NS_IN_MSEC,
+		(void *)instance,
+		timer_function_netif_check_timeout,
+		&instance->timer_netif_check_timeout);
+
+	*loopback_context = instance;
+	return (0);
+}
+
+int totemloopback_finalize (
+	void *loopback_context)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+	struct list_head *list;
+	struct loopback_frame *frame;
+
+	qb_loop_timer_del (instance->totemloopback_poll_handle,
+		instance->timer_netif_check_timeout);
+
+	/*
+	 * Frames already scheduled are freed when they fire
+	 */
+	for (list = instance->pending_list.next;
+		list != &instance->pending_list;
+		list = list->next) {
+
+		frame = list_entry (list, struct loopback_frame, list);
+		frame->discard = 1;
+	}
+
+	list_del (&instance->list);
+	instance->active = 0;
+
+	return (0);
+}
+
+void *totemloopback_buffer_alloc (void)
+{
+	return malloc (FRAME_SIZE_MAX);
+}
+
+void totemloopback_buffer_release (void *ptr)
+{
+	return free (ptr);
+}
+
+int totemloopback_processor_count_set (
+	void *loopback_context,
+	int processor_count)
+{
+	return (0);
+}
+
+int totemloopback_recv_flush (void *loopback_context)
+{
+	return (0);
+}
+
+int totemloopback_send_flush (void *loopback_context)
+{
+	return (0);
+}
+
+int totemloopback_token_send (
+	void *loopback_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+
+	ucast_sendmsg (instance, &instance->token_target, msg, msg_len);
+
+	return (0);
+}
+
+int totemloopback_mcast_flush_send (
+	void *loopback_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+
+	mcast_sendmsg (instance, msg, msg_len);
+
+	return (0);
+}
+
+int totemloopback_mcast_noflush_send (
+	void *loopback_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+
+	mcast_sendmsg (instance, msg, msg_len);
+
+	return (0);
+}
+
+int totemloopback_iface_check (void *loopback_context)
+{
+	return (0);
+}
+
+void totemloopback_net_mtu_adjust (void *loopback_context, struct totem_config *totem_config)
+{
+
+	assert(totem_config->interface_count > 0);
+
+	/*
+	 * Keep the same frame budget as the UDP transports
+	 */
+	totem_config->net_mtu -= crypto_sec_header_size(totem_config->crypto_cipher_type,
+							totem_config->crypto_hash_type) +
+				 totemip_udpip_header_size(totem_config->interfaces[0].bindnet.family);
+}
+
+const char *totemloopback_iface_print (void *loopback_context)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+
+	return (totemip_print (&instance->my_id));
+}
+
+int totemloopback_iface_get (
+	void *loopback_context,
+	struct totem_ip_address *addr)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+
+	memcpy (addr, &instance->my_id, sizeof (struct totem_ip_address));
+
+	return (0);
+}
+
+int totemloopback_token_target_set (
+	void *loopback_context,
+	const struct totem_ip_address *token_target)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+
+	memcpy (&instance->token_target, token_target,
+		sizeof (struct totem_ip_address));
+
+	instance->totemloopback_target_set_completed (instance->context);
+
+	return (0);
+}
+
+int totemloopback_crypto_set (
+	void *loopback_context,
+	const char *cipher_type,
+	const char *hash_type)
+{
+
+	return (0);
+}
+
+/*
+ * Throw away every frame in flight towards this instance
+ */
+int totemloopback_recv_mcast_empty (
+	void *loopback_context)
+{
+	struct totemloopback_instance *instance = (struct totemloopback_instance *)loopback_context;
+	struct list_head *list;
+	struct loopback_frame *frame;
+	int msg_processed = 0;
+
+	for (list = instance->pending_list.next;
+		list != &instance->pending_list;
+		list = list->next) {
+
+		frame = list_entry (list, struct loopback_frame, list);
+		if (frame->discard == 0) {
+			frame->discard = 1;
+			msg_processed = 1;
+		}
+	}
+
+	return (msg_processed);
+}
+
+/*
+ * Every instance on the simulated network is a member
+ */
+int totemloopback_member_add (
+	void *loopback_context,
+	const struct totem_ip_address *member)
+{
+	return (0);
+}
+
+int totemloopback_member_remove (
+	void *loopback_context,
+	const struct totem_ip_address *member)
+{
+	return (0);
+}
+
+int totemloopback_member_set_active (
+	void *loopback_context,
+	const struct totem_ip_address *member_ip,
+	int active)
+{
+	return (0);
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TOTEMLOOPBACK_H_DEFINED
+#define TOTEMLOOPBACK_H_DEFINED
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <qb/qbloop.h>
+
+#include <corosync/totem/totem.h>
+
+/*
+ * In-process loopback transport.  Every instance created in a process is
+ * attached to one simulated network, multicasts reach all of them and
+ * tokens reach the instance whose bindnet address is the token target.
+ * Only meant for benchmarking and testing the protocol stack.
+ */
+
+struct totemloopback_network_config {
+	/*
+	 * Probability in parts per million that a frame is lost
+	 */
+	unsigned int loss_ppm;
+
+	/*
+	 * Probability in parts per million that a frame is delayed
+	 * by an additional reorder_delay_usec and so overtaken
+	 */
+	unsigned int reorder_ppm;
+
+	unsigned int reorder_delay_usec;
+
+	/*
+	 * One way delivery latency
+	 */
+	unsigned int latency_usec;
+};
+
+struct totemloopback_network_stats {
+	uint64_t frames_sent;
+	uint64_t frames_delivered;
+	uint64_t frames_lost;
+	uint64_t frames_reordered;
+	uint64_t bytes_delivered;
+};
+
+extern void totemloopback_network_config_set (
+	const struct totemloopback_network_config *config);
+
+extern void totemloopback_network_stats_get (
+	struct totemloopback_network_stats *stats);
+
+/**
+ * Create an instance
+ */
+extern int totemloopback_initialize (
+	qb_loop_t *poll_handle,
+	void **loopback_context,
+	struct totem_config *totem_config,
+	totemsrp_stats_t *stats,
+	int interface_no,
+	void *context,
+
+	void (*deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len),
+
+	void (*iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address),
+
+	void (*target_set_completed) (
+		void *context));
+
+extern void *totemloopback_buffer_alloc (void);
+
+extern void totemloopback_buffer_release (void *ptr);
+
+extern int totemloopback_processor_count_set (
+	void *loopback_context,
+	int processor_count);
+
+extern int totemloopback_token_send (
+	void *loopback_context,
+	const void *msg,
+	unsigned int msg_len);
+
+extern int totemloopback_mcast_flush_send (
+	void *loopback_context,
+	const void *msg,
+	unsigned int msg_len);
+
+extern int totemloopback_mcast_noflush_send (
+	void *loopback_context,
+	const void *msg,
+	unsigned int msg_len);
+
+extern int totemloopback_recv_flush (void *loopback_context);
+
+extern int totemloopback_send_flush (void *loopback_context);
+
+extern int totemloopback_iface_check (void *loopback_context);
+
+extern int totemloopback_finalize (void *loopback_context);
+
+extern void totemloopback_net_mtu_adjust (void *loopback_context, struct totem_config *totem_config);
+
+extern const char *totemloopback_iface_print (void *loopback_context);
+
+extern int totemloopback_iface_get (
+	void *loopback_context,
+	struct totem_ip_address *addr);
+
+extern int totemloopback_token_target_set (
+	void *loopback_context,
+	const struct totem_ip_address *token_target);
+
+extern int totemloopback_crypto_set (
+	void *loopback_context,
+	const char *cipher_type,
+	const char *hash_type);
+
+extern int totemloopback_recv_mcast_empty (
+	void *loopback_context);
+
+extern int totemloopback_member_add (
+	void *loopback_context,
+	const struct totem_ip_address *member);
+
+extern int totemloopback_member_remove (
+	void *loopback_context,
+	const struct totem_ip_address *member);
+
+extern int totemloopback_member_set_active (
+	void *loopback_context,
+	const struct totem_ip_address *member_ip,
+	int active);
+
+#endif /* TOTEMLOOPBACK_H_DEFINED */
@@ -162,9 +162,36 @@ void totemmrp_finalize (void)
 int totemmrp_mcast (
 	struct iovec *iovec,
 	unsigned int iov_len,
-	int priority)
+	int priority,
+	int lane)
 {
-	return totemsrp_mcast (totemsrp_context, iovec, iov_len, priority);
+	return totemsrp_mcast (totemsrp_context, iovec, iov_len, priority, lane);
+}
+
+void *totemmrp_frame_alloc (unsigned int len)
+{
+	return (totemsrp_frame_alloc (totemsrp_context, len));
+}
+
+void totemmrp_frame_release (void *frame)
+{
+	totemsrp_frame_release (totemsrp_context, frame);
+}
+
+unsigned int totemmrp_frame_headroom (void)
+{
+	return (totemsrp_frame_headroom ());
+}
+
+int totemmrp_mcast_frame (
+	void *frame,
+	unsigned int offset,
+	unsigned int msg_len,
+	int priority,
+	int lane)
+{
+	return totemsrp_mcast_frame (totemsrp_context, frame, offset, msg_len,
+		priority, lane);
 }
 
 /*
@@ -175,6 +202,11 @@ int totemmrp_avail (void)
 	return (totemsrp_avail (totemsrp_context));
 }
 
+int totemmrp_lane_avail (int lane)
+{
+	return (totemsrp_lane_avail (totemsrp_context, lane));
+}
+
 int totemmrp_callback_token_create (
 	void **handle_out,
 	enum totem_callback_token_type type,
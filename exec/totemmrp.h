@@ -86,13 +86,32 @@ extern void totemmrp_finalize (void);
 extern int totemmrp_mcast (
 	struct iovec *iovec,
 	unsigned int iov_len,
-	int priority);
+	int priority,
+	int lane);
+
+/**
+ * Multicast a message built in place in a frame from totemmrp_frame_alloc
+ */
+extern void *totemmrp_frame_alloc (unsigned int len);
+
+extern void totemmrp_frame_release (void *frame);
+
+extern unsigned int totemmrp_frame_headroom (void);
+
+extern int totemmrp_mcast_frame (
+	void *frame,
+	unsigned int offset,
+	unsigned int msg_len,
+	int priority,
+	int lane);
 
 /**
  * Return number of available messages that can be queued
  */
 extern int totemmrp_avail (void);
 
+extern int totemmrp_lane_avail (int lane);
+
 extern int totemmrp_callback_token_create (
 	void **handle_out,
 	enum totem_callback_token_type type,
@@ -42,6 +42,7 @@
 #endif
 #include <totemudp.h>
 #include <totemudpu.h>
+#include <totemloopback.h>
 #include <totemnet.h>
 #include <qb/qbloop.h>
 
@@ -202,8 +203,31 @@ struct transport transport_entries[] = {
 		.crypto_set = totemiba_crypto_set,
 		.recv_mcast_empty = totemiba_recv_mcast_empty
 
-	}
+	},
 #endif
+	[TOTEM_TRANSPORT_LOOPBACK] = {
+		.name = "Loopback (in-process)",
+		.initialize = totemloopback_initialize,
+		.buffer_alloc = totemloopback_buffer_alloc,
+		.buffer_release = totemloopback_buffer_release,
+		.processor_count_set = totemloopback_processor_count_set,
+		.token_send = totemloopback_token_send,
+		.mcast_flush_send = totemloopback_mcast_flush_send,
+		.mcast_noflush_send = totemloopback_mcast_noflush_send,
+		.recv_flush = totemloopback_recv_flush,
+		.send_flush = totemloopback_send_flush,
+		.iface_check = totemloopback_iface_check,
+		.finalize = totemloopback_finalize,
+		.net_mtu_adjust = totemloopback_net_mtu_adjust,
+		.iface_print = totemloopback_iface_print,
+		.iface_get = totemloopback_iface_get,
+		.token_target_set = totemloopback_token_target_set,
+		.crypto_set = totemloopback_crypto_set,
+		.recv_mcast_empty = totemloopback_recv_mcast_empty,
+		.member_add = totemloopback_member_add,
+		.member_remove = totemloopback_member_remove,
+		.member_set_active = totemloopback_member_set_active
+	}
 };
 	
 struct totemnet_instance {
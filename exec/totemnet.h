@@ -74,6 +74,9 @@ extern int totemnet_initialize (
 	void (*target_set_completed) (
 		void *context));
 
+/*
+ * Buffers are FRAME_SIZE_MAX bytes for every transport
+ */
 extern void *totemnet_buffer_alloc (void *net_context);
 
 extern void totemnet_buffer_release (void *net_context, void *ptr);
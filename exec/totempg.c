@@ -67,18 +67,16 @@
 /*
  * ASSEMBLY AND UNPACKING ALGORITHM:
  *
- * copy incoming packet into assembly data buffer indexed by current
- * location of end of fragment
+ * if the assembly data buffer holds a fragment
+ *	append the first packed message to the assembly data buffer
+ *	deliver it from the assembly data buffer
+ * deliver the remaining complete messages directly from the packet
+ * if fragmented
+ *	copy last fragmented section to the assembly data buffer
  *
- * if not fragmented
- *	deliver all messages in assembly data buffer
- * else
- * if msg_count > 1 and fragmented
- *	deliver all messages except last message in assembly data buffer
- *	copy last fragmented section to start of assembly data buffer
- * else
- * if msg_count = 1 and fragmented
- *	do nothing
+ * Only fragments are ever copied.  The assembly data buffer grows on
+ * demand up to MESSAGE_SIZE_MAX and is shrunk back once the fragmented
+ * message has been delivered.
  *
  */
 
@@ -155,13 +153,6 @@ struct totempg_mcast {
 #define TOTEMPG_PACKET_SIZE (totempg_totem_config->net_mtu - \
 	sizeof (struct totempg_mcast))
 
-/*
- * Local variables used for packing small messages
- */
-static unsigned short mcast_packed_msg_lens[FRAME_SIZE_MAX];
-
-static int mcast_packed_msg_count = 0;
-
 static int totempg_reserved = 1;
 
 static unsigned int totempg_size_limit;
@@ -196,9 +187,19 @@ enum throw_away_mode {
 	THROW_AWAY_ACTIVE
 };
 
+/*
+ * Assembly buffers start at ASSEMBLY_DATA_MIN bytes, double as fragments
+ * arrive and are shrunk back to ASSEMBLY_DATA_MIN once idle
+ */
+#define ASSEMBLY_DATA_MIN	FRAME_SIZE_MAX
+
+#define ASSEMBLY_HASH_SIZE	256
+
 struct assembly {
 	unsigned int nodeid;
-	unsigned char data[MESSAGE_SIZE_MAX];
+	unsigned int lane;
+	unsigned char *data;
+	unsigned int data_size;
 	int index;
 	unsigned char last_frag_num;
 	enum throw_away_mode throw_away_mode;
@@ -210,32 +211,51 @@ static void assembly_deref (struct assembly *assembly);
 static int callback_token_received_fn (enum totem_callback_token_type type,
 	const void *data);
 
-DECLARE_LIST_INIT(assembly_list_inuse);
+/*
+ * Inuse assemblies are hashed by nodeid, one table for operational and
+ * one for transitional assemblies
+ */
+static struct list_head assembly_hash_inuse[ASSEMBLY_HASH_SIZE];
+
+static struct list_head assembly_hash_inuse_trans[ASSEMBLY_HASH_SIZE];
 
 /*
  * Free list is used both for transitional and operational assemblies
  */
 DECLARE_LIST_INIT(assembly_list_free);
 
-DECLARE_LIST_INIT(assembly_list_inuse_trans);
-
 DECLARE_LIST_INIT(totempg_groups_list);
 
 /*
- * Staging buffer for packed messages.  Messages are staged in this buffer
- * before sending.  Multiple messages may fit which cuts down on the
+ * Staging buffer for packed messages, one per lane.  Messages are staged
+ * in this buffer before sending.  Multiple messages may fit which cuts down on the
  * number of mcasts sent.  If a message doesn't completely fit, then
  * the mcast header has a fragment bit set that says that there are more
  * data to follow.  fragment_size is an index into the buffer.  It indicates
  * the size of message data and where to place new message data.
  * fragment_contuation indicates whether the first packed message in
  * the buffer is a continuation of a previously packed fragment.
+ *
+ * The staging buffer lives inside a totem frame at fragmentation_data_offset
+ * so the totempg and srp headers can be written in front of the data when
+ * the frame is sent, rather than copying the data again.
  */
-static unsigned char *fragmentation_data;
+struct totempg_lane {
+	unsigned int lane;
+	unsigned char *fragmentation_frame;
+	unsigned char *fragmentation_data;
+	int fragment_size;
+	int fragment_continuation;
+	unsigned char next_fragment;
+	int mcast_packed_msg_count;
+	unsigned short mcast_packed_msg_lens[FRAME_SIZE_MAX];
+};
+
+static struct totempg_lane totempg_lanes[TOTEM_LANES];
 
-static int fragment_size = 0;
+static unsigned int fragmentation_data_offset;
 
-static int fragment_continuation = 0;
+static unsigned int fragmentation_frame_size;
 
 static int totempg_waiting_transack = 0;
 
@@ -261,8 +281,6 @@ struct totempg_group_instance {
 	struct list_head list;
 };
 
-static unsigned char next_fragment = 1;
-
 static pthread_mutex_t totempg_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_mutex_t callback_token_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -279,7 +297,7 @@ do {								\
 
 static int msg_count_send_ok (int msg_count);
 
-static int byte_count_send_ok (int byte_count);
+static int byte_count_send_ok (int lane, int byte_count);
 
 static void totempg_waiting_trans_ack_cb (int waiting_trans_ack)
 {
@@ -287,61 +305,149 @@ static void totempg_waiting_trans_ack_cb (int waiting_trans_ack)
 	totempg_waiting_transack = waiting_trans_ack;
 }
 
-static struct assembly *assembly_ref (unsigned int nodeid)
+static void assembly_hash_init (void)
 {
-	struct assembly *assembly;
-	struct list_head *list;
-	struct list_head *active_assembly_list_inuse;
+	int i;
 
-	if (totempg_waiting_transack) {
-		active_assembly_list_inuse = &assembly_list_inuse_trans;
-	} else {
-		active_assembly_list_inuse = &assembly_list_inuse;
+	for (i = 0; i < ASSEMBLY_HASH_SIZE; i++) {
+		list_init (&assembly_hash_inuse[i]);
+		list_init (&assembly_hash_inuse_trans[i]);
 	}
+}
 
-	/*
-	 * Search inuse list for node id and return assembly buffer if found
-	 */
-	for (list = active_assembly_list_inuse->next;
-		list != active_assembly_list_inuse;
-		list = list->next) {
+static inline struct list_head *assembly_hash_bucket (
+	struct list_head *table,
+	unsigned int nodeid)
+{
+	nodeid ^= nodeid >> 16;
+	nodeid ^= nodeid >> 8;
+
+	return (&table[nodeid & (ASSEMBLY_HASH_SIZE - 1)]);
+}
+
+static struct assembly *assembly_find (
+	struct list_head *table,
+	unsigned int nodeid,
+	unsigned int lane)
+{
+	struct list_head *bucket;
+	struct list_head *list;
+	struct assembly *assembly;
 
+	bucket = assembly_hash_bucket (table, nodeid);
+
+	for (list = bucket->next; list != bucket; list = list->next) {
 		assembly = list_entry (list, struct assembly, list);
 
-		if (nodeid == assembly->nodeid) {
+		if (nodeid == assembly->nodeid && lane == assembly->lane) {
 			return (assembly);
 		}
 	}
 
+	return (NULL);
+}
+
+/*
+ * Make sure the assembly data buffer can hold size bytes
+ */
+static int assembly_data_reserve (
+	struct assembly *assembly,
+	unsigned int size)
+{
+	unsigned int new_size;
+	unsigned char *new_data;
+
+	if (size <= assembly->data_size) {
+		return (0);
+	}
+	if (size > MESSAGE_SIZE_MAX) {
+		return (-1);
+	}
+
+	new_size = assembly->data_size ? assembly->data_size : ASSEMBLY_DATA_MIN;
+	while (new_size < size) {
+		new_size *= 2;
+	}
+	if (new_size > MESSAGE_SIZE_MAX) {
+		new_size = MESSAGE_SIZE_MAX;
+	}
+
+	new_data = realloc (assembly->data, new_size);
+	if (new_data == NULL) {
+		return (-1);
+	}
+	assembly->data = new_data;
+	assembly->data_size = new_size;
+
+	return (0);
+}
+
+/*
+ * Give back memory of a buffer grown by a large fragmented message
+ */
+static void assembly_data_shrink (struct assembly *assembly)
+{
+	unsigned char *new_data;
+
+	if (assembly->data_size <= ASSEMBLY_DATA_MIN) {
+		return;
+	}
+
+	new_data = realloc (assembly->data, ASSEMBLY_DATA_MIN);
+	if (new_data == NULL) {
+		return;
+	}
+	assembly->data = new_data;
+	assembly->data_size = ASSEMBLY_DATA_MIN;
+}
+
+static struct assembly *assembly_ref (unsigned int nodeid, unsigned int lane)
+{
+	struct assembly *assembly;
+	struct list_head *active_assembly_hash_inuse;
+
+	if (totempg_waiting_transack) {
+		active_assembly_hash_inuse = assembly_hash_inuse_trans;
+	} else {
+		active_assembly_hash_inuse = assembly_hash_inuse;
+	}
+
 	/*
-	 * Nothing found in inuse list get one from free list if available
+	 * Search inuse table for node id and return assembly buffer if found
 	 */
-	if (list_empty (&assembly_list_free) == 0) {
-		assembly = list_entry (assembly_list_free.next, struct assembly, list);
-		list_del (&assembly->list);
-		list_add (&assembly->list, active_assembly_list_inuse);
-		assembly->nodeid = nodeid;
-		assembly->index = 0;
-		assembly->last_frag_num = 0;
-		assembly->throw_away_mode = THROW_AWAY_INACTIVE;
+	assembly = assembly_find (active_assembly_hash_inuse, nodeid, lane);
+	if (assembly) {
 		return (assembly);
 	}
 
 	/*
-	 * Nothing available in inuse or free list, so allocate a new one
+	 * Nothing found in inuse table get one from free list if available
 	 */
-	assembly = malloc (sizeof (struct assembly));
-	/*
-	 * TODO handle memory allocation failure here
-	 */
-	assert (assembly);
+	if (list_empty (&assembly_list_free) == 0) {
+		assembly = list_entry (assembly_list_free.next, struct assembly, list);
+		list_del (&assembly->list);
+	} else {
+		/*
+		 * Nothing available in inuse or free list, so allocate a new one.
+		 * The data buffer is allocated when the first fragment arrives.
+		 */
+		assembly = malloc (sizeof (struct assembly));
+		/*
+		 * TODO handle memory allocation failure here
+		 */
+		assert (assembly);
+		assembly->data = NULL;
+		assembly->data_size = 0;
+		list_init (&assembly->list);
+	}
+
 	assembly->nodeid = nodeid;
-	assembly->data[0] = 0;
+	assembly->lane = lane;
 	assembly->index = 0;
 	assembly->last_frag_num = 0;
 	assembly->throw_away_mode = THROW_AWAY_INACTIVE;
-	list_init (&assembly->list);
-	list_add (&assembly->list, active_assembly_list_inuse);
+	list_add (&assembly->list,
+		assembly_hash_bucket (active_assembly_hash_inuse, nodeid));
 
 	return (assembly);
 }
@@ -350,37 +456,26 @@ static void assembly_deref (struct assembly *assembly)
 {
 
 	list_del (&assembly->list);
+	assembly_data_shrink (assembly);
 	list_add (&assembly->list, &assembly_list_free);
 }
 
 static void assembly_deref_from_normal_and_trans (int nodeid)
 {
-	int j;
-	struct list_head *list, *list_next;
-	struct list_head *active_assembly_list_inuse;
 	struct assembly *assembly;
+	unsigned int lane;
 
-	for (j = 0; j < 2; j++) {
-		if (j == 0) {
-			active_assembly_list_inuse = &assembly_list_inuse;
-		} else {
-			active_assembly_list_inuse = &assembly_list_inuse_trans;
+	for (lane = 0; lane < TOTEM_LANES; lane++) {
+		assembly = assembly_find (assembly_hash_inuse, nodeid, lane);
+		if (assembly) {
+			assembly_deref (assembly);
 		}
 
-		for (list = active_assembly_list_inuse->next;
-			list != active_assembly_list_inuse;
-			list = list_next) {
-
-			list_next = list->next;
-			assembly = list_entry (list, struct assembly, list);
-
-			if (nodeid == assembly->nodeid) {
-				list_del (&assembly->list);
-				list_add (&assembly->list, &assembly_list_free);
-			}
+		assembly = assembly_find (assembly_hash_inuse_trans, nodeid, lane);
+		if (assembly) {
+			assembly_deref (assembly);
 		}
 	}
-
 }
 
 static inline void app_confchg_fn (
@@ -613,30 +708,40 @@ static void totempg_deliver_fn (
 	char header[FRAME_SIZE_MAX];
 	int msg_count;
 	int continuation;
-	int start;
 	const char *data;
 	int datasize;
-	struct iovec iov_delv;
-
-	assembly = assembly_ref (nodeid);
-	assert (assembly);
+	int offset;
+	unsigned int lane;
 
 	/*
-	 * Assemble the header into one block of data and
-	 * assemble the packet contents into one block of data to simplify delivery
+	 * Assemble the header into one block of data.  Complete packed
+	 * messages are delivered straight out of the packet, only fragments
+	 * are copied into the assembly buffer.
 	 */
 
 	mcast = (struct totempg_mcast *)msg;
 	if (endian_conversion_required) {
+		mcast->header.type = swab16 (mcast->header.type);
 		mcast->msg_count = swab16 (mcast->msg_count);
 	}
 
+	/*
+	 * Each lane of a node is assembled separately, as frames of a control
+	 * lane message may be sent in between fragments of a bulk message
+	 */
+	lane = TOTEM_LANE_BULK;
+	if (mcast->header.type == TOTEM_LANE_CONTROL) {
+		lane = TOTEM_LANE_CONTROL;
+	}
+	assembly = assembly_ref (nodeid, lane);
+	assert (assembly);
+
 	msg_count = mcast->msg_count;
 	datasize = sizeof (struct totempg_mcast) +
 		msg_count * sizeof (unsigned short);
 
 	memcpy (header, msg, datasize);
-	data = msg;
+	data = (const char *)msg + datasize;
 
 	msg_lens = (unsigned short *) (header + sizeof (struct totempg_mcast));
 	if (endian_conversion_required) {
@@ -645,19 +750,15 @@ static void totempg_deliver_fn (
 		}
 	}
 
-	memcpy (&assembly->data[assembly->index], &data[datasize],
-		msg_len - datasize);
-
 	/*
 	 * If the last message in the buffer is a fragment, then we
 	 * can't deliver it.  We'll first deliver the full messages
-	 * then adjust the assembly buffer so we can add the rest of the
-	 * fragment when it arrives.
+	 * then keep the fragment in the assembly buffer so we can add
+	 * the rest of it when it arrives.
 	 */
 	msg_count = mcast->fragmented ? mcast->msg_count - 1 : mcast->msg_count;
 	continuation = mcast->continuation;
-	iov_delv.iov_base = (void *)&assembly->data[0];
-	iov_delv.iov_len = assembly->index + msg_lens[0];
+	offset = 0;
 
 	/*
 	 * Make sure that if this message is a continuation, that it
@@ -669,30 +770,42 @@ static void totempg_deliver_fn (
 	 * continuation and the assembly buffer is empty, we have to discard
 	 * the continued message.
 	 */
-	start = 0;
-
 	if (assembly->throw_away_mode == THROW_AWAY_ACTIVE) {
 		 /* Throw away the first msg block */
 		if (mcast->fragmented == 0 || mcast->fragmented == 1) {
 			assembly->throw_away_mode = THROW_AWAY_INACTIVE;
-
-			assembly->index += msg_lens[0];
-			iov_delv.iov_base = (void *)&assembly->data[assembly->index];
-			iov_delv.iov_len = msg_lens[1];
-			start = 1;
+			assembly->index = 0;
 		}
 	} else
 	if (assembly->throw_away_mode == THROW_AWAY_INACTIVE) {
 		if (continuation == assembly->last_frag_num) {
 			assembly->last_frag_num = mcast->fragmented;
-			for  (i = start; i < msg_count; i++) {
-				app_deliver_fn(nodeid, iov_delv.iov_base, iov_delv.iov_len,
-					endian_conversion_required);
-				assembly->index += msg_lens[i];
-				iov_delv.iov_base = (void *)&assembly->data[assembly->index];
-				if (i < (msg_count - 1)) {
-					iov_delv.iov_len = msg_lens[i + 1];
+			for  (i = 0; i < msg_count; i++) {
+				if (i == 0 && assembly->index != 0) {
+					/*
+					 * First message completes the fragment
+					 * held in the assembly buffer
+					 */
+					if (assembly_data_reserve (assembly,
+						assembly->index + msg_lens[0]) == -1) {
+
+						log_printf (LOG_WARNING,
+							"Unable to grow assembly buffer, discarding message");
+						assembly->index = 0;
+						offset += msg_lens[0];
+						continue;
+					}
+					memcpy (&assembly->data[assembly->index],
+						data, msg_lens[0]);
+					app_deliver_fn(nodeid, assembly->data,
+						assembly->index + msg_lens[0],
+						endian_conversion_required);
+					assembly->index = 0;
+				} else {
+					app_deliver_fn(nodeid, (void *)&data[offset],
+						msg_lens[i], endian_conversion_required);
 				}
+				offset += msg_lens[i];
 			}
 		} else {
 			log_printf (LOG_DEBUG, "fragmented continuation %u is not equal to assembly last_frag_num %u",
@@ -710,15 +823,27 @@ static void totempg_deliver_fn (
 		assembly_deref (assembly);
 	} else {
 		/*
-		 * Message is fragmented, keep around assembly list
+		 * Message is fragmented, keep around assembly list.
+		 * The trailing fragment either continues the fragment
+		 * already in the assembly buffer or starts a new one.
 		 */
-		if (mcast->msg_count > 1) {
-			memmove (&assembly->data[0],
-				&assembly->data[assembly->index],
-				msg_lens[msg_count]);
+		if (msg_count > 0) {
+			for (i = 0, offset = 0; i < msg_count; i++) {
+				offset += msg_lens[i];
+			}
+			assembly->index = 0;
+		}
+		if (assembly_data_reserve (assembly,
+			assembly->index + msg_lens[msg_count]) == -1) {
 
+			log_printf (LOG_WARNING,
+				"Unable to grow assembly buffer, discarding fragment");
 			assembly->index = 0;
+			assembly->throw_away_mode = THROW_AWAY_ACTIVE;
+			return;
 		}
+		memcpy (&assembly->data[assembly->index], &data[offset],
+			msg_lens[msg_count]);
 		assembly->index += msg_lens[msg_count];
 	}
 }
@@ -730,50 +855,110 @@ static void totempg_deliver_fn (
 
 void *callback_token_received_handle;
 
+static int fragmentation_frame_get (struct totempg_lane *lane)
+{
+	if (lane->fragmentation_frame != NULL) {
+		return (0);
+	}
+
+	lane->fragmentation_frame = totemmrp_frame_alloc (fragmentation_frame_size);
+	if (lane->fragmentation_frame == NULL) {
+		return (-1);
+	}
+	lane->fragmentation_data = &lane->fragmentation_frame[fragmentation_data_offset];
+
+	return (0);
+}
+
+/*
+ * Put the totempg header and the packed message lengths in front of the
+ * staged data and hand the frame over to totemmrp
+ */
+static int fragmentation_frame_send (
+	struct totempg_lane *lane,
+	struct totempg_mcast *mcast,
+	unsigned int data_len,
+	int guarantee)
+{
+	unsigned int lens_len;
+	unsigned int hdr_len;
+	unsigned int headroom;
+	unsigned char *data;
+	int res;
+
+	lens_len = mcast->msg_count * sizeof (unsigned short);
+	hdr_len = sizeof (struct totempg_mcast) + lens_len;
+	headroom = totemmrp_frame_headroom ();
+	data = lane->fragmentation_data;
+
+	/*
+	 * Very many small messages may not fit in the room reserved for
+	 * the lengths, so slide the data up
+	 */
+	if (headroom + hdr_len > fragmentation_data_offset) {
+		data = &lane->fragmentation_frame[headroom + hdr_len];
+		memmove (data, lane->fragmentation_data, data_len);
+	}
+
+	memcpy (data - hdr_len, mcast, sizeof (struct totempg_mcast));
+	memcpy (data - lens_len, lane->mcast_packed_msg_lens, lens_len);
+
+	res = totemmrp_mcast_frame (lane->fragmentation_frame,
+		(data - hdr_len) - lane->fragmentation_frame,
+		hdr_len + data_len, guarantee, lane->lane);
+	if (res == -1) {
+		if (data != lane->fragmentation_data) {
+			memmove (lane->fragmentation_data, data, data_len);
+		}
+		return (-1);
+	}
+
+	lane->fragmentation_frame = NULL;
+	lane->fragmentation_data = NULL;
+
+	return (0);
+}
+
 int callback_token_received_fn (enum totem_callback_token_type type,
 				const void *data)
 {
 	struct totempg_mcast mcast;
-	struct iovec iovecs[3];
+	struct totempg_lane *lane;
+	int i;
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&mcast_msg_mutex);
 	}
-	if (mcast_packed_msg_count == 0) {
-		if (totempg_threaded_mode == 1) {
-			pthread_mutex_unlock (&mcast_msg_mutex);
-		}
-		return (0);
-	}
-	if (totemmrp_avail() == 0) {
-		if (totempg_threaded_mode == 1) {
-			pthread_mutex_unlock (&mcast_msg_mutex);
-		}
-		return (0);
-	}
-	mcast.header.version = 0;
-	mcast.header.type = 0;
-	mcast.fragmented = 0;
 
 	/*
-	 * Was the first message in this buffer a continuation of a
-	 * fragmented message?
+	 * Send the partly filled frames, control lane first
 	 */
-	mcast.continuation = fragment_continuation;
-	fragment_continuation = 0;
+	for (i = TOTEM_LANES - 1; i >= 0; i--) {
+		lane = &totempg_lanes[i];
+		if (lane->mcast_packed_msg_count == 0) {
+			continue;
+		}
+		if (totemmrp_lane_avail (lane->lane) == 0) {
+			continue;
+		}
+		mcast.header.version = 0;
+		mcast.header.type = lane->lane;
+		mcast.fragmented = 0;
+
+		/*
+		 * Was the first message in this buffer a continuation of a
+		 * fragmented message?
+		 */
+		mcast.continuation = lane->fragment_continuation;
+		lane->fragment_continuation = 0;
 
-	mcast.msg_count = mcast_packed_msg_count;
+		mcast.msg_count = lane->mcast_packed_msg_count;
 
-	iovecs[0].iov_base = (void *)&mcast;
-	iovecs[0].iov_len = sizeof (struct totempg_mcast);
-	iovecs[1].iov_base = (void *)mcast_packed_msg_lens;
-	iovecs[1].iov_len = mcast_packed_msg_count * sizeof (unsigned short);
-	iovecs[2].iov_base = (void *)&fragmentation_data[0];
-	iovecs[2].iov_len = fragment_size;
-	(void)totemmrp_mcast (iovecs, 3, 0);
+		(void)fragmentation_frame_send (lane, &mcast, lane->fragment_size, 0);
 
-	mcast_packed_msg_count = 0;
-	fragment_size = 0;
+		lane->mcast_packed_msg_count = 0;
+		lane->fragment_size = 0;
+	}
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&mcast_msg_mutex);
@@ -789,6 +974,8 @@ int totempg_initialize (
 	struct totem_config *totem_config)
 {
 	int res;
+	int lens_room;
+	int i;
 
 	totempg_totem_config = totem_config;
 	totempg_log_level_security = totem_config->totem_logging_configuration.log_level_security;
@@ -799,13 +986,15 @@ int totempg_initialize (
 	totempg_log_printf = totem_config->totem_logging_configuration.log_printf;
 	totempg_subsys_id = totem_config->totem_logging_configuration.log_subsys_id;
 
-	fragmentation_data = malloc (TOTEMPG_PACKET_SIZE);
-	if (fragmentation_data == 0) {
-		return (-1);
-	}
-
 	totemsrp_net_mtu_adjust (totem_config);
 
+	assembly_hash_init ();
+
+	for (i = 0; i < TOTEM_LANES; i++) {
+		totempg_lanes[i].lane = i;
+		totempg_lanes[i].next_fragment = 1;
+	}
+
 	res = totemmrp_initialize (
 		poll_handle,
 		totem_config,
@@ -821,6 +1010,21 @@ int totempg_initialize (
 		callback_token_received_fn,
 		0);
 
+	/*
+	 * Leave room in front of the staged data for the srp header, the
+	 * totempg header and the message lengths. The lengths get the staging
+	 * room of a packet sized frame, so frames come from that class and
+	 * totemsrp queues them without a copy. Frames with more lengths slide
+	 * the data up when sent.
+	 */
+	lens_room = TOTEMSRP_FRAME_STAGING;
+	if (lens_room > (int)TOTEMPG_PACKET_SIZE) {
+		lens_room = TOTEMPG_PACKET_SIZE;
+	}
+	fragmentation_data_offset = totemmrp_frame_headroom () +
+		sizeof (struct totempg_mcast) + (lens_room & ~1);
+	fragmentation_frame_size = fragmentation_data_offset + TOTEMPG_PACKET_SIZE;
+
 	totempg_size_limit = (totemmrp_avail() - 1) *
 		(totempg_totem_config->net_mtu -
 		sizeof (struct totempg_mcast) - 16);
@@ -851,7 +1055,6 @@ static int mcast_msg (
 {
 	int res = 0;
 	struct totempg_mcast mcast;
-	struct iovec iovecs[3];
 	struct iovec iovec[64];
 	int i;
 	int dest, src;
@@ -859,6 +1062,22 @@ static int mcast_msg (
 	int copy_len = 0;
 	int copy_base = 0;
 	int total_size = 0;
+	struct totempg_lane *lane;
+
+	/*
+	 * Lanes are only used when enabled, older versions assemble
+	 * frames of both lanes as one stream.  While waiting for the
+	 * transitional ack sync messages must stay in the order they
+	 * were sent, so everything goes through one lane.
+	 */
+	lane = &totempg_lanes[TOTEM_LANE_BULK];
+	if ((guarantee & TOTEMPG_PRIORITY_CONTROL) &&
+		totempg_totem_config->priority_lanes &&
+		totempg_waiting_transack == 0) {
+
+		lane = &totempg_lanes[TOTEM_LANE_CONTROL];
+	}
+	guarantee &= ~TOTEMPG_PRIORITY_CONTROL;
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&mcast_msg_mutex);
@@ -878,9 +1097,9 @@ static int mcast_msg (
 	iov_len = dest;
 
 	max_packet_size = TOTEMPG_PACKET_SIZE -
-		(sizeof (unsigned short) * (mcast_packed_msg_count + 1));
+		(sizeof (unsigned short) * (lane->mcast_packed_msg_count + 1));
 
-	mcast_packed_msg_lens[mcast_packed_msg_count] = 0;
+	lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] = 0;
 
 	/*
 	 * Check if we would overwrite new message queue
@@ -889,8 +1108,8 @@ static int mcast_msg (
 		total_size += iovec[i].iov_len;
 	}
 
-	if (byte_count_send_ok (total_size + sizeof(unsigned short) *
-		(mcast_packed_msg_count)) == 0) {
+	if (byte_count_send_ok (lane->lane, total_size + sizeof(unsigned short) *
+		(lane->mcast_packed_msg_count)) == 0) {
 
 		if (totempg_threaded_mode == 1) {
 			pthread_mutex_unlock (&mcast_msg_mutex);
@@ -898,10 +1117,18 @@ static int mcast_msg (
 		return(-1);
 	}
 
+	if (fragmentation_frame_get (lane) == -1) {
+		if (totempg_threaded_mode == 1) {
+			pthread_mutex_unlock (&mcast_msg_mutex);
+		}
+		return(-1);
+	}
+
 	mcast.header.version = 0;
+	mcast.header.type = lane->lane;
 	for (i = 0; i < iov_len; ) {
 		mcast.fragmented = 0;
-		mcast.continuation = fragment_continuation;
+		mcast.continuation = lane->fragment_continuation;
 		copy_len = iovec[i].iov_len - copy_base;
 
 		/*
@@ -910,14 +1137,14 @@ static int mcast_msg (
 		 * fragment_buffer on exit so that max_packet_size + fragment_size
 		 * doesn't exceed the size of the fragment_buffer on the next call.
 		 */
-		if ((copy_len + fragment_size) <
+		if ((copy_len + lane->fragment_size) <
 			(max_packet_size - sizeof (unsigned short))) {
 
-			memcpy (&fragmentation_data[fragment_size],
+			memcpy (&lane->fragmentation_data[lane->fragment_size],
 				(char *)iovec[i].iov_base + copy_base, copy_len);
-			fragment_size += copy_len;
-			mcast_packed_msg_lens[mcast_packed_msg_count] += copy_len;
-			next_fragment = 1;
+			lane->fragment_size += copy_len;
+			lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] += copy_len;
+			lane->next_fragment = 1;
 			copy_len = 0;
 			copy_base = 0;
 			i++;
@@ -927,20 +1154,11 @@ static int mcast_msg (
 		 * If it just fits or is too big, then send out what fits.
 		 */
 		} else {
-			unsigned char *data_ptr;
-
-			copy_len = min(copy_len, max_packet_size - fragment_size);
-			if( copy_len == max_packet_size )
-				data_ptr = (unsigned char *)iovec[i].iov_base + copy_base;
-			else {
-				data_ptr = fragmentation_data;
-				memcpy (&fragmentation_data[fragment_size],
-				(unsigned char *)iovec[i].iov_base + copy_base, copy_len);
-			}
+			copy_len = min(copy_len, max_packet_size - lane->fragment_size);
 
-			memcpy (&fragmentation_data[fragment_size],
+			memcpy (&lane->fragmentation_data[lane->fragment_size],
 				(unsigned char *)iovec[i].iov_base + copy_base, copy_len);
-			mcast_packed_msg_lens[mcast_packed_msg_count] += copy_len;
+			lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] += copy_len;
 
 			/*
 			 * if we're not on the last iovec or the iovec is too large to
@@ -949,30 +1167,24 @@ static int mcast_msg (
 			 */
 			if ((i < (iov_len - 1)) ||
 					((copy_base + copy_len) < iovec[i].iov_len)) {
-				if (!next_fragment) {
-					next_fragment++;
+				if (!lane->next_fragment) {
+					lane->next_fragment++;
 				}
-				fragment_continuation = next_fragment;
-				mcast.fragmented = next_fragment++;
-				assert(fragment_continuation != 0);
+				lane->fragment_continuation = lane->next_fragment;
+				mcast.fragmented = lane->next_fragment++;
+				assert(lane->fragment_continuation != 0);
 				assert(mcast.fragmented != 0);
 			} else {
-				fragment_continuation = 0;
+				lane->fragment_continuation = 0;
 			}
 
 			/*
 			 * assemble the message and send it
 			 */
-			mcast.msg_count = ++mcast_packed_msg_count;
-			iovecs[0].iov_base = (void *)&mcast;
-			iovecs[0].iov_len = sizeof(struct totempg_mcast);
-			iovecs[1].iov_base = (void *)mcast_packed_msg_lens;
-			iovecs[1].iov_len = mcast_packed_msg_count *
-				sizeof(unsigned short);
-			iovecs[2].iov_base = (void *)data_ptr;
-			iovecs[2].iov_len = max_packet_size;
-			assert (totemmrp_avail() > 0);
-			res = totemmrp_mcast (iovecs, 3, guarantee);
+			mcast.msg_count = ++lane->mcast_packed_msg_count;
+			assert (totemmrp_lane_avail (lane->lane) > 0);
+			res = fragmentation_frame_send (lane, &mcast, max_packet_size,
+				guarantee);
 			if (res == -1) {
 				goto error_exit;
 			}
@@ -980,11 +1192,16 @@ static int mcast_msg (
 			/*
 			 * Recalculate counts and indexes for the next.
 			 */
-			mcast_packed_msg_lens[0] = 0;
-			mcast_packed_msg_count = 0;
-			fragment_size = 0;
+			lane->mcast_packed_msg_lens[0] = 0;
+			lane->mcast_packed_msg_count = 0;
+			lane->fragment_size = 0;
 			max_packet_size = TOTEMPG_PACKET_SIZE - (sizeof(unsigned short));
 
+			res = fragmentation_frame_get (lane);
+			if (res == -1) {
+				goto error_exit;
+			}
+
 			/*
 			 * If the iovec all fit, go to the next iovec
 			 */
@@ -1007,8 +1224,8 @@ static int mcast_msg (
 	 * the last buffer just fit into the fragmentation_data buffer
 	 * and we were at the last iovec.
 	 */
-	if (mcast_packed_msg_lens[mcast_packed_msg_count]) {
-			mcast_packed_msg_count++;
+	if (lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count]) {
+			lane->mcast_packed_msg_count++;
 	}
 
 error_exit:
@@ -1033,12 +1250,13 @@ static int msg_count_send_ok (
 }
 
 static int byte_count_send_ok (
+	int lane,
 	int byte_count)
 {
 	unsigned int msg_count = 0;
 	int avail = 0;
 
-	avail = totemmrp_avail ();
+	avail = totemmrp_lane_avail (lane);
 
 	msg_count = (byte_count / (totempg_totem_config->net_mtu - sizeof (struct totempg_mcast) - 16)) + 1;
 
@@ -1304,7 +1522,7 @@ int totempg_groups_joined_reserve (
 		goto error_exit;
 	}
 
-	if (byte_count_send_ok (size)) {
+	if (byte_count_send_ok (TOTEM_LANE_BULK, size)) {
 		reserved = send_reserve (size);
 	} else {
 		reserved = 0;
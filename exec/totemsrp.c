@@ -74,6 +74,7 @@
 #include <sys/poll.h>
 #include <sys/uio.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <qb/qbdefs.h>
 #include <qb/qbutil.h>
@@ -100,6 +101,22 @@
 #define RETRANSMIT_ENTRIES_MAX			30
 #define TOKEN_SIZE_MAX				64000 /* bytes */
 #define LEAVE_DUMMY_NODEID                      0
+#define FCC_ADAPTIVE_GROWTH			4 /* limit as multiple of configured values */
+#define FCC_ADAPTIVE_DECREASE_HOLD		4 /* rotations between decreases */
+#define FCC_ADAPTIVE_LOSS_PERCENT		5 /* of window, tolerated per rotation */
+#define FCC_KERNEL_BUFFER_SIZE			256000 /* bytes, see max_messages in corosync.conf.5 */
+#define FRAME_POOL_SLAB_SIZE			65536 /* bytes allocated at once */
+#define FRAME_POOL_FRAMES_MAX			QUEUE_RTR_ITEMS_SIZE_MAX /* frames kept per size class */
+#define FRAME_CLASS_SMALL_SIZE			256 /* bytes */
+#define FRAME_CLASS_MEDIUM_SIZE			1024 /* bytes */
+
+/*
+ * Membership set operations map addresses to a dense index and work on
+ * bitmaps. The index is only a cache, it is reset when it fills up.
+ */
+#define MEMB_INDEX_MAX				(PROCESSOR_COUNT_MAX * 4)
+#define MEMB_INDEX_HASH_SIZE			(8192) /* power of two > 2 * MEMB_INDEX_MAX */
+#define MEMB_BITMAP_WORDS			((MEMB_INDEX_MAX + 63) / 64)
 
 /*
  * Rollover handling:
@@ -265,14 +282,73 @@ struct memb_commit_token {
  */
 }__attribute__((packed));
 
+/*
+ * buffer is the transport buffer the message lives in and is what gets
+ * released; mcast may point into it past some headroom
+ */
 struct message_item {
 	struct mcast *mcast;
 	unsigned int msg_len;
+	void *buffer;
+	unsigned long long enqueue_time; /* 0 unless queued by totemsrp_mcast */
 };
 
 struct sort_queue_item {
 	struct mcast *mcast;
 	unsigned int msg_len;
+	void *buffer;
+	unsigned long long enqueue_time;
+};
+
+/*
+ * Size classes of message frames. Messages are kept in the smallest
+ * class they fit in. MTU frames hold anything that fits in one packet
+ * plus TOTEMSRP_FRAME_STAGING, so totempg builds messages in them, and
+ * FULL frames are FRAME_SIZE_MAX.
+ */
+enum frame_class {
+	FRAME_CLASS_SMALL = 0,
+	FRAME_CLASS_MEDIUM = 1,
+	FRAME_CLASS_MTU = 2,
+	FRAME_CLASS_FULL = 3
+};
+
+#define FRAME_CLASS_COUNT 4
+
+/*
+ * Header in front of every frame handed out by totemsrp_buffer_alloc.
+ * Free pooled frames are linked through next. Header size keeps frames
+ * 16 byte aligned.
+ */
+struct frame_pool_frame {
+	struct frame_pool_frame *next;
+	uint32_t pooled;
+	uint32_t frame_class;
+};
+
+struct frame_pool_slab {
+	struct frame_pool_slab *next;
+	uint64_t __pad;
+};
+
+struct frame_pool_class {
+	struct frame_pool_frame *free_list;
+	struct frame_pool_slab *slabs;
+	unsigned int frame_size;
+	unsigned int slab_frames;
+	unsigned int frames;
+};
+
+/*
+ * Frames for messages and the retransmit queues are carved from slabs
+ * which are never freed while the instance exists, so the per message
+ * path doesn't malloc and long runs don't fragment the heap. Each class
+ * keeps at most FRAME_POOL_FRAMES_MAX frames, beyond that frames fall
+ * back to malloc.
+ */
+struct frame_pool {
+	pthread_mutex_t mutex;
+	struct frame_pool_class classes[FRAME_CLASS_COUNT];
 };
 
 enum memb_state {
@@ -367,6 +443,8 @@ struct totemsrp_instance {
 	 */
 	struct cs_queue new_message_queue;
 
+	struct cs_queue new_message_queue_control;
+
 	struct cs_queue new_message_queue_trans;
 
 	struct cs_queue retrans_message_queue;
@@ -504,6 +582,25 @@ struct totemsrp_instance {
 
 	unsigned int my_cbl;
 
+	/*
+	 * Adaptive flow control state
+	 */
+	unsigned int fcc_window_size;
+
+	unsigned int fcc_max_messages;
+
+	unsigned int fcc_decrease_hold;
+
+	unsigned long long fcc_token_rx_time;
+
+	unsigned long long fcc_rotation_avg;
+
+	uint64_t fcc_mcast_retx;
+
+	uint64_t fcc_rx_msg_dropped;
+
+	unsigned long long hist_token_rx_time;
+
 	uint64_t pause_timestamp;
 
 	struct memb_commit_token *commit_token;
@@ -516,6 +613,8 @@ struct totemsrp_instance {
 
 	uint32_t threaded_mode_enabled;
 
+	struct frame_pool frame_pool;
+
 	uint32_t waiting_trans_ack;
 
 	int 	flushing;
@@ -662,7 +761,11 @@ static void timer_function_heartbeat_timeout (void *data);
 static void timer_function_token_retransmit_timeout (void *data);
 static void timer_function_token_hold_retransmit_timeout (void *data);
 static void timer_function_merge_detect_timeout (void *data);
-static void *totemsrp_buffer_alloc (struct totemsrp_instance *instance);
+static void frame_pool_init (struct frame_pool *pool, unsigned int mtu_size);
+static void frame_pool_free (struct frame_pool *pool);
+static void frame_pool_prealloc (struct totemsrp_instance *instance,
+	enum frame_class frame_class, unsigned int frames);
+static void *totemsrp_buffer_alloc (struct totemsrp_instance *instance, unsigned int len);
 static void totemsrp_buffer_release (struct totemsrp_instance *instance, void *ptr);
 static const char* gsfrom_to_msg(enum gather_state_from gsfrom);
 
@@ -800,6 +903,17 @@ static int token_event_stats_collector (enum totem_callback_token_type type, con
 	time_now = (nano_secs / QB_TIME_NS_IN_MSEC);
 
 	if (type == TOTEM_CALLBACK_TOKEN_RECEIVED) {
+		/*
+		 * A rotation spanning a token loss is not a rotation
+		 */
+		if (instance->hist_token_rx_time != 0 &&
+		    nano_secs - instance->hist_token_rx_time <
+		    (unsigned long long)instance->totem_config->token_timeout * QB_TIME_NS_IN_MSEC) {
+			totem_histogram_record (&instance->stats.token_rotation_hist,
+				(nano_secs - instance->hist_token_rx_time) / QB_TIME_NS_IN_USEC);
+		}
+		instance->hist_token_rx_time = nano_secs;
+
 		/* incr latest token the index */
 		if (instance->stats.latest_token == (TOTEM_TOKEN_STATS_MAX - 1))
 			instance->stats.latest_token = 0;
@@ -822,10 +936,46 @@ static int token_event_stats_collector (enum totem_callback_token_type type, con
 		instance->stats.token[instance->stats.latest_token].tx = 0; /* in case we drop the token */
 	} else {
 		instance->stats.token[instance->stats.latest_token].tx = time_now;
+		if (instance->hist_token_rx_time != 0) {
+			totem_histogram_record (&instance->stats.token_hold_hist,
+				(nano_secs - instance->hist_token_rx_time) / QB_TIME_NS_IN_USEC);
+		}
 	}
 	return 0;
 }
 
+/*
+ * New messages are added by library threads (serialized by totempg) and
+ * removed only by totem thread, so lock-free SPSC queue is enough.
+ */
+static int new_message_queue_threaded_mode (const struct totemsrp_instance *instance)
+{
+
+	if (instance->threaded_mode_enabled) {
+		return (CS_QUEUE_THREADED_MODE_SPSC);
+	}
+
+	return (CS_QUEUE_THREADED_MODE_NONE);
+}
+
+/*
+ * Queue for new messages of a lane. While waiting for the transitional
+ * ack all lanes share one queue so sync messages keep their order.
+ */
+static struct cs_queue *new_message_queue_get (
+	struct totemsrp_instance *instance,
+	int lane)
+{
+
+	if (instance->waiting_trans_ack) {
+		return (&instance->new_message_queue_trans);
+	}
+	if (lane == TOTEM_LANE_CONTROL) {
+		return (&instance->new_message_queue_control);
+	}
+	return (&instance->new_message_queue);
+}
+
 /*
  * Exported interfaces
  */
@@ -917,6 +1067,16 @@ int totemsrp_initialize (
 		"window size per rotation (%d messages) maximum messages per rotation (%d messages)",
 		totem_config->window_size, totem_config->max_messages);
 
+	if (totem_config->fcc_adaptive) {
+		log_printf (instance->totemsrp_log_level_debug,
+			"adaptive flow control enabled (up to %d times configured window)",
+			FCC_ADAPTIVE_GROWTH);
+	}
+	instance->fcc_window_size = totem_config->window_size;
+	instance->fcc_max_messages = totem_config->max_messages;
+	instance->stats.fcc_window_size = instance->fcc_window_size;
+	instance->stats.fcc_max_messages = instance->fcc_max_messages;
+
 	log_printf (instance->totemsrp_log_level_debug,
 		"missed count const (%d messages)",
 		totem_config->miss_count_const);
@@ -1008,13 +1168,30 @@ int totemsrp_initialize (
 	/*
 	 * Must have net_mtu adjusted by totemrrp_initialize first
 	 */
+	frame_pool_init (&instance->frame_pool,
+		totem_config->net_mtu + sizeof (struct mcast) + TOTEMSRP_FRAME_STAGING);
+
+	/*
+	 * Preallocate packet sized frames for the messages of two rotations
+	 */
+	frame_pool_prealloc (instance, FRAME_CLASS_MTU, 2 * totem_config->window_size *
+		(totem_config->fcc_adaptive ? FCC_ADAPTIVE_GROWTH : 1));
+	log_printf (instance->totemsrp_log_level_debug,
+		"frame pool preallocated (%u frames of %u bytes)",
+		instance->frame_pool.classes[FRAME_CLASS_MTU].frames,
+		instance->frame_pool.classes[FRAME_CLASS_MTU].frame_size);
+
 	cs_queue_init (&instance->new_message_queue,
 		MESSAGE_QUEUE_MAX,
-		sizeof (struct message_item), instance->threaded_mode_enabled);
+		sizeof (struct message_item), new_message_queue_threaded_mode (instance));
+
+	cs_queue_init (&instance->new_message_queue_control,
+		MESSAGE_QUEUE_MAX,
+		sizeof (struct message_item), new_message_queue_threaded_mode (instance));
 
 	cs_queue_init (&instance->new_message_queue_trans,
 		MESSAGE_QUEUE_MAX,
-		sizeof (struct message_item), instance->threaded_mode_enabled);
+		sizeof (struct message_item), new_message_queue_threaded_mode (instance));
 
 	totemsrp_callback_token_create (instance,
 		&instance->token_recv_event_handle,
@@ -1044,10 +1221,12 @@ void totemsrp_finalize (
 	memb_leave_message_send (instance);
 	totemrrp_finalize (instance->totemrrp_context);
 	cs_queue_free (&instance->new_message_queue);
+	cs_queue_free (&instance->new_message_queue_control);
 	cs_queue_free (&instance->new_message_queue_trans);
 	cs_queue_free (&instance->retrans_message_queue);
 	sq_free (&instance->regular_sort_queue);
 	sq_free (&instance->recovery_sort_queue);
+	frame_pool_free (&instance->frame_pool);
 	free (instance);
 }
 
@@ -1215,34 +1394,191 @@ static void srp_addr_copy_endian_convert (struct srp_addr *out, const struct srp
 	}
 }
 
+struct memb_bitmap {
+	uint64_t words[MEMB_BITMAP_WORDS];
+};
+
+/*
+ * Shared by all instances, indexes are never kept across a reset
+ */
+static struct memb_index {
+	struct totem_ip_address addr[MEMB_INDEX_MAX];
+	uint16_t hash[MEMB_INDEX_HASH_SIZE]; /* index + 1, 0 is empty */
+	unsigned int entries;
+	unsigned int generation;
+} memb_index;
+
+static unsigned int memb_index_addrlen (const struct totem_ip_address *addr)
+{
+	if (addr->family == AF_INET) {
+		return (sizeof (struct in_addr));
+	}
+	if (addr->family == AF_INET6) {
+		return (sizeof (struct in6_addr));
+	}
+	return (0);
+}
+
+/*
+ * Make room for count new addresses, invalidates all indexes if the
+ * index has to be reset
+ */
+static void memb_index_reserve (unsigned int count)
+{
+	assert (count <= MEMB_INDEX_MAX);
+
+	if (memb_index.entries + count > MEMB_INDEX_MAX) {
+		memset (memb_index.hash, 0, sizeof (memb_index.hash));
+		memb_index.entries = 0;
+		memb_index.generation++;
+	}
+}
+
+/*
+ * Same equality as srp_addr_equal. Returns -1 for unknown addresses
+ * unless insert is set.
+ */
+static int memb_index_get (const struct srp_addr *srp_addr, int insert)
+{
+	const struct totem_ip_address *addr = &srp_addr->addr[0];
+	unsigned int addrlen = memb_index_addrlen (addr);
+	uint32_t hash = 2166136261U ^ addr->family;
+	unsigned int slot;
+	unsigned int i;
+	struct totem_ip_address *entry;
+
+	for (i = 0; i < addrlen; i++) {
+		hash = (hash ^ addr->addr[i]) * 16777619U;
+	}
+
+	for (slot = hash & (MEMB_INDEX_HASH_SIZE - 1);
+		memb_index.hash[slot] != 0;
+		slot = (slot + 1) & (MEMB_INDEX_HASH_SIZE - 1)) {
+
+		entry = &memb_index.addr[memb_index.hash[slot] - 1];
+		if (entry->family == addr->family &&
+		    memcmp (entry->addr, addr->addr, addrlen) == 0) {
+			return (memb_index.hash[slot] - 1);
+		}
+	}
+
+	if (insert == 0) {
+		return (-1);
+	}
+
+	assert (memb_index.entries < MEMB_INDEX_MAX);
+	totemip_copy (&memb_index.addr[memb_index.entries], addr);
+	memb_index.hash[slot] = ++memb_index.entries;
+
+	return (memb_index.entries - 1);
+}
+
+static inline void memb_bitmap_set (struct memb_bitmap *bitmap, int index)
+{
+	bitmap->words[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+static inline int memb_bitmap_isset (const struct memb_bitmap *bitmap, int index)
+{
+	if (index < 0) {
+		return (0);
+	}
+	return ((bitmap->words[index / 64] >> (index % 64)) & 1);
+}
+
+static void memb_bitmap_from_set (
+	struct memb_bitmap *bitmap,
+	const struct srp_addr *set, int set_entries)
+{
+	int i;
+
+	memset (bitmap, 0, sizeof (struct memb_bitmap));
+
+	for (i = 0; i < set_entries; i++) {
+		memb_bitmap_set (bitmap, memb_index_get (&set[i], 1));
+	}
+}
+
+/*
+ * Word loops without early exits so the compiler can vectorize them
+ */
+static void memb_bitmap_and_not (
+	struct memb_bitmap *out,
+	const struct memb_bitmap *one,
+	const struct memb_bitmap *two)
+{
+	int i;
+
+	for (i = 0; i < MEMB_BITMAP_WORDS; i++) {
+		out->words[i] = one->words[i] & ~two->words[i];
+	}
+}
+
+static int memb_bitmap_is_subset (
+	const struct memb_bitmap *subset,
+	const struct memb_bitmap *fullset)
+{
+	uint64_t missing = 0;
+	int i;
+
+	for (i = 0; i < MEMB_BITMAP_WORDS; i++) {
+		missing |= subset->words[i] & ~fullset->words[i];
+	}
+
+	return (missing == 0);
+}
+
+static unsigned int memb_bitmap_count (const struct memb_bitmap *bitmap)
+{
+	unsigned int count = 0;
+	int i;
+
+	for (i = 0; i < MEMB_BITMAP_WORDS; i++) {
+		count += __builtin_popcountll (bitmap->words[i]);
+	}
+
+	return (count);
+}
+
 static void memb_consensus_reset (struct totemsrp_instance *instance)
 {
 	instance->consensus_list_entries = 0;
 }
 
+static void memb_consensus_bitmap (
+	struct totemsrp_instance *instance,
+	struct memb_bitmap *bitmap)
+{
+	int i;
+
+	memset (bitmap, 0, sizeof (struct memb_bitmap));
+
+	for (i = 0; i < instance->consensus_list_entries; i++) {
+		if (instance->consensus_list[i].set) {
+			memb_bitmap_set (bitmap,
+				memb_index_get (&instance->consensus_list[i].addr, 1));
+		}
+	}
+}
+
 static void memb_set_subtract (
         struct srp_addr *out_list, int *out_list_entries,
         struct srp_addr *one_list, int one_list_entries,
         struct srp_addr *two_list, int two_list_entries)
 {
-	int found = 0;
+	struct memb_bitmap two_bitmap;
 	int i;
-	int j;
 
 	*out_list_entries = 0;
 
+	memb_index_reserve (two_list_entries);
+	memb_bitmap_from_set (&two_bitmap, two_list, two_list_entries);
+
 	for (i = 0; i < one_list_entries; i++) {
-		for (j = 0; j < two_list_entries; j++) {
-			if (srp_addr_equal (&one_list[i], &two_list[j])) {
-				found = 1;
-				break;
-			}
-		}
-		if (found == 0) {
+		if (!memb_bitmap_isset (&two_bitmap, memb_index_get (&one_list[i], 0))) {
 			srp_addr_copy (&out_list[*out_list_entries], &one_list[i]);
 			*out_list_entries = *out_list_entries + 1;
 		}
-		found = 0;
 	}
 }
 
@@ -1273,44 +1609,32 @@ static void memb_consensus_set (
 	return;
 }
 
-/*
- * Is consensus set for a specific processor
- */
-static int memb_consensus_isset (
-	struct totemsrp_instance *instance,
-	const struct srp_addr *addr)
-{
-	int i;
-
-	for (i = 0; i < instance->consensus_list_entries; i++) {
-		if (srp_addr_equal (addr, &instance->consensus_list[i].addr)) {
-			return (instance->consensus_list[i].set);
-		}
-	}
-	return (0);
-}
-
 /*
  * Is consensus agreed upon based upon consensus database
  */
 static int memb_consensus_agreed (
 	struct totemsrp_instance *instance)
 {
-	struct srp_addr token_memb[PROCESSOR_COUNT_MAX];
-	int token_memb_entries = 0;
-	int agreed = 1;
-	int i;
-
-	memb_set_subtract (token_memb, &token_memb_entries,
-		instance->my_proc_list, instance->my_proc_list_entries,
+	struct memb_bitmap proc_bitmap;
+	struct memb_bitmap failed_bitmap;
+	struct memb_bitmap consensus_bitmap;
+	struct memb_bitmap token_memb;
+	int token_memb_entries;
+	int agreed;
+
+	memb_index_reserve (instance->my_proc_list_entries +
+		instance->my_failed_list_entries +
+		instance->consensus_list_entries);
+	memb_bitmap_from_set (&proc_bitmap,
+		instance->my_proc_list, instance->my_proc_list_entries);
+	memb_bitmap_from_set (&failed_bitmap,
 		instance->my_failed_list, instance->my_failed_list_entries);
+	memb_consensus_bitmap (instance, &consensus_bitmap);
 
-	for (i = 0; i < token_memb_entries; i++) {
-		if (memb_consensus_isset (instance, &token_memb[i]) == 0) {
-			agreed = 0;
-			break;
-		}
-	}
+	memb_bitmap_and_not (&token_memb, &proc_bitmap, &failed_bitmap);
+	token_memb_entries = memb_bitmap_count (&token_memb);
+
+	agreed = memb_bitmap_is_subset (&token_memb, &consensus_bitmap);
 
 	if (agreed && instance->failed_to_recv == 1) {
 		/*
@@ -1333,12 +1657,18 @@ static void memb_consensus_notset (
 	struct srp_addr *comparison_list,
 	int comparison_list_entries)
 {
+	struct memb_bitmap consensus_bitmap;
 	int i;
 
 	*no_consensus_list_entries = 0;
 
+	memb_index_reserve (instance->consensus_list_entries);
+	memb_consensus_bitmap (instance, &consensus_bitmap);
+
 	for (i = 0; i < instance->my_proc_list_entries; i++) {
-		if (memb_consensus_isset (instance, &instance->my_proc_list[i]) == 0) {
+		if (!memb_bitmap_isset (&consensus_bitmap,
+			memb_index_get (&instance->my_proc_list[i], 0))) {
+
 			srp_addr_copy (&no_consensus_list[*no_consensus_list_entries], &instance->my_proc_list[i]);
 			*no_consensus_list_entries = *no_consensus_list_entries + 1;
 		}
@@ -1352,25 +1682,20 @@ static int memb_set_equal (
 	struct srp_addr *set1, int set1_entries,
 	struct srp_addr *set2, int set2_entries)
 {
+	struct memb_bitmap set1_bitmap;
 	int i;
-	int j;
-
-	int found = 0;
 
 	if (set1_entries != set2_entries) {
 		return (0);
 	}
+
+	memb_index_reserve (set1_entries);
+	memb_bitmap_from_set (&set1_bitmap, set1, set1_entries);
+
 	for (i = 0; i < set2_entries; i++) {
-		for (j = 0; j < set1_entries; j++) {
-			if (srp_addr_equal (&set1[j], &set2[i])) {
-				found = 1;
-				break;
-			}
-		}
-		if (found == 0) {
+		if (!memb_bitmap_isset (&set1_bitmap, memb_index_get (&set2[i], 0))) {
 			return (0);
 		}
-		found = 0;
 	}
 	return (1);
 }
@@ -1382,23 +1707,32 @@ static int memb_set_subset (
 	const struct srp_addr *subset, int subset_entries,
 	const struct srp_addr *fullset, int fullset_entries)
 {
+	struct memb_bitmap fullset_bitmap;
 	int i;
-	int j;
-	int found = 0;
 
 	if (subset_entries > fullset_entries) {
 		return (0);
 	}
-	for (i = 0; i < subset_entries; i++) {
-		for (j = 0; j < fullset_entries; j++) {
-			if (srp_addr_equal (&subset[i], &fullset[j])) {
-				found = 1;
+
+	/*
+	 * Single address lookups are cheaper as a plain scan
+	 */
+	if (subset_entries == 1) {
+		for (i = 0; i < fullset_entries; i++) {
+			if (srp_addr_equal (&subset[0], &fullset[i])) {
+				return (1);
 			}
 		}
-		if (found == 0) {
+		return (0);
+	}
+
+	memb_index_reserve (fullset_entries);
+	memb_bitmap_from_set (&fullset_bitmap, fullset, fullset_entries);
+
+	for (i = 0; i < subset_entries; i++) {
+		if (!memb_bitmap_isset (&fullset_bitmap, memb_index_get (&subset[i], 0))) {
 			return (0);
 		}
-		found = 0;
 	}
 	return (1);
 }
@@ -1409,22 +1743,20 @@ static void memb_set_merge (
 	const struct srp_addr *subset, int subset_entries,
 	struct srp_addr *fullset, int *fullset_entries)
 {
-	int found = 0;
+	struct memb_bitmap fullset_bitmap;
+	int index;
 	int i;
-	int j;
+
+	memb_index_reserve (*fullset_entries + subset_entries);
+	memb_bitmap_from_set (&fullset_bitmap, fullset, *fullset_entries);
 
 	for (i = 0; i < subset_entries; i++) {
-		for (j = 0; j < *fullset_entries; j++) {
-			if (srp_addr_equal (&fullset[j], &subset[i])) {
-				found = 1;
-				break;
-			}
-		}
-		if (found == 0) {
+		index = memb_index_get (&subset[i], 1);
+		if (!memb_bitmap_isset (&fullset_bitmap, index)) {
 			srp_addr_copy (&fullset[*fullset_entries], &subset[i]);
 			*fullset_entries = *fullset_entries + 1;
+			memb_bitmap_set (&fullset_bitmap, index);
 		}
-		found = 0;
 	}
 	return;
 }
@@ -1439,26 +1771,35 @@ static void memb_set_and_with_ring_id (
 	struct srp_addr *and,
 	int *and_entries)
 {
+	struct memb_bitmap set1_bitmap;
+	uint16_t set1_pos[MEMB_INDEX_MAX];
+	int index;
 	int i;
 	int j;
-	int found = 0;
 
 	*and_entries = 0;
 
+	/*
+	 * Remember the first position of each address in set1
+	 */
+	memb_index_reserve (set1_entries);
+	memset (&set1_bitmap, 0, sizeof (struct memb_bitmap));
+	for (j = set1_entries - 1; j >= 0; j--) {
+		index = memb_index_get (&set1[j], 1);
+		memb_bitmap_set (&set1_bitmap, index);
+		set1_pos[index] = j;
+	}
+
 	for (i = 0; i < set2_entries; i++) {
-		for (j = 0; j < set1_entries; j++) {
-			if (srp_addr_equal (&set1[j], &set2[i])) {
-				if (memcmp (&set1_ring_ids[j], old_ring_id, sizeof (struct memb_ring_id)) == 0) {
-					found = 1;
-				}
-				break;
-			}
+		index = memb_index_get (&set2[i], 0);
+		if (!memb_bitmap_isset (&set1_bitmap, index)) {
+			continue;
 		}
-		if (found) {
+		j = set1_pos[index];
+		if (memcmp (&set1_ring_ids[j], old_ring_id, sizeof (struct memb_ring_id)) == 0) {
 			srp_addr_copy (&and[*and_entries], &set1[j]);
 			*and_entries = *and_entries + 1;
 		}
-		found = 0;
 	}
 	return;
 }
@@ -1529,16 +1870,219 @@ static void my_leave_memb_set(
 }
 
 
-static void *totemsrp_buffer_alloc (struct totemsrp_instance *instance)
+/*
+ * Add one slab of frames to the free list of a class, called with the
+ * pool locked
+ */
+static int frame_pool_grow (
+	struct totemsrp_instance *instance,
+	struct frame_pool_class *fpc,
+	enum frame_class frame_class)
+{
+	struct frame_pool_slab *slab;
+	struct frame_pool_frame *frame;
+	size_t frame_len;
+	char *addr;
+	int i;
+
+	frame_len = sizeof (struct frame_pool_frame) + fpc->frame_size;
+	slab = malloc (sizeof (struct frame_pool_slab) + fpc->slab_frames * frame_len);
+	if (slab == NULL) {
+		return (-1);
+	}
+	slab->next = fpc->slabs;
+	fpc->slabs = slab;
+
+	addr = (char *)slab + sizeof (struct frame_pool_slab);
+	for (i = fpc->slab_frames - 1; i >= 0; i--) {
+		frame = (struct frame_pool_frame *)(addr + i * frame_len);
+		frame->pooled = 1;
+		frame->frame_class = frame_class;
+		frame->next = fpc->free_list;
+		fpc->free_list = frame;
+	}
+	fpc->frames += fpc->slab_frames;
+
+	instance->stats.frame_pool_size += fpc->slab_frames;
+	instance->stats.frame_pool_bytes += fpc->slab_frames * fpc->frame_size;
+
+	return (0);
+}
+
+static void frame_pool_init (struct frame_pool *pool, unsigned int mtu_size)
+{
+	struct frame_pool_class *fpc;
+	int i;
+
+	memset (pool, 0, sizeof (struct frame_pool));
+	pthread_mutex_init (&pool->mutex, NULL);
+
+	/*
+	 * Keep frame sizes a multiple of 16 so frames in a slab stay aligned
+	 */
+	mtu_size = (mtu_size + 15) & ~15;
+	if (mtu_size < FRAME_CLASS_MEDIUM_SIZE) {
+		mtu_size = FRAME_CLASS_MEDIUM_SIZE;
+	}
+	if (mtu_size > FRAME_SIZE_MAX) {
+		mtu_size = FRAME_SIZE_MAX;
+	}
+
+	pool->classes[FRAME_CLASS_SMALL].frame_size = FRAME_CLASS_SMALL_SIZE;
+	pool->classes[FRAME_CLASS_MEDIUM].frame_size = FRAME_CLASS_MEDIUM_SIZE;
+	pool->classes[FRAME_CLASS_MTU].frame_size = mtu_size;
+	pool->classes[FRAME_CLASS_FULL].frame_size = FRAME_SIZE_MAX;
+
+	for (i = 0; i < FRAME_CLASS_COUNT; i++) {
+		fpc = &pool->classes[i];
+		fpc->slab_frames = FRAME_POOL_SLAB_SIZE /
+			(sizeof (struct frame_pool_frame) + fpc->frame_size);
+		if (fpc->slab_frames == 0) {
+			fpc->slab_frames = 1;
+		}
+	}
+}
+
+static void frame_pool_prealloc (
+	struct totemsrp_instance *instance,
+	enum frame_class frame_class,
+	unsigned int frames)
+{
+	struct frame_pool_class *fpc = &instance->frame_pool.classes[frame_class];
+
+	while (fpc->frames < frames && fpc->frames < FRAME_POOL_FRAMES_MAX) {
+		if (frame_pool_grow (instance, fpc, frame_class) != 0) {
+			break;
+		}
+	}
+}
+
+static void frame_pool_free (struct frame_pool *pool)
+{
+	struct frame_pool_slab *slab;
+	int i;
+
+	for (i = 0; i < FRAME_CLASS_COUNT; i++) {
+		while (pool->classes[i].slabs) {
+			slab = pool->classes[i].slabs;
+			pool->classes[i].slabs = slab->next;
+			free (slab);
+		}
+	}
+	pthread_mutex_destroy (&pool->mutex);
+}
+
+/*
+ * Smallest class with frames of at least len bytes
+ */
+static enum frame_class frame_pool_class_get (
+	struct frame_pool *pool,
+	unsigned int len)
+{
+	int i;
+
+	for (i = 0; i < FRAME_CLASS_FULL; i++) {
+		if (len <= pool->classes[i].frame_size) {
+			return (i);
+		}
+	}
+	return (FRAME_CLASS_FULL);
+}
+
+static enum frame_class frame_pool_frame_class (void *ptr)
+{
+	struct frame_pool_frame *frame;
+
+	frame = (struct frame_pool_frame *)((char *)ptr - sizeof (struct frame_pool_frame));
+	return (frame->frame_class);
+}
+
+/*
+ * Allocate a frame that holds at least len bytes
+ */
+static void *totemsrp_buffer_alloc (struct totemsrp_instance *instance, unsigned int len)
 {
-	assert (instance != NULL);
-	return totemrrp_buffer_alloc (instance->totemrrp_context);
+	struct frame_pool *pool = &instance->frame_pool;
+	struct frame_pool_class *fpc;
+	struct frame_pool_frame *frame;
+	enum frame_class frame_class;
+
+	assert (len <= FRAME_SIZE_MAX);
+	frame_class = frame_pool_class_get (pool, len);
+	fpc = &pool->classes[frame_class];
+
+	/*
+	 * Library threads allocate concurrently with the totem thread
+	 * only in threaded mode
+	 */
+	if (instance->threaded_mode_enabled) {
+		pthread_mutex_lock (&pool->mutex);
+	}
+
+	if (fpc->free_list == NULL && fpc->frames < FRAME_POOL_FRAMES_MAX) {
+		frame_pool_grow (instance, fpc, frame_class);
+	}
+
+	frame = fpc->free_list;
+	if (frame != NULL) {
+		fpc->free_list = frame->next;
+	} else {
+		frame = malloc (sizeof (struct frame_pool_frame) + fpc->frame_size);
+		if (frame != NULL) {
+			frame->pooled = 0;
+			frame->frame_class = frame_class;
+			instance->stats.frame_pool_overflow++;
+		}
+	}
+
+	if (frame != NULL) {
+		instance->stats.frame_pool_in_use++;
+		if (instance->stats.frame_pool_in_use > instance->stats.frame_pool_in_use_max) {
+			instance->stats.frame_pool_in_use_max = instance->stats.frame_pool_in_use;
+		}
+		instance->stats.frame_pool_bytes_in_use += fpc->frame_size;
+		if (instance->stats.frame_pool_bytes_in_use > instance->stats.frame_pool_bytes_in_use_max) {
+			instance->stats.frame_pool_bytes_in_use_max = instance->stats.frame_pool_bytes_in_use;
+		}
+	}
+
+	if (instance->threaded_mode_enabled) {
+		pthread_mutex_unlock (&pool->mutex);
+	}
+
+	if (frame == NULL) {
+		return (NULL);
+	}
+	return ((char *)frame + sizeof (struct frame_pool_frame));
 }
 
 static void totemsrp_buffer_release (struct totemsrp_instance *instance, void *ptr)
 {
-	assert (instance != NULL);
-	totemrrp_buffer_release (instance->totemrrp_context, ptr);
+	struct frame_pool *pool = &instance->frame_pool;
+	struct frame_pool_class *fpc;
+	struct frame_pool_frame *frame;
+
+	frame = (struct frame_pool_frame *)((char *)ptr - sizeof (struct frame_pool_frame));
+	fpc = &pool->classes[frame->frame_class];
+
+	if (instance->threaded_mode_enabled) {
+		pthread_mutex_lock (&pool->mutex);
+	}
+
+	instance->stats.frame_pool_in_use--;
+	instance->stats.frame_pool_bytes_in_use -= fpc->frame_size;
+	if (frame->pooled) {
+		frame->next = fpc->free_list;
+		fpc->free_list = frame;
+	}
+
+	if (instance->threaded_mode_enabled) {
+		pthread_mutex_unlock (&pool->mutex);
+	}
+
+	if (frame->pooled == 0) {
+		free (frame);
+	}
 }
 
 static void reset_token_retransmit_timeout (struct totemsrp_instance *instance)
@@ -1873,6 +2417,8 @@ static void deliver_messages_from_recovery_to_regular (struct totemsrp_instance
 				(struct mcast *)(((char *)recovery_message_item->mcast) + sizeof (struct mcast));
 			regular_message_item.msg_len =
 			recovery_message_item->msg_len - sizeof (struct mcast);
+			regular_message_item.buffer = regular_message_item.mcast;
+			regular_message_item.enqueue_time = 0;
 			mcast = regular_message_item.mcast;
 		} else {
 			/*
@@ -2077,7 +2623,7 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 			struct sort_queue_item *regular_message;
 
 			regular_message = ptr;
-			free (regular_message->mcast);
+			totemsrp_buffer_release (instance, regular_message->buffer);
 		}
 	}
 	sq_items_release (&instance->regular_sort_queue, instance->my_high_delivered);
@@ -2279,6 +2825,8 @@ static void memb_state_commit_enter (
 	instance->my_trc = 0;
 	instance->my_pbl = 0;
 	instance->my_cbl = 0;
+	instance->fcc_token_rx_time = 0;
+	instance->hist_token_rx_time = 0;
 	/*
 	 * commit token sent after callback that token target has been set
 	 */
@@ -2296,6 +2844,7 @@ static void memb_state_recovery_enter (
 	const struct srp_addr *addr;
 	struct memb_commit_token_memb_entry *memb_list;
 	struct memb_ring_id my_new_memb_ring_id_list[PROCESSOR_COUNT_MAX];
+	struct memb_bitmap trans_memb_bitmap;
 
 	addr = (const struct srp_addr *)commit_token->end_of_commit_token;
 	memb_list = (struct memb_commit_token_memb_entry *)(addr + commit_token->addr_entries);
@@ -2361,12 +2910,16 @@ static void memb_state_recovery_enter (
 
 	//	assert (totemip_print (&memb_list[i].ring_id.rep) != 0);
 	}
+	memb_index_reserve (instance->my_trans_memb_entries);
+	memb_bitmap_from_set (&trans_memb_bitmap,
+		instance->my_trans_memb_list, instance->my_trans_memb_entries);
+
 	/*
 	 * Determine if any received flag is false
 	 */
 	for (i = 0; i < commit_token->addr_entries; i++) {
-		if (memb_set_subset (&instance->my_new_memb_list[i], 1,
-			instance->my_trans_memb_list, instance->my_trans_memb_entries) &&
+		if (memb_bitmap_isset (&trans_memb_bitmap,
+			memb_index_get (&instance->my_new_memb_list[i], 0)) &&
 
 			memb_list[i].received_flg == 0) {
 			instance->my_deliver_memb_entries = instance->my_trans_memb_entries;
@@ -2382,11 +2935,11 @@ static void memb_state_recovery_enter (
 
 	/*
 	 * Calculate my_low_ring_aru, instance->my_high_ring_delivered for the transitional membership
+	 * my_deliver_memb_list is a copy of my_trans_memb_list at this point
 	 */
 	for (i = 0; i < commit_token->addr_entries; i++) {
-		if (memb_set_subset (&instance->my_new_memb_list[i], 1,
-			instance->my_deliver_memb_list,
-			 instance->my_deliver_memb_entries) &&
+		if (memb_bitmap_isset (&trans_memb_bitmap,
+			memb_index_get (&instance->my_new_memb_list[i], 0)) &&
 
 		memcmp (&instance->my_old_ring_id,
 			&memb_list[i].ring_id,
@@ -2433,8 +2986,10 @@ static void memb_state_recovery_enter (
 		messages_originated++;
 		memset (&message_item, 0, sizeof (struct message_item));
 	// TODO	 LEAK
-		message_item.mcast = totemsrp_buffer_alloc (instance);
+		message_item.mcast = totemsrp_buffer_alloc (instance,
+			sort_queue_item->msg_len + sizeof (struct mcast));
 		assert (message_item.mcast);
+		message_item.buffer = message_item.mcast;
 		message_item.mcast->header.type = MESSAGE_TYPE_MCAST;
 		srp_addr_copy (&message_item.mcast->system_from, &instance->my_id);
 		message_item.mcast->header.encapsulated = MESSAGE_ENCAPSULATED;
@@ -2488,20 +3043,18 @@ int totemsrp_mcast (
 	void *srp_context,
 	struct iovec *iovec,
 	unsigned int iov_len,
-	int guarantee)
+	int guarantee,
+	int lane)
 {
 	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
 	int i;
 	struct message_item message_item;
 	char *addr;
 	unsigned int addr_idx;
+	unsigned int msg_len;
 	struct cs_queue *queue_use;
 
-	if (instance->waiting_trans_ack) {
-		queue_use = &instance->new_message_queue_trans;
-	} else {
-		queue_use = &instance->new_message_queue;
-	}
+	queue_use = new_message_queue_get (instance, lane);
 
 	if (cs_queue_is_full (queue_use)) {
 		log_printf (instance->totemsrp_log_level_debug, "queue full");
@@ -2510,13 +3063,19 @@ int totemsrp_mcast (
 
 	memset (&message_item, 0, sizeof (struct message_item));
 
+	msg_len = sizeof (struct mcast);
+	for (i = 0; i < iov_len; i++) {
+		msg_len += iovec[i].iov_len;
+	}
+
 	/*
 	 * Allocate pending item
 	 */
-	message_item.mcast = totemsrp_buffer_alloc (instance);
+	message_item.mcast = totemsrp_buffer_alloc (instance, msg_len);
 	if (message_item.mcast == 0) {
 		goto error_mcast;
 	}
+	message_item.buffer = message_item.mcast;
 
 	/*
 	 * Set mcast header
@@ -2539,9 +3098,13 @@ int totemsrp_mcast (
 	}
 
 	message_item.msg_len = addr_idx;
+	message_item.enqueue_time = qb_util_nano_current_get ();
 
 	log_printf (instance->totemsrp_log_level_trace, "mcasted message added to pending queue");
 	instance->stats.mcast_tx++;
+	if (lane == TOTEM_LANE_CONTROL) {
+		instance->stats.mcast_tx_control++;
+	}
 	cs_queue_item_add (queue_use, &message_item);
 
 	return (0);
@@ -2550,21 +3113,122 @@ error_mcast:
 	return (-1);
 }
 
+/*
+ * Frame interface used by totempg to build messages in place
+ */
+void *totemsrp_frame_alloc (void *srp_context, unsigned int len)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+
+	return (totemsrp_buffer_alloc (instance, len));
+}
+
+void totemsrp_frame_release (void *srp_context, void *frame)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+
+	totemsrp_buffer_release (instance, frame);
+}
+
+unsigned int totemsrp_frame_headroom (void)
+{
+	return (sizeof (struct mcast));
+}
+
+/*
+ * Multicast a message that was built in a frame from totemsrp_frame_alloc.
+ * The message is msg_len bytes at frame + offset, and there must be at
+ * least totemsrp_frame_headroom() bytes in front of it for the srp header.
+ * On success the frame belongs to totemsrp, on failure it stays with
+ * the caller.
+ */
+int totemsrp_mcast_frame (
+	void *srp_context,
+	void *frame,
+	unsigned int offset,
+	unsigned int msg_len,
+	int guarantee,
+	int lane)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+	struct message_item message_item;
+	struct cs_queue *queue_use;
+	enum frame_class frame_class;
+	void *buffer;
+
+	assert (offset >= sizeof (struct mcast));
+
+	queue_use = new_message_queue_get (instance, lane);
+
+	if (cs_queue_is_full (queue_use)) {
+		log_printf (instance->totemsrp_log_level_debug, "queue full");
+		return (-1);
+	}
+
+	/*
+	 * Packet sized messages are queued in the frame they were built in.
+	 * A message that fits a SMALL or MEDIUM frame is moved there, which
+	 * copies at most FRAME_CLASS_MEDIUM_SIZE bytes, so queued small
+	 * messages don't each pin a packet sized frame.
+	 */
+	frame_class = frame_pool_class_get (&instance->frame_pool,
+		sizeof (struct mcast) + msg_len);
+	if (frame_class < FRAME_CLASS_MTU &&
+	    frame_class < frame_pool_frame_class (frame)) {
+
+		buffer = totemsrp_buffer_alloc (instance, sizeof (struct mcast) + msg_len);
+		if (buffer != NULL) {
+			memcpy ((char *)buffer + sizeof (struct mcast),
+				(char *)frame + offset, msg_len);
+			totemsrp_buffer_release (instance, frame);
+			frame = buffer;
+			offset = sizeof (struct mcast);
+		}
+	}
+
+	memset (&message_item, 0, sizeof (struct message_item));
+	message_item.buffer = frame;
+	message_item.mcast = (struct mcast *)((char *)frame + offset -
+		sizeof (struct mcast));
+
+	memset(message_item.mcast, 0, sizeof (struct mcast));
+	message_item.mcast->header.type = MESSAGE_TYPE_MCAST;
+	message_item.mcast->header.endian_detector = ENDIAN_LOCAL;
+	message_item.mcast->header.encapsulated = MESSAGE_NOT_ENCAPSULATED;
+	message_item.mcast->header.nodeid = instance->my_id.addr[0].nodeid;
+	assert (message_item.mcast->header.nodeid);
+
+	message_item.mcast->guarantee = guarantee;
+	srp_addr_copy (&message_item.mcast->system_from, &instance->my_id);
+
+	message_item.msg_len = sizeof (struct mcast) + msg_len;
+	message_item.enqueue_time = qb_util_nano_current_get ();
+
+	log_printf (instance->totemsrp_log_level_trace, "mcasted message added to pending queue");
+	instance->stats.mcast_tx++;
+	if (lane == TOTEM_LANE_CONTROL) {
+		instance->stats.mcast_tx_control++;
+	}
+	cs_queue_item_add (queue_use, &message_item);
+
+	return (0);
+}
+
 /*
  * Determine if there is room to queue a new message
  */
 int totemsrp_avail (void *srp_context)
+{
+
+	return (totemsrp_lane_avail (srp_context, TOTEM_LANE_BULK));
+}
+
+int totemsrp_lane_avail (void *srp_context, int lane)
 {
 	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
 	int avail;
-	struct cs_queue *queue_use;
 
-	if (instance->waiting_trans_ack) {
-		queue_use = &instance->new_message_queue_trans;
-	} else {
-		queue_use = &instance->new_message_queue;
-	}
-	cs_queue_avail (queue_use, &avail);
+	cs_queue_avail (new_message_queue_get (instance, lane), &avail);
 
 	return (avail);
 }
@@ -2658,7 +3322,7 @@ static void messages_free (
 			instance->last_released + i, &ptr);
 		if (res == 0) {
 			regular_message = ptr;
-			totemsrp_buffer_release (instance, regular_message->mcast);
+			totemsrp_buffer_release (instance, regular_message->buffer);
 		}
 		sq_items_release (&instance->regular_sort_queue,
 			instance->last_released + i);
@@ -2707,34 +3371,20 @@ static void update_aru (
 }
 
 /*
- * Multicasts pending messages onto the ring (requires orf_token possession)
+ * Multicasts up to fcc_mcasts_allowed messages of mcast_queue onto the ring
  */
-static int orf_token_mcast (
+static int orf_token_mcast_queue (
 	struct totemsrp_instance *instance,
 	struct orf_token *token,
+	struct cs_queue *mcast_queue,
+	struct sq *sort_queue,
 	int fcc_mcasts_allowed)
 {
 	struct message_item *message_item = 0;
-	struct cs_queue *mcast_queue;
-	struct sq *sort_queue;
 	struct sort_queue_item sort_queue_item;
 	struct mcast *mcast;
 	unsigned int fcc_mcast_current;
 
-	if (instance->memb_state == MEMB_STATE_RECOVERY) {
-		mcast_queue = &instance->retrans_message_queue;
-		sort_queue = &instance->recovery_sort_queue;
-		reset_token_retransmit_timeout (instance); // REVIEWED
-	} else {
-		if (instance->waiting_trans_ack) {
-			mcast_queue = &instance->new_message_queue_trans;
-		} else {
-			mcast_queue = &instance->new_message_queue;
-		}
-
-		sort_queue = &instance->regular_sort_queue;
-	}
-
 	for (fcc_mcast_current = 0; fcc_mcast_current < fcc_mcasts_allowed; fcc_mcast_current++) {
 		if (cs_queue_is_empty (mcast_queue)) {
 			break;
@@ -2750,6 +3400,8 @@ static int orf_token_mcast (
 		memset (&sort_queue_item, 0, sizeof (struct sort_queue_item));
 		sort_queue_item.mcast = message_item->mcast;
 		sort_queue_item.msg_len = message_item->msg_len;
+		sort_queue_item.buffer = message_item->buffer;
+		sort_queue_item.enqueue_time = message_item->enqueue_time;
 
 		mcast = sort_queue_item.mcast;
 
@@ -2776,6 +3428,54 @@ static int orf_token_mcast (
 		instance->my_high_seq_received = token->seq;
 	}
 
+
+	return (fcc_mcast_current);
+}
+
+/*
+ * Multicasts pending messages onto the ring (requires orf_token possession)
+ */
+static int orf_token_mcast (
+	struct totemsrp_instance *instance,
+	struct orf_token *token,
+	int fcc_mcasts_allowed)
+{
+	struct sq *sort_queue;
+	int control_allowed;
+	int fcc_mcast_current;
+
+	if (instance->memb_state == MEMB_STATE_RECOVERY) {
+		reset_token_retransmit_timeout (instance); // REVIEWED
+		fcc_mcast_current = orf_token_mcast_queue (instance, token,
+			&instance->retrans_message_queue,
+			&instance->recovery_sort_queue, fcc_mcasts_allowed);
+	} else
+	if (instance->waiting_trans_ack) {
+		fcc_mcast_current = orf_token_mcast_queue (instance, token,
+			&instance->new_message_queue_trans,
+			&instance->regular_sort_queue, fcc_mcasts_allowed);
+	} else {
+		/*
+		 * The control lane goes first, but takes at most half of the
+		 * allowance while bulk messages are waiting.  Allowance one
+		 * lane doesn't use goes to the other.
+		 */
+		sort_queue = &instance->regular_sort_queue;
+		control_allowed = fcc_mcasts_allowed;
+		if (cs_queue_is_empty (&instance->new_message_queue) == 0) {
+			control_allowed = (fcc_mcasts_allowed + 1) / 2;
+		}
+		fcc_mcast_current = orf_token_mcast_queue (instance, token,
+			&instance->new_message_queue_control, sort_queue,
+			control_allowed);
+		fcc_mcast_current += orf_token_mcast_queue (instance, token,
+			&instance->new_message_queue, sort_queue,
+			fcc_mcasts_allowed - fcc_mcast_current);
+		fcc_mcast_current += orf_token_mcast_queue (instance, token,
+			&instance->new_message_queue_control, sort_queue,
+			fcc_mcasts_allowed - fcc_mcast_current);
+	}
+
 	update_aru (instance);
 
 	/*
@@ -2869,6 +3569,16 @@ static int orf_token_rtr (
 	for (i = 1; (orf_token->rtr_list_entries < RETRANSMIT_ENTRIES_MAX) &&
 		(i <= range); i++) {
 
+		/*
+		 * Find the next message missing from this processor,
+		 * skipping received messages a bitmap word at a time
+		 */
+		i = sq_item_next_missing (sort_queue, instance->my_aru + i,
+			instance->my_aru + range) - instance->my_aru;
+		if (i > range) {
+			break;
+		}
+
 		/*
 		 * Ensure message is within the sort queue range
 		 */
@@ -2878,42 +3588,36 @@ static int orf_token_rtr (
 		}
 
 		/*
-		 * Find if a message is missing from this processor
+		 * Determine how many times we have missed receiving
+		 * this sequence number.  sq_item_miss_count increments
+		 * a counter for the sequence number.  The miss count
+		 * will be returned and compared.  This allows time for
+		 * delayed multicast messages to be received before
+		 * declaring the message is missing and requesting a
+		 * retransmit.
 		 */
-		res = sq_item_inuse (sort_queue, instance->my_aru + i);
-		if (res == 0) {
-			/*
-			 * Determine how many times we have missed receiving
-			 * this sequence number.  sq_item_miss_count increments
-			 * a counter for the sequence number.  The miss count
-			 * will be returned and compared.  This allows time for
-			 * delayed multicast messages to be received before
-			 * declaring the message is missing and requesting a
-			 * retransmit.
-			 */
-			res = sq_item_miss_count (sort_queue, instance->my_aru + i);
-			if (res < instance->totem_config->miss_count_const) {
-				continue;
-			}
+		res = sq_item_miss_count (sort_queue, instance->my_aru + i);
+		if (res < instance->totem_config->miss_count_const) {
+			continue;
+		}
 
+		/*
+		 * Determine if missing message is already in retransmit list
+		 */
+		found = 0;
+		for (j = 0; j < orf_token->rtr_list_entries; j++) {
+			if (instance->my_aru + i == rtr_list[j].seq) {
+				found = 1;
+			}
+		}
+		if (found == 0) {
 			/*
-			 * Determine if missing message is already in retransmit list
+			 * Missing message not found in current retransmit list so add it
 			 */
-			found = 0;
-			for (j = 0; j < orf_token->rtr_list_entries; j++) {
-				if (instance->my_aru + i == rtr_list[j].seq) {
-					found = 1;
-				}
-			}
-			if (found == 0) {
-				/*
-				 * Missing message not found in current retransmit list so add it
-				 */
-				memcpy (&rtr_list[orf_token->rtr_list_entries].ring_id,
-					&instance->my_ring_id, sizeof (struct memb_ring_id));
-				rtr_list[orf_token->rtr_list_entries].seq = instance->my_aru + i;
-				orf_token->rtr_list_entries++;
-			}
+			memcpy (&rtr_list[orf_token->rtr_list_entries].ring_id,
+				&instance->my_ring_id, sizeof (struct memb_ring_id));
+			rtr_list[orf_token->rtr_list_entries].seq = instance->my_aru + i;
+			orf_token->rtr_list_entries++;
 		}
 	}
 	return (instance->fcc_remcast_current);
@@ -3560,6 +4264,7 @@ static unsigned int backlog_get (struct totemsrp_instance *instance)
 			queue_use = &instance->new_message_queue_trans;
 		} else {
 			queue_use = &instance->new_message_queue;
+			backlog = cs_queue_used (&instance->new_message_queue_control);
 		}
 	} else
 	if (instance->memb_state == MEMB_STATE_RECOVERY) {
@@ -3567,34 +4272,144 @@ static unsigned int backlog_get (struct totemsrp_instance *instance)
 	}
 
 	if (queue_use != NULL) {
-		backlog = cs_queue_used (queue_use);
+		backlog += cs_queue_used (queue_use);
 	}
 
 	instance->stats.token[instance->stats.latest_token].backlog_calc = backlog;
 	return (backlog);
 }
 
+static unsigned int fcc_window_size_get (struct totemsrp_instance *instance)
+{
+	if (instance->totem_config->fcc_adaptive) {
+		return (instance->fcc_window_size);
+	}
+	return (instance->totem_config->window_size);
+}
+
+/*
+ * AIMD control of window_size and max_messages, run once per rotation.
+ * Retransmits above FCC_ADAPTIVE_LOSS_PERCENT of the window, dropped
+ * messages and token rotation approaching the token retransmit timeout
+ * halve both, otherwise a backlog grows them by one. Small random loss
+ * is not taken as congestion.
+ */
+static void fcc_adaptive_update (
+	struct totemsrp_instance *instance,
+	struct orf_token *token)
+{
+	struct totem_config *totem_config = instance->totem_config;
+	unsigned long long now = qb_util_nano_current_get ();
+	unsigned long long rotation = 0;
+	unsigned int window_size_max;
+	unsigned int max_messages_max;
+	unsigned int loss_allowed;
+	int congested = 0;
+
+	if (instance->fcc_token_rx_time != 0) {
+		rotation = now - instance->fcc_token_rx_time;
+	}
+	instance->fcc_token_rx_time = now;
+
+	/*
+	 * Rotations spanning a token loss say nothing about load
+	 */
+	if (rotation > 0 &&
+	    rotation < (unsigned long long)totem_config->token_timeout * QB_TIME_NS_IN_MSEC) {
+		instance->fcc_rotation_avg = instance->fcc_rotation_avg -
+			instance->fcc_rotation_avg / 8 + rotation / 8;
+	}
+
+	loss_allowed = instance->fcc_window_size * FCC_ADAPTIVE_LOSS_PERCENT / 100;
+	if (token->rtr_list_entries > loss_allowed ||
+	    instance->stats.mcast_retx - instance->fcc_mcast_retx > loss_allowed ||
+	    instance->stats.rx_msg_dropped != instance->fcc_rx_msg_dropped ||
+	    instance->fcc_rotation_avg >
+	    (unsigned long long)totem_config->token_retransmit_timeout * QB_TIME_NS_IN_MSEC / 2) {
+		congested = 1;
+	}
+	instance->fcc_mcast_retx = instance->stats.mcast_retx;
+	instance->fcc_rx_msg_dropped = instance->stats.rx_msg_dropped;
+
+	window_size_max = totem_config->window_size * FCC_ADAPTIVE_GROWTH;
+	if (window_size_max > QUEUE_RTR_ITEMS_SIZE_MAX / 4) {
+		window_size_max = QUEUE_RTR_ITEMS_SIZE_MAX / 4;
+	}
+	max_messages_max = totem_config->max_messages * FCC_ADAPTIVE_GROWTH;
+	if (max_messages_max > FCC_KERNEL_BUFFER_SIZE / totem_config->net_mtu) {
+		max_messages_max = FCC_KERNEL_BUFFER_SIZE / totem_config->net_mtu;
+	}
+	if (max_messages_max < totem_config->max_messages) {
+		max_messages_max = totem_config->max_messages;
+	}
+
+	if (instance->fcc_decrease_hold > 0) {
+		instance->fcc_decrease_hold--;
+	}
+
+	if (congested) {
+		if (instance->fcc_decrease_hold == 0) {
+			instance->fcc_window_size /= 2;
+			instance->fcc_max_messages /= 2;
+			instance->fcc_decrease_hold = FCC_ADAPTIVE_DECREASE_HOLD;
+			instance->stats.fcc_decreases++;
+		}
+	} else if (instance->my_cbl > 0) {
+		instance->fcc_window_size++;
+		instance->fcc_max_messages++;
+	}
+
+	if (instance->fcc_window_size > window_size_max) {
+		instance->fcc_window_size = window_size_max;
+	}
+	if (instance->fcc_max_messages > max_messages_max) {
+		instance->fcc_max_messages = max_messages_max;
+	}
+	if (instance->fcc_max_messages < 1) {
+		instance->fcc_max_messages = 1;
+	}
+	if (instance->fcc_window_size < instance->fcc_max_messages) {
+		instance->fcc_window_size = instance->fcc_max_messages;
+	}
+
+	instance->stats.fcc_window_size = instance->fcc_window_size;
+	instance->stats.fcc_max_messages = instance->fcc_max_messages;
+	instance->stats.fcc_token_rotation = instance->fcc_rotation_avg / QB_TIME_NS_IN_USEC;
+}
+
 static int fcc_calculate (
 	struct totemsrp_instance *instance,
 	struct orf_token *token)
 {
 	unsigned int transmits_allowed;
 	unsigned int backlog_calc;
+	unsigned int window_size;
 
-	transmits_allowed = instance->totem_config->max_messages;
+	instance->my_cbl = backlog_get (instance);
 
-	if (transmits_allowed > instance->totem_config->window_size - token->fcc) {
-		transmits_allowed = instance->totem_config->window_size - token->fcc;
+	if (instance->totem_config->fcc_adaptive) {
+		fcc_adaptive_update (instance, token);
+		transmits_allowed = instance->fcc_max_messages;
+	} else {
+		transmits_allowed = instance->totem_config->max_messages;
 	}
+	window_size = fcc_window_size_get (instance);
 
-	instance->my_cbl = backlog_get (instance);
+	/*
+	 * Other processors may use a larger adaptive window
+	 */
+	if (token->fcc >= window_size) {
+		transmits_allowed = 0;
+	} else if (transmits_allowed > window_size - token->fcc) {
+		transmits_allowed = window_size - token->fcc;
+	}
 
 	/*
 	 * Only do backlog calculation if there is a backlog otherwise
 	 * we would result in div by zero
 	 */
 	if (token->backlog + instance->my_cbl - instance->my_pbl) {
-		backlog_calc = (instance->totem_config->window_size * instance->my_pbl) /
+		backlog_calc = (window_size * instance->my_pbl) /
 			(token->backlog + instance->my_cbl - instance->my_pbl);
 		if (backlog_calc > 0 && transmits_allowed > backlog_calc) {
 			transmits_allowed = backlog_calc;
@@ -3612,12 +4427,13 @@ static void fcc_rtr_limit (
 	struct orf_token *token,
 	unsigned int *transmits_allowed)
 {
+	unsigned int window_size = fcc_window_size_get (instance);
 	int check = QUEUE_RTR_ITEMS_SIZE_MAX;
-	check -= (*transmits_allowed + instance->totem_config->window_size);
+	check -= (*transmits_allowed + window_size);
 	assert (check >= 0);
 	if (sq_lt_compare (instance->last_released +
 		QUEUE_RTR_ITEMS_SIZE_MAX - *transmits_allowed -
-		instance->totem_config->window_size,
+		window_size,
 
 			token->seq)) {
 
@@ -3963,6 +4779,9 @@ static void messages_deliver_to_app (
 	unsigned int range = 0;
 	int endian_conversion_required;
 	unsigned int my_high_delivered_stored = 0;
+	struct memb_bitmap deliver_memb_bitmap;
+	unsigned int deliver_memb_generation = 0;
+	int deliver_memb_bitmap_valid = 0;
 
 
 	range = end_point - instance->my_high_delivered;
@@ -4021,13 +4840,22 @@ static void messages_deliver_to_app (
 		}
 
 		/*
-		 * Skip messages not originated in instance->my_deliver_memb
+		 * Skip messages not originated in instance->my_deliver_memb.
+		 * The bitmap is rebuilt only if the index was reset meanwhile.
 		 */
-		if (skip &&
-			memb_set_subset (&mcast_header.system_from,
-				1,
+		if (skip && (deliver_memb_bitmap_valid == 0 ||
+			deliver_memb_generation != memb_index.generation)) {
+
+			memb_index_reserve (instance->my_deliver_memb_entries);
+			memb_bitmap_from_set (&deliver_memb_bitmap,
 				instance->my_deliver_memb_list,
-				instance->my_deliver_memb_entries) == 0) {
+				instance->my_deliver_memb_entries);
+			deliver_memb_generation = memb_index.generation;
+			deliver_memb_bitmap_valid = 1;
+		}
+		if (skip &&
+			memb_bitmap_isset (&deliver_memb_bitmap,
+				memb_index_get (&mcast_header.system_from, 0)) == 0) {
 
 			instance->my_high_delivered = my_high_delivered_stored + i;
 
@@ -4041,6 +4869,12 @@ static void messages_deliver_to_app (
 			"Delivering MCAST message with seq %x to pending delivery queue",
 			mcast_header.seq);
 
+		if (sort_queue_item_p->enqueue_time != 0) {
+			totem_histogram_record (&instance->stats.mcast_latency_hist,
+				(qb_util_nano_current_get () - sort_queue_item_p->enqueue_time) /
+				QB_TIME_NS_IN_USEC);
+		}
+
 		/*
 		 * Message is locally originated multicast
 		 */
@@ -4145,12 +4979,14 @@ static int message_handler_mcast (
 		 * Allocate new multicast memory block
 		 */
 // TODO LEAK
-		sort_queue_item.mcast = totemsrp_buffer_alloc (instance);
+		sort_queue_item.mcast = totemsrp_buffer_alloc (instance, msg_len);
 		if (sort_queue_item.mcast == NULL) {
 			return (-1); /* error here is corrected by the algorithm */
 		}
 		memcpy (sort_queue_item.mcast, msg, msg_len);
 		sort_queue_item.msg_len = msg_len;
+		sort_queue_item.buffer = sort_queue_item.mcast;
+		sort_queue_item.enqueue_time = 0;
 
 		if (sq_lt_compare (instance->my_high_seq_received,
 			mcast_header.seq)) {
@@ -4838,6 +5674,13 @@ void totemsrp_threaded_mode_enable (void *context)
 	struct totemsrp_instance *instance = (struct totemsrp_instance *)context;
 
 	instance->threaded_mode_enabled = 1;
+
+	cs_queue_threaded_mode_set (&instance->new_message_queue,
+		new_message_queue_threaded_mode (instance));
+	cs_queue_threaded_mode_set (&instance->new_message_queue_control,
+		new_message_queue_threaded_mode (instance));
+	cs_queue_threaded_mode_set (&instance->new_message_queue_trans,
+		new_message_queue_threaded_mode (instance));
 }
 
 void totemsrp_trans_ack (void *context)
@@ -78,13 +78,41 @@ int totemsrp_mcast (
 	void *srp_context,
 	struct iovec *iovec,
 	unsigned int iov_len,
-	int priority);
+	int priority,
+	int lane);
+
+/**
+ * Build a message directly in a transport frame and multicast it.
+ * Frames of up to the headroom, one packet of net_mtu bytes and
+ * TOTEMSRP_FRAME_STAGING more bytes come from the packet sized pool,
+ * the staging room lets the caller build headers in front of the data.
+ */
+#define TOTEMSRP_FRAME_STAGING		256 /* bytes */
+
+extern void *totemsrp_frame_alloc (void *srp_context, unsigned int len);
+
+extern void totemsrp_frame_release (void *srp_context, void *frame);
+
+extern unsigned int totemsrp_frame_headroom (void);
+
+extern int totemsrp_mcast_frame (
+	void *srp_context,
+	void *frame,
+	unsigned int offset,
+	unsigned int msg_len,
+	int guarantee,
+	int lane);
 
 /**
  * Return number of available messages that can be queued
  */
 int totemsrp_avail (void *srp_context);
 
+/**
+ * Return number of available messages that can be queued in a lane
+ */
+int totemsrp_lane_avail (void *srp_context, int lane);
+
 int totemsrp_callback_token_create (
 	void *srp_context,
 	void **handle_out,
@@ -90,6 +90,16 @@
 
 #define MESSAGE_TYPE_MEMB_JOIN	3
 
+/*
+ * Maximum number of datagrams drained by one recvmmsg call
+ */
+#define RECV_BATCH_MAX		16
+
+/*
+ * Maximum number of frames encrypted together by crypto worker threads
+ */
+#define SEND_BATCH_MAX		32
+
 struct totemudp_socket {
 	int mcast_recv;
 	int mcast_send;
@@ -161,6 +171,16 @@ struct totemudp_instance {
 
 	struct iovec totemudp_iov_recv_flush;
 
+#ifdef HAVE_RECVMMSG
+	char recv_batch_buffer[RECV_BATCH_MAX][FRAME_SIZE_MAX];
+
+	struct iovec recv_batch_iov[RECV_BATCH_MAX];
+
+	struct sockaddr_storage recv_batch_from[RECV_BATCH_MAX];
+
+	struct mmsghdr recv_batch_msgs[RECV_BATCH_MAX];
+#endif
+
 	struct totemudp_socket totemudp_sockets;
 
 	struct totem_ip_address mcast_address;
@@ -192,6 +212,16 @@ struct totemudp_instance {
 	totemsrp_stats_t *stats;
 
 	struct totem_ip_address token_target;
+
+	unsigned char send_batch_plain[SEND_BATCH_MAX][FRAME_SIZE_MAX];
+
+	unsigned char send_batch_buffer[SEND_BATCH_MAX][FRAME_SIZE_MAX];
+
+	struct iovec send_batch_iov[SEND_BATCH_MAX][3];
+
+	struct crypto_send_item send_batch_items[SEND_BATCH_MAX];
+
+	int send_batch_entries;
 };
 
 struct work_item {
@@ -211,6 +241,10 @@ static struct totem_ip_address localhost;
 
 static void totemudp_instance_initialize (struct totemudp_instance *instance)
 {
+#ifdef HAVE_RECVMMSG
+	int i;
+#endif
+
 	memset (instance, 0, sizeof (struct totemudp_instance));
 
 	instance->netif_state_report = NETIF_STATE_REPORT_UP | NETIF_STATE_REPORT_DOWN;
@@ -222,6 +256,16 @@ static void totemudp_instance_initialize (struct totemudp_instance *instance)
 
 	instance->totemudp_iov_recv_flush.iov_len = FRAME_SIZE_MAX; //sizeof (instance->iov_buffer);
 
+#ifdef HAVE_RECVMMSG
+	for (i = 0; i < RECV_BATCH_MAX; i++) {
+		instance->recv_batch_iov[i].iov_base = instance->recv_batch_buffer[i];
+		instance->recv_batch_iov[i].iov_len = FRAME_SIZE_MAX;
+		instance->recv_batch_msgs[i].msg_hdr.msg_name = &instance->recv_batch_from[i];
+		instance->recv_batch_msgs[i].msg_hdr.msg_iov = &instance->recv_batch_iov[i];
+		instance->recv_batch_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+
 	/*
 	 * There is always atleast 1 processor
 	 */
@@ -264,28 +308,26 @@ static inline void ucast_sendmsg (
 {
 	struct msghdr msg_ucast;
 	int res = 0;
-	size_t buf_out_len;
+	unsigned int iov_len;
 	unsigned char buf_out[FRAME_SIZE_MAX];
 	struct sockaddr_storage sockaddr;
-	struct iovec iovec;
+	struct iovec iovec[3];
 	int addrlen;
 
 	/*
 	 * Encrypt and digest the message
 	 */
-	if (crypto_encrypt_and_sign (
+	if (crypto_encrypt_and_sign_iov (
 		instance->crypto_inst,
 		(const unsigned char *)msg,
 		msg_len,
 		buf_out,
-		&buf_out_len) != 0) {
+		iovec,
+		&iov_len) != 0) {
 		log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
 		return;
 	}
 
-	iovec.iov_base = (void *)buf_out;
-	iovec.iov_len = buf_out_len;
-
 	/*
 	 * Build unicast message
 	 */
@@ -294,8 +336,8 @@ static inline void ucast_sendmsg (
 		instance->totem_interface->ip_port - 1, &sockaddr, &addrlen);
 	msg_ucast.msg_name = &sockaddr;
 	msg_ucast.msg_namelen = addrlen;
-	msg_ucast.msg_iov = (void *)&iovec;
-	msg_ucast.msg_iovlen = 1;
+	msg_ucast.msg_iov = (void *)iovec;
+	msg_ucast.msg_iovlen = iov_len;
 #ifdef HAVE_MSGHDR_CONTROL
 	msg_ucast.msg_control = 0;
 #endif
@@ -325,35 +367,16 @@ static inline void ucast_sendmsg (
 	}
 }
 
-static inline void mcast_sendmsg (
+static void mcast_send_iov (
 	struct totemudp_instance *instance,
-	const void *msg,
-	unsigned int msg_len)
+	struct iovec *iovec,
+	unsigned int iov_len)
 {
 	struct msghdr msg_mcast;
 	int res = 0;
-	size_t buf_out_len;
-	unsigned char buf_out[FRAME_SIZE_MAX];
-	struct iovec iovec;
 	struct sockaddr_storage sockaddr;
 	int addrlen;
 
-	/*
-	 * Encrypt and digest the message
-	 */
-	if (crypto_encrypt_and_sign (
-		instance->crypto_inst,
-		(const unsigned char *)msg,
-		msg_len,
-		buf_out,
-		&buf_out_len) != 0) {
-		log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
-		return;
-	}
-
-	iovec.iov_base = (void *)&buf_out;
-	iovec.iov_len = buf_out_len;
-
 	/*
 	 * Build multicast message
 	 */
@@ -362,8 +385,8 @@ static inline void mcast_sendmsg (
 	memset(&msg_mcast, 0, sizeof(msg_mcast));
 	msg_mcast.msg_name = &sockaddr;
 	msg_mcast.msg_namelen = addrlen;
-	msg_mcast.msg_iov = (void *)&iovec;
-	msg_mcast.msg_iovlen = 1;
+	msg_mcast.msg_iov = (void *)iovec;
+	msg_mcast.msg_iovlen = iov_len;
 #ifdef HAVE_MSGHDR_CONTROL
 	msg_mcast.msg_control = 0;
 #endif
@@ -409,6 +432,82 @@ static inline void mcast_sendmsg (
 	}
 }
 
+static inline void mcast_sendmsg (
+	struct totemudp_instance *instance,
+	const void *msg,
+	unsigned int msg_len)
+{
+	unsigned int iov_len;
+	unsigned char buf_out[FRAME_SIZE_MAX];
+	struct iovec iovec[3];
+
+	/*
+	 * Encrypt and digest the message
+	 */
+	if (crypto_encrypt_and_sign_iov (
+		instance->crypto_inst,
+		(const unsigned char *)msg,
+		msg_len,
+		buf_out,
+		iovec,
+		&iov_len) != 0) {
+		log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
+		return;
+	}
+
+	mcast_send_iov (instance, iovec, iov_len);
+}
+
+/*
+ * With crypto worker threads, frames sent without flush are queued and
+ * encrypted together by mcast_send_batch_flush. The caller's buffer may
+ * be released before the flush, so the frame is copied into the batch.
+ */
+static inline void mcast_send_batch_add (
+	struct totemudp_instance *instance,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct crypto_send_item *item;
+
+	memcpy (instance->send_batch_plain[instance->send_batch_entries],
+		msg, msg_len);
+
+	item = &instance->send_batch_items[instance->send_batch_entries];
+	item->buf_in = instance->send_batch_plain[instance->send_batch_entries];
+	item->buf_in_len = msg_len;
+	item->buf_out = instance->send_batch_buffer[instance->send_batch_entries];
+	item->iov_out = instance->send_batch_iov[instance->send_batch_entries];
+
+	instance->send_batch_entries++;
+}
+
+static void mcast_send_batch_flush (
+	struct totemudp_instance *instance)
+{
+	struct crypto_send_item *item;
+	int entries = instance->send_batch_entries;
+	int i;
+
+	if (entries == 0) {
+		return;
+	}
+
+	instance->send_batch_entries = 0;
+
+	crypto_encrypt_and_sign_iov_batch (instance->crypto_inst,
+		instance->send_batch_items, entries);
+
+	for (i = 0; i < entries; i++) {
+		item = &instance->send_batch_items[i];
+		if (item->res != 0) {
+			log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
+			continue;
+		}
+		mcast_send_iov (instance, item->iov_out, item->iov_out_len);
+	}
+}
+
 
 int totemudp_finalize (
 	void *udp_context)
@@ -436,6 +535,8 @@ int totemudp_finalize (
 		close (instance->totemudp_sockets.token);
 	}
 
+	crypto_workers_stop (instance->crypto_inst);
+
 	return (res);
 }
 
@@ -443,6 +544,102 @@ int totemudp_finalize (
  * Only designed to work with a message with one iov
  */
 
+static void net_deliver_decrypted_frame (
+	struct totemudp_instance *instance,
+	void *buf,
+	int bytes_received,
+	int res)
+{
+	char *message_type;
+
+	if (res == -1) {
+		log_printf (instance->totemudp_log_level_security, "Received message has invalid digest... ignoring.");
+		log_printf (instance->totemudp_log_level_security,
+			"Invalid packet data");
+		return;
+	}
+
+	/*
+	 * Drop all non-mcast messages (more specifically join
+	 * messages should be dropped)
+	 */
+	message_type = (char *)buf;
+	if (instance->flushing == 1 && *message_type == MESSAGE_TYPE_MEMB_JOIN) {
+		log_printf(instance->totemudp_log_level_warning, "JOIN or LEAVE message was thrown away during flush operation.");
+		return;
+	}
+
+	/*
+	 * Handle incoming message
+	 */
+	instance->totemudp_deliver_fn (
+		instance->context,
+		buf,
+		bytes_received);
+}
+
+/*
+ * Authenticate and if authenticated, decrypt datagram and deliver it
+ */
+static void net_deliver_frame (
+	struct totemudp_instance *instance,
+	void *buf,
+	int bytes_received)
+{
+	int res;
+
+	res = crypto_authenticate_and_decrypt (instance->crypto_inst, buf, &bytes_received);
+
+	net_deliver_decrypted_frame (instance, buf, bytes_received, res);
+}
+
+#ifdef HAVE_RECVMMSG
+/*
+ * Drain up to RECV_BATCH_MAX datagrams with a single syscall.  A flush
+ * started while delivering these uses the separate flush buffer, so the
+ * batch buffers stay intact.
+ */
+static int net_deliver_batch (
+	struct totemudp_instance *instance,
+	int fd)
+{
+	struct crypto_recv_item recv_items[RECV_BATCH_MAX];
+	int received;
+	int i;
+
+	for (i = 0; i < RECV_BATCH_MAX; i++) {
+		instance->recv_batch_msgs[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_storage);
+	}
+
+	received = recvmmsg (fd, instance->recv_batch_msgs, RECV_BATCH_MAX,
+		MSG_DONTWAIT, NULL);
+	if (received == -1) {
+		return (0);
+	}
+
+	for (i = 0; i < received; i++) {
+		instance->stats_recv += instance->recv_batch_msgs[i].msg_len;
+		recv_items[i].buf = (unsigned char *)instance->recv_batch_buffer[i];
+		recv_items[i].buf_len = instance->recv_batch_msgs[i].msg_len;
+	}
+
+	/*
+	 * Authenticate and decrypt the whole batch, then deliver in order
+	 */
+	crypto_authenticate_and_decrypt_batch (instance->crypto_inst,
+		recv_items, received);
+
+	for (i = 0; i < received; i++) {
+		net_deliver_decrypted_frame (instance,
+			recv_items[i].buf,
+			recv_items[i].buf_len,
+			recv_items[i].res);
+	}
+
+	return (0);
+}
+#endif
+
 static int net_deliver_fn (
 	int fd,
 	int revents,
@@ -453,8 +650,12 @@ static int net_deliver_fn (
 	struct iovec *iovec;
 	struct sockaddr_storage system_from;
 	int bytes_received;
-	int res = 0;
-	char *message_type;
+
+#ifdef HAVE_RECVMMSG
+	if (instance->flushing == 0) {
+		return (net_deliver_batch (instance, fd));
+	}
+#endif
 
 	if (instance->flushing == 1) {
 		iovec = &instance->totemudp_iov_recv_flush;
@@ -492,39 +693,8 @@ static int net_deliver_fn (
 		instance->stats_recv += bytes_received;
 	}
 
-	/*
-	 * Authenticate and if authenticated, decrypt datagram
-	 */
-	res = crypto_authenticate_and_decrypt (instance->crypto_inst, iovec->iov_base, &bytes_received);
-	if (res == -1) {
-		log_printf (instance->totemudp_log_level_security, "Received message has invalid digest... ignoring.");
-		log_printf (instance->totemudp_log_level_security,
-			"Invalid packet data");
-		iovec->iov_len = FRAME_SIZE_MAX;
-		return 0;
-	}
-	iovec->iov_len = bytes_received;
-
-	/*
-	 * Drop all non-mcast messages (more specifically join
-	 * messages should be dropped)
-	 */
-	message_type = (char *)iovec->iov_base;
-	if (instance->flushing == 1 && *message_type == MESSAGE_TYPE_MEMB_JOIN) {
-		log_printf(instance->totemudp_log_level_warning, "JOIN or LEAVE message was thrown away during flush operation.");
-		iovec->iov_len = FRAME_SIZE_MAX;
-		return (0);
-	}
-
-	/*
-	 * Handle incoming message
-	 */
-	instance->totemudp_deliver_fn (
-		instance->context,
-		iovec->iov_base,
-		iovec->iov_len);
+	net_deliver_frame (instance, iovec->iov_base, bytes_received);
 
-	iovec->iov_len = FRAME_SIZE_MAX;
 	return (0);
 }
 
@@ -1169,6 +1339,7 @@ int totemudp_initialize (
 		free(instance);
 		return (-1);
 	}
+	crypto_workers_start (instance->crypto_inst, totem_config->threads);
 	/*
 	 * Initialize local variables for totemudp
 	 */
@@ -1275,6 +1446,10 @@ int totemudp_recv_flush (void *udp_context)
 
 int totemudp_send_flush (void *udp_context)
 {
+	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
+
+	mcast_send_batch_flush (instance);
+
 	return 0;
 }
 
@@ -1286,6 +1461,10 @@ int totemudp_token_send (
 	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
 	int res = 0;
 
+	/*
+	 * Queued messages must reach the members before the token does
+	 */
+	mcast_send_batch_flush (instance);
 	ucast_sendmsg (instance, &instance->token_target, msg, msg_len);
 
 	return (res);
@@ -1298,6 +1477,7 @@ int totemudp_mcast_flush_send (
 	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
 	int res = 0;
 
+	mcast_send_batch_flush (instance);
 	mcast_sendmsg (instance, msg, msg_len);
 
 	return (res);
@@ -1311,7 +1491,15 @@ int totemudp_mcast_noflush_send (
 	struct totemudp_instance *instance = (struct totemudp_instance *)udp_context;
 	int res = 0;
 
-	mcast_sendmsg (instance, msg, msg_len);
+	if (crypto_workers_get (instance->crypto_inst) == 0) {
+		mcast_sendmsg (instance, msg, msg_len);
+		return (res);
+	}
+
+	if (instance->send_batch_entries == SEND_BATCH_MAX) {
+		mcast_send_batch_flush (instance);
+	}
+	mcast_send_batch_add (instance, msg, msg_len);
 
 	return (res);
 }
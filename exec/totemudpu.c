@@ -88,6 +88,17 @@
 #define BIND_STATE_REGULAR	1
 #define BIND_STATE_LOOPBACK	2
 
+/*
+ * Maximum number of datagrams drained by one recvmmsg call
+ */
+#define RECV_BATCH_MAX		16
+
+/*
+ * Maximum number of frames queued by mcast_noflush_send before they are
+ * sent to every member with one sendmmsg call per member
+ */
+#define SEND_BATCH_MAX		32
+
 struct totemudpu_member {
 	struct list_head list;
 	struct totem_ip_address member;
@@ -149,6 +160,16 @@ struct totemudpu_instance {
 
 	struct iovec totemudpu_iov_recv;
 
+#ifdef HAVE_RECVMMSG
+	char recv_batch_buffer[RECV_BATCH_MAX][FRAME_SIZE_MAX];
+
+	struct iovec recv_batch_iov[RECV_BATCH_MAX];
+
+	struct sockaddr_storage recv_batch_from[RECV_BATCH_MAX];
+
+	struct mmsghdr recv_batch_msgs[RECV_BATCH_MAX];
+#endif
+
 	struct list_head member_list;
 
 	int stats_sent;
@@ -184,6 +205,20 @@ struct totemudpu_instance {
 	int send_merge_detect_message;
 
 	unsigned int merge_detect_messages_sent_before_timeout;
+
+#ifdef HAVE_SENDMMSG
+	unsigned char send_batch_plain[SEND_BATCH_MAX][FRAME_SIZE_MAX];
+
+	unsigned char send_batch_buffer[SEND_BATCH_MAX][FRAME_SIZE_MAX];
+
+	struct iovec send_batch_iov[SEND_BATCH_MAX][3];
+
+	struct crypto_send_item send_batch_items[SEND_BATCH_MAX];
+
+	struct mmsghdr send_batch_msgs[SEND_BATCH_MAX];
+
+	int send_batch_entries;
+#endif
 };
 
 struct work_item {
@@ -214,6 +249,10 @@ static struct totem_ip_address localhost;
 
 static void totemudpu_instance_initialize (struct totemudpu_instance *instance)
 {
+#ifdef HAVE_RECVMMSG
+	int i;
+#endif
+
 	memset (instance, 0, sizeof (struct totemudpu_instance));
 
 	instance->netif_state_report = NETIF_STATE_REPORT_UP | NETIF_STATE_REPORT_DOWN;
@@ -222,6 +261,16 @@ static void totemudpu_instance_initialize (struct totemudpu_instance *instance)
 
 	instance->totemudpu_iov_recv.iov_len = FRAME_SIZE_MAX; //sizeof (instance->iov_buffer);
 
+#ifdef HAVE_RECVMMSG
+	for (i = 0; i < RECV_BATCH_MAX; i++) {
+		instance->recv_batch_iov[i].iov_base = instance->recv_batch_buffer[i];
+		instance->recv_batch_iov[i].iov_len = FRAME_SIZE_MAX;
+		instance->recv_batch_msgs[i].msg_hdr.msg_name = &instance->recv_batch_from[i];
+		instance->recv_batch_msgs[i].msg_hdr.msg_iov = &instance->recv_batch_iov[i];
+		instance->recv_batch_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+
 	/*
 	 * There is always atleast 1 processor
 	 */
@@ -265,28 +314,26 @@ static inline void ucast_sendmsg (
 {
 	struct msghdr msg_ucast;
 	int res = 0;
-	size_t buf_out_len;
+	unsigned int iov_len;
 	unsigned char buf_out[FRAME_SIZE_MAX];
 	struct sockaddr_storage sockaddr;
-	struct iovec iovec;
+	struct iovec iovec[3];
 	int addrlen;
 
 	/*
 	 * Encrypt and digest the message
 	 */
-	if (crypto_encrypt_and_sign (
+	if (crypto_encrypt_and_sign_iov (
 		instance->crypto_inst,
 		(const unsigned char *)msg,
 		msg_len,
 		buf_out,
-		&buf_out_len) != 0) {
+		iovec,
+		&iov_len) != 0) {
 		log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
 		return;
 	}
 
-	iovec.iov_base = (void *)buf_out;
-	iovec.iov_len = buf_out_len;
-
 	/*
 	 * Build unicast message
 	 */
@@ -295,8 +342,8 @@ static inline void ucast_sendmsg (
 	memset(&msg_ucast, 0, sizeof(msg_ucast));
 	msg_ucast.msg_name = &sockaddr;
 	msg_ucast.msg_namelen = addrlen;
-	msg_ucast.msg_iov = (void *)&iovec;
-	msg_ucast.msg_iovlen = 1;
+	msg_ucast.msg_iov = (void *)iovec;
+	msg_ucast.msg_iovlen = iov_len;
 #ifdef HAVE_MSGHDR_CONTROL
 	msg_ucast.msg_control = 0;
 #endif
@@ -333,9 +380,9 @@ static inline void mcast_sendmsg (
 {
 	struct msghdr msg_mcast;
 	int res = 0;
-	size_t buf_out_len;
+	unsigned int iov_len;
 	unsigned char buf_out[FRAME_SIZE_MAX];
-	struct iovec iovec;
+	struct iovec iovec[3];
 	struct sockaddr_storage sockaddr;
 	int addrlen;
         struct list_head *list;
@@ -344,19 +391,17 @@ static inline void mcast_sendmsg (
 	/*
 	 * Encrypt and digest the message
 	 */
-	if (crypto_encrypt_and_sign (
+	if (crypto_encrypt_and_sign_iov (
 		instance->crypto_inst,
 		(const unsigned char *)msg,
 		msg_len,
 		buf_out,
-		&buf_out_len) != 0) {
+		iovec,
+		&iov_len) != 0) {
 		log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
 		return;
 	}
 
-	iovec.iov_base = (void *)buf_out;
-	iovec.iov_len = buf_out_len;
-
 	memset(&msg_mcast, 0, sizeof(msg_mcast));
 	/*
 	 * Build multicast message
@@ -380,8 +425,8 @@ static inline void mcast_sendmsg (
 			instance->totem_interface->ip_port, &sockaddr, &addrlen);
 		msg_mcast.msg_name = &sockaddr;
 		msg_mcast.msg_namelen = addrlen;
-		msg_mcast.msg_iov = (void *)&iovec;
-		msg_mcast.msg_iovlen = 1;
+		msg_mcast.msg_iov = (void *)iovec;
+		msg_mcast.msg_iovlen = iov_len;
 	#ifdef HAVE_MSGHDR_CONTROL
 		msg_mcast.msg_control = 0;
 	#endif
@@ -418,6 +463,131 @@ static inline void mcast_sendmsg (
 	}
 }
 
+#ifdef HAVE_SENDMMSG
+/*
+ * Queue a frame to be sent to the members by mcast_send_batch_flush.
+ * Frames are encrypted at flush time, in parallel when crypto worker
+ * threads are configured. The caller's buffer may be released before
+ * the flush (the sort queue is freed when the ring changes), so the
+ * frame is copied into the batch slot here.
+ */
+static inline void mcast_send_batch_add (
+	struct totemudpu_instance *instance,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct crypto_send_item *item;
+
+	memcpy (instance->send_batch_plain[instance->send_batch_entries],
+		msg, msg_len);
+
+	item = &instance->send_batch_items[instance->send_batch_entries];
+	item->buf_in = instance->send_batch_plain[instance->send_batch_entries];
+	item->buf_in_len = msg_len;
+	item->buf_out = instance->send_batch_buffer[instance->send_batch_entries];
+	item->iov_out = instance->send_batch_iov[instance->send_batch_entries];
+
+	instance->send_batch_entries++;
+}
+
+/*
+ * Send all queued frames, one sendmmsg per member instead of one
+ * sendmsg per member and frame
+ */
+static void mcast_send_batch_flush (
+	struct totemudpu_instance *instance)
+{
+	struct sockaddr_storage sockaddr;
+	int addrlen;
+	struct list_head *list;
+	struct totemudpu_member *member;
+	int entries = instance->send_batch_entries;
+	int frame[SEND_BATCH_MAX];
+	int sent;
+	int i;
+
+	if (entries == 0) {
+		return;
+	}
+
+	instance->send_batch_entries = 0;
+
+	crypto_encrypt_and_sign_iov_batch (instance->crypto_inst,
+		instance->send_batch_items, entries);
+
+	/*
+	 * Frames which failed to encrypt are left out
+	 */
+	for (i = 0, sent = 0; i < entries; i++) {
+		if (instance->send_batch_items[i].res != 0) {
+			log_printf(LOGSYS_LEVEL_CRIT, "Error encrypting/signing packet (non-critical)");
+			continue;
+		}
+		frame[sent++] = i;
+	}
+	entries = sent;
+	if (entries == 0) {
+		return;
+	}
+
+	for (list = instance->member_list.next;
+		list != &instance->member_list;
+		list = list->next) {
+
+		member = list_entry (list,
+			struct totemudpu_member,
+			list);
+
+		/*
+		 * Same rule as mcast_sendmsg for "noflush" messages
+		 */
+		if (!member->active && !instance->send_merge_detect_message)
+			continue ;
+
+		totemip_totemip_to_sockaddr_convert(instance->my_id.scope_id, &member->member,
+			instance->totem_interface->ip_port, &sockaddr, &addrlen);
+
+		memset (instance->send_batch_msgs, 0,
+			entries * sizeof (struct mmsghdr));
+		for (i = 0; i < entries; i++) {
+			instance->send_batch_msgs[i].msg_hdr.msg_name = &sockaddr;
+			instance->send_batch_msgs[i].msg_hdr.msg_namelen = addrlen;
+			instance->send_batch_msgs[i].msg_hdr.msg_iov =
+				instance->send_batch_iov[frame[i]];
+			instance->send_batch_msgs[i].msg_hdr.msg_iovlen =
+				instance->send_batch_items[frame[i]].iov_out_len;
+		}
+
+		/*
+		 * Transmit multicast messages
+		 * An error here is recovered by totemsrp
+		 */
+		sent = sendmmsg (member->fd, instance->send_batch_msgs, entries, MSG_NOSIGNAL);
+		if (sent < 0) {
+			LOGSYS_PERROR (errno, instance->totemudpu_log_level_debug,
+				"sendmmsg(mcast) failed (non-critical)");
+			continue;
+		}
+		if (sent < entries) {
+			log_printf (instance->totemudpu_log_level_debug,
+				"sendmmsg(mcast) sent only %d of %d messages (non-critical)",
+				sent, entries);
+		}
+		if (sent > 1) {
+			instance->stats->tx_syscalls_saved += sent - 1;
+		}
+	}
+
+	if (instance->send_merge_detect_message) {
+		/*
+		 * Current messages were sent to all nodes
+		 */
+		instance->merge_detect_messages_sent_before_timeout++;
+		instance->send_merge_detect_message = 0;
+	}
+}
+#endif /* HAVE_SENDMMSG */
+
 int totemudpu_finalize (
 	void *udpu_context)
 {
@@ -432,9 +602,83 @@ int totemudpu_finalize (
 
 	totemudpu_stop_merge_detect_timeout(instance);
 
+	crypto_workers_stop (instance->crypto_inst);
+
 	return (res);
 }
 
+/*
+ * Deliver a frame after crypto_authenticate_and_decrypt returned res
+ */
+static void net_deliver_decrypted_frame (
+	struct totemudpu_instance *instance,
+	void *buf,
+	int bytes_received,
+	int res)
+{
+
+	if (res == -1) {
+		log_printf (instance->totemudpu_log_level_security, "Received message has invalid digest... ignoring.");
+		log_printf (instance->totemudpu_log_level_security,
+			"Invalid packet data");
+		return;
+	}
+
+	/*
+	 * Handle incoming message
+	 */
+	instance->totemudpu_deliver_fn (
+		instance->context,
+		buf,
+		bytes_received);
+}
+
+#ifdef HAVE_RECVMMSG
+/*
+ * Drain up to RECV_BATCH_MAX datagrams with a single syscall
+ */
+static int net_deliver_fn (
+	int fd,
+	int revents,
+	void *data)
+{
+	struct totemudpu_instance *instance = (struct totemudpu_instance *)data;
+	struct crypto_recv_item recv_items[RECV_BATCH_MAX];
+	int received;
+	int i;
+
+	for (i = 0; i < RECV_BATCH_MAX; i++) {
+		instance->recv_batch_msgs[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_storage);
+	}
+
+	received = recvmmsg (fd, instance->recv_batch_msgs, RECV_BATCH_MAX,
+		MSG_DONTWAIT, NULL);
+	if (received == -1) {
+		return (0);
+	}
+
+	for (i = 0; i < received; i++) {
+		instance->stats_recv += instance->recv_batch_msgs[i].msg_len;
+		recv_items[i].buf = (unsigned char *)instance->recv_batch_buffer[i];
+		recv_items[i].buf_len = instance->recv_batch_msgs[i].msg_len;
+	}
+
+	/*
+	 * Authenticate and decrypt the whole batch, then deliver in order
+	 */
+	crypto_authenticate_and_decrypt_batch (instance->crypto_inst,
+		recv_items, received);
+
+	for (i = 0; i < received; i++) {
+		net_deliver_decrypted_frame (instance,
+			recv_items[i].buf,
+			recv_items[i].buf_len,
+			recv_items[i].res);
+	}
+
+	return (0);
+}
+#else
 static int net_deliver_fn (
 	int fd,
 	int revents,
@@ -445,7 +689,7 @@ static int net_deliver_fn (
 	struct iovec *iovec;
 	struct sockaddr_storage system_from;
 	int bytes_received;
-	int res = 0;
+	int res;
 
 	iovec = &instance->totemudpu_iov_recv;
 
@@ -482,28 +726,14 @@ static int net_deliver_fn (
 	/*
 	 * Authenticate and if authenticated, decrypt datagram
 	 */
+	res = crypto_authenticate_and_decrypt (instance->crypto_inst,
+		iovec->iov_base, &bytes_received);
 
-	res = crypto_authenticate_and_decrypt (instance->crypto_inst, iovec->iov_base, &bytes_received);
-	if (res == -1) {
-		log_printf (instance->totemudpu_log_level_security, "Received message has invalid digest... ignoring.");
-		log_printf (instance->totemudpu_log_level_security,
-			"Invalid packet data");
-		iovec->iov_len = FRAME_SIZE_MAX;
-		return 0;
-	}
-	iovec->iov_len = bytes_received;
-
-	/*
-	 * Handle incoming message
-	 */
-	instance->totemudpu_deliver_fn (
-		instance->context,
-		iovec->iov_base,
-		iovec->iov_len);
+	net_deliver_decrypted_frame (instance, iovec->iov_base, bytes_received, res);
 
-	iovec->iov_len = FRAME_SIZE_MAX;
 	return (0);
 }
+#endif /* HAVE_RECVMMSG */
 
 static int netif_determine (
 	struct totemudpu_instance *instance,
@@ -819,6 +1049,7 @@ int totemudpu_initialize (
 		free(instance);
 		return (-1);
 	}
+	crypto_workers_start (instance->crypto_inst, totem_config->threads);
 	/*
 	 * Initialize local variables for totemudpu
 	 */
@@ -898,6 +1129,11 @@ int totemudpu_recv_flush (void *udpu_context)
 int totemudpu_send_flush (void *udpu_context)
 {
 	int res = 0;
+#ifdef HAVE_SENDMMSG
+	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
+
+	mcast_send_batch_flush (instance);
+#endif
 
 	return (res);
 }
@@ -910,6 +1146,12 @@ int totemudpu_token_send (
 	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
 	int res = 0;
 
+#ifdef HAVE_SENDMMSG
+	/*
+	 * Queued messages must reach the members before the token does
+	 */
+	mcast_send_batch_flush (instance);
+#endif
 	ucast_sendmsg (instance, &instance->token_target, msg, msg_len);
 
 	return (res);
@@ -922,6 +1164,9 @@ int totemudpu_mcast_flush_send (
 	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
 	int res = 0;
 
+#ifdef HAVE_SENDMMSG
+	mcast_send_batch_flush (instance);
+#endif
 	mcast_sendmsg (instance, msg, msg_len, 0);
 
 	return (res);
@@ -935,7 +1180,14 @@ int totemudpu_mcast_noflush_send (
 	struct totemudpu_instance *instance = (struct totemudpu_instance *)udpu_context;
 	int res = 0;
 
+#ifdef HAVE_SENDMMSG
+	if (instance->send_batch_entries == SEND_BATCH_MAX) {
+		mcast_send_batch_flush (instance);
+	}
+	mcast_send_batch_add (instance, msg, msg_len);
+#else
 	mcast_sendmsg (instance, msg, msg_len, 1);
+#endif
 
 	return (res);
 }
@@ -129,6 +129,18 @@ typedef void (*cmap_notify_fn_t) (
 	struct cmap_notify_value old_value,
 	void *user_data);
 
+/**
+ * Prototype for dump callback function. It's called by cmap_dump_prefix for every key,
+ * value is valid only until callback returns.
+ */
+typedef void (*cmap_dump_fn_t) (
+	cmap_handle_t cmap_handle,
+	const char *key_name,
+	const void *value,
+	size_t value_len,
+	cmap_value_types_t type,
+	void *user_data);
+
 /**
  * Create a new cmap connection
  *
@@ -321,6 +333,25 @@ extern cs_error_t cmap_iter_next(
  */
 extern cs_error_t cmap_iter_finalize(cmap_handle_t handle, cmap_iter_handle_t iter_handle);
 
+/**
+ * @brief Call dump_fn for every key (with value) starting with prefix.
+ *
+ * Keys are transferred in batches, so it's much faster than iteration followed by cmap_get
+ * of every key.
+ *
+ * @param handle cmap handle
+ * @param prefix prefix to dump, NULL for whole database
+ * @param dump_fn function called for every key
+ * @param user_data given pointer is unchanged passed to dump_fn
+ * @return CS_ERR_NOT_SUPPORTED if the executive is too old to dump keys, in
+ * which case dump_fn was not called and iteration has to be used instead
+ */
+extern cs_error_t cmap_dump_prefix(
+	cmap_handle_t handle,
+	const char *prefix,
+	cmap_dump_fn_t dump_fn,
+	void *user_data);
+
 /**
  * @brief Add tracking function for given key_name.
  *
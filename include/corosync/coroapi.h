@@ -40,6 +40,7 @@
 #ifdef HAVE_SYS_UIO_H
 #include <sys/uio.h>
 #endif
+#include <corosync/corotypes.h>
 #include <corosync/hdb.h>
 #include <qb/qbloop.h>
 #include <corosync/swab.h>
@@ -101,6 +102,7 @@ struct corosync_tpg_group {
 
 #define TOTEM_AGREED	0
 #define TOTEM_SAFE	1
+#define TOTEM_PRIORITY_CONTROL	0x10
 
 #define MILLI_2_NANO_SECONDS 1000000ULL
 
@@ -455,6 +457,13 @@ struct corosync_api_v1 {
 		qb_loop_t * handle,
 		int fd);
 
+	void *(*ipc_dispatch_buf_create) (const struct iovec *iov,
+					  unsigned int iov_len);
+
+	int (*ipc_dispatch_buf_send) (void *conn, void *buf);
+
+	void (*ipc_dispatch_buf_release) (void *buf);
+
 };
 
 #define SERVICE_ID_MAKE(a,b) ( ((a)<<16) | (b) )
@@ -469,6 +478,11 @@ struct corosync_api_v1 {
 struct corosync_lib_handler {
 	void (*lib_handler_fn) (void *conn, const void *msg);
 	enum cs_lib_flow_control flow_control;
+	/*
+	 * Optional, called instead of lib_handler_fn when the request is
+	 * rejected (flow control, invalid size) before reaching the handler
+	 */
+	void (*lib_drop_fn) (void *conn, const void *msg, cs_error_t error);
 };
 
 /**
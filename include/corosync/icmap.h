@@ -107,6 +107,27 @@ typedef void (*icmap_notify_fn_t) (
 	struct icmap_notify_value old_value,
 	void *user_data);
 
+/**
+ * One coalesced change passed to batch notify callback. Meaning of items is same as
+ * for icmap_notify_fn_t.
+ */
+struct icmap_notify_change {
+	int32_t event;
+	const char *key_name;
+	struct icmap_notify_value new_value;
+	struct icmap_notify_value old_value;
+};
+
+/**
+ * Prototype for batch notify callback function. It's called once per committed
+ * transaction with all changes matching the track (see icmap_track_set_batch_fn).
+ * Changes array is valid only during the callback.
+ */
+typedef void (*icmap_notify_batch_fn_t) (
+	const struct icmap_notify_change *changes,
+	size_t no_changes,
+	void *user_data);
+
 /**
  * @brief icmap type.
  *
@@ -127,6 +148,11 @@ typedef qb_map_iter_t *icmap_iter_t;
  */
 typedef struct icmap_track *icmap_track_t;
 
+/**
+ * @brief Counter type
+ */
+typedef struct icmap_counter *icmap_counter_t;
+
 /**
  * @brief Initialize global icmap
  * @return
@@ -439,6 +465,52 @@ extern cs_error_t icmap_fast_dec(const char *key_name);
  */
 extern cs_error_t icmap_fast_dec_r(const icmap_map_t map, const char *key_name);
 
+/**
+ * @brief Create counter handle for key_name.
+ *
+ * Counter resolves key only on first use (and again after key was replaced by
+ * icmap_set or deleted), so it's much cheaper than icmap_fast_inc for hot path
+ * statistics. Key doesn't need to exist when counter is created.
+ *
+ * @param key_name
+ * @param counter
+ * @return
+ */
+extern cs_error_t icmap_counter_create(const char *key_name, icmap_counter_t *counter);
+
+/**
+ * @brief icmap_counter_create_r
+ * @param map
+ * @param key_name
+ * @param counter
+ * @return
+ */
+extern cs_error_t icmap_counter_create_r(const icmap_map_t map, const char *key_name, icmap_counter_t *counter);
+
+/**
+ * @brief Add step to integer value of counter key.
+ *
+ * Semantics are same as icmap_fast_adjust_int (trackers are notified, but without old value).
+ *
+ * @param counter
+ * @param step
+ * @return
+ */
+extern cs_error_t icmap_counter_adjust(icmap_counter_t counter, int32_t step);
+
+/**
+ * @brief Increase value of counter key by one
+ * @param counter
+ * @return
+ */
+extern cs_error_t icmap_counter_inc(icmap_counter_t counter);
+
+/**
+ * @brief Destroy counter handle. Key itself is not deleted.
+ * @param counter
+ */
+extern void icmap_counter_destroy(icmap_counter_t counter);
+
 /**
  * @brief Initialize iterator with given prefix
  * @param prefix
@@ -508,6 +580,39 @@ extern void *icmap_track_get_user_data(icmap_track_t icmap_track);
  */
 extern cs_error_t icmap_track_delete(icmap_track_t icmap_track);
 
+/**
+ * @brief Set batch notify function for track.
+ *
+ * Changes made inside of transaction (see icmap_transaction_begin) are then passed
+ * to batch_fn in one call instead of calling notify_fn for each of them. Changes made
+ * outside of transaction are still passed to notify_fn. NULL batch_fn restores default
+ * behavior.
+ *
+ * @param icmap_track
+ * @param batch_fn
+ * @return
+ */
+extern cs_error_t icmap_track_set_batch_fn(icmap_track_t icmap_track, icmap_notify_batch_fn_t batch_fn);
+
+/**
+ * @brief Begin transaction on global icmap.
+ *
+ * Changes made inside of transaction are visible immediately, but notifications
+ * are deferred until icmap_transaction_commit. Multiple changes of one key are
+ * coalesced into one notification (or none if key ends with its original value).
+ * Transactions can be nested, notifications are sent when outermost transaction
+ * is committed.
+ *
+ * @return
+ */
+extern cs_error_t icmap_transaction_begin(void);
+
+/**
+ * @brief Commit transaction and send coalesced notifications to trackers.
+ * @return CS_ERR_BAD_OPERATION if there is no transaction in progress
+ */
+extern cs_error_t icmap_transaction_commit(void);
+
 /**
  * @brief Set read-only access for given key (key_name) or prefix,
  * If prefix is set. ro_access can be !0, which means, that old information
@@ -52,6 +52,7 @@ enum req_cmap_types {
 	MESSAGE_REQ_CMAP_ITER_FINALIZE = 6,
 	MESSAGE_REQ_CMAP_TRACK_ADD = 7,
 	MESSAGE_REQ_CMAP_TRACK_DELETE = 8,
+	MESSAGE_REQ_CMAP_DUMP_PREFIX = 9,
 };
 
 /**
@@ -68,8 +69,55 @@ enum res_cmap_types {
 	MESSAGE_RES_CMAP_TRACK_ADD = 7,
 	MESSAGE_RES_CMAP_TRACK_DELETE = 8,
 	MESSAGE_RES_CMAP_NOTIFY_CALLBACK = 9,
+	MESSAGE_RES_CMAP_DUMP_PREFIX = 10,
+	MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK = 11,
 };
 
+/**
+ * Set by library in req_lib_cmap_track_add track_type if it is able to handle
+ * MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK. Never passed to icmap.
+ */
+#define CMAP_TRACK_NOTIFY_BATCH	0x10000
+
+/**
+ * Key set by executives which know MESSAGE_REQ_CMAP_DUMP_PREFIX. Older executives
+ * don't check the request id against their handler table, so the request must
+ * not be sent to them.
+ */
+#define CMAP_DUMP_PREFIX_SUPPORTED_KEY	"runtime.services.cmap.dump_prefix"
+
+/**
+ * Maximum size of res_lib_cmap_dump_prefix including items. Must be able to hold
+ * at least one item with maximum key name and value length.
+ */
+#define CMAP_DUMP_PREFIX_RES_MAX_SIZE	(48 * 1024)
+
+/**
+ * Size of res_lib_cmap_dump_prefix_item with key name of key_len (without
+ * terminating zero) and value of value_len. Both item and value are 8 bytes aligned.
+ */
+#define CMAP_DUMP_PREFIX_VALUE_OFFSET(key_len)	(((key_len) + 1 + 7) & ~7)
+#define CMAP_DUMP_PREFIX_ITEM_SIZE(key_len, value_len)	\
+	((sizeof(struct res_lib_cmap_dump_prefix_item) +	\
+	CMAP_DUMP_PREFIX_VALUE_OFFSET(key_len) + (value_len) + 7) & ~7)
+
+/**
+ * Maximum size of res_lib_cmap_notify_batch_callback including items. Must be able
+ * to hold at least one item with maximum key name and two maximum values.
+ */
+#define CMAP_NOTIFY_BATCH_RES_MAX_SIZE	(48 * 1024)
+
+/**
+ * Offsets of new and old value in res_lib_cmap_notify_batch_item data and size of
+ * whole item. Key name, both values and item are 8 bytes aligned.
+ */
+#define CMAP_NOTIFY_BATCH_NEW_VALUE_OFFSET(key_len)	(((key_len) + 1 + 7) & ~7)
+#define CMAP_NOTIFY_BATCH_OLD_VALUE_OFFSET(key_len, new_value_len)	\
+	(CMAP_NOTIFY_BATCH_NEW_VALUE_OFFSET(key_len) + (((new_value_len) + 7) & ~7))
+#define CMAP_NOTIFY_BATCH_ITEM_SIZE(key_len, new_value_len, old_value_len)	\
+	((sizeof(struct res_lib_cmap_notify_batch_item) +			\
+	CMAP_NOTIFY_BATCH_OLD_VALUE_OFFSET(key_len, new_value_len) + (old_value_len) + 7) & ~7)
+
 /**
  * @brief The req_lib_cmap_set struct
  */
@@ -187,6 +235,44 @@ struct res_lib_cmap_iter_finalize {
 	struct qb_ipc_response_header header __attribute__((aligned(8)));
 };
 
+/**
+ * @brief The req_lib_cmap_dump_prefix struct
+ *
+ * First request has dump_handle 0 and prefix set. Following requests pass
+ * dump_handle returned by previous response.
+ */
+struct req_lib_cmap_dump_prefix {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+	mar_name_t prefix __attribute__((aligned(8)));
+	mar_uint64_t dump_handle __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cmap_dump_prefix struct
+ *
+ * dump_handle is 0 when there are no more keys to dump. Response is followed
+ * by no_items of res_lib_cmap_dump_prefix_item.
+ */
+struct res_lib_cmap_dump_prefix {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint64_t dump_handle __attribute__((aligned(8)));
+	mar_uint32_t no_items __attribute__((aligned(8)));
+	mar_uint8_t items[] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cmap_dump_prefix_item struct
+ *
+ * data contains zero terminated key name followed by value at
+ * CMAP_DUMP_PREFIX_VALUE_OFFSET(key_len).
+ */
+struct res_lib_cmap_dump_prefix_item {
+	mar_size_t value_len __attribute__((aligned(8)));
+	mar_uint16_t key_len __attribute__((aligned(8)));
+	mar_uint8_t type __attribute__((aligned(8)));
+	mar_uint8_t data[] __attribute__((aligned(8)));
+};
+
 /**
  * @brief The req_lib_cmap_track_add struct
  */
@@ -243,4 +329,33 @@ struct res_lib_cmap_notify_callback {
 	mar_uint8_t new_value[];
 };
 
+/**
+ * @brief The res_lib_cmap_notify_batch_callback struct
+ *
+ * Coalesced changes of one icmap transaction. Response is followed by no_items
+ * of res_lib_cmap_notify_batch_item. Big transactions are split into more messages.
+ */
+struct res_lib_cmap_notify_batch_callback {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint64_t track_inst_handle __attribute__((aligned(8)));
+	mar_uint32_t no_items __attribute__((aligned(8)));
+	mar_uint8_t items[] __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cmap_notify_batch_item struct
+ *
+ * data contains zero terminated key name followed by new value at
+ * CMAP_NOTIFY_BATCH_NEW_VALUE_OFFSET and old value at CMAP_NOTIFY_BATCH_OLD_VALUE_OFFSET.
+ */
+struct res_lib_cmap_notify_batch_item {
+	mar_int32_t event __attribute__((aligned(8)));
+	mar_uint16_t key_len __attribute__((aligned(8)));
+	mar_uint8_t new_value_type __attribute__((aligned(8)));
+	mar_uint8_t old_value_type __attribute__((aligned(8)));
+	mar_size_t new_value_len __attribute__((aligned(8)));
+	mar_size_t old_value_len __attribute__((aligned(8)));
+	mar_uint8_t data[] __attribute__((aligned(8)));
+};
+
 #endif /* IPC_CMAP_H_DEFINED */
@@ -59,6 +59,7 @@ enum req_cpg_types {
 	MESSAGE_REQ_CPG_ZC_FREE = 10,
 	MESSAGE_REQ_CPG_ZC_EXECUTE = 11,
 	MESSAGE_REQ_CPG_PARTIAL_MCAST = 12,
+	MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM = 13,
 };
 
 /**
@@ -291,6 +292,32 @@ struct res_lib_cpg_local_get {
 	mar_uint32_t local_nodeid __attribute__((aligned(8)));
 };
 
+/**
+ * The executive accepts MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM
+ */
+#define CPG_FEATURE_PARTIAL_MCAST_STREAM	(1 << 0)
+
+/**
+ * @brief The req_lib_cpg_local_get_features struct
+ *
+ * Sent as MESSAGE_REQ_CPG_LOCAL_GET to also ask for the features of the
+ * executive. Executives which only know req_lib_cpg_local_get ignore the
+ * features field and answer with res_lib_cpg_local_get.
+ */
+struct req_lib_cpg_local_get_features {
+	struct qb_ipc_request_header header __attribute__((aligned(8)));
+	mar_uint32_t features __attribute__((aligned(8)));
+};
+
+/**
+ * @brief The res_lib_cpg_local_get_features struct
+ */
+struct res_lib_cpg_local_get_features {
+	struct qb_ipc_response_header header __attribute__((aligned(8)));
+	mar_uint32_t local_nodeid __attribute__((aligned(8)));
+	mar_uint32_t features __attribute__((aligned(8)));
+};
+
 /**
  * @brief The res_lib_cpg_partial_send struct
  */
@@ -310,6 +337,12 @@ struct req_lib_cpg_mcast {
 
 /**
  * @brief The req_lib_cpg_partial_mcast struct
+ *
+ * Sent as MESSAGE_REQ_CPG_PARTIAL_MCAST, every fragment is answered with
+ * res_lib_cpg_partial_send. Fragments sent as
+ * MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM are not answered. Their result is
+ * reported by the answer to the next MESSAGE_REQ_CPG_PARTIAL_MCAST
+ * fragment of the same message.
  */
 struct req_lib_cpg_partial_mcast {
 	struct qb_ipc_response_header header __attribute__((aligned(8)));
@@ -37,19 +37,32 @@
 #include <errno.h>
 #include <string.h>
 
+/**
+ * SQ_BITMAP_WORD_BITS number of items tracked by one word of the presence
+ *	bitmap.
+ */
+#define SQ_BITMAP_WORD_BITS (sizeof (unsigned long) * 8)
+
 /**
  * @brief The sq struct
+ *
+ * Presence of items is kept in the items_inuse bitmap so holes can be
+ * found a word at a time. seqid_max is the highest seqid added since
+ * the queue was (re)initialized, items past it were never touched and
+ * need no reset. Miss counts can be bumped for any seqid in range and
+ * are always reset as a whole.
  */
 struct sq {
 	unsigned int head;
 	unsigned int size;
 	void *items;
-	unsigned int *items_inuse;
+	unsigned long *items_inuse;
 	unsigned int *items_miss_count;
 	unsigned int size_per_item;
 	unsigned int head_seqid;
 	unsigned int item_count;
 	unsigned int pos_max;
+	unsigned int seqid_max;
 };
 
 /*
@@ -107,6 +120,117 @@ static inline int sq_lte_compare (unsigned int a, unsigned int b) {
 	return (0);
 }
 
+/**
+ * @brief sq_bitmap_words
+ * @param item_count
+ * @return
+ */
+static inline unsigned int sq_bitmap_words (unsigned int item_count)
+{
+	return ((item_count + SQ_BITMAP_WORD_BITS - 1) / SQ_BITMAP_WORD_BITS);
+}
+
+/**
+ * @brief sq_bitmap_isset
+ * @param sq
+ * @param pos
+ * @return
+ */
+static inline int sq_bitmap_isset (const struct sq *sq, unsigned int pos)
+{
+	return ((sq->items_inuse[pos / SQ_BITMAP_WORD_BITS] >>
+		(pos % SQ_BITMAP_WORD_BITS)) & 1);
+}
+
+/**
+ * @brief sq_bitmap_clear_range clears count bits starting at pos, must not wrap
+ * @param sq
+ * @param pos
+ * @param count
+ */
+static inline void sq_bitmap_clear_range (
+	struct sq *sq,
+	unsigned int pos,
+	unsigned int count)
+{
+	unsigned int end = pos + count;
+	unsigned int word;
+	unsigned long mask;
+
+	while (pos < end) {
+		word = pos / SQ_BITMAP_WORD_BITS;
+		if (pos % SQ_BITMAP_WORD_BITS == 0 && end - pos >= SQ_BITMAP_WORD_BITS) {
+			sq->items_inuse[word] = 0;
+			pos += SQ_BITMAP_WORD_BITS;
+			continue;
+		}
+		mask = 1UL << (pos % SQ_BITMAP_WORD_BITS);
+		sq->items_inuse[word] &= ~mask;
+		pos++;
+	}
+}
+
+/**
+ * @brief sq_positions_clear resets presence and miss counts of count
+ *	positions starting at pos, wrapping at the end of the queue
+ * @param sq
+ * @param pos
+ * @param count
+ */
+static inline void sq_positions_clear (
+	struct sq *sq,
+	unsigned int pos,
+	unsigned int count)
+{
+	unsigned int first;
+
+	if (count > sq->size) {
+		count = sq->size;
+	}
+	first = sq->size - pos;
+	if (first > count) {
+		first = count;
+	}
+	sq_bitmap_clear_range (sq, pos, first);
+	memset (&sq->items_miss_count[pos], 0, first * sizeof (unsigned int));
+	if (count > first) {
+		sq_bitmap_clear_range (sq, 0, count - first);
+		memset (sq->items_miss_count, 0, (count - first) * sizeof (unsigned int));
+	}
+}
+
+/**
+ * @brief sq_used_count number of positions from head which may have been
+ *	touched since the queue was (re)initialized
+ * @param sq
+ * @return
+ */
+static inline unsigned int sq_used_count (const struct sq *sq)
+{
+	unsigned int count;
+
+	if (sq_lt_compare (sq->seqid_max, sq->head_seqid)) {
+		return (0);
+	}
+	count = sq->seqid_max - sq->head_seqid + 1;
+	if (count > sq->size) {
+		count = sq->size;
+	}
+	return (count);
+}
+
+/**
+ * @brief sq_seqid_touch
+ * @param sq
+ * @param seqid
+ */
+static inline void sq_seqid_touch (struct sq *sq, unsigned int seqid)
+{
+	if (sq_lt_compare (sq->seqid_max, seqid)) {
+		sq->seqid_max = seqid;
+	}
+}
+
 /**
  * @brief sq_init
  * @param sq
@@ -127,6 +251,7 @@ static inline int sq_init (
 	sq->head_seqid = head_seqid;
 	sq->item_count = item_count;
 	sq->pos_max = 0;
+	sq->seqid_max = head_seqid - 1;
 
 	sq->items = malloc (item_count * size_per_item);
 	if (sq->items == NULL) {
@@ -134,33 +259,35 @@ static inline int sq_init (
 	}
 	memset (sq->items, 0, item_count * size_per_item);
 
-	if ((sq->items_inuse = malloc (item_count * sizeof (unsigned int)))
-	    == NULL) {
+	if ((sq->items_inuse = malloc (sq_bitmap_words (item_count) *
+	    sizeof (unsigned long))) == NULL) {
 		return (-ENOMEM);
 	}
 	if ((sq->items_miss_count = malloc (item_count * sizeof (unsigned int)))
 	    == NULL) {
 		return (-ENOMEM);
 	}
-	memset (sq->items_inuse, 0, item_count * sizeof (unsigned int));
+	memset (sq->items_inuse, 0, sq_bitmap_words (item_count) * sizeof (unsigned long));
 	memset (sq->items_miss_count, 0, item_count * sizeof (unsigned int));
 	return (0);
 }
 
 /**
- * @brief sq_reinit
+ * @brief sq_reinit only resets the positions used since the last
+ *	(re)initialization and the miss counts, items are never read unless
+ *	in use so they are left as they are
  * @param sq
  * @param head_seqid
  */
 static inline void sq_reinit (struct sq *sq, unsigned int head_seqid)
 {
+	sq_positions_clear (sq, sq->head, sq_used_count (sq));
+	memset (sq->items_miss_count, 0, sq->item_count * sizeof (unsigned int));
+
 	sq->head = 0;
 	sq->head_seqid = head_seqid;
 	sq->pos_max = 0;
-
-	memset (sq->items, 0, sq->item_count * sq->size_per_item);
-	memset (sq->items_inuse, 0, sq->item_count * sizeof (unsigned int));
-	memset (sq->items_miss_count, 0, sq->item_count * sizeof (unsigned int));
+	sq->seqid_max = head_seqid - 1;
 }
 
 /**
@@ -175,30 +302,53 @@ static inline void sq_assert (const struct sq *sq, unsigned int pos)
 //	printf ("Instrument[%d] Asserting from %d to %d\n",
 //		pos, sq->pos_max, sq->size);
 	for (i = sq->pos_max + 1; i < sq->size; i++) {
-		assert (sq->items_inuse[i] == 0);
+		if (i % SQ_BITMAP_WORD_BITS == 0 && sq->size - i >= SQ_BITMAP_WORD_BITS) {
+			assert (sq->items_inuse[i / SQ_BITMAP_WORD_BITS] == 0);
+			i += SQ_BITMAP_WORD_BITS - 1;
+			continue;
+		}
+		assert (sq_bitmap_isset (sq, i) == 0);
 	}
 }
 
 /**
- * @brief sq_copy
+ * @brief sq_copy copies the used range and the miss counts of sq_src,
+ *	both queues must have the same item count and item size
  * @param sq_dest
  * @param sq_src
  */
 static inline void sq_copy (struct sq *sq_dest, const struct sq *sq_src)
 {
+	unsigned int count;
+	unsigned int first;
+
 	sq_assert (sq_src, 20);
+	sq_positions_clear (sq_dest, sq_dest->head, sq_used_count (sq_dest));
+
 	sq_dest->head = sq_src->head;
 	sq_dest->size = sq_src->item_count;
 	sq_dest->size_per_item = sq_src->size_per_item;
 	sq_dest->head_seqid = sq_src->head_seqid;
 	sq_dest->item_count = sq_src->item_count;
 	sq_dest->pos_max = sq_src->pos_max;
-	memcpy (sq_dest->items, sq_src->items,
-		sq_src->item_count * sq_src->size_per_item);
-	memcpy (sq_dest->items_inuse, sq_src->items_inuse,
-		sq_src->item_count * sizeof (unsigned int));
+	sq_dest->seqid_max = sq_src->seqid_max;
+
+	count = sq_used_count (sq_src);
+	first = sq_src->size - sq_src->head;
+	if (first > count) {
+		first = count;
+	}
+	memcpy ((char *)sq_dest->items + sq_src->head * sq_src->size_per_item,
+		(char *)sq_src->items + sq_src->head * sq_src->size_per_item,
+		first * sq_src->size_per_item);
+	if (count > first) {
+		memcpy (sq_dest->items, sq_src->items,
+			(count - first) * sq_src->size_per_item);
+	}
 	memcpy (sq_dest->items_miss_count, sq_src->items_miss_count,
 		sq_src->item_count * sizeof (unsigned int));
+	memcpy (sq_dest->items_inuse, sq_src->items_inuse,
+		sq_bitmap_words (sq_src->item_count) * sizeof (unsigned long));
 }
 
 /**
@@ -230,16 +380,14 @@ static inline void *sq_item_add (
 	if (sq_position > sq->pos_max) {
 		sq->pos_max = sq_position;
 	}
+	sq_seqid_touch (sq, seqid);
 
 	sq_item = sq->items;
 	sq_item += sq_position * sq->size_per_item;
-	assert(sq->items_inuse[sq_position] == 0);
+	assert(sq_bitmap_isset (sq, sq_position) == 0);
 	memcpy (sq_item, item, sq->size_per_item);
-	if (seqid == 0) {
-		sq->items_inuse[sq_position] = 1;
-	} else {
-		sq->items_inuse[sq_position] = seqid;
-	}
+	sq->items_inuse[sq_position / SQ_BITMAP_WORD_BITS] |=
+		1UL << (sq_position % SQ_BITMAP_WORD_BITS);
 	sq->items_miss_count[sq_position] = 0;
 
 	return (sq_item);
@@ -270,7 +418,68 @@ static inline unsigned int sq_item_inuse (
 	}
 #endif
 	sq_position = (sq->head - sq->head_seqid + seq_id) % sq->size;
-	return (sq->items_inuse[sq_position] != 0);
+	return (sq_bitmap_isset (sq, sq_position));
+}
+
+/**
+ * @brief sq_item_next_missing finds the first seqid from seq_id to
+ *	seq_id_last which is not in use, checking a bitmap word at a time
+ * @param sq
+ * @param seq_id
+ * @param seq_id_last
+ * @return the missing seqid, seq_id_last + 1 if all items are in use.
+ *	Items past the end of the queue count as missing, so the result
+ *	has to be checked with sq_in_range.
+ */
+static inline unsigned int sq_item_next_missing (
+	const struct sq *sq,
+	unsigned int seq_id,
+	unsigned int seq_id_last)
+{
+	unsigned int remaining;
+	unsigned int offset;
+	unsigned int pos;
+	unsigned int chunk;
+	unsigned int bit;
+	unsigned long word;
+
+	if (sq_lt_compare (seq_id_last, seq_id)) {
+		return (seq_id);
+	}
+	offset = seq_id - sq->head_seqid;
+	if (offset >= sq->size) {
+		return (seq_id);
+	}
+	remaining = seq_id_last - seq_id + 1;
+	if (remaining > sq->size - offset) {
+		remaining = sq->size - offset;
+	}
+	pos = sq->head + offset;
+	if (pos >= sq->size) {
+		pos -= sq->size;
+	}
+
+	while (remaining > 0) {
+		bit = pos % SQ_BITMAP_WORD_BITS;
+		word = ~sq->items_inuse[pos / SQ_BITMAP_WORD_BITS] >> bit;
+		chunk = SQ_BITMAP_WORD_BITS - bit;
+		if (chunk > sq->size - pos) {
+			chunk = sq->size - pos;
+		}
+		if (chunk > remaining) {
+			chunk = remaining;
+		}
+		if (word != 0 && (unsigned int)__builtin_ctzl (word) < chunk) {
+			return (seq_id + __builtin_ctzl (word));
+		}
+		seq_id += chunk;
+		remaining -= chunk;
+		pos += chunk;
+		if (pos == sq->size) {
+			pos = 0;
+		}
+	}
+	return (seq_id);
 }
 
 /**
@@ -365,7 +574,7 @@ static inline unsigned int sq_item_get (
 //	sq_position = (sq->head - sq->head_seqid + seq_id) % sq->size;
 //printf ("sq_position = %x\n", sq_position);
 //printf ("ITEMGET %d %d %d %d\n", sq_position, sq->head, sq->head_seqid, seq_id);
-	if (sq->items_inuse[sq_position] == 0) {
+	if (sq_bitmap_isset (sq, sq_position) == 0) {
 		return (ENOENT);
 	}
 	sq_item = sq->items;
@@ -386,18 +595,7 @@ static inline void sq_items_release (struct sq *sq, unsigned int seqid)
 	oldhead = sq->head;
 
 	sq->head = (sq->head + seqid - sq->head_seqid + 1) % sq->size;
-	if ((oldhead + seqid - sq->head_seqid + 1) > sq->size) {
-//		printf ("releasing %d for %d\n", oldhead, sq->size - oldhead);
-//		printf ("releasing %d for %d\n", 0, sq->head);
-		memset (&sq->items_inuse[oldhead], 0, (sq->size - oldhead) * sizeof (unsigned int));
-		memset (sq->items_inuse, 0, sq->head * sizeof (unsigned int));
-	} else {
-//		printf ("releasing %d for %d\n", oldhead, seqid - sq->head_seqid + 1);
-		memset (&sq->items_inuse[oldhead], 0,
-			(seqid - sq->head_seqid + 1) * sizeof (unsigned int));
-		memset (&sq->items_miss_count[oldhead], 0,
-			(seqid - sq->head_seqid + 1) * sizeof (unsigned int));
-	}
+	sq_positions_clear (sq, oldhead, seqid - sq->head_seqid + 1);
 	sq->head_seqid = seqid + 1;
 }
 
@@ -35,6 +35,7 @@
 #ifndef TOTEM_H_DEFINED
 #define TOTEM_H_DEFINED
 #include "totemip.h"
+#include "totemhist.h"
 #include <corosync/hdb.h>
 
 #ifdef HAVE_SMALL_MEMORY_FOOTPRINT
@@ -52,6 +53,14 @@
 #define SEND_THREADS_MAX	16
 #define INTERFACE_MAX		2
 
+/*
+ * Lanes of new messages.  On receipt of the token control lane messages
+ * are sent ahead of bulk ones.
+ */
+#define TOTEM_LANE_BULK		0
+#define TOTEM_LANE_CONTROL	1
+#define TOTEM_LANES		2
+
 /**
  * Maximum number of continuous gather states
  */
@@ -96,7 +105,8 @@ enum { TOTEM_RRP_MODE_BYTES = 64 };
 typedef enum {
 	TOTEM_TRANSPORT_UDP = 0,
 	TOTEM_TRANSPORT_UDPU = 1,
-	TOTEM_TRANSPORT_RDMA = 2
+	TOTEM_TRANSPORT_RDMA = 2,
+	TOTEM_TRANSPORT_LOOPBACK = 3
 } totem_transport_t;
 
 #define MEMB_RING_ID
@@ -195,6 +205,10 @@ struct totem_config {
 	void (*totem_memb_ring_id_store) (
 	    const struct memb_ring_id *memb_ring_id,
 	    const struct totem_ip_address *addr);
+
+	unsigned int fcc_adaptive;
+
+	unsigned int priority_lanes;
 };
 
 #define TOTEM_CONFIGURATION_TYPE
@@ -273,6 +287,28 @@ typedef struct {
 #define TOTEM_TOKEN_STATS_MAX 100
 	totemsrp_token_stats_t token[TOTEM_TOKEN_STATS_MAX];
 
+	uint64_t tx_syscalls_saved;
+	uint32_t fcc_window_size;
+	uint32_t fcc_max_messages;
+	uint32_t fcc_token_rotation;
+	uint64_t fcc_decreases;
+
+	/*
+	 * Latencies in microseconds
+	 */
+	struct totem_histogram token_rotation_hist;
+	struct totem_histogram token_hold_hist;
+	struct totem_histogram mcast_latency_hist;
+
+	uint32_t frame_pool_size;
+	uint32_t frame_pool_in_use;
+	uint32_t frame_pool_in_use_max;
+	uint64_t frame_pool_overflow;
+	uint64_t frame_pool_bytes;
+	uint64_t frame_pool_bytes_in_use;
+	uint64_t frame_pool_bytes_in_use_max;
+	uint64_t mcast_tx_control;
+
 } totemsrp_stats_t;
 
  
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Log-linear latency histogram
+ *
+ * Values are bucketed by their highest set bit and the
+ * TOTEM_HISTOGRAM_SUB_BITS bits below it, so every bucket is at most
+ * 1/8 of its value wide. Recording is a few instructions and no
+ * allocation, percentiles are computed by the reader.
+ */
+
+#ifndef TOTEMHIST_H_DEFINED
+#define TOTEMHIST_H_DEFINED
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOTEM_HISTOGRAM_SUB_BITS	3
+#define TOTEM_HISTOGRAM_SUB_COUNT	(1 << TOTEM_HISTOGRAM_SUB_BITS)
+#define TOTEM_HISTOGRAM_BUCKETS		((32 - TOTEM_HISTOGRAM_SUB_BITS + 1) << TOTEM_HISTOGRAM_SUB_BITS)
+
+struct totem_histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[TOTEM_HISTOGRAM_BUCKETS];
+};
+
+static inline unsigned int totem_histogram_index (uint64_t value)
+{
+	unsigned int bit;
+
+	if (value > UINT32_MAX) {
+		value = UINT32_MAX;
+	}
+	if (value < TOTEM_HISTOGRAM_SUB_COUNT) {
+		return ((unsigned int)value);
+	}
+	bit = 31 - __builtin_clz ((uint32_t)value);
+
+	return (((bit - TOTEM_HISTOGRAM_SUB_BITS + 1) << TOTEM_HISTOGRAM_SUB_BITS) +
+		((value >> (bit - TOTEM_HISTOGRAM_SUB_BITS)) & (TOTEM_HISTOGRAM_SUB_COUNT - 1)));
+}
+
+/*
+ * Highest value which falls into bucket idx
+ */
+static inline uint64_t totem_histogram_bucket_value (unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < TOTEM_HISTOGRAM_SUB_COUNT) {
+		return (idx);
+	}
+	shift = (idx >> TOTEM_HISTOGRAM_SUB_BITS) - 1;
+
+	return ((((uint64_t)(idx & (TOTEM_HISTOGRAM_SUB_COUNT - 1)) + TOTEM_HISTOGRAM_SUB_COUNT + 1) << shift) - 1);
+}
+
+static inline void totem_histogram_record (
+	struct totem_histogram *hist,
+	uint64_t value)
+{
+	hist->bucket[totem_histogram_index (value)]++;
+	hist->count++;
+	hist->sum += value;
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+static inline void totem_histogram_reset (struct totem_histogram *hist)
+{
+	memset (hist, 0, sizeof (struct totem_histogram));
+}
+
+/*
+ * dst = cur - prev, for reporting samples recorded since prev was taken.
+ * max can't be subtracted, it is taken from the highest non empty bucket.
+ */
+static inline void totem_histogram_diff (
+	struct totem_histogram *dst,
+	const struct totem_histogram *cur,
+	const struct totem_histogram *prev)
+{
+	unsigned int i;
+
+	dst->count = cur->count - prev->count;
+	dst->sum = cur->sum - prev->sum;
+	dst->max = 0;
+	for (i = 0; i < TOTEM_HISTOGRAM_BUCKETS; i++) {
+		dst->bucket[i] = cur->bucket[i] - prev->bucket[i];
+		if (dst->bucket[i] != 0) {
+			dst->max = totem_histogram_bucket_value (i);
+		}
+	}
+	if (dst->max > cur->max) {
+		dst->max = cur->max;
+	}
+}
+
+/*
+ * Value at or below which permille/1000 of the samples fall
+ */
+static inline uint64_t totem_histogram_percentile (
+	const struct totem_histogram *hist,
+	unsigned int permille)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	if (hist->count == 0) {
+		return (0);
+	}
+	rank = (hist->count * permille + 999) / 1000;
+	if (rank == 0) {
+		rank = 1;
+	}
+	for (i = 0; i < TOTEM_HISTOGRAM_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= rank) {
+			break;
+		}
+	}
+	if (i == TOTEM_HISTOGRAM_BUCKETS ||
+	    totem_histogram_bucket_value (i) > hist->max) {
+		return (hist->max);
+	}
+
+	return (totem_histogram_bucket_value (i));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TOTEMHIST_H_DEFINED */
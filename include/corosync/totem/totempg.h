@@ -60,6 +60,12 @@ struct totempg_group {
 #define TOTEMPG_AGREED			0
 #define TOTEMPG_SAFE			1
 
+/*
+ * Or'ed into guarantee to send a message on the control lane, ahead of
+ * bulk messages.  Only effective with totem.priority_lanes enabled.
+ */
+#define TOTEMPG_PRIORITY_CONTROL	0x10
+
 /**
  * Initialize the totem process groups abstraction
  */
@@ -54,10 +54,20 @@
 #include "util.h"
 #include <stdio.h>
 
+/*
+ * Does the executive know MESSAGE_REQ_CMAP_DUMP_PREFIX?
+ */
+enum cmap_dump_prefix_support {
+	CMAP_DUMP_PREFIX_UNKNOWN = 0,
+	CMAP_DUMP_PREFIX_SUPPORTED = 1,
+	CMAP_DUMP_PREFIX_UNSUPPORTED = 2,
+};
+
 struct cmap_inst {
 	int finalize;
 	qb_ipcc_connection_t *c;
 	const void *context;
+	enum cmap_dump_prefix_support dump_prefix;
 };
 
 struct cmap_track_inst {
@@ -104,6 +114,7 @@ cs_error_t cmap_initialize (cmap_handle_t *handle)
 
 	error = CS_OK;
 	cmap_inst->finalize = 0;
+	cmap_inst->dump_prefix = CMAP_DUMP_PREFIX_UNKNOWN;
 	cmap_inst->c = qb_ipcc_connect("cmap", IPC_REQUEST_SIZE);
 	if (cmap_inst->c == NULL) {
 		error = qb_to_cs_error(-errno);
@@ -195,6 +206,10 @@ cs_error_t cmap_dispatch (
 	struct qb_ipc_response_header *dispatch_data;
 	char dispatch_buf[IPC_DISPATCH_SIZE];
 	struct res_lib_cmap_notify_callback *res_lib_cmap_notify_callback;
+	struct res_lib_cmap_notify_batch_callback *res_lib_cmap_notify_batch_callback;
+	struct res_lib_cmap_notify_batch_item *item;
+	size_t offset;
+	uint32_t i;
 	struct cmap_track_inst *cmap_track_inst;
 	struct cmap_notify_value old_val;
 	struct cmap_notify_value new_val;
@@ -280,6 +295,53 @@ cs_error_t cmap_dispatch (
 
 			(void)hdb_handle_put(&cmap_track_handle_t_db, res_lib_cmap_notify_callback->track_inst_handle);
 			break;
+		case MESSAGE_RES_CMAP_NOTIFY_BATCH_CALLBACK:
+			res_lib_cmap_notify_batch_callback = (struct res_lib_cmap_notify_batch_callback *)dispatch_data;
+
+			offset = 0;
+			for (i = 0; i < res_lib_cmap_notify_batch_callback->no_items && !cmap_inst->finalize; i++) {
+				item = (struct res_lib_cmap_notify_batch_item *)
+				    (res_lib_cmap_notify_batch_callback->items + offset);
+				offset += CMAP_NOTIFY_BATCH_ITEM_SIZE(item->key_len,
+				    item->new_value_len, item->old_value_len);
+
+				/*
+				 * Handle is checked for every item because notify_fn may delete the tracker
+				 */
+				error = hdb_error_to_cs(hdb_handle_get(&cmap_track_handle_t_db,
+						res_lib_cmap_notify_batch_callback->track_inst_handle,
+						(void *)&cmap_track_inst));
+				if (error == CS_ERR_BAD_HANDLE) {
+					/*
+					 * User deleted tracker -> ignore error
+					 */
+					error = CS_OK;
+					break;
+				}
+				if (error != CS_OK) {
+					goto error_put;
+				}
+
+				new_val.type = item->new_value_type;
+				old_val.type = item->old_value_type;
+				new_val.len = item->new_value_len;
+				old_val.len = item->old_value_len;
+				new_val.data = item->data + CMAP_NOTIFY_BATCH_NEW_VALUE_OFFSET(item->key_len);
+				old_val.data = item->data +
+				    CMAP_NOTIFY_BATCH_OLD_VALUE_OFFSET(item->key_len, item->new_value_len);
+
+				cmap_track_inst->notify_fn(handle,
+						cmap_track_inst->track_handle,
+						item->event,
+						(char *)item->data,
+						new_val,
+						old_val,
+						cmap_track_inst->user_data);
+
+				(void)hdb_handle_put(&cmap_track_handle_t_db,
+				    res_lib_cmap_notify_batch_callback->track_inst_handle);
+			}
+			break;
 		default:
 			error = CS_ERR_LIBRARY;
 			goto error_put;
@@ -930,6 +992,146 @@ cs_error_t cmap_iter_finalize(
 	return (error);
 }
 
+/*
+ * Find out if the executive knows MESSAGE_REQ_CMAP_DUMP_PREFIX by looking up
+ * CMAP_DUMP_PREFIX_SUPPORTED_KEY, which only newer executives set
+ */
+static cs_error_t cmap_dump_prefix_check(struct cmap_inst *cmap_inst)
+{
+	cs_error_t error;
+	struct iovec iov;
+	struct req_lib_cmap_get req_lib_cmap_get;
+	struct res_lib_cmap_get res_lib_cmap_get;
+
+	memset(&req_lib_cmap_get, 0, sizeof(req_lib_cmap_get));
+	req_lib_cmap_get.header.size = sizeof(req_lib_cmap_get);
+	req_lib_cmap_get.header.id = MESSAGE_REQ_CMAP_GET;
+
+	memcpy(req_lib_cmap_get.key_name.value, CMAP_DUMP_PREFIX_SUPPORTED_KEY,
+	    strlen(CMAP_DUMP_PREFIX_SUPPORTED_KEY));
+	req_lib_cmap_get.key_name.length = strlen(CMAP_DUMP_PREFIX_SUPPORTED_KEY);
+	req_lib_cmap_get.value_len = 0;
+
+	iov.iov_base = (char *)&req_lib_cmap_get;
+	iov.iov_len = sizeof(req_lib_cmap_get);
+
+	error = qb_to_cs_error(qb_ipcc_sendv_recv(
+		cmap_inst->c,
+		&iov,
+		1,
+		&res_lib_cmap_get,
+		sizeof(res_lib_cmap_get), CS_IPC_TIMEOUT_MS));
+
+	if (error == CS_OK) {
+		error = res_lib_cmap_get.header.error;
+	}
+
+	if (error == CS_OK) {
+		cmap_inst->dump_prefix = CMAP_DUMP_PREFIX_SUPPORTED;
+	} else if (error == CS_ERR_NOT_EXIST) {
+		cmap_inst->dump_prefix = CMAP_DUMP_PREFIX_UNSUPPORTED;
+		error = CS_OK;
+	}
+
+	return (error);
+}
+
+cs_error_t cmap_dump_prefix(
+	cmap_handle_t handle,
+	const char *prefix,
+	cmap_dump_fn_t dump_fn,
+	void *user_data)
+{
+	cs_error_t error;
+	struct iovec iov;
+	struct cmap_inst *cmap_inst;
+	struct req_lib_cmap_dump_prefix req_lib_cmap_dump_prefix;
+	struct res_lib_cmap_dump_prefix *res_lib_cmap_dump_prefix;
+	struct res_lib_cmap_dump_prefix_item *item;
+	size_t offset;
+	uint32_t i;
+
+	if (dump_fn == NULL) {
+		return (CS_ERR_INVALID_PARAM);
+	}
+
+	if (prefix != NULL && strlen(prefix) >= CS_MAX_NAME_LENGTH) {
+		return (CS_ERR_NAME_TOO_LONG);
+	}
+
+	error = hdb_error_to_cs(hdb_handle_get (&cmap_handle_t_db, handle, (void *)&cmap_inst));
+	if (error != CS_OK) {
+		return (error);
+	}
+
+	if (cmap_inst->dump_prefix == CMAP_DUMP_PREFIX_UNKNOWN) {
+		error = cmap_dump_prefix_check(cmap_inst);
+		if (error != CS_OK) {
+			goto error_put;
+		}
+	}
+
+	if (cmap_inst->dump_prefix != CMAP_DUMP_PREFIX_SUPPORTED) {
+		error = CS_ERR_NOT_SUPPORTED;
+		goto error_put;
+	}
+
+	res_lib_cmap_dump_prefix = malloc(CMAP_DUMP_PREFIX_RES_MAX_SIZE);
+	if (res_lib_cmap_dump_prefix == NULL) {
+		error = CS_ERR_NO_MEMORY;
+		goto error_put;
+	}
+
+	memset(&req_lib_cmap_dump_prefix, 0, sizeof(req_lib_cmap_dump_prefix));
+	req_lib_cmap_dump_prefix.header.size = sizeof(req_lib_cmap_dump_prefix);
+	req_lib_cmap_dump_prefix.header.id = MESSAGE_REQ_CMAP_DUMP_PREFIX;
+
+	if (prefix) {
+		memcpy(req_lib_cmap_dump_prefix.prefix.value, prefix, strlen(prefix));
+		req_lib_cmap_dump_prefix.prefix.length = strlen(prefix);
+	}
+
+	iov.iov_base = (char *)&req_lib_cmap_dump_prefix;
+	iov.iov_len = sizeof(req_lib_cmap_dump_prefix);
+
+	do {
+		error = qb_to_cs_error(qb_ipcc_sendv_recv(
+			cmap_inst->c,
+			&iov,
+			1,
+			res_lib_cmap_dump_prefix,
+			CMAP_DUMP_PREFIX_RES_MAX_SIZE, CS_IPC_TIMEOUT_MS));
+
+		if (error == CS_OK) {
+			error = res_lib_cmap_dump_prefix->header.error;
+		}
+
+		if (error != CS_OK) {
+			break;
+		}
+
+		offset = sizeof(*res_lib_cmap_dump_prefix);
+		for (i = 0; i < res_lib_cmap_dump_prefix->no_items; i++) {
+			item = (struct res_lib_cmap_dump_prefix_item *)((char *)res_lib_cmap_dump_prefix + offset);
+
+			dump_fn(handle, (const char *)item->data,
+			    item->data + CMAP_DUMP_PREFIX_VALUE_OFFSET(item->key_len),
+			    item->value_len, item->type, user_data);
+
+			offset += CMAP_DUMP_PREFIX_ITEM_SIZE(item->key_len, item->value_len);
+		}
+
+		req_lib_cmap_dump_prefix.dump_handle = res_lib_cmap_dump_prefix->dump_handle;
+	} while (req_lib_cmap_dump_prefix.dump_handle != 0);
+
+	free(res_lib_cmap_dump_prefix);
+
+error_put:
+	(void)hdb_handle_put (&cmap_handle_t_db, handle);
+
+	return (error);
+}
+
 cs_error_t cmap_track_add(
 	cmap_handle_t handle,
 	const char *key_name,
@@ -983,7 +1185,7 @@ cs_error_t cmap_track_add(
 		req_lib_cmap_track_add.key_name.length = strlen(key_name);
 	}
 
-	req_lib_cmap_track_add.track_type = track_type;
+	req_lib_cmap_track_add.track_type = track_type | CMAP_TRACK_NOTIFY_BATCH;
 	req_lib_cmap_track_add.track_inst_handle = cmap_track_inst_handle;
 
 	iov.iov_base = (char *)&req_lib_cmap_track_add;
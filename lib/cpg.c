@@ -75,6 +75,22 @@
  */
 #define MAX_RETRIES 100
 
+/*
+ * Number of large message fragments in flight and how often
+ * the executive is asked to acknowledge them
+ */
+#define CPG_PARTIAL_WINDOW 4
+#define CPG_PARTIAL_ACK_INTERVAL 2
+
+/*
+ * Does the executive know MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM?
+ */
+enum cpg_partial_stream {
+	CPG_PARTIAL_STREAM_UNKNOWN = 0,
+	CPG_PARTIAL_STREAM_SUPPORTED = 1,
+	CPG_PARTIAL_STREAM_UNSUPPORTED = 2,
+};
+
 /*
  * ZCB files have following umask (umask is same as used in libqb)
  */
@@ -97,6 +113,7 @@ struct cpg_inst {
 					 * the cluster/group in the middle of a CPG message send
 					 * so we don't pass on a partial message to the client.
 					 */
+    enum cpg_partial_stream partial_stream;
 };
 static void cpg_inst_free (void *inst);
 
@@ -226,6 +243,7 @@ cs_error_t cpg_model_initialize (
 
 	/* Allow space for corosync internal headers */
 	cpg_inst->max_msg_size = IPC_REQUEST_SIZE - 1024;
+	cpg_inst->partial_stream = CPG_PARTIAL_STREAM_UNKNOWN;
 	cpg_inst->model_data.model = model;
 	cpg_inst->context = context;
 
@@ -472,6 +490,13 @@ cs_error_t cpg_dispatch (
 					&res_cpg_partial_deliver_callback->group_name);
 
 				if (res_cpg_partial_deliver_callback->type == LIBCPG_PARTIAL_FIRST) {
+					/*
+					 * The sender may restart a message it failed to send
+					 */
+					if (cpg_inst->assembling) {
+						free(cpg_inst->assembly_buf);
+						cpg_inst->assembling = 0;
+					}
 					/*
 					 * Allocate a buffer to contain a full message.
 					 */
@@ -1052,23 +1077,110 @@ error_exit:
 	return (error);
 }
 
-static cs_error_t send_fragments (
+/*
+ * Wait for the answer to the oldest acknowledged fragment in flight
+ */
+static cs_error_t partial_ack_receive (
+	struct cpg_inst *cpg_inst,
+	unsigned int *acks_pending)
+{
+	struct res_lib_cpg_partial_send res_lib_cpg_partial_send;
+	ssize_t res;
+
+	(*acks_pending)--;
+
+	res = qb_ipcc_recv (cpg_inst->c,
+			    &res_lib_cpg_partial_send,
+			    sizeof (res_lib_cpg_partial_send),
+			    CS_IPC_TIMEOUT_MS);
+	if (res < 0) {
+		return (qb_to_cs_error (res));
+	}
+
+	return (res_lib_cpg_partial_send.header.error);
+}
+
+/*
+ * Find out if the executive knows MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM, before
+ * it is used for the first time. Older executives don't check the request id
+ * against their handler table, so an unknown request must never be sent to
+ * them. Instead MESSAGE_REQ_CPG_LOCAL_GET, which every executive knows, is
+ * sent with a features field. Older executives ignore the field and send the
+ * short answer without features.
+ */
+static cs_error_t partial_stream_check (struct cpg_inst *cpg_inst)
+{
+	struct iovec iov;
+	struct req_lib_cpg_local_get_features req_lib_cpg_local_get_features;
+	struct res_lib_cpg_local_get_features res_lib_cpg_local_get_features;
+	cs_error_t error;
+
+	memset (&res_lib_cpg_local_get_features, 0, sizeof (res_lib_cpg_local_get_features));
+
+	req_lib_cpg_local_get_features.header.size = sizeof (struct req_lib_cpg_local_get_features);
+	req_lib_cpg_local_get_features.header.id = MESSAGE_REQ_CPG_LOCAL_GET;
+	req_lib_cpg_local_get_features.features = CPG_FEATURE_PARTIAL_MCAST_STREAM;
+
+	iov.iov_base = (void *)&req_lib_cpg_local_get_features;
+	iov.iov_len = sizeof (struct req_lib_cpg_local_get_features);
+
+	error = coroipcc_msg_send_reply_receive (cpg_inst->c, &iov, 1,
+		&res_lib_cpg_local_get_features, sizeof (res_lib_cpg_local_get_features));
+	if (error != CS_OK) {
+		return (error);
+	}
+	if (res_lib_cpg_local_get_features.header.error != CS_OK) {
+		return (res_lib_cpg_local_get_features.header.error);
+	}
+
+	if (res_lib_cpg_local_get_features.header.size >= sizeof (struct res_lib_cpg_local_get_features) &&
+	    (res_lib_cpg_local_get_features.features & CPG_FEATURE_PARTIAL_MCAST_STREAM)) {
+		cpg_inst->partial_stream = CPG_PARTIAL_STREAM_SUPPORTED;
+	} else {
+		cpg_inst->partial_stream = CPG_PARTIAL_STREAM_UNSUPPORTED;
+	}
+
+	return (CS_OK);
+}
+
+/*
+ * Large messages are streamed to the executive in fragments of
+ * max_msg_size / CPG_PARTIAL_WINDOW bytes, so that several of them fit into
+ * the request ring at once. Only every CPG_PARTIAL_ACK_INTERVAL-th fragment
+ * and the last one are answered, and at most CPG_PARTIAL_WINDOW fragments
+ * are in flight.
+ *
+ * Executives without MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM get every fragment
+ * as MESSAGE_REQ_CPG_PARTIAL_MCAST and one fragment at a time.
+ *
+ * restart is set when the message was not sent and has to be sent again from
+ * its first fragment.
+ */
+static cs_error_t send_fragments_once (
 	struct cpg_inst *cpg_inst,
 	cpg_guarantee_t guarantee,
 	size_t msg_len,
 	const struct iovec *iovec,
-	unsigned int iov_len)
+	unsigned int iov_len,
+	int *restart)
 {
 	int i;
 	cs_error_t error = CS_OK;
+	cs_error_t ack_error;
 	struct iovec iov[2];
 	struct req_lib_cpg_partial_mcast req_lib_cpg_mcast;
-	struct res_lib_cpg_partial_send res_lib_cpg_partial_send;
 	size_t sent = 0;
 	size_t iov_sent = 0;
-	int retry_count;
+	size_t frag_size;
+	unsigned int frags_unacked = 0;
+	unsigned int acks_pending = 0;
+	int retry_count = 0;
+	int stream;
+
+	*restart = 0;
+	stream = (cpg_inst->partial_stream == CPG_PARTIAL_STREAM_SUPPORTED);
+	frag_size = cpg_inst->max_msg_size / CPG_PARTIAL_WINDOW;
 
-	req_lib_cpg_mcast.header.id = MESSAGE_REQ_CPG_PARTIAL_MCAST;
 	req_lib_cpg_mcast.guarantee = guarantee;
 	req_lib_cpg_mcast.msglen = msg_len;
 
@@ -1077,13 +1189,11 @@ static cs_error_t send_fragments (
 
 	i=0;
 	iov_sent = 0 ;
-	qb_ipcc_fc_enable_max_set(cpg_inst->c,  2);
 
 	while (error == CS_OK && sent < msg_len) {
 
-		retry_count = 0;
-		if ( (iovec[i].iov_len - iov_sent) > cpg_inst->max_msg_size) {
-			iov[1].iov_len = cpg_inst->max_msg_size;
+		if ( (iovec[i].iov_len - iov_sent) > frag_size) {
+			iov[1].iov_len = frag_size;
 		}
 		else {
 			iov[1].iov_len = iovec[i].iov_len - iov_sent;
@@ -1099,23 +1209,73 @@ static cs_error_t send_fragments (
 			req_lib_cpg_mcast.type = LIBCPG_PARTIAL_CONTINUED;
 		}
 
+		if (!stream || req_lib_cpg_mcast.type == LIBCPG_PARTIAL_LAST ||
+		    frags_unacked + 1 >= CPG_PARTIAL_ACK_INTERVAL) {
+			req_lib_cpg_mcast.header.id = MESSAGE_REQ_CPG_PARTIAL_MCAST;
+		} else {
+			req_lib_cpg_mcast.header.id = MESSAGE_REQ_CPG_PARTIAL_MCAST_STREAM;
+		}
+
 		req_lib_cpg_mcast.fraglen = iov[1].iov_len;
 		req_lib_cpg_mcast.header.size = sizeof (struct req_lib_cpg_partial_mcast) + iov[1].iov_len;
 		iov[1].iov_base = (char *)iovec[i].iov_base + iov_sent;
 
+		if (acks_pending * CPG_PARTIAL_ACK_INTERVAL + frags_unacked >=
+		    CPG_PARTIAL_WINDOW && acks_pending > 0) {
+			error = partial_ack_receive (cpg_inst, &acks_pending);
+			if (error != CS_OK) {
+				break;
+			}
+		}
+
 	resend:
-		error = coroipcc_msg_send_reply_receive (cpg_inst->c, iov, 2,
-							 &res_lib_cpg_partial_send,
-							 sizeof (res_lib_cpg_partial_send));
+		error = qb_to_cs_error(qb_ipcc_sendv(cpg_inst->c, iov, 2));
 
 		if (error == CS_ERR_TRY_AGAIN) {
-			fprintf(stderr, "sleep. counter=%d\n", retry_count);
+			/*
+			 * The request ring is full or the executive is flow
+			 * controlled. Waiting for an answer is cheaper than
+			 * sleeping, if there is one to wait for.
+			 */
+			if (acks_pending > 0) {
+				error = partial_ack_receive (cpg_inst, &acks_pending);
+				if (error != CS_OK) {
+					break;
+				}
+				goto resend;
+			}
 			if (++retry_count > MAX_RETRIES) {
-				goto error_exit;
+				break;
 			}
 			usleep(10000);
 			goto resend;
 		}
+		if (error != CS_OK) {
+			break;
+		}
+
+		if (req_lib_cpg_mcast.header.id == MESSAGE_REQ_CPG_PARTIAL_MCAST) {
+			acks_pending++;
+			frags_unacked = 0;
+		} else {
+			frags_unacked++;
+		}
+
+		if (!stream) {
+			/*
+			 * The executive doesn't remember dropped fragments, so
+			 * each one is confirmed before the next is sent
+			 */
+			error = partial_ack_receive (cpg_inst, &acks_pending);
+			if (error == CS_ERR_TRY_AGAIN && ++retry_count <= MAX_RETRIES) {
+				usleep(10000);
+				goto resend;
+			}
+			if (error != CS_OK) {
+				break;
+			}
+		}
+		retry_count = 0;
 
 		iov_sent += iov[1].iov_len;
 		sent += iov[1].iov_len;
@@ -1125,9 +1285,60 @@ static cs_error_t send_fragments (
 			i++;
 			iov_sent = 0;
 		}
-		error = res_lib_cpg_partial_send.header.error;
 	}
-error_exit:
+
+	/*
+	 * Collect the remaining answers, so the next request on this
+	 * connection doesn't pick up one of them as its reply
+	 */
+	while (acks_pending > 0) {
+		ack_error = partial_ack_receive (cpg_inst, &acks_pending);
+		if (error == CS_OK) {
+			error = ack_error;
+		}
+	}
+
+	/*
+	 * CS_ERR_TRY_AGAIN in an answer means the executive dropped a fragment
+	 * (and all fragments after it), so the whole message is sent again
+	 */
+	if (stream && error == CS_ERR_TRY_AGAIN && retry_count <= MAX_RETRIES) {
+		*restart = 1;
+	}
+
+	return error;
+}
+
+static cs_error_t send_fragments (
+	struct cpg_inst *cpg_inst,
+	cpg_guarantee_t guarantee,
+	size_t msg_len,
+	const struct iovec *iovec,
+	unsigned int iov_len)
+{
+	cs_error_t error;
+	int restart;
+	int retry_count = 0;
+
+	if (cpg_inst->partial_stream == CPG_PARTIAL_STREAM_UNKNOWN) {
+		error = partial_stream_check (cpg_inst);
+		if (error != CS_OK) {
+			return (error);
+		}
+	}
+
+	qb_ipcc_fc_enable_max_set(cpg_inst->c,  2);
+
+	while (1) {
+		error = send_fragments_once (cpg_inst, guarantee, msg_len, iovec, iov_len, &restart);
+		if (!restart || ++retry_count > MAX_RETRIES) {
+			break;
+		}
+		if (error == CS_ERR_TRY_AGAIN) {
+			usleep(10000);
+		}
+	}
+
 	qb_ipcc_fc_enable_max_set(cpg_inst->c,  1);
 
 	return error;
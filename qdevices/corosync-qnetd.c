@@ -167,20 +167,139 @@ qnetd_pr_poll_array_create(struct qnetd_instance *instance)
 	return (poll_array->array);
 }
 
+/*
+ * Process events of one poll array item. out_flags is 0 when poll timed out.
+ * Returns -1 on fatal error, otherwise 0.
+ */
 static int
-qnetd_poll(struct qnetd_instance *instance)
+qnetd_poll_process(struct qnetd_instance *instance,
+    const struct qnetd_poll_array_user_data *user_data, PRInt16 out_flags)
 {
 	struct qnetd_client *client;
-	PRPollDesc *pfds;
-	PRInt32 poll_res;
-	ssize_t i;
 	int client_disconnect;
-	struct qnetd_poll_array_user_data *user_data;
 	struct unix_socket_client *ipc_client;
 
 	client = NULL;
+	ipc_client = NULL;
 	client_disconnect = 0;
 
+	switch (user_data->type) {
+	case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
+		break;
+	case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
+		client = user_data->client;
+		client_disconnect = client->schedule_disconnect;
+		break;
+	case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
+		break;
+	case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
+		ipc_client = user_data->ipc_client;
+		client_disconnect = ipc_client->schedule_disconnect;
+	}
+
+	if (!client_disconnect && out_flags & PR_POLL_READ) {
+		switch (user_data->type) {
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
+			qnetd_client_net_accept(instance);
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
+			if (qnetd_client_net_read(instance, client) == -1) {
+				client_disconnect = 1;
+			}
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
+			qnetd_ipc_accept(instance, &ipc_client);
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
+			qnetd_ipc_io_read(instance, ipc_client);
+			break;
+		}
+	}
+
+	if (!client_disconnect && out_flags & PR_POLL_WRITE) {
+		switch (user_data->type) {
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
+			/*
+			 * Poll write on listen socket -> fatal error
+			 */
+			qnetd_log(LOG_CRIT, "POLL_WRITE on listening socket");
+
+			return (-1);
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
+			if (qnetd_client_net_write(instance, client) == -1) {
+				client_disconnect = 1;
+			}
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
+			qnetd_log(LOG_CRIT, "POLL_WRITE on listening IPC socket");
+			return (-1);
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
+			qnetd_ipc_io_write(instance, ipc_client);
+			break;
+		}
+	}
+
+	if (!client_disconnect &&
+	    (out_flags & (PR_POLL_ERR|PR_POLL_NVAL|PR_POLL_HUP|PR_POLL_EXCEPT)) &&
+	    !(out_flags & (PR_POLL_READ|PR_POLL_WRITE))) {
+		switch (user_data->type) {
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
+			if (out_flags != PR_POLL_NVAL) {
+				/*
+				 * Poll ERR on listening socket is fatal error.
+				 * POLL_NVAL is used as a signal to quit poll loop.
+				 */
+				 qnetd_log(LOG_CRIT, "POLL_ERR (%u) on listening "
+				    "socket", out_flags);
+			} else {
+				qnetd_log(LOG_DEBUG, "Listening socket is closed");
+			}
+
+			return (-1);
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
+			qnetd_log(LOG_DEBUG, "POLL_ERR (%u) on client socket. "
+			    "Disconnecting.", out_flags);
+
+			client_disconnect = 1;
+			break;
+		case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
+			qnetd_log(LOG_DEBUG, "POLL_ERR (%u) on ipc client socket."
+			    " Disconnecting.", out_flags);
+
+			client_disconnect = 1;
+			break;
+		}
+	}
+
+	/*
+	 * If client is scheduled for disconnect, disconnect it
+	 */
+	if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT) {
+		if (client_disconnect) {
+			qnetd_instance_client_disconnect(instance, client, 0);
+		} else {
+			qnetd_client_epoll_update_queue(client);
+		}
+	} else if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT &&
+	    (client_disconnect || ipc_client->schedule_disconnect)) {
+		qnetd_ipc_client_disconnect(instance, ipc_client);
+	}
+
+	return (0);
+}
+
+static int
+qnetd_poll(struct qnetd_instance *instance)
+{
+	PRPollDesc *pfds;
+	PRInt32 poll_res;
+	ssize_t i;
+	struct qnetd_poll_array_user_data *user_data;
+
 	pfds = qnetd_pr_poll_array_create(instance);
 	if (pfds == NULL) {
 		return (-1);
@@ -196,117 +315,46 @@ qnetd_poll(struct qnetd_instance *instance)
 		for (i = 0; i < pr_poll_array_size(&instance->poll_array); i++) {
 			user_data = pr_poll_array_get_user_data(&instance->poll_array, i);
 
-			client = NULL;
-			ipc_client = NULL;
-			client_disconnect = 0;
-
-			switch (user_data->type) {
-			case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
-				break;
-			case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
-				client = user_data->client;
-				client_disconnect = client->schedule_disconnect;
-				break;
-			case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
-				break;
-			case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
-				ipc_client = user_data->ipc_client;
-				client_disconnect = ipc_client->schedule_disconnect;
+			if (qnetd_poll_process(instance, user_data,
+			    (poll_res > 0 ? pfds[i].out_flags : 0)) == -1) {
+				return (-1);
 			}
+		}
+	}
 
-			if (!client_disconnect && poll_res > 0 &&
-			    pfds[i].out_flags & PR_POLL_READ) {
-				switch (user_data->type) {
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
-					qnetd_client_net_accept(instance);
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
-					if (qnetd_client_net_read(instance, client) == -1) {
-						client_disconnect = 1;
-					}
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
-					qnetd_ipc_accept(instance, &ipc_client);
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
-					qnetd_ipc_io_read(instance, ipc_client);
-					break;
-				}
-			}
 
-			if (!client_disconnect && poll_res > 0 &&
-			    pfds[i].out_flags & PR_POLL_WRITE) {
-				switch (user_data->type) {
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
-					/*
-					 * Poll write on listen socket -> fatal error
-					 */
-					qnetd_log(LOG_CRIT, "POLL_WRITE on listening socket");
-
-					return (-1);
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
-					if (qnetd_client_net_write(instance, client) == -1) {
-						client_disconnect = 1;
-					}
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
-					qnetd_log(LOG_CRIT, "POLL_WRITE on listening IPC socket");
-					return (-1);
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
-					qnetd_ipc_io_write(instance, ipc_client);
-					break;
-				}
-			}
+	return (0);
+}
 
-			if (!client_disconnect && poll_res > 0 &&
-			    (pfds[i].out_flags & (PR_POLL_ERR|PR_POLL_NVAL|PR_POLL_HUP|PR_POLL_EXCEPT)) &&
-			    !(pfds[i].out_flags & (PR_POLL_READ|PR_POLL_WRITE))) {
-				switch (user_data->type) {
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET:
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET:
-					if (pfds[i].out_flags != PR_POLL_NVAL) {
-						/*
-						 * Poll ERR on listening socket is fatal error.
-						 * POLL_NVAL is used as a signal to quit poll loop.
-						 */
-						 qnetd_log(LOG_CRIT, "POLL_ERR (%u) on listening "
-						    "socket", pfds[i].out_flags);
-					} else {
-						qnetd_log(LOG_DEBUG, "Listening socket is closed");
-					}
-
-					return (-1);
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT:
-					qnetd_log(LOG_DEBUG, "POLL_ERR (%u) on client socket. "
-					    "Disconnecting.", pfds[i].out_flags);
-
-					client_disconnect = 1;
-					break;
-				case QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT:
-					qnetd_log(LOG_DEBUG, "POLL_ERR (%u) on ipc client socket."
-					    " Disconnecting.", pfds[i].out_flags);
-
-					client_disconnect = 1;
-					break;
-				}
-			}
+/*
+ * Same as qnetd_poll, but only ready sockets (and clients scheduled for disconnect)
+ * are visited.
+ */
+static int
+qnetd_poll_epoll(struct qnetd_instance *instance)
+{
+	int no_events;
+	int i;
 
-			/*
-			 * If client is scheduled for disconnect, disconnect it
-			 */
-			if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT &&
-			    client_disconnect) {
-				qnetd_instance_client_disconnect(instance, client, 0);
-			} else if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT &&
-			    (client_disconnect || ipc_client->schedule_disconnect)) {
-				qnetd_ipc_client_disconnect(instance, ipc_client);
-			}
-		}
+	if (qnetd_ipc_is_closed(instance)) {
+		qnetd_log(LOG_DEBUG, "Listening socket is closed");
+
+		return (-1);
+	}
+
+	if ((no_events = qnetd_epoll_wait(instance,
+	    timer_list_time_to_expire(&instance->main_timer_list))) == -1) {
+		return (-1);
 	}
 
+	timer_list_expire(&instance->main_timer_list);
+
+	for (i = 0; i < no_events; i++) {
+		if (qnetd_poll_process(instance, instance->epoll.events[i].user_data,
+		    instance->epoll.events[i].out_flags) == -1) {
+			return (-1);
+		}
+	}
 
 	return (0);
 }
@@ -612,11 +660,23 @@ main(int argc, char * const argv[])
 		exit(1);
 	}
 
+	if (advanced_settings.poll_backend == QNETD_POLL_BACKEND_EPOLL) {
+		qnetd_log(LOG_DEBUG, "Initializing epoll");
+		if (qnetd_epoll_start(&instance) != 0) {
+			exit(1);
+		}
+	}
+
 	qnetd_log(LOG_DEBUG, "QNetd ready to provide service");
 	/*
 	 * MAIN LOOP
 	 */
-	while (qnetd_poll(&instance) == 0) {
+	if (advanced_settings.poll_backend == QNETD_POLL_BACKEND_EPOLL) {
+		while (qnetd_poll_epoll(&instance) == 0) {
+		}
+	} else {
+		while (qnetd_poll(&instance) == 0) {
+		}
 	}
 
 	/*
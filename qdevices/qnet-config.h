@@ -85,6 +85,12 @@ extern "C" {
 #define QNETD_DEFAULT_IPC_MAX_SEND_SIZE			(10*1024*1024)
 #define QNETD_MIN_IPC_RECEIVE_SEND_SIZE			1024
 
+#define QNETD_DEFAULT_POLL_BACKEND			QNETD_POLL_BACKEND_PR_POLL
+#define QNETD_EPOLL_MAX_EVENTS				64
+
+#define QNETD_CLUSTER_LIST_HASH_SIZE			256
+#define QNETD_CLUSTER_NODE_ID_HASH_SIZE			32
+
 #define QNETD_TOOL_PROGRAM_NAME				"corosync-qnetd-tool"
 
 #define QDEVICE_NET_DEFAULT_NSS_DB_DIR			COROSYSCONFDIR "/qdevice/net/nssdb"
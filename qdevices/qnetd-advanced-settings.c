@@ -72,6 +72,7 @@ qnetd_advanced_settings_init(struct qnetd_advanced_settings *settings)
 	settings->ipc_max_clients = QNETD_DEFAULT_IPC_MAX_CLIENTS;
 	settings->ipc_max_receive_size = QNETD_DEFAULT_IPC_MAX_RECEIVE_SIZE;
 	settings->ipc_max_send_size = QNETD_DEFAULT_IPC_MAX_SEND_SIZE;
+	settings->poll_backend = QNETD_DEFAULT_POLL_BACKEND;
 
 	return (0);
 }
@@ -205,6 +206,16 @@ qnetd_advanced_settings_set(struct qnetd_advanced_settings *settings,
 		}
 
 		settings->ipc_max_send_size = (size_t)tmpll;
+	} else if (strcasecmp(option, "poll_backend") == 0) {
+		if (strcasecmp(value, "poll") == 0) {
+			settings->poll_backend = QNETD_POLL_BACKEND_PR_POLL;
+#ifdef HAVE_SYS_EPOLL_H
+		} else if (strcasecmp(value, "epoll") == 0) {
+			settings->poll_backend = QNETD_POLL_BACKEND_EPOLL;
+#endif
+		} else {
+			return (-2);
+		}
 	} else {
 		return (-1);
 	}
@@ -39,6 +39,11 @@
 extern "C" {
 #endif
 
+enum qnetd_poll_backend {
+	QNETD_POLL_BACKEND_PR_POLL,
+	QNETD_POLL_BACKEND_EPOLL,
+};
+
 struct qnetd_advanced_settings {
 	int listen_backlog;
 	size_t max_client_send_buffers;
@@ -56,6 +61,7 @@ struct qnetd_advanced_settings {
 	size_t ipc_max_clients;
 	size_t ipc_max_send_size;
 	size_t ipc_max_receive_size;
+	enum qnetd_poll_backend poll_backend;
 };
 
 extern int		qnetd_advanced_settings_init(struct qnetd_advanced_settings *settings);
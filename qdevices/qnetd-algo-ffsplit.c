@@ -152,81 +152,182 @@ qnetd_algo_ffsplit_is_prefered_partition(const struct qnetd_client *client,
 	return (node_list_find_node_id(membership_node_list, prefered_node_id) != NULL);
 }
 
+/*
+ * Get ring id, config and membership node list of iter_client as seen by algorithm.
+ * Values for client are passed as arguments because they are not yet stored in client.
+ * Returns 0 if iter_client should be skipped (client is leaving), otherwise 1.
+ */
+static int
+qnetd_algo_ffsplit_client_view(const struct qnetd_client *client, int client_leaving,
+    const struct tlv_ring_id *ring_id, const struct node_list *config_node_list,
+    const struct node_list *membership_node_list, const struct qnetd_client *iter_client,
+    const struct tlv_ring_id **iter_ring_id, const struct node_list **iter_config_node_list,
+    const struct node_list **iter_membership_node_list)
+{
+
+	if (iter_client->node_id == client->node_id) {
+		if (client_leaving) {
+			return (0);
+		}
+
+		*iter_ring_id = ring_id;
+		*iter_config_node_list = config_node_list;
+		*iter_membership_node_list = membership_node_list;
+	} else {
+		*iter_ring_id = &iter_client->last_ring_id;
+		*iter_config_node_list = &iter_client->configuration_node_list;
+		*iter_membership_node_list = &iter_client->last_membership_node_list;
+	}
+
+	return (1);
+}
+
+/*
+ * Return 1 if every node id of node_list1 is in node_list2
+ */
+static int
+qnetd_algo_ffsplit_node_list_is_subset(const struct node_list *node_list1,
+    const struct node_list *node_list2)
+{
+	const struct node_list_entry *iter_node;
+
+	TAILQ_FOREACH(iter_node, node_list1, entries) {
+		if (node_list_find_node_id(node_list2, iter_node->node_id) == NULL) {
+			return (0);
+		}
+	}
+
+	return (1);
+}
+
+/*
+ * Return 1 if both node lists contain same set of node ids. Lists sent by nodes of same
+ * partition are usually in same order, so try cheap ordered compare first.
+ */
+static int
+qnetd_algo_ffsplit_node_lists_eq(const struct node_list *node_list1,
+    const struct node_list *node_list2)
+{
+	const struct node_list_entry *iter_node1, *iter_node2;
+
+	if (node_list1 == node_list2) {
+		return (1);
+	}
+
+	iter_node1 = TAILQ_FIRST(node_list1);
+	iter_node2 = TAILQ_FIRST(node_list2);
+
+	while (iter_node1 != NULL && iter_node2 != NULL &&
+	    iter_node1->node_id == iter_node2->node_id) {
+		iter_node1 = TAILQ_NEXT(iter_node1, entries);
+		iter_node2 = TAILQ_NEXT(iter_node2, entries);
+	}
+
+	if (iter_node1 == NULL && iter_node2 == NULL) {
+		return (1);
+	}
+
+	return (qnetd_algo_ffsplit_node_list_is_subset(node_list1, node_list2) &&
+	    qnetd_algo_ffsplit_node_list_is_subset(node_list2, node_list1));
+}
+
+/*
+ * Find first client which (as seen by algorithm) has given ring id. Cluster partition
+ * summary is used, so only clients of partition are searched. Client (whose ring id
+ * is not yet stored) may be in other partition, so it's returned as a fallback.
+ */
+static const struct qnetd_client *
+qnetd_algo_ffsplit_partition_representative(const struct qnetd_client *client,
+    int client_leaving, const struct tlv_ring_id *ring_id,
+    const struct tlv_ring_id *iter_ring_id)
+{
+	const struct qnetd_cluster_partition *partition;
+	const struct qnetd_client *iter_client;
+
+	partition = qnetd_cluster_find_partition(client->cluster, iter_ring_id);
+	if (partition != NULL) {
+		TAILQ_FOREACH(iter_client, &partition->client_list, cluster_partition_entries) {
+			if (iter_client->node_id != client->node_id ||
+			    (!client_leaving && tlv_ring_id_eq(ring_id, iter_ring_id))) {
+				return (iter_client);
+			}
+		}
+	}
+
+	return (client);
+}
+
 static int
 qnetd_algo_ffsplit_is_membership_stable(const struct qnetd_client *client, int client_leaving,
     const struct tlv_ring_id *ring_id, const struct node_list *config_node_list,
     const struct node_list *membership_node_list)
 {
 	const struct qnetd_client *iter_client1, *iter_client2;
+	const struct qnetd_client *ref_client;
 	const struct node_list *config_node_list1, *config_node_list2;
 	const struct node_list *membership_node_list1, *membership_node_list2;
-	const struct node_list_entry *iter_node1, *iter_node2;
-	const struct node_list_entry *iter_node3, *iter_node4;
+	const struct node_list *ref_config_node_list;
+	const struct node_list_entry *iter_node1;
 	const struct tlv_ring_id *ring_id1, *ring_id2;
+	int partitions_consistent;
 
 	/*
-	 * Test if all active clients share same config list.
+	 * Test if all active clients share same config list. Equality is transitive, so
+	 * it's enough to compare every client with first one.
 	 */
+	ref_config_node_list = NULL;
+
 	TAILQ_FOREACH(iter_client1, &client->cluster->client_list, cluster_entries) {
-		TAILQ_FOREACH(iter_client2, &client->cluster->client_list, cluster_entries) {
-			if (iter_client1 == iter_client2) {
-				continue;
-			}
+		if (!qnetd_algo_ffsplit_client_view(client, client_leaving, ring_id,
+		    config_node_list, membership_node_list, iter_client1,
+		    &ring_id1, &config_node_list1, &membership_node_list1)) {
+			continue;
+		}
 
-			if (iter_client1->node_id == client->node_id) {
-				if (client_leaving) {
-					continue;
-				}
+		if (ref_config_node_list == NULL) {
+			ref_config_node_list = config_node_list1;
+		} else if (!qnetd_algo_ffsplit_node_lists_eq(ref_config_node_list,
+		    config_node_list1)) {
+			return (0);
+		}
+	}
 
-				config_node_list1 = config_node_list;
-			} else {
-				config_node_list1 = &iter_client1->configuration_node_list;
-			}
+	/*
+	 * Test if same partitions share same ring ids and membership node list.
+	 *
+	 * Usual case is that all clients of one partition sent equal membership node list.
+	 * Check this first by comparing every client with first client of its partition.
+	 */
+	partitions_consistent = 1;
 
-			if (iter_client2->node_id == client->node_id) {
-				if (client_leaving) {
-					continue;
-				}
+	TAILQ_FOREACH(iter_client1, &client->cluster->client_list, cluster_entries) {
+		if (!qnetd_algo_ffsplit_client_view(client, client_leaving, ring_id,
+		    config_node_list, membership_node_list, iter_client1,
+		    &ring_id1, &config_node_list1, &membership_node_list1)) {
+			continue;
+		}
 
-				config_node_list2 = config_node_list;
-			} else {
-				config_node_list2 = &iter_client2->configuration_node_list;
-			}
+		ref_client = qnetd_algo_ffsplit_partition_representative(client, client_leaving,
+		    ring_id, ring_id1);
 
-			/*
-			 * Walk thru all node ids in given config node list...
-			 */
-			TAILQ_FOREACH(iter_node1, config_node_list1, entries) {
-				/*
-				 * ... and try to find given node id in other list
-				 */
-				iter_node2 = node_list_find_node_id(config_node_list2, iter_node1->node_id);
-
-				if (iter_node2 == NULL) {
-					/*
-					 * Node with iter_node1->node_id was not found in
-					 * config_node_list2 -> lists doesn't match
-					 */
-					return (0);
-				}
-			}
+		if (ref_client == iter_client1 ||
+		    !qnetd_algo_ffsplit_client_view(client, client_leaving, ring_id,
+		    config_node_list, membership_node_list, ref_client,
+		    &ring_id2, &config_node_list2, &membership_node_list2)) {
+			continue;
+		}
+
+		if (!qnetd_algo_ffsplit_node_lists_eq(membership_node_list1, membership_node_list2)) {
+			partitions_consistent = 0;
+			break;
 		}
 	}
 
-	/*
-	 * Test if same partitions share same ring ids and membership node list
-	 */
 	TAILQ_FOREACH(iter_client1, &client->cluster->client_list, cluster_entries) {
-		if (iter_client1->node_id == client->node_id) {
-			if (client_leaving) {
-				continue;
-			}
-
-			membership_node_list1 = membership_node_list;
-			ring_id1 = ring_id;
-		} else {
-			membership_node_list1 = &iter_client1->last_membership_node_list;
-			ring_id1 = &iter_client1->last_ring_id;
+		if (!qnetd_algo_ffsplit_client_view(client, client_leaving, ring_id,
+		    config_node_list, membership_node_list, iter_client1,
+		    &ring_id1, &config_node_list1, &membership_node_list1)) {
+			continue;
 		}
 
 		/*
@@ -245,16 +346,10 @@ qnetd_algo_ffsplit_is_membership_stable(const struct qnetd_client *client, int c
 				continue;
 			}
 
-			if (iter_client2->node_id == client->node_id) {
-				if (client_leaving) {
-					continue;
-				}
-
-				membership_node_list2 = membership_node_list;
-				ring_id2 = ring_id;
-			} else {
-				membership_node_list2 = &iter_client2->last_membership_node_list;
-				ring_id2 = &iter_client2->last_ring_id;
+			if (!qnetd_algo_ffsplit_client_view(client, client_leaving, ring_id,
+			    config_node_list, membership_node_list, iter_client2,
+			    &ring_id2, &config_node_list2, &membership_node_list2)) {
+				continue;
 			}
 
 			/*
@@ -265,22 +360,18 @@ qnetd_algo_ffsplit_is_membership_stable(const struct qnetd_client *client, int c
 			}
 
 			/*
-			 * Now compare that membership node list equals, so walk thru all
-			 * members ...
+			 * Now compare that membership node list equals. Clients with same ring id
+			 * are in same partition, so when partitions are consistent lists are
+			 * known to be equal.
 			 */
-			TAILQ_FOREACH(iter_node3, membership_node_list1, entries) {
+			if (!partitions_consistent &&
+			    !qnetd_algo_ffsplit_node_list_is_subset(membership_node_list1,
+			    membership_node_list2)) {
 				/*
-				 * ... and try to find given node id in other membership node list
+				 * Some node of membership_node_list1 was not found in
+				 * membership_node_list2 -> lists doesn't match
 				 */
-				iter_node4 = node_list_find_node_id(membership_node_list2, iter_node3->node_id);
-
-				if (iter_node4 == NULL) {
-					/*
-					 * Node with iter_node3->node_id was not found in
-					 * membership_node_list2 -> lists doesn't match
-					 */
-					return (0);
-				}
+				return (0);
 			}
 		}
 	}
@@ -507,6 +598,7 @@ qnetd_algo_ffsplit_send_votes(struct qnetd_client *client, int client_leaving,
 			    iter_client_data->vote_info_expected_seq_num, ring_id_to_send,
 			    vote_to_send) == -1) {
 				client->schedule_disconnect = 1;
+				qnetd_client_epoll_update_queue(client);
 			}
 		}
 	}
@@ -50,26 +50,23 @@ qnetd_algo_all_ring_ids_match(struct qnetd_client *client, const struct tlv_ring
 	struct node_list_entry *node_info;
  	struct qnetd_client *other_client;
 
-	TAILQ_FOREACH(other_client, &client->cluster->client_list, cluster_entries) {
-		int in_our_partition = 0;
-
-		if (other_client == client) {
-			continue; /* We've seen our membership list */
+	/*
+	 * Look down our node list and check clients which are known to us
+	 */
+	TAILQ_FOREACH(node_info, &client->last_membership_node_list, entries) {
+		other_client = qnetd_cluster_find_client_by_node_id(client->cluster,
+		    node_info->node_id);
+
+		if (other_client == NULL || other_client == client) {
+			continue; /* Not connected or we've seen our membership list */
 		}
 		qnetd_log(LOG_DEBUG, "algo-util: all_ring_ids_match: seen nodeid %d (client %p) ring_id (%d/%ld)", other_client->node_id, other_client, other_client->last_ring_id.node_id, other_client->last_ring_id.seq);
 
-		/* Look down our node list and see if this client is known to us */
-		TAILQ_FOREACH(node_info, &client->last_membership_node_list, entries) {
-			if (node_info->node_id == other_client->node_id) {
-				in_our_partition = 1;
-			}
-		}
-
 		/*
 		 * If the other nodes on our side of a partition have a different ring ID then
 		 * we need to wait until they have all caught up before making a decision
 		 */
-		if (in_our_partition && !tlv_ring_id_eq(ring_id, &other_client->last_ring_id)) {
+		if (!tlv_ring_id_eq(ring_id, &other_client->last_ring_id)) {
 			qnetd_log(LOG_DEBUG, "algo-util: nodeid %d in our partition has different ring_id (%d/%ld) to us (%d/%ld)", other_client->node_id, other_client->last_ring_id.node_id, other_client->last_ring_id.seq, ring_id->node_id, ring_id->seq);
 			return (-1); /* ring IDs don't match */
 		}
@@ -91,31 +88,30 @@ qnetd_algo_find_partition(partitions_list_t *partitions_list, const struct tlv_r
 	return (NULL);
 }
 
+/*
+ * Partitions are taken from client->cluster partition summary, which is kept up to date
+ * whenever client changes ring id, so there is no need to walk all clients
+ */
 int
 qnetd_algo_create_partitions(struct qnetd_client *client, partitions_list_t *partitions_list, const struct tlv_ring_id *ring_id)
 {
- 	struct qnetd_client *other_client;
+	struct qnetd_cluster_partition *cluster_partition;
 	int num_partitions = 0;
 
-	TAILQ_FOREACH(other_client, &client->cluster->client_list, cluster_entries) {
+	TAILQ_FOREACH(cluster_partition, &client->cluster->partition_list, entries) {
 		struct qnetd_algo_partition *partition;
 
-		if (other_client->last_ring_id.seq == 0){
+		if (cluster_partition->ring_id.seq == 0){
 			continue; /* not initialised yet */
 		}
-		partition = qnetd_algo_find_partition(partitions_list, &other_client->last_ring_id);
+		partition = malloc(sizeof(struct qnetd_algo_partition));
 		if (!partition) {
-			partition = malloc(sizeof(struct qnetd_algo_partition));
-			if (!partition) {
-				return (-1);
-			}
-			partition->num_nodes = 0;
-			memcpy(&partition->ring_id, &other_client->last_ring_id, sizeof(*ring_id));
-			num_partitions++;
-			TAILQ_INSERT_TAIL(partitions_list, partition, entries);
+			return (-1);
 		}
-		partition->num_nodes++;
-
+		partition->num_nodes = cluster_partition->no_clients;
+		memcpy(&partition->ring_id, &cluster_partition->ring_id, sizeof(*ring_id));
+		num_partitions++;
+		TAILQ_INSERT_TAIL(partitions_list, partition, entries);
 	}
 
 	return (num_partitions);
@@ -62,6 +62,7 @@ qnetd_client_algo_timer_callback(void *data1, void *data2)
 
 		if (qnetd_client_send_err(client, 0, 0, reply_error_code) != 0) {
 			client->schedule_disconnect = 1;
+			qnetd_client_epoll_update_queue(client);
 			return (0);
 		}
 
@@ -81,6 +82,7 @@ qnetd_client_algo_timer_callback(void *data1, void *data2)
 		    client->algo_timer_vote_info_msq_seq_number, &client->last_ring_id,
 		    result_vote) != 0) {
 			client->schedule_disconnect = 1;
+			qnetd_client_epoll_update_queue(client);
 			return (0);
 		}
 	}
@@ -277,7 +277,12 @@ qnetd_client_msg_received_init_check_new_client(struct qnetd_instance *instance,
 		return (TLV_REPLY_ERROR_CODE_NO_ERROR);
 	}
 
-	TAILQ_FOREACH(client, &cluster->client_list, cluster_entries) {
+	/*
+	 * Every client was checked when it joined, so all clients in cluster share
+	 * tie-breaker and algorithm and it's enough to compare with first one
+	 */
+	client = TAILQ_FIRST(&cluster->client_list);
+	if (client != NULL) {
 		if (!tlv_tie_breaker_eq(&new_client->tie_breaker, &client->tie_breaker)) {
 			qnetd_log(LOG_ERR, "Received init message contains tie-breaker which "
 			    "differs from rest of cluster. Sending error reply");
@@ -291,13 +296,13 @@ qnetd_client_msg_received_init_check_new_client(struct qnetd_instance *instance,
 
 			return (TLV_REPLY_ERROR_CODE_ALGORITHM_DIFFERS_FROM_OTHER_NODES);
 		}
+	}
 
-		if (new_client->node_id == client->node_id) {
-			qnetd_log(LOG_ERR, "Received init message contains node id which is "
-			    "duplicate of other node in cluster. Sending error reply");
+	if (qnetd_cluster_find_client_by_node_id(cluster, new_client->node_id) != NULL) {
+		qnetd_log(LOG_ERR, "Received init message contains node id which is "
+		    "duplicate of other node in cluster. Sending error reply");
 
-			return (TLV_REPLY_ERROR_CODE_DUPLICATE_NODE_ID);
-		}
+		return (TLV_REPLY_ERROR_CODE_DUPLICATE_NODE_ID);
 	}
 
 	return (TLV_REPLY_ERROR_CODE_NO_ERROR);
@@ -800,7 +805,12 @@ qnetd_client_msg_received_node_list(struct qnetd_instance *instance, struct qnet
 
 			return (-1);
 		}
-		memcpy(&client->last_ring_id, &msg->ring_id, sizeof(struct tlv_ring_id));
+		if (qnetd_cluster_set_client_ring_id(client->cluster, client, &msg->ring_id) == -1) {
+			qnetd_log(LOG_ERR, "Can't alloc cluster partition. "
+			    "Disconnecting client connection.");
+
+			return (-1);
+		}
 		break;
 	case TLV_NODE_LIST_TYPE_QUORUM:
 		case_processed = 1;
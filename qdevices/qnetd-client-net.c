@@ -238,6 +238,8 @@ qnetd_client_net_accept(struct qnetd_instance *instance)
 		goto exit_close;
 	}
 
+	qnetd_epoll_client_add(instance, client);
+
 	return (0);
 
 exit_close:
@@ -41,6 +41,25 @@
 #include "qnetd-log-debug.h"
 #include "msg.h"
 
+/*
+ * Messages created here are also sent to clients other than the one being
+ * processed, so the epoll backend has to be told when write interest appears.
+ */
+static void
+qnetd_client_send_buffer_put(struct qnetd_client *client,
+    struct send_buffer_list_entry *send_buffer)
+{
+	int was_empty;
+
+	was_empty = send_buffer_list_empty(&client->send_buffer_list);
+
+	send_buffer_list_put(&client->send_buffer_list, send_buffer);
+
+	if (was_empty) {
+		qnetd_client_epoll_update_queue(client);
+	}
+}
+
 int
 qnetd_client_send_err(struct qnetd_client *client, int add_msg_seq_number, uint32_t msg_seq_number,
     enum tlv_reply_error_code reply)
@@ -64,7 +83,7 @@ qnetd_client_send_err(struct qnetd_client *client, int add_msg_seq_number, uint3
 		return (-1);
 	};
 
-	send_buffer_list_put(&client->send_buffer_list, send_buffer);
+	qnetd_client_send_buffer_put(client, send_buffer);
 
 	return (0);
 }
@@ -101,7 +120,7 @@ qnetd_client_send_vote_info(struct qnetd_client *client, uint32_t msg_seq_number
 		return (-1);
 	};
 
-	send_buffer_list_put(&client->send_buffer_list, send_buffer);
+	qnetd_client_send_buffer_put(client, send_buffer);
 
 	return (0);
 }
@@ -38,6 +38,7 @@
 
 #include "qnet-config.h"
 #include "qnetd-client.h"
+#include "qnetd-client-list.h"
 
 void
 qnetd_client_init(struct qnetd_client *client, PRFileDesc *sock, PRNetAddr *addr,
@@ -56,12 +57,19 @@ qnetd_client_init(struct qnetd_client *client, PRFileDesc *sock, PRNetAddr *addr
 	node_list_init(&client->last_membership_node_list);
 	node_list_init(&client->last_quorum_node_list);
 	client->main_timer_list = main_timer_list;
+	client->epoll.user_data.type = QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT;
+	client->epoll.user_data.client = client;
 }
 
 void
 qnetd_client_destroy(struct qnetd_client *client)
 {
 
+	if (client->epoll.update_queued) {
+		TAILQ_REMOVE(client->epoll.update_list, client, epoll.update_entries);
+		client->epoll.update_queued = 0;
+	}
+
 	free(client->cluster_name);
 	free(client->addr_str);
 	node_list_free(&client->last_quorum_node_list);
@@ -70,3 +78,20 @@ qnetd_client_destroy(struct qnetd_client *client)
 	send_buffer_list_free(&client->send_buffer_list);
 	dynar_destroy(&client->receive_buffer);
 }
+
+/*
+ * Ask the epoll backend to look at the client again before the next wait. Needed
+ * when the client starts to have something to send or is scheduled for disconnect
+ * outside of processing its own events.
+ */
+void
+qnetd_client_epoll_update_queue(struct qnetd_client *client)
+{
+
+	if (client->epoll.update_list == NULL || client->epoll.update_queued) {
+		return ;
+	}
+
+	TAILQ_INSERT_TAIL(client->epoll.update_list, client, epoll.update_entries);
+	client->epoll.update_queued = 1;
+}
@@ -45,6 +45,7 @@
 #include "tlv.h"
 #include "send-buffer-list.h"
 #include "node-list.h"
+#include "qnetd-poll-array-user-data.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -79,6 +80,7 @@ struct qnetd_client {
 	struct tlv_ring_id last_ring_id;
 	struct qnetd_cluster *cluster;
 	struct qnetd_cluster_list *cluster_list;
+	struct qnetd_cluster_partition *cluster_partition;
 	struct timer_list *main_timer_list;
 	struct timer_list_entry *algo_timer;
 	uint32_t algo_timer_vote_info_msq_seq_number;
@@ -87,8 +89,26 @@ struct qnetd_client {
 	uint32_t dpd_msg_received_since_last_check;
 	enum tlv_vote last_sent_vote;
 	enum tlv_vote last_sent_ack_nack_vote;
+	struct {
+		/*
+		 * State kept by the epoll backend. update_list is NULL when
+		 * the client is not handled by epoll.
+		 */
+		struct qnetd_poll_array_user_data user_data;
+		struct qnetd_client_list *update_list;
+		int update_queued;
+		int registered;
+		uint32_t events;
+		PRInt16 in_flags_read;
+		PRInt16 in_flags_write;
+		uint64_t event_round;
+		size_t event_index;
+		TAILQ_ENTRY(qnetd_client) update_entries;
+	} epoll;
 	TAILQ_ENTRY(qnetd_client) entries;
 	TAILQ_ENTRY(qnetd_client) cluster_entries;
+	TAILQ_ENTRY(qnetd_client) cluster_node_id_entries;
+	TAILQ_ENTRY(qnetd_client) cluster_partition_entries;
 };
 
 extern void		qnetd_client_init(struct qnetd_client *client, PRFileDesc *sock,
@@ -97,6 +117,8 @@ extern void		qnetd_client_init(struct qnetd_client *client, PRFileDesc *sock,
 
 extern void		qnetd_client_destroy(struct qnetd_client *client);
 
+extern void		qnetd_client_epoll_update_queue(struct qnetd_client *client);
+
 #ifdef __cplusplus
 }
 #endif
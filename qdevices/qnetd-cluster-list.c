@@ -38,11 +38,37 @@
 
 #include "qnetd-cluster-list.h"
 
+/*
+ * FNV-1a hash of cluster name
+ */
+static size_t
+qnetd_cluster_list_name_hash(const char *cluster_name, size_t cluster_name_len)
+{
+	uint32_t hash;
+	size_t i;
+
+	hash = 2166136261U;
+
+	for (i = 0; i < cluster_name_len; i++) {
+		hash ^= (uint8_t)cluster_name[i];
+		hash *= 16777619U;
+	}
+
+	return (hash % QNETD_CLUSTER_LIST_HASH_SIZE);
+}
+
 void
 qnetd_cluster_list_init(struct qnetd_cluster_list *list)
 {
+	size_t i;
 
-	TAILQ_INIT(list);
+	TAILQ_INIT(&list->list);
+
+	for (i = 0; i < QNETD_CLUSTER_LIST_HASH_SIZE; i++) {
+		TAILQ_INIT(&list->hash[i]);
+	}
+
+	list->size = 0;
 }
 
 struct qnetd_cluster *
@@ -51,7 +77,8 @@ qnetd_cluster_list_find_by_name(struct qnetd_cluster_list *list,
 {
 	struct qnetd_cluster *cluster;
 
-	TAILQ_FOREACH(cluster, list, entries) {
+	TAILQ_FOREACH(cluster, &list->hash[qnetd_cluster_list_name_hash(cluster_name,
+	    cluster_name_len)], hash_entries) {
 		if (cluster->cluster_name_len == cluster_name_len &&
 		    memcmp(cluster->cluster_name, cluster_name, cluster_name_len) == 0) {
 			return (cluster);
@@ -61,6 +88,19 @@ qnetd_cluster_list_find_by_name(struct qnetd_cluster_list *list,
 	return (NULL);
 }
 
+static void
+qnetd_cluster_list_del_cluster(struct qnetd_cluster_list *list, struct qnetd_cluster *cluster)
+{
+
+	TAILQ_REMOVE(&list->list, cluster, entries);
+	TAILQ_REMOVE(&list->hash[qnetd_cluster_list_name_hash(cluster->cluster_name,
+	    cluster->cluster_name_len)], cluster, hash_entries);
+	list->size--;
+
+	qnetd_cluster_destroy(cluster);
+	free(cluster);
+}
+
 struct qnetd_cluster *
 qnetd_cluster_list_add_client(struct qnetd_cluster_list *list, struct qnetd_client *client)
 {
@@ -81,10 +121,19 @@ qnetd_cluster_list_add_client(struct qnetd_cluster_list *list, struct qnetd_clie
 			return (NULL);
 		}
 
-		TAILQ_INSERT_TAIL(list, cluster, entries);
+		TAILQ_INSERT_TAIL(&list->list, cluster, entries);
+		TAILQ_INSERT_TAIL(&list->hash[qnetd_cluster_list_name_hash(cluster->cluster_name,
+		    cluster->cluster_name_len)], cluster, hash_entries);
+		list->size++;
 	}
 
-	TAILQ_INSERT_TAIL(&cluster->client_list, client, cluster_entries);
+	if (qnetd_cluster_add_client(cluster, client) != 0) {
+		if (qnetd_cluster_size(cluster) == 0) {
+			qnetd_cluster_list_del_cluster(list, cluster);
+		}
+
+		return (NULL);
+	}
 
 	return (cluster);
 }
@@ -94,13 +143,10 @@ qnetd_cluster_list_del_client(struct qnetd_cluster_list *list, struct qnetd_clus
     struct qnetd_client *client)
 {
 
-	TAILQ_REMOVE(&cluster->client_list, client, cluster_entries);
-
-	if (TAILQ_EMPTY(&cluster->client_list)) {
-		TAILQ_REMOVE(list, cluster, entries);
+	qnetd_cluster_del_client(cluster, client);
 
-		qnetd_cluster_destroy(cluster);
-		free(cluster);
+	if (qnetd_cluster_size(cluster) == 0) {
+		qnetd_cluster_list_del_cluster(list, cluster);
 	}
 }
 
@@ -110,7 +156,7 @@ qnetd_cluster_list_free(struct qnetd_cluster_list *list)
 	struct qnetd_cluster *cluster;
 	struct qnetd_cluster *cluster_next;
 
-	cluster = TAILQ_FIRST(list);
+	cluster = TAILQ_FIRST(&list->list);
 	while (cluster != NULL) {
 		cluster_next = TAILQ_NEXT(cluster, entries);
 
@@ -120,20 +166,12 @@ qnetd_cluster_list_free(struct qnetd_cluster_list *list)
 		cluster = cluster_next;
 	}
 
-	TAILQ_INIT(list);
+	qnetd_cluster_list_init(list);
 }
 
 size_t
 qnetd_cluster_list_size(const struct qnetd_cluster_list *list)
 {
-	size_t res;
-	struct qnetd_cluster *cluster;
-
-	res = 0;
-
-	TAILQ_FOREACH(cluster, list, entries) {
-		res++;
-	}
 
-	return (res);
+	return (list->size);
 }
@@ -47,7 +47,17 @@
 extern "C" {
 #endif
 
-TAILQ_HEAD(qnetd_cluster_list, qnetd_cluster);
+TAILQ_HEAD(qnetd_cluster_list_head, qnetd_cluster);
+
+/*
+ * Clusters are kept both in list (for iteration in order of creation) and in
+ * hash table keyed by cluster name (for lookup of cluster for new client)
+ */
+struct qnetd_cluster_list {
+	struct qnetd_cluster_list_head list;
+	struct qnetd_cluster_list_head hash[QNETD_CLUSTER_LIST_HASH_SIZE];
+	size_t size;
+};
 
 extern void				 qnetd_cluster_list_init(struct qnetd_cluster_list *list);
 
@@ -38,9 +38,17 @@
 
 #include "qnetd-cluster.h"
 
+static size_t
+qnetd_cluster_node_id_hash(uint32_t node_id)
+{
+
+	return (node_id % QNETD_CLUSTER_NODE_ID_HASH_SIZE);
+}
+
 int
 qnetd_cluster_init(struct qnetd_cluster *cluster, const char *cluster_name, size_t cluster_name_len)
 {
+	size_t i;
 
 	memset(cluster, 0, sizeof(*cluster));
 
@@ -54,12 +62,31 @@ qnetd_cluster_init(struct qnetd_cluster *cluster, const char *cluster_name, size
 	cluster->cluster_name_len = cluster_name_len;
 	TAILQ_INIT(&cluster->client_list);
 
+	for (i = 0; i < QNETD_CLUSTER_NODE_ID_HASH_SIZE; i++) {
+		TAILQ_INIT(&cluster->node_id_hash[i]);
+	}
+
+	TAILQ_INIT(&cluster->partition_list);
+
 	return (0);
 }
 
 void
 qnetd_cluster_destroy(struct qnetd_cluster *cluster)
 {
+	struct qnetd_cluster_partition *partition;
+	struct qnetd_cluster_partition *partition_next;
+
+	partition = TAILQ_FIRST(&cluster->partition_list);
+	while (partition != NULL) {
+		partition_next = TAILQ_NEXT(partition, entries);
+
+		free(partition);
+
+		partition = partition_next;
+	}
+
+	TAILQ_INIT(&cluster->partition_list);
 
 	free(cluster->cluster_name);
 	cluster->cluster_name = NULL;
@@ -68,16 +95,8 @@ qnetd_cluster_destroy(struct qnetd_cluster *cluster)
 size_t
 qnetd_cluster_size(const struct qnetd_cluster *cluster)
 {
-	size_t res;
-	struct qnetd_client *client;
 
-	res = 0;
-
-	TAILQ_FOREACH(client, &cluster->client_list, cluster_entries) {
-		res++;
-	}
-
-	return (res);
+	return (cluster->no_clients);
 }
 
 struct qnetd_client *
@@ -85,7 +104,8 @@ qnetd_cluster_find_client_by_node_id(const struct qnetd_cluster *cluster, uint32
 {
 	struct qnetd_client *client;
 
-	TAILQ_FOREACH(client, &cluster->client_list, cluster_entries) {
+	TAILQ_FOREACH(client, &cluster->node_id_hash[qnetd_cluster_node_id_hash(node_id)],
+	    cluster_node_id_entries) {
 		if (client->node_id == node_id) {
 			return (client);
 		}
@@ -93,3 +113,125 @@ qnetd_cluster_find_client_by_node_id(const struct qnetd_cluster *cluster, uint32
 
 	return (NULL);
 }
+
+struct qnetd_cluster_partition *
+qnetd_cluster_find_partition(const struct qnetd_cluster *cluster, const struct tlv_ring_id *ring_id)
+{
+	struct qnetd_cluster_partition *partition;
+
+	TAILQ_FOREACH(partition, &cluster->partition_list, entries) {
+		if (tlv_ring_id_eq(&partition->ring_id, ring_id)) {
+			return (partition);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Find partition with given ring id or create new (empty) one
+ */
+static struct qnetd_cluster_partition *
+qnetd_cluster_get_partition(struct qnetd_cluster *cluster, const struct tlv_ring_id *ring_id)
+{
+	struct qnetd_cluster_partition *partition;
+
+	partition = qnetd_cluster_find_partition(cluster, ring_id);
+	if (partition != NULL) {
+		return (partition);
+	}
+
+	partition = malloc(sizeof(*partition));
+	if (partition == NULL) {
+		return (NULL);
+	}
+
+	memset(partition, 0, sizeof(*partition));
+	memcpy(&partition->ring_id, ring_id, sizeof(*ring_id));
+	TAILQ_INIT(&partition->client_list);
+	TAILQ_INSERT_TAIL(&cluster->partition_list, partition, entries);
+
+	return (partition);
+}
+
+static void
+qnetd_cluster_partition_add_client(struct qnetd_cluster_partition *partition,
+    struct qnetd_client *client)
+{
+
+	TAILQ_INSERT_TAIL(&partition->client_list, client, cluster_partition_entries);
+	partition->no_clients++;
+	client->cluster_partition = partition;
+}
+
+static void
+qnetd_cluster_partition_del_client(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+	struct qnetd_cluster_partition *partition;
+
+	partition = client->cluster_partition;
+
+	TAILQ_REMOVE(&partition->client_list, client, cluster_partition_entries);
+	partition->no_clients--;
+	client->cluster_partition = NULL;
+
+	if (partition->no_clients == 0) {
+		TAILQ_REMOVE(&cluster->partition_list, partition, entries);
+		free(partition);
+	}
+}
+
+int
+qnetd_cluster_add_client(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+	struct qnetd_cluster_partition *partition;
+
+	partition = qnetd_cluster_get_partition(cluster, &client->last_ring_id);
+	if (partition == NULL) {
+		return (-1);
+	}
+
+	TAILQ_INSERT_TAIL(&cluster->client_list, client, cluster_entries);
+	TAILQ_INSERT_TAIL(&cluster->node_id_hash[qnetd_cluster_node_id_hash(client->node_id)],
+	    client, cluster_node_id_entries);
+	qnetd_cluster_partition_add_client(partition, client);
+	cluster->no_clients++;
+
+	return (0);
+}
+
+void
+qnetd_cluster_del_client(struct qnetd_cluster *cluster, struct qnetd_client *client)
+{
+
+	TAILQ_REMOVE(&cluster->client_list, client, cluster_entries);
+	TAILQ_REMOVE(&cluster->node_id_hash[qnetd_cluster_node_id_hash(client->node_id)],
+	    client, cluster_node_id_entries);
+	qnetd_cluster_partition_del_client(cluster, client);
+	cluster->no_clients--;
+}
+
+/*
+ * Store new client->last_ring_id and move client to matching partition.
+ * Returns -1 (and keeps old ring id) if partition can't be allocated.
+ */
+int
+qnetd_cluster_set_client_ring_id(struct qnetd_cluster *cluster, struct qnetd_client *client,
+    const struct tlv_ring_id *ring_id)
+{
+	struct qnetd_cluster_partition *partition;
+
+	if (!tlv_ring_id_eq(&client->last_ring_id, ring_id)) {
+		partition = qnetd_cluster_get_partition(cluster, ring_id);
+		if (partition == NULL) {
+			return (-1);
+		}
+
+		qnetd_cluster_partition_del_client(cluster, client);
+		qnetd_cluster_partition_add_client(partition, client);
+	}
+
+	memcpy(&client->last_ring_id, ring_id, sizeof(*ring_id));
+
+	return (0);
+}
@@ -40,6 +40,7 @@
 #include <sys/queue.h>
 #include <inttypes.h>
 
+#include "qnet-config.h"
 #include "tlv.h"
 #include "qnetd-client-list.h"
 
@@ -47,12 +48,30 @@
 extern "C" {
 #endif
 
+/*
+ * Summary of clients sharing same last_ring_id. Kept up to date when client is
+ * added, removed or changes ring id, so algorithms don't have to rebuild it
+ * by walking all clients.
+ */
+struct qnetd_cluster_partition {
+	struct tlv_ring_id ring_id;
+	size_t no_clients;
+	struct qnetd_client_list client_list;
+	TAILQ_ENTRY(qnetd_cluster_partition) entries;
+};
+
+TAILQ_HEAD(qnetd_cluster_partition_list, qnetd_cluster_partition);
+
 struct qnetd_cluster {
 	char *cluster_name;
 	size_t cluster_name_len;
 	void *algorithm_data;
 	struct qnetd_client_list client_list;
+	size_t no_clients;
+	struct qnetd_client_list node_id_hash[QNETD_CLUSTER_NODE_ID_HASH_SIZE];
+	struct qnetd_cluster_partition_list partition_list;
 	TAILQ_ENTRY(qnetd_cluster) entries;
+	TAILQ_ENTRY(qnetd_cluster) hash_entries;
 };
 
 extern int			qnetd_cluster_init(struct qnetd_cluster *cluster,
@@ -62,6 +81,18 @@ extern void			qnetd_cluster_destroy(struct qnetd_cluster *cluster);
 
 extern size_t			qnetd_cluster_size(const struct qnetd_cluster *cluster);
 
+extern int			qnetd_cluster_add_client(struct qnetd_cluster *cluster,
+    struct qnetd_client *client);
+
+extern void			qnetd_cluster_del_client(struct qnetd_cluster *cluster,
+    struct qnetd_client *client);
+
+extern int			qnetd_cluster_set_client_ring_id(struct qnetd_cluster *cluster,
+    struct qnetd_client *client, const struct tlv_ring_id *ring_id);
+
+extern struct qnetd_cluster_partition *qnetd_cluster_find_partition(
+    const struct qnetd_cluster *cluster, const struct tlv_ring_id *ring_id);
+
 extern struct qnetd_client	*qnetd_cluster_find_client_by_node_id(
     const struct qnetd_cluster *cluster, uint32_t node_id);
 
@@ -57,6 +57,7 @@ qnetd_dpd_timer_cb(void *data1, void *data2)
 				    client->addr_str, client->dpd_time_since_last_check);
 
 				client->schedule_disconnect = 1;
+				qnetd_client_epoll_update_queue(client);
 			} else {
 				client->dpd_time_since_last_check = 0;
 				client->dpd_msg_received_since_last_check = 0;
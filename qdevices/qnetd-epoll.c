@@ -0,0 +1,484 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the Red Hat, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "qnet-config.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "qnetd-epoll.h"
+#include "qnetd-instance.h"
+#include "qnetd-ipc.h"
+#include "qnetd-log.h"
+
+/*
+ * Needed for getting unix fd from nspr handle
+ */
+#include <private/pprio.h>
+
+void
+qnetd_epoll_init(struct qnetd_epoll *epoll)
+{
+
+	memset(epoll, 0, sizeof(*epoll));
+	epoll->fd = -1;
+	qnetd_client_list_init(&epoll->update_list);
+	epoll->server_user_data.type = QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET;
+	epoll->ipc_socket_user_data.type = QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_SOCKET;
+}
+
+void
+qnetd_epoll_destroy(struct qnetd_epoll *epoll)
+{
+
+	if (epoll->fd != -1) {
+		close(epoll->fd);
+		epoll->fd = -1;
+	}
+
+	free(epoll->events);
+	epoll->events = NULL;
+	epoll->no_events = 0;
+	epoll->allocated_events = 0;
+}
+
+void
+qnetd_epoll_client_add(struct qnetd_instance *instance, struct qnetd_client *client)
+{
+
+	if (instance->epoll.fd == -1) {
+		return ;
+	}
+
+	client->epoll.update_list = &instance->epoll.update_list;
+	qnetd_client_epoll_update_queue(client);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static int
+qnetd_epoll_event_add(struct qnetd_epoll *epoll, struct qnetd_poll_array_user_data *user_data,
+    PRInt16 out_flags)
+{
+	struct qnetd_epoll_event *new_events;
+	struct qnetd_ipc_user_data *ipc_user_data;
+	uint64_t *event_round;
+	size_t *event_index;
+	size_t new_size;
+
+	event_round = NULL;
+	event_index = NULL;
+
+	if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT) {
+		event_round = &user_data->client->epoll.event_round;
+		event_index = &user_data->client->epoll.event_index;
+	} else if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT) {
+		ipc_user_data = (struct qnetd_ipc_user_data *)user_data->ipc_client->user_data;
+		event_round = &ipc_user_data->epoll_event_round;
+		event_index = &ipc_user_data->epoll_event_index;
+	}
+
+	/*
+	 * Client and IPC client may be both ready after update (or scheduled for
+	 * disconnect) and returned by epoll_wait. Report them only once.
+	 */
+	if (event_round != NULL && *event_round == epoll->round) {
+		epoll->events[*event_index].out_flags |= out_flags;
+
+		return (0);
+	}
+
+	if (epoll->no_events >= epoll->allocated_events) {
+		new_size = (epoll->allocated_events * 2) + QNETD_EPOLL_MAX_EVENTS;
+
+		new_events = realloc(epoll->events, sizeof(*new_events) * new_size);
+		if (new_events == NULL) {
+			return (-1);
+		}
+
+		epoll->events = new_events;
+		epoll->allocated_events = new_size;
+	}
+
+	if (event_round != NULL) {
+		*event_round = epoll->round;
+		*event_index = epoll->no_events;
+	}
+
+	epoll->events[epoll->no_events].user_data = user_data;
+	epoll->events[epoll->no_events].out_flags = out_flags;
+	epoll->no_events++;
+
+	return (0);
+}
+
+/*
+ * Translate epoll events of the OS socket to flags of the (possibly SSL) NSPR socket.
+ * This is the same translation PR_Poll does for layered sockets.
+ */
+static PRInt16
+qnetd_epoll_events_to_out_flags(uint32_t events, PRInt16 in_flags_read, PRInt16 in_flags_write)
+{
+	PRInt16 out_flags;
+
+	out_flags = 0;
+
+	if (events & EPOLLIN) {
+		if (in_flags_read & PR_POLL_READ) {
+			out_flags |= PR_POLL_READ;
+		}
+
+		if (in_flags_write & PR_POLL_READ) {
+			out_flags |= PR_POLL_WRITE;
+		}
+	}
+
+	if (events & EPOLLOUT) {
+		if (in_flags_read & PR_POLL_WRITE) {
+			out_flags |= PR_POLL_READ;
+		}
+
+		if (in_flags_write & PR_POLL_WRITE) {
+			out_flags |= PR_POLL_WRITE;
+		}
+	}
+
+	if (events & EPOLLERR) {
+		out_flags |= PR_POLL_ERR;
+	}
+
+	if (events & EPOLLHUP) {
+		out_flags |= PR_POLL_HUP;
+	}
+
+	return (out_flags);
+}
+
+static int
+qnetd_epoll_ctl(struct qnetd_epoll *epoll, int op, int fd, uint32_t events,
+    struct qnetd_poll_array_user_data *user_data)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = user_data;
+
+	return (epoll_ctl(epoll->fd, op, fd, &ev));
+}
+
+/*
+ * Register client socket or change its events. Returns -1 on error, otherwise 0
+ * and ready_flags set when the client can be processed without waiting for OS socket.
+ */
+static int
+qnetd_epoll_client_update(struct qnetd_epoll *epoll, struct qnetd_client *client,
+    PRInt16 *ready_flags)
+{
+	PRInt16 in_flags_read, in_flags_write;
+	PRInt16 out_flags_read, out_flags_write;
+	uint32_t events;
+	int op;
+
+	/*
+	 * Ask socket layers what they need from the OS socket, same as PR_Poll does.
+	 * SSL layer may already hold decrypted data, so client is ready even
+	 * when nothing more arrives on the OS socket.
+	 */
+	out_flags_read = 0;
+	out_flags_write = 0;
+	in_flags_write = 0;
+
+	in_flags_read = client->socket->methods->poll(client->socket, PR_POLL_READ,
+	    &out_flags_read);
+
+	if (!send_buffer_list_empty(&client->send_buffer_list)) {
+		in_flags_write = client->socket->methods->poll(client->socket, PR_POLL_WRITE,
+		    &out_flags_write);
+	}
+
+	client->epoll.in_flags_read = in_flags_read;
+	client->epoll.in_flags_write = in_flags_write;
+
+	events = 0;
+	if ((in_flags_read | in_flags_write) & PR_POLL_READ) {
+		events |= EPOLLIN;
+	}
+
+	if ((in_flags_read | in_flags_write) & PR_POLL_WRITE) {
+		events |= EPOLLOUT;
+	}
+
+	if (!client->epoll.registered || events != client->epoll.events) {
+		op = (client->epoll.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+
+		if (qnetd_epoll_ctl(epoll, op, PR_FileDesc2NativeHandle(client->socket), events,
+		    &client->epoll.user_data) == -1) {
+			qnetd_log_err(LOG_ERR, "Can't update epoll events of client socket. "
+			    "Disconnecting client");
+
+			return (-1);
+		}
+
+		client->epoll.registered = 1;
+		client->epoll.events = events;
+	}
+
+	*ready_flags = 0;
+	if ((in_flags_read & out_flags_read) || (in_flags_write & out_flags_write)) {
+		*ready_flags = out_flags_read | out_flags_write;
+	}
+
+	return (0);
+}
+
+/*
+ * There are only few IPC clients, so their events are simply checked on every wakeup
+ */
+static int
+qnetd_epoll_ipc_clients_update(struct qnetd_instance *instance)
+{
+	struct qnetd_epoll *epoll;
+	struct unix_socket_client *ipc_client;
+	struct qnetd_ipc_user_data *ipc_user_data;
+	uint32_t events;
+	int op;
+
+	epoll = &instance->epoll;
+
+	TAILQ_FOREACH(ipc_client, &instance->local_ipc.clients, entries) {
+		ipc_user_data = (struct qnetd_ipc_user_data *)ipc_client->user_data;
+		ipc_user_data->epoll_user_data.type = QNETD_POLL_ARRAY_USER_DATA_TYPE_IPC_CLIENT;
+		ipc_user_data->epoll_user_data.ipc_client = ipc_client;
+
+		events = 0;
+		if (ipc_client->reading_line) {
+			events |= EPOLLIN;
+		}
+
+		if (ipc_client->writing_buffer) {
+			events |= EPOLLOUT;
+		}
+
+		if (!ipc_client->schedule_disconnect && events != ipc_user_data->epoll_events) {
+			if (events == 0) {
+				op = EPOLL_CTL_DEL;
+			} else if (ipc_user_data->epoll_events == 0) {
+				op = EPOLL_CTL_ADD;
+			} else {
+				op = EPOLL_CTL_MOD;
+			}
+
+			if (qnetd_epoll_ctl(epoll, op, ipc_client->socket, events,
+			    &ipc_user_data->epoll_user_data) == -1) {
+				qnetd_log_err(LOG_ERR, "Can't update epoll events of IPC client "
+				    "socket. Disconnecting client");
+
+				ipc_client->schedule_disconnect = 1;
+			} else {
+				ipc_user_data->epoll_events = events;
+			}
+		}
+
+		if (ipc_client->schedule_disconnect) {
+			if (qnetd_epoll_event_add(epoll, &ipc_user_data->epoll_user_data, 0) != 0) {
+				return (-1);
+			}
+		}
+	}
+
+	return (0);
+}
+
+static int
+qnetd_epoll_timeout(PRIntervalTime timeout)
+{
+	PRUint32 timeout_ms;
+
+	if (timeout == PR_INTERVAL_NO_TIMEOUT) {
+		return (-1);
+	}
+
+	/*
+	 * Round up, otherwise epoll_wait would spin until timer expires
+	 */
+	timeout_ms = PR_IntervalToMilliseconds(timeout);
+	if (PR_MillisecondsToInterval(timeout_ms) < timeout) {
+		timeout_ms++;
+	}
+
+	if (timeout_ms > INT_MAX) {
+		timeout_ms = INT_MAX;
+	}
+
+	return ((int)timeout_ms);
+}
+
+int
+qnetd_epoll_start(struct qnetd_instance *instance)
+{
+	struct qnetd_epoll *epoll;
+
+	epoll = &instance->epoll;
+
+	if ((epoll->fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+		qnetd_log_err(LOG_ERR, "Can't create epoll fd");
+
+		return (-1);
+	}
+
+	if (qnetd_epoll_ctl(epoll, EPOLL_CTL_ADD,
+	    PR_FileDesc2NativeHandle(instance->server.socket), EPOLLIN,
+	    &epoll->server_user_data) == -1) {
+		qnetd_log_err(LOG_ERR, "Can't add listening socket to epoll");
+
+		return (-1);
+	}
+
+	if (qnetd_epoll_ctl(epoll, EPOLL_CTL_ADD, instance->local_ipc.socket, EPOLLIN,
+	    &epoll->ipc_socket_user_data) == -1) {
+		qnetd_log_err(LOG_ERR, "Can't add IPC listening socket to epoll");
+
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Wait for events. Clients on update list are (re)registered first. Result is
+ * stored in epoll->events and every client is there at most once.
+ *
+ * Returns number of events or -1 on fatal error.
+ */
+int
+qnetd_epoll_wait(struct qnetd_instance *instance, PRIntervalTime timeout)
+{
+	struct epoll_event events[QNETD_EPOLL_MAX_EVENTS];
+	struct qnetd_epoll *epoll;
+	struct qnetd_client *client;
+	struct qnetd_poll_array_user_data *user_data;
+	PRInt16 out_flags;
+	int no_events;
+	int i;
+
+	epoll = &instance->epoll;
+
+	epoll->round++;
+	epoll->no_events = 0;
+
+	if (qnetd_epoll_ipc_clients_update(instance) != 0) {
+		return (-1);
+	}
+
+	while ((client = TAILQ_FIRST(&epoll->update_list)) != NULL) {
+		TAILQ_REMOVE(&epoll->update_list, client, epoll.update_entries);
+		client->epoll.update_queued = 0;
+
+		out_flags = 0;
+
+		if (!client->schedule_disconnect &&
+		    qnetd_epoll_client_update(epoll, client, &out_flags) != 0) {
+			client->schedule_disconnect = 1;
+		}
+
+		if (client->schedule_disconnect || out_flags != 0) {
+			if (qnetd_epoll_event_add(epoll, &client->epoll.user_data, out_flags) != 0) {
+				return (-1);
+			}
+		}
+	}
+
+	if (epoll->no_events > 0) {
+		timeout = PR_INTERVAL_NO_WAIT;
+	}
+
+	no_events = epoll_wait(epoll->fd, events, QNETD_EPOLL_MAX_EVENTS,
+	    qnetd_epoll_timeout(timeout));
+	if (no_events == -1) {
+		if (errno != EINTR) {
+			qnetd_log_err(LOG_CRIT, "epoll_wait failed");
+
+			return (-1);
+		}
+
+		no_events = 0;
+	}
+
+	for (i = 0; i < no_events; i++) {
+		user_data = (struct qnetd_poll_array_user_data *)events[i].data.ptr;
+
+		if (user_data->type == QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT) {
+			client = user_data->client;
+			out_flags = qnetd_epoll_events_to_out_flags(events[i].events,
+			    client->epoll.in_flags_read, client->epoll.in_flags_write);
+		} else {
+			out_flags = qnetd_epoll_events_to_out_flags(events[i].events,
+			    PR_POLL_READ, PR_POLL_WRITE);
+		}
+
+		if (qnetd_epoll_event_add(epoll, user_data, out_flags) != 0) {
+			return (-1);
+		}
+	}
+
+	return (epoll->no_events);
+}
+
+#else
+
+int
+qnetd_epoll_start(struct qnetd_instance *instance)
+{
+
+	qnetd_log(LOG_ERR, "Epoll is not supported on this platform");
+
+	return (-1);
+}
+
+int
+qnetd_epoll_wait(struct qnetd_instance *instance, PRIntervalTime timeout)
+{
+
+	return (-1);
+}
+
+#endif
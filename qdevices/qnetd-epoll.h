@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the Red Hat, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _QNETD_EPOLL_H_
+#define _QNETD_EPOLL_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <nspr.h>
+
+#include "qnetd-client-list.h"
+#include "qnetd-poll-array-user-data.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct qnetd_instance;
+
+struct qnetd_epoll_event {
+	struct qnetd_poll_array_user_data *user_data;
+	PRInt16 out_flags;
+};
+
+/*
+ * Epoll backend of the qnetd main loop. Sockets stay registered for their whole
+ * life and registration of a client is only changed when the client is put on
+ * update_list, so an idle client costs nothing per wakeup.
+ */
+struct qnetd_epoll {
+	int fd;
+	struct qnetd_client_list update_list;
+	struct qnetd_epoll_event *events;
+	size_t no_events;
+	size_t allocated_events;
+	uint64_t round;
+	struct qnetd_poll_array_user_data server_user_data;
+	struct qnetd_poll_array_user_data ipc_socket_user_data;
+};
+
+extern void		qnetd_epoll_init(struct qnetd_epoll *epoll);
+
+extern int		qnetd_epoll_start(struct qnetd_instance *instance);
+
+extern void		qnetd_epoll_destroy(struct qnetd_epoll *epoll);
+
+extern void		qnetd_epoll_client_add(struct qnetd_instance *instance,
+    struct qnetd_client *client);
+
+extern int		qnetd_epoll_wait(struct qnetd_instance *instance,
+    PRIntervalTime timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QNETD_EPOLL_H_ */
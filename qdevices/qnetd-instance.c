@@ -54,6 +54,7 @@ qnetd_instance_init(struct qnetd_instance *instance,
 	instance->advanced_settings = advanced_settings;
 
 	pr_poll_array_init(&instance->poll_array, sizeof(struct qnetd_poll_array_user_data));
+	qnetd_epoll_init(&instance->epoll);
 	qnetd_client_list_init(&instance->clients);
 	qnetd_cluster_list_init(&instance->clusters);
 
@@ -89,6 +90,7 @@ qnetd_instance_destroy(struct qnetd_instance *instance)
 	}
 
 	pr_poll_array_destroy(&instance->poll_array);
+	qnetd_epoll_destroy(&instance->epoll);
 	qnetd_cluster_list_free(&instance->clusters);
 	qnetd_client_list_free(&instance->clients);
 	timer_list_free(&instance->main_timer_list);
@@ -44,6 +44,7 @@
 #include "qnetd-client-list.h"
 #include "qnetd-cluster-list.h"
 #include "pr-poll-array.h"
+#include "qnetd-epoll.h"
 #include "qnet-config.h"
 #include "timer-list.h"
 #include "unix-socket-ipc.h"
@@ -63,6 +64,7 @@ struct qnetd_instance {
 	struct qnetd_client_list clients;
 	struct qnetd_cluster_list clusters;
 	struct pr_poll_array poll_array;
+	struct qnetd_epoll epoll;
 	enum tlv_tls_supported tls_supported;
 	int tls_client_cert_required;
 	const char *host_addr;
@@ -248,7 +248,7 @@ qnetd_ipc_cmd_list(struct qnetd_instance *instance, struct dynar *outbuf, int ve
 	size_t cluster_no, client_no;
 
 	cluster_no = 0;
-	TAILQ_FOREACH(cluster, &instance->clusters, entries) {
+	TAILQ_FOREACH(cluster, &instance->clusters.list, entries) {
 		if (cluster_name != NULL && strcmp(cluster_name, "") != 0 &&
 		    strcmp(cluster_name, cluster->cluster_name) != 0) {
 			continue;
@@ -36,6 +36,7 @@
 #define _QNETD_IPC_H_
 
 #include "qnetd-instance.h"
+#include "qnetd-poll-array-user-data.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,6 +45,10 @@ extern "C" {
 struct qnetd_ipc_user_data {
 	int shutdown_requested;
 	PRFileDesc *nspr_poll_fd;
+	struct qnetd_poll_array_user_data epoll_user_data;
+	uint32_t epoll_events;
+	uint64_t epoll_event_round;
+	size_t epoll_event_index;
 };
 
 extern int		qnetd_ipc_init(struct qnetd_instance *instance);
@@ -35,12 +35,13 @@
 #ifndef _QNETD_POLL_ARRAY_USER_DATA_H_
 #define _QNETD_POLL_ARRAY_USER_DATA_H_
 
-#include "qnetd-client.h"
-
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct qnetd_client;
+struct unix_socket_client;
+
 enum qnetd_poll_array_user_data_type {
 	QNETD_POLL_ARRAY_USER_DATA_TYPE_SOCKET,
 	QNETD_POLL_ARRAY_USER_DATA_TYPE_CLIENT,
@@ -40,11 +40,13 @@
 #include "qnetd-client.h"
 #include "qnetd-client-list.h"
 
+#define TEST_CLUSTERS	(QNETD_CLUSTER_LIST_HASH_SIZE * 4)
+
 static struct qnetd_client_list clients;
 static struct qnetd_cluster_list clusters;
 
 static void
-add_client(const char *cluster_name, size_t cluster_name_len,
+add_client(const char *cluster_name, size_t cluster_name_len, uint32_t node_id,
     struct qnetd_client **client, struct qnetd_cluster **cluster)
 {
 	PRNetAddr addr;
@@ -63,6 +65,7 @@ add_client(const char *cluster_name, size_t cluster_name_len,
 	assert(tmp_client->cluster_name != NULL);
 	memcpy(tmp_client->cluster_name, cluster_name, cluster_name_len);
 	tmp_client->cluster_name_len = cluster_name_len;
+	tmp_client->node_id = node_id;
 
 	tmp_cluster = qnetd_cluster_list_add_client(&clusters, tmp_client);
 	assert(cluster != NULL);
@@ -95,7 +98,7 @@ no_clusters(void)
 
 	i = 0;
 
-	TAILQ_FOREACH(cluster, &clusters, entries) {
+	TAILQ_FOREACH(cluster, &clusters.list, entries) {
 		i++;
 	}
 
@@ -116,6 +119,21 @@ is_client_in_cluster(struct qnetd_cluster *cluster, const struct qnetd_client *c
 	return (0);
 }
 
+static size_t
+no_partitions(struct qnetd_cluster *cluster)
+{
+	size_t i;
+	struct qnetd_cluster_partition *partition;
+
+	i = 0;
+
+	TAILQ_FOREACH(partition, &cluster->partition_list, entries) {
+		i++;
+	}
+
+	return (i);
+}
+
 static void
 del_client(struct qnetd_client *client)
 {
@@ -129,7 +147,11 @@ main(void)
 {
 	struct qnetd_client *client[4];
 	struct qnetd_cluster *cluster[4];
+	struct qnetd_client *many_clients[TEST_CLUSTERS];
+	struct tlv_ring_id ring_id1, ring_id2;
+	char cl_name_buf[32];
 	const char *cl_name;
+	size_t i;
 
 	qnetd_client_list_init(&clients);
 	qnetd_cluster_list_init(&clusters);
@@ -137,15 +159,15 @@ main(void)
 	assert(no_clusters() == 0);
 
 	cl_name = "test_cluster";
-	add_client(cl_name, strlen(cl_name), &client[0], &cluster[0]);
+	add_client(cl_name, strlen(cl_name), 1, &client[0], &cluster[0]);
 	assert(no_clusters() == 1);
-	add_client(cl_name, strlen(cl_name), &client[1], &cluster[1]);
+	add_client(cl_name, strlen(cl_name), 2, &client[1], &cluster[1]);
 	assert(no_clusters() == 1);
 
 	cl_name = "cluster2";
-	add_client(cl_name, strlen(cl_name), &client[2], &cluster[2]);
+	add_client(cl_name, strlen(cl_name), 3, &client[2], &cluster[2]);
 	assert(no_clusters() == 2);
-	add_client(cl_name, strlen(cl_name), &client[3], &cluster[3]);
+	add_client(cl_name, strlen(cl_name), 4, &client[3], &cluster[3]);
 	assert(no_clusters() == 2);
 
 	assert(cluster[0] == cluster[1]);
@@ -177,7 +199,7 @@ main(void)
 	assert(!is_client_in_cluster(cluster[0], client[2]));
 	assert(!is_client_in_cluster(cluster[0], client[3]));
 
-	add_client(cl_name, strlen(cl_name), &client[0], &cluster[0]);
+	add_client(cl_name, strlen(cl_name), 5, &client[0], &cluster[0]);
 	assert(no_clients_in_cluster(cluster[1]) == 1);
 	assert(no_clients_in_cluster(cluster[2]) == 3);
 
@@ -202,6 +224,90 @@ main(void)
 
 	del_client(client[0]);
 	assert(no_clusters() == 0);
+	assert(qnetd_cluster_list_size(&clusters) == 0);
+
+	/*
+	 * Lookup of client by node id and partitions
+	 */
+	cl_name = "test_cluster";
+	add_client(cl_name, strlen(cl_name), 1, &client[0], &cluster[0]);
+	add_client(cl_name, strlen(cl_name), 2, &client[1], &cluster[1]);
+	add_client(cl_name, strlen(cl_name), 1 + QNETD_CLUSTER_NODE_ID_HASH_SIZE,
+	    &client[2], &cluster[2]);
+	assert(qnetd_cluster_size(cluster[0]) == 3);
+
+	assert(qnetd_cluster_find_client_by_node_id(cluster[0], 1) == client[0]);
+	assert(qnetd_cluster_find_client_by_node_id(cluster[0], 2) == client[1]);
+	assert(qnetd_cluster_find_client_by_node_id(cluster[0],
+	    1 + QNETD_CLUSTER_NODE_ID_HASH_SIZE) == client[2]);
+	assert(qnetd_cluster_find_client_by_node_id(cluster[0], 3) == NULL);
+
+	assert(no_partitions(cluster[0]) == 1);
+	assert(qnetd_cluster_find_partition(cluster[0], &client[0]->last_ring_id)->no_clients == 3);
+
+	ring_id1.node_id = 1;
+	ring_id1.seq = 4;
+	ring_id2.node_id = 2;
+	ring_id2.seq = 8;
+	assert(qnetd_cluster_set_client_ring_id(cluster[0], client[0], &ring_id1) == 0);
+	assert(tlv_ring_id_eq(&client[0]->last_ring_id, &ring_id1));
+	assert(qnetd_cluster_set_client_ring_id(cluster[0], client[1], &ring_id1) == 0);
+	assert(no_partitions(cluster[0]) == 2);
+	assert(qnetd_cluster_find_partition(cluster[0], &ring_id1)->no_clients == 2);
+	assert(client[0]->cluster_partition == client[1]->cluster_partition);
+	assert(client[0]->cluster_partition != client[2]->cluster_partition);
+
+	assert(qnetd_cluster_set_client_ring_id(cluster[0], client[2], &ring_id2) == 0);
+	assert(no_partitions(cluster[0]) == 2);
+	assert(qnetd_cluster_find_partition(cluster[0], &ring_id2)->no_clients == 1);
+
+	assert(qnetd_cluster_set_client_ring_id(cluster[0], client[2], &ring_id1) == 0);
+	assert(no_partitions(cluster[0]) == 1);
+	assert(qnetd_cluster_find_partition(cluster[0], &ring_id2) == NULL);
+	assert(qnetd_cluster_find_partition(cluster[0], &ring_id1)->no_clients == 3);
+
+	del_client(client[1]);
+	assert(qnetd_cluster_find_client_by_node_id(cluster[0], 2) == NULL);
+	assert(qnetd_cluster_find_client_by_node_id(cluster[0], 1) == client[0]);
+	assert(qnetd_cluster_find_partition(cluster[0], &ring_id1)->no_clients == 2);
+	del_client(client[0]);
+	del_client(client[2]);
+	assert(no_clusters() == 0);
+
+	/*
+	 * More clusters than hash buckets are still found by name
+	 */
+	for (i = 0; i < TEST_CLUSTERS; i++) {
+		snprintf(cl_name_buf, sizeof(cl_name_buf), "cluster%zu", i);
+		add_client(cl_name_buf, strlen(cl_name_buf), 1, &many_clients[i], &cluster[0]);
+	}
+	assert(qnetd_cluster_list_size(&clusters) == TEST_CLUSTERS);
+	assert(no_clusters() == TEST_CLUSTERS);
+
+	for (i = 0; i < TEST_CLUSTERS; i++) {
+		snprintf(cl_name_buf, sizeof(cl_name_buf), "cluster%zu", i);
+		assert(qnetd_cluster_list_find_by_name(&clusters, cl_name_buf,
+		    strlen(cl_name_buf)) == many_clients[i]->cluster);
+	}
+	assert(qnetd_cluster_list_find_by_name(&clusters, "cluster", strlen("cluster")) == NULL);
+
+	for (i = 0; i < TEST_CLUSTERS; i += 2) {
+		del_client(many_clients[i]);
+	}
+	assert(qnetd_cluster_list_size(&clusters) == TEST_CLUSTERS / 2);
+
+	for (i = 0; i < TEST_CLUSTERS; i++) {
+		snprintf(cl_name_buf, sizeof(cl_name_buf), "cluster%zu", i);
+		cluster[0] = qnetd_cluster_list_find_by_name(&clusters, cl_name_buf,
+		    strlen(cl_name_buf));
+		if (i % 2 == 0) {
+			assert(cluster[0] == NULL);
+		} else {
+			assert(cluster[0] == many_clients[i]->cluster);
+			del_client(many_clients[i]);
+		}
+	}
+	assert(no_clusters() == 0);
 
 	return (0);
 }
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the Red Hat, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "timer-list.h"
+
+#define TEST_ENTRIES	1000
+
+static struct timer_list tlist;
+static struct timer_list_entry *entries[TEST_ENTRIES];
+static int fired[TEST_ENTRIES];
+static PRIntervalTime last_expire_time;
+static int fired_out_of_order;
+
+static void
+check_heap(void)
+{
+	size_t i;
+
+	for (i = 0; i < tlist.heap_size; i++) {
+		assert(tlist.heap[i]->is_active);
+		assert(tlist.heap[i]->heap_index == i);
+
+		if (i > 0) {
+			assert((PRInt32)(tlist.heap[i]->expire_time -
+			    tlist.heap[(i - 1) / 2]->expire_time) >= 0);
+		}
+	}
+}
+
+static int
+timer_cb(void *data1, void *data2)
+{
+	size_t i;
+
+	i = (size_t)data1;
+	fired[i]++;
+
+	if (fired[i] == 1 && (PRInt32)(entries[i]->expire_time - last_expire_time) < 0) {
+		fired_out_of_order = 1;
+	}
+	last_expire_time = entries[i]->expire_time;
+
+	return (data2 != NULL);
+}
+
+static int
+timer_delete_other_cb(void *data1, void *data2)
+{
+
+	/*
+	 * Delete both itself and other timer from callback
+	 */
+	timer_list_delete(&tlist, (struct timer_list_entry *)data2);
+	timer_list_delete(&tlist, entries[(size_t)data1]);
+	fired[(size_t)data1]++;
+
+	return (-1);
+}
+
+static void
+wait_and_expire(PRUint32 ms)
+{
+
+	PR_Sleep(PR_MillisecondsToInterval(ms));
+	timer_list_expire(&tlist);
+	check_heap();
+}
+
+int
+main(void)
+{
+	size_t i;
+
+	timer_list_init(&tlist);
+
+	assert(timer_list_time_to_expire(&tlist) == PR_INTERVAL_NO_TIMEOUT);
+	assert(timer_list_add(&tlist, 0, timer_cb, NULL, NULL) == NULL);
+	assert(timer_list_add(&tlist, TIMER_LIST_MAX_INTERVAL + 1, timer_cb, NULL, NULL) == NULL);
+
+	/*
+	 * Timers added in random order must fire ordered by expire time
+	 */
+	srand(1);
+	memset(fired, 0, sizeof(fired));
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		entries[i] = timer_list_add(&tlist, 1 + rand() % 50, timer_cb, (void *)i, NULL);
+		assert(entries[i] != NULL);
+	}
+	check_heap();
+	assert(tlist.heap_size == TEST_ENTRIES);
+	assert(timer_list_time_to_expire(&tlist) <= PR_MillisecondsToInterval(50));
+
+	/*
+	 * Delete every third timer, it must never fire
+	 */
+	for (i = 0; i < TEST_ENTRIES; i += 3) {
+		timer_list_delete(&tlist, entries[i]);
+		assert(!entries[i]->is_active);
+		/*
+		 * Second delete is no-op
+		 */
+		timer_list_delete(&tlist, entries[i]);
+	}
+	check_heap();
+
+	last_expire_time = tlist.heap[0]->expire_time;
+	fired_out_of_order = 0;
+	wait_and_expire(100);
+	assert(!fired_out_of_order);
+	assert(tlist.heap_size == 0);
+	assert(timer_list_time_to_expire(&tlist) == PR_INTERVAL_NO_TIMEOUT);
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		assert(fired[i] == (i % 3 == 0 ? 0 : 1));
+		assert(!entries[i]->is_active);
+	}
+
+	/*
+	 * Entries from free list are reused
+	 */
+	memset(fired, 0, sizeof(fired));
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		entries[i] = timer_list_add(&tlist, (i % 2 == 0 ? 10 : 500), timer_cb, (void *)i,
+		    (i == 1 ? (void *)1 : NULL));
+		assert(entries[i] != NULL);
+	}
+	assert(tlist.heap_size == TEST_ENTRIES);
+	assert(TAILQ_EMPTY(&tlist.free_list));
+	check_heap();
+
+	/*
+	 * Rescheduling moves timers behind others
+	 */
+	for (i = 0; i < TEST_ENTRIES; i += 4) {
+		entries[i]->interval = 500;
+		timer_list_reschedule(&tlist, entries[i]);
+	}
+	check_heap();
+
+	wait_and_expire(50);
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		assert(fired[i] == (i % 2 == 0 && i % 4 != 0 ? 1 : 0));
+	}
+
+	/*
+	 * Entry 1 returns nonzero so it is scheduled again and stays active
+	 */
+	wait_and_expire(600);
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		assert(fired[i] == 1);
+		assert(entries[i]->is_active == (i == 1));
+	}
+	assert(tlist.heap_size == 1);
+	assert(timer_list_time_to_expire(&tlist) <= PR_MillisecondsToInterval(500));
+
+	wait_and_expire(600);
+	assert(fired[1] == 2);
+	timer_list_delete(&tlist, entries[1]);
+	assert(tlist.heap_size == 0);
+
+	/*
+	 * Callback deleting itself and other timer
+	 */
+	memset(fired, 0, sizeof(fired));
+	entries[1] = timer_list_add(&tlist, 100, timer_cb, (void *)1, NULL);
+	entries[2] = timer_list_add(&tlist, 100, timer_cb, (void *)2, NULL);
+	entries[0] = timer_list_add(&tlist, 1, timer_delete_other_cb, (void *)0, entries[1]);
+	assert(entries[0] != NULL && entries[1] != NULL && entries[2] != NULL);
+	wait_and_expire(10);
+	assert(fired[0] == 1);
+	assert(!entries[0]->is_active && !entries[1]->is_active && entries[2]->is_active);
+	assert(tlist.heap_size == 1 && tlist.heap[0] == entries[2]);
+
+	timer_list_free(&tlist);
+	assert(tlist.heap_size == 0);
+	assert(tlist.heap == NULL);
+
+	return (0);
+}
@@ -32,17 +32,19 @@
  * THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "timer-list.h"
 
+#define TIMER_LIST_HEAP_MIN_ALLOCATED		16
+
 void
 timer_list_init(struct timer_list *tlist)
 {
 
 	memset(tlist, 0, sizeof(*tlist));
 
-	TAILQ_INIT(&tlist->list);
 	TAILQ_INIT(&tlist->free_list);
 }
 
@@ -62,51 +64,135 @@ timer_list_entry_time_to_expire(const struct timer_list_entry *entry, PRInterval
 	return (diff);
 }
 
+/*
+ * Return nonzero if entry1 expires before entry2. All active entries expire
+ * within TIMER_LIST_MAX_INTERVAL of each other, which is less than half of
+ * PRIntervalTime range, so signed difference is correct also on wrap.
+ */
 static int
-timer_list_entry_cmp(const struct timer_list_entry *entry1,
-    const struct timer_list_entry *entry2, PRIntervalTime current_time)
+timer_list_entry_lt(const struct timer_list_entry *entry1, const struct timer_list_entry *entry2)
 {
-	PRIntervalTime diff1, diff2;
-	int res;
 
-	diff1 = timer_list_entry_time_to_expire(entry1, current_time);
-	diff2 = timer_list_entry_time_to_expire(entry2, current_time);
+	return ((PRInt32)(entry1->expire_time - entry2->expire_time) < 0);
+}
+
+static void
+timer_list_heap_set(struct timer_list *tlist, size_t index, struct timer_list_entry *entry)
+{
 
-	res = 0;
+	tlist->heap[index] = entry;
+	entry->heap_index = index;
+}
 
-	if (diff1 < diff2) res = -1;
-	if (diff1 > diff2) res = 1;
+static void
+timer_list_heap_sift_up(struct timer_list *tlist, size_t index)
+{
+	struct timer_list_entry *entry;
+	size_t parent;
+
+	entry = tlist->heap[index];
+
+	while (index > 0) {
+		parent = (index - 1) / 2;
+
+		if (!timer_list_entry_lt(entry, tlist->heap[parent])) {
+			break;
+		}
+
+		timer_list_heap_set(tlist, index, tlist->heap[parent]);
+		index = parent;
+	}
 
-	return (res);
+	timer_list_heap_set(tlist, index, entry);
 }
 
 static void
-timer_list_insert_into_list(struct timer_list *tlist, struct timer_list_entry *new_entry)
+timer_list_heap_sift_down(struct timer_list *tlist, size_t index)
 {
 	struct timer_list_entry *entry;
+	size_t child;
 
-	/*
-	 * This can overflow and it's not a problem
-	 */
-	new_entry->expire_time = new_entry->epoch + PR_MillisecondsToInterval(new_entry->interval);
+	entry = tlist->heap[index];
 
-	entry = TAILQ_FIRST(&tlist->list);
-	while (entry != NULL) {
-		if (timer_list_entry_cmp(entry, new_entry, new_entry->epoch) > 0) {
-			/*
-			 * Insert new entry right before current entry
-			 */
-			TAILQ_INSERT_BEFORE(entry, new_entry, entries);
+	while ((child = index * 2 + 1) < tlist->heap_size) {
+		if (child + 1 < tlist->heap_size &&
+		    timer_list_entry_lt(tlist->heap[child + 1], tlist->heap[child])) {
+			child++;
+		}
 
+		if (!timer_list_entry_lt(tlist->heap[child], entry)) {
 			break;
 		}
 
-		entry = TAILQ_NEXT(entry, entries);
+		timer_list_heap_set(tlist, index, tlist->heap[child]);
+		index = child;
+	}
+
+	timer_list_heap_set(tlist, index, entry);
+}
+
+/*
+ * Restore heap property after expire_time of entry at index has changed
+ */
+static void
+timer_list_heap_update(struct timer_list *tlist, size_t index)
+{
+
+	if (index > 0 && timer_list_entry_lt(tlist->heap[index], tlist->heap[(index - 1) / 2])) {
+		timer_list_heap_sift_up(tlist, index);
+	} else {
+		timer_list_heap_sift_down(tlist, index);
+	}
+}
+
+static void
+timer_list_heap_remove(struct timer_list *tlist, size_t index)
+{
+
+	tlist->heap_size--;
+
+	if (index == tlist->heap_size) {
+		return ;
 	}
 
-	if (entry == NULL) {
-		TAILQ_INSERT_TAIL(&tlist->list, new_entry, entries);
+	timer_list_heap_set(tlist, index, tlist->heap[tlist->heap_size]);
+	timer_list_heap_update(tlist, index);
+}
+
+static int
+timer_list_heap_reserve(struct timer_list *tlist)
+{
+	struct timer_list_entry **new_heap;
+	size_t new_allocated;
+
+	if (tlist->heap_size < tlist->heap_allocated) {
+		return (0);
+	}
+
+	new_allocated = tlist->heap_allocated * 2;
+	if (new_allocated < TIMER_LIST_HEAP_MIN_ALLOCATED) {
+		new_allocated = TIMER_LIST_HEAP_MIN_ALLOCATED;
+	}
+
+	new_heap = realloc(tlist->heap, new_allocated * sizeof(*new_heap));
+	if (new_heap == NULL) {
+		return (-1);
 	}
+
+	tlist->heap = new_heap;
+	tlist->heap_allocated = new_allocated;
+
+	return (0);
+}
+
+static void
+timer_list_entry_set_expire_time(struct timer_list_entry *entry)
+{
+
+	/*
+	 * This can overflow and it's not a problem
+	 */
+	entry->expire_time = entry->epoch + PR_MillisecondsToInterval(entry->interval);
 }
 
 struct timer_list_entry *
@@ -119,6 +205,10 @@ timer_list_add(struct timer_list *tlist, PRUint32 interval, timer_list_cb_fn fun
 		return (NULL);
 	}
 
+	if (timer_list_heap_reserve(tlist) != 0) {
+		return (NULL);
+	}
+
 	if (!TAILQ_EMPTY(&tlist->free_list)) {
 		/*
 		 * Use free list entry
@@ -142,8 +232,11 @@ timer_list_add(struct timer_list *tlist, PRUint32 interval, timer_list_cb_fn fun
 	new_entry->user_data1 = data1;
 	new_entry->user_data2 = data2;
 	new_entry->is_active = 1;
+	timer_list_entry_set_expire_time(new_entry);
 
-	timer_list_insert_into_list(tlist, new_entry);
+	tlist->heap[tlist->heap_size] = new_entry;
+	tlist->heap_size++;
+	timer_list_heap_sift_up(tlist, tlist->heap_size - 1);
 
 	return (new_entry);
 }
@@ -154,8 +247,8 @@ timer_list_reschedule(struct timer_list *tlist, struct timer_list_entry *entry)
 
 	if (entry->is_active) {
 		entry->epoch = PR_IntervalNow();
-		TAILQ_REMOVE(&tlist->list, entry, entries);
-		timer_list_insert_into_list(tlist, entry);
+		timer_list_entry_set_expire_time(entry);
+		timer_list_heap_update(tlist, entry->heap_index);
 	}
 }
 
@@ -168,8 +261,8 @@ timer_list_expire(struct timer_list *tlist)
 
 	now = PR_IntervalNow();
 
-	while ((entry = TAILQ_FIRST(&tlist->list)) != NULL &&
-	    timer_list_entry_time_to_expire(entry, now) == 0) {
+	while (tlist->heap_size > 0 &&
+	    timer_list_entry_time_to_expire((entry = tlist->heap[0]), now) == 0) {
 		/*
 		 * Expired
 		 */
@@ -181,11 +274,12 @@ timer_list_expire(struct timer_list *tlist)
 			timer_list_delete(tlist, entry);
 		} else if (entry->is_active) {
 			/*
-			 * Schedule again
+			 * Schedule again. Callback may have changed heap, so use
+			 * entry position instead of assuming it is still on top.
 			 */
 			entry->epoch = now;
-			TAILQ_REMOVE(&tlist->list, entry, entries);
-			timer_list_insert_into_list(tlist, entry);
+			timer_list_entry_set_expire_time(entry);
+			timer_list_heap_update(tlist, entry->heap_index);
 		}
 	}
 }
@@ -193,14 +287,12 @@ timer_list_expire(struct timer_list *tlist)
 PRIntervalTime
 timer_list_time_to_expire(struct timer_list *tlist)
 {
-	struct timer_list_entry *entry;
 
-	entry = TAILQ_FIRST(&tlist->list);
-	if (entry == NULL) {
+	if (tlist->heap_size == 0) {
 		return (PR_INTERVAL_NO_TIMEOUT);
 	}
 
-	return (timer_list_entry_time_to_expire(entry, PR_IntervalNow()));
+	return (timer_list_entry_time_to_expire(tlist->heap[0], PR_IntervalNow()));
 }
 
 void
@@ -211,7 +303,7 @@ timer_list_delete(struct timer_list *tlist, struct timer_list_entry *entry)
 		/*
 		 * Move item to free list
 		 */
-		TAILQ_REMOVE(&tlist->list, entry, entries);
+		timer_list_heap_remove(tlist, entry->heap_index);
 		TAILQ_INSERT_HEAD(&tlist->free_list, entry, entries);
 		entry->is_active = 0;
 	}
@@ -222,18 +314,14 @@ timer_list_free(struct timer_list *tlist)
 {
 	struct timer_list_entry *entry;
 	struct timer_list_entry *entry_next;
+	size_t i;
 
-
-	entry = TAILQ_FIRST(&tlist->list);
-
-	while (entry != NULL) {
-		entry_next = TAILQ_NEXT(entry, entries);
-
-		free(entry);
-
-		entry = entry_next;
+	for (i = 0; i < tlist->heap_size; i++) {
+		free(tlist->heap[i]);
 	}
 
+	free(tlist->heap);
+
 	entry = TAILQ_FIRST(&tlist->free_list);
 
 	while (entry != NULL) {
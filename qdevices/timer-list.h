@@ -35,6 +35,7 @@
 #ifndef _TIMER_LIST_H_
 #define _TIMER_LIST_H_
 
+#include <sys/types.h>
 #include <sys/queue.h>
 
 #include <nspr.h>
@@ -62,11 +63,20 @@ struct timer_list_entry {
 	void *user_data1;
 	void *user_data2;
 	int is_active;
+	/* Position in timer_list heap array (valid only when is_active) */
+	size_t heap_index;
+	/* Used only for free list */
 	TAILQ_ENTRY(timer_list_entry) entries;
 };
 
+/*
+ * Active entries are kept in binary min-heap ordered by expire_time, so add,
+ * reschedule and delete are O(log n) and nearest timer is always heap[0].
+ */
 struct timer_list {
-	TAILQ_HEAD(, timer_list_entry) list;
+	struct timer_list_entry **heap;
+	size_t heap_size;
+	size_t heap_allocated;
 	TAILQ_HEAD(, timer_list_entry) free_list;
 };
 
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include <corosync/totem/totem.h>
+#include "../exec/totemcrypto.h"
+
+/*
+ * Measure packets/s of crypto_encrypt_and_sign and
+ * crypto_authenticate_and_decrypt for every cipher/hash combination.
+ * With -t, also check a batch round trip through the crypto worker pool.
+ */
+
+#ifndef timersub
+#define timersub(a, b, result)						\
+	do {								\
+		(result)->tv_sec = (a)->tv_sec - (b)->tv_sec;		\
+		(result)->tv_usec = (a)->tv_usec - (b)->tv_usec;	\
+		if ((result)->tv_usec < 0) {				\
+			--(result)->tv_sec;				\
+			(result)->tv_usec += 1000000;			\
+		}							\
+	} while (0)
+#endif /* timersub */
+
+static const char *ciphers[] = {
+	"none", "aes256", "aes192", "aes128", "3des", "aes256-gcm", "aes128-gcm"
+};
+
+static const char *hashes[] = {
+	"none", "md5", "sha1", "sha256", "sha384", "sha512"
+};
+
+static uint64_t packets_count = 100000;
+static size_t packet_size = 1400;
+static unsigned int threads = 0;
+
+#define BATCH_SIZE	16
+
+static void bench_log_printf (
+	int level,
+	int subsys,
+	const char *function,
+	const char *file,
+	int line,
+	const char *format,
+	...) __attribute__((format(printf, 6, 7)));
+
+static void bench_log_printf (
+	int level,
+	int subsys,
+	const char *function,
+	const char *file,
+	int line,
+	const char *format,
+	...)
+{
+	va_list ap;
+
+	va_start (ap, format);
+	vfprintf (stderr, format, ap);
+	va_end (ap);
+	fprintf (stderr, "\n");
+}
+
+static int is_gcm (const char *cipher)
+{
+	return (strstr (cipher, "-gcm") != NULL);
+}
+
+static void crypto_benchmark (const char *cipher, const char *hash)
+{
+	struct crypto_instance *instance;
+	unsigned char private_key[128];
+	unsigned char plain[FRAME_SIZE_MAX];
+	unsigned char packet[FRAME_SIZE_MAX];
+	size_t packet_len;
+	int buf_len;
+	struct timeval tv1, tv2, tv_elapsed;
+	double secs;
+	uint64_t i;
+
+	memset (private_key, 0x5a, sizeof (private_key));
+	for (i = 0; i < packet_size; i++) {
+		plain[i] = i;
+	}
+
+	instance = crypto_init (private_key, sizeof (private_key), cipher, hash,
+		bench_log_printf, LOG_ERR, LOG_NOTICE, LOG_ERR, 0);
+	if (instance == NULL) {
+		fprintf (stderr, "Can't initialize crypto %s/%s\n", cipher, hash);
+		exit (1);
+	}
+
+	gettimeofday (&tv1, NULL);
+	for (i = 0; i < packets_count; i++) {
+		if (crypto_encrypt_and_sign (instance, plain, packet_size,
+			packet, &packet_len) != 0) {
+
+			fprintf (stderr, "Encrypt failed %s/%s\n", cipher, hash);
+			exit (1);
+		}
+		buf_len = packet_len;
+		if (crypto_authenticate_and_decrypt (instance, packet, &buf_len) != 0) {
+			fprintf (stderr, "Decrypt failed %s/%s\n", cipher, hash);
+			exit (1);
+		}
+	}
+	gettimeofday (&tv2, NULL);
+
+	if (buf_len != (int)packet_size || memcmp (packet, plain, packet_size) != 0) {
+		fprintf (stderr, "Round trip mismatch %s/%s\n", cipher, hash);
+		exit (1);
+	}
+
+	timersub (&tv2, &tv1, &tv_elapsed);
+	secs = tv_elapsed.tv_sec + (tv_elapsed.tv_usec / 1000000.0);
+
+	printf ("%-10s %-6s: %8"PRIu64" packets of %zu bytes in %7.3f s, %10.2f packets/s, overhead %zu bytes\n",
+		cipher, hash, packets_count, packet_size, secs, packets_count / secs,
+		packet_len - packet_size);
+}
+
+/*
+ * Encrypt a batch of distinct frames on the workers, tamper with one and
+ * decrypt the batch. Every other frame must come back in order and the
+ * tampered one must be rejected.
+ */
+static void crypto_batch_check (const char *cipher, const char *hash)
+{
+	struct crypto_instance *instance;
+	unsigned char private_key[128];
+	static unsigned char plain[BATCH_SIZE][FRAME_SIZE_MAX];
+	static unsigned char packet[BATCH_SIZE][FRAME_SIZE_MAX];
+	static unsigned char wire[BATCH_SIZE][FRAME_SIZE_MAX];
+	struct iovec iov[BATCH_SIZE][3];
+	struct crypto_send_item send_items[BATCH_SIZE];
+	struct crypto_recv_item recv_items[BATCH_SIZE];
+	unsigned int tampered = BATCH_SIZE / 2;
+	size_t len;
+	unsigned int i, j;
+
+	memset (private_key, 0x5a, sizeof (private_key));
+
+	instance = crypto_init (private_key, sizeof (private_key), cipher, hash,
+		bench_log_printf, LOG_ERR, LOG_NOTICE, LOG_ERR, 0);
+	if (instance == NULL) {
+		fprintf (stderr, "Can't initialize crypto %s/%s\n", cipher, hash);
+		exit (1);
+	}
+	if (crypto_workers_start (instance, threads) != 0) {
+		fprintf (stderr, "Can't start crypto workers %s/%s\n", cipher, hash);
+		exit (1);
+	}
+
+	for (i = 0; i < BATCH_SIZE; i++) {
+		for (j = 0; j < packet_size; j++) {
+			plain[i][j] = i + j;
+		}
+		send_items[i].buf_in = plain[i];
+		send_items[i].buf_in_len = packet_size;
+		send_items[i].buf_out = packet[i];
+		send_items[i].iov_out = iov[i];
+	}
+
+	crypto_encrypt_and_sign_iov_batch (instance, send_items, BATCH_SIZE);
+
+	for (i = 0; i < BATCH_SIZE; i++) {
+		if (send_items[i].res != 0) {
+			fprintf (stderr, "Batch encrypt failed %s/%s\n", cipher, hash);
+			exit (1);
+		}
+		/*
+		 * Without a cipher the payload is left in place, linearize it
+		 */
+		len = 0;
+		for (j = 0; j < send_items[i].iov_out_len; j++) {
+			memcpy (wire[i] + len, iov[i][j].iov_base, iov[i][j].iov_len);
+			len += iov[i][j].iov_len;
+		}
+		recv_items[i].buf = wire[i];
+		recv_items[i].buf_len = len;
+	}
+	wire[tampered][recv_items[tampered].buf_len - 1] ^= 0x01;
+
+	crypto_authenticate_and_decrypt_batch (instance, recv_items, BATCH_SIZE);
+
+	for (i = 0; i < BATCH_SIZE; i++) {
+		if (i == tampered) {
+			if (recv_items[i].res == 0 && strcmp (hash, "none") != 0) {
+				fprintf (stderr, "Tampered frame accepted %s/%s\n", cipher, hash);
+				exit (1);
+			}
+			continue;
+		}
+		if (recv_items[i].res != 0 ||
+		    recv_items[i].buf_len != (int)packet_size ||
+		    memcmp (wire[i], plain[i], packet_size) != 0) {
+			fprintf (stderr, "Batch round trip mismatch %s/%s frame %u\n",
+				cipher, hash, i);
+			exit (1);
+		}
+	}
+
+	crypto_workers_stop (instance);
+
+	printf ("%-10s %-6s: batch of %u frames on %u workers ok\n",
+		cipher, hash, BATCH_SIZE, threads);
+}
+
+int main (int argc, char *argv[])
+{
+	unsigned int c, h;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "n:s:t:")) != -1) {
+		switch (opt) {
+		case 'n':
+			packets_count = strtoull (optarg, NULL, 10);
+			break;
+		case 's':
+			packet_size = strtoul (optarg, NULL, 10);
+			if (packet_size == 0 || packet_size > FRAME_SIZE_MAX - 512) {
+				fprintf (stderr, "Invalid packet size\n");
+				return (1);
+			}
+			break;
+		case 't':
+			threads = strtoul (optarg, NULL, 10);
+			break;
+		default:
+			fprintf (stderr, "usage: %s [-n packets] [-s packet_size] [-t threads]\n", argv[0]);
+			return (1);
+		}
+	}
+
+	for (c = 0; c < sizeof (ciphers) / sizeof (ciphers[0]); c++) {
+		for (h = 0; h < sizeof (hashes) / sizeof (hashes[0]); h++) {
+			/*
+			 * CBC ciphers require a hash, GCM ignores it
+			 */
+			if (strcmp (ciphers[c], "none") != 0 && !is_gcm (ciphers[c]) &&
+			    strcmp (hashes[h], "none") == 0) {
+				continue;
+			}
+			if (is_gcm (ciphers[c]) && strcmp (hashes[h], "none") != 0) {
+				continue;
+			}
+			crypto_benchmark (ciphers[c], hashes[h]);
+			if (threads > 0) {
+				crypto_batch_check (ciphers[c], hashes[h]);
+			}
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../exec/cs_queue.h"
+
+/*
+ * Compare mutex and lock-free SPSC cs_queue with one producer and one consumer thread
+ */
+
+#ifndef timersub
+#define timersub(a, b, result)						\
+	do {								\
+		(result)->tv_sec = (a)->tv_sec - (b)->tv_sec;		\
+		(result)->tv_usec = (a)->tv_usec - (b)->tv_usec;	\
+		if ((result)->tv_usec < 0) {				\
+			--(result)->tv_sec;				\
+			(result)->tv_usec += 1000000;			\
+		}							\
+	} while (0)
+#endif /* timersub */
+
+#define QUEUE_SIZE	1024
+#define BATCH_MAX	64
+
+/*
+ * Same size as totemsrp message_item
+ */
+struct bench_item {
+	void *mcast;
+	void *buffer;
+	unsigned int msg_len;
+	uint64_t seq;
+};
+
+static struct cs_queue queue;
+static uint64_t items_count = 10000000;
+static int batch_size;
+
+static void *producer_thread (void *arg)
+{
+	struct bench_item items[BATCH_MAX];
+	uint64_t seq = 0;
+	int avail;
+	int count;
+	int i;
+
+	memset (items, 0, sizeof (items));
+
+	while (seq < items_count) {
+		if (batch_size > 1) {
+			cs_queue_avail (&queue, &avail);
+			if (avail == 0) {
+				sched_yield ();
+				continue;
+			}
+			count = (avail < batch_size ? avail : batch_size);
+			if (count > (int)(items_count - seq)) {
+				count = items_count - seq;
+			}
+			for (i = 0; i < count; i++) {
+				items[i].seq = seq++;
+			}
+			cs_queue_items_add (&queue, items, count);
+		} else {
+			if (cs_queue_is_full (&queue)) {
+				sched_yield ();
+				continue;
+			}
+			items[0].seq = seq++;
+			cs_queue_item_add (&queue, &items[0]);
+		}
+	}
+
+	return (NULL);
+}
+
+static void *consumer_thread (void *arg)
+{
+	struct bench_item *item;
+	uint64_t seq = 0;
+	int used;
+	int i;
+
+	while (seq < items_count) {
+		if (batch_size > 1) {
+			used = cs_queue_used (&queue);
+			if (used == 0) {
+				sched_yield ();
+				continue;
+			}
+			if (used > batch_size) {
+				used = batch_size;
+			}
+			cs_queue_item_iterator_init (&queue);
+			for (i = 0; i < used; i++) {
+				item = cs_queue_item_iterator_get (&queue);
+				if (item->seq != seq++) {
+					fprintf (stderr, "Out of order item %"PRIu64"\n", item->seq);
+					exit (1);
+				}
+				cs_queue_item_iterator_next (&queue);
+			}
+			cs_queue_items_remove (&queue, used);
+		} else {
+			if (cs_queue_is_empty (&queue)) {
+				sched_yield ();
+				continue;
+			}
+			item = cs_queue_item_get (&queue);
+			if (item->seq != seq++) {
+				fprintf (stderr, "Out of order item %"PRIu64"\n", item->seq);
+				exit (1);
+			}
+			cs_queue_item_remove (&queue);
+		}
+	}
+
+	return (NULL);
+}
+
+static void queue_benchmark (const char *name, int threaded_mode, int batch)
+{
+	struct timeval tv1, tv2, tv_elapsed;
+	pthread_t producer, consumer;
+	double secs;
+
+	batch_size = batch;
+
+	if (cs_queue_init (&queue, QUEUE_SIZE, sizeof (struct bench_item), threaded_mode) != 0) {
+		fprintf (stderr, "Can't initialize queue\n");
+		exit (1);
+	}
+
+	gettimeofday (&tv1, NULL);
+	pthread_create (&consumer, NULL, consumer_thread, NULL);
+	pthread_create (&producer, NULL, producer_thread, NULL);
+	pthread_join (producer, NULL);
+	pthread_join (consumer, NULL);
+	gettimeofday (&tv2, NULL);
+
+	timersub (&tv2, &tv1, &tv_elapsed);
+	secs = tv_elapsed.tv_sec + (tv_elapsed.tv_usec / 1000000.0);
+
+	printf ("%-6s batch %2d: %10"PRIu64" items in %7.3f s, %12.2f items/s, usedhw %d\n",
+		name, batch, items_count, secs, items_count / secs, cs_queue_usedhw (&queue));
+
+	cs_queue_free (&queue);
+}
+
+int main (int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt (argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			items_count = strtoull (optarg, NULL, 10);
+			break;
+		default:
+			fprintf (stderr, "usage: %s [-n items]\n", argv[0]);
+			return (1);
+		}
+	}
+
+	queue_benchmark ("mutex", CS_QUEUE_THREADED_MODE_MUTEX, 1);
+	queue_benchmark ("spsc", CS_QUEUE_THREADED_MODE_SPSC, 1);
+	queue_benchmark ("mutex", CS_QUEUE_THREADED_MODE_MUTEX, 16);
+	queue_benchmark ("spsc", CS_QUEUE_THREADED_MODE_SPSC, 16);
+
+	return (0);
+}
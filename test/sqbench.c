@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <corosync/sq.h>
+
+/*
+ * Check the sort queue against a plain array model, then time the hole
+ * scan used to build the retransmit list and the ring change reinit
+ */
+
+#ifndef timersub
+#define timersub(a, b, result)						\
+	do {								\
+		(result)->tv_sec = (a)->tv_sec - (b)->tv_sec;		\
+		(result)->tv_usec = (a)->tv_usec - (b)->tv_usec;	\
+		if ((result)->tv_usec < 0) {				\
+			--(result)->tv_sec;				\
+			(result)->tv_usec += 1000000;			\
+		}							\
+	} while (0)
+#endif /* timersub */
+
+/*
+ * Same as QUEUE_RTR_ITEMS_SIZE_MAX in totemsrp
+ */
+#define QUEUE_SIZE	16384
+
+/*
+ * Same size as totemsrp sort_queue_item
+ */
+struct bench_item {
+	void *mcast;
+	unsigned int msg_len;
+	void *buffer;
+	unsigned long long enqueue_time;
+};
+
+static struct sq sq_a;
+static struct sq sq_b;
+static unsigned char model[QUEUE_SIZE];
+static unsigned int iterations = 1000;
+
+static double elapsed_secs (const struct timeval *tv1)
+{
+	struct timeval tv2, tv_elapsed;
+
+	gettimeofday (&tv2, NULL);
+	timersub (&tv2, tv1, &tv_elapsed);
+	return (tv_elapsed.tv_sec + (tv_elapsed.tv_usec / 1000000.0));
+}
+
+static void fail (const char *what, unsigned int seq)
+{
+	fprintf (stderr, "FAIL: %s at seq %x\n", what, seq);
+	exit (1);
+}
+
+/*
+ * Fill the window [head_seqid, head_seqid + count) of the queue and
+ * the model, leaving a hole with probability 1 / hole_ratio
+ */
+static void window_fill (
+	struct sq *sq,
+	unsigned int head_seqid,
+	unsigned int count,
+	unsigned int hole_ratio)
+{
+	struct bench_item item;
+	unsigned int i;
+
+	memset (&item, 0, sizeof (item));
+	for (i = 0; i < count; i++) {
+		model[i] = (random () % hole_ratio) != 0;
+		if (model[i]) {
+			item.msg_len = head_seqid + i;
+			sq_item_add (sq, &item, head_seqid + i);
+		}
+	}
+}
+
+static void window_check (
+	struct sq *sq,
+	unsigned int head_seqid,
+	unsigned int count)
+{
+	struct bench_item *item;
+	void *ptr;
+	unsigned int seq;
+	unsigned int next;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		seq = head_seqid + i;
+		if (sq_in_range (sq, seq) == 0) {
+			fail ("sq_in_range", seq);
+		}
+		if (sq_item_inuse (sq, seq) != model[i]) {
+			fail ("sq_item_inuse", seq);
+		}
+		if (sq_item_get (sq, seq, &ptr) != (model[i] ? 0 : ENOENT)) {
+			fail ("sq_item_get", seq);
+		}
+		if (model[i]) {
+			item = ptr;
+			if (item->msg_len != seq) {
+				fail ("item contents", seq);
+			}
+		}
+	}
+
+	/*
+	 * Every hole must be found, in order, by the bitmap scan
+	 */
+	seq = head_seqid;
+	for (i = 0; i <= count; i++) {
+		if (i < count && model[i]) {
+			continue;
+		}
+		next = sq_item_next_missing (sq, seq, head_seqid + count - 1);
+		if (next != head_seqid + i) {
+			fail ("sq_item_next_missing", head_seqid + i);
+		}
+		seq = next + 1;
+	}
+}
+
+static void sq_check (void)
+{
+	unsigned int head_seqid;
+	unsigned int released;
+	unsigned int round;
+	unsigned int count;
+	unsigned int i;
+
+	sq_init (&sq_a, QUEUE_SIZE, sizeof (struct bench_item), 0);
+	sq_init (&sq_b, QUEUE_SIZE, sizeof (struct bench_item), 0);
+
+	/*
+	 * Start close to the rollover adjustment point so windows cross it
+	 */
+	head_seqid = 0x7ffff000;
+	for (round = 0; round < 200; round++) {
+		sq_reinit (&sq_a, head_seqid);
+		count = 1 + random () % (QUEUE_SIZE - 1);
+		window_fill (&sq_a, head_seqid, count, 1 + random () % 64);
+		window_check (&sq_a, head_seqid, count);
+
+		/*
+		 * Count a miss on every hole so reinit has to clear them
+		 */
+		for (i = 0; i < count; i++) {
+			if (model[i] == 0 && sq_item_miss_count (&sq_a, head_seqid + i) != 1) {
+				fail ("sq_item_miss_count", head_seqid + i);
+			}
+		}
+
+		/*
+		 * Release a prefix, wrapping the head around the queue
+		 */
+		released = random () % count;
+		if (released) {
+			sq_items_release (&sq_a, head_seqid + released - 1);
+			memmove (model, &model[released], count - released);
+		}
+		window_check (&sq_a, head_seqid + released, count - released);
+
+		sq_copy (&sq_b, &sq_a);
+		window_check (&sq_b, head_seqid + released, count - released);
+		for (i = 0; i < count - released; i++) {
+			if (model[i] == 0 && sq_item_miss_count (&sq_b,
+				head_seqid + released + i) != 2) {
+
+				fail ("sq_copy miss count", head_seqid + released + i);
+			}
+		}
+
+		head_seqid += count;
+	}
+
+	/*
+	 * A reinit queue must be empty, with no stale miss counts
+	 */
+	sq_reinit (&sq_b, 1);
+	memset (model, 0, sizeof (model));
+	window_check (&sq_b, 1, QUEUE_SIZE);
+	for (i = 0; i < QUEUE_SIZE; i++) {
+		if (sq_item_miss_count (&sq_b, 1 + i) != 1) {
+			fail ("sq_reinit miss count", 1 + i);
+		}
+	}
+
+	sq_free (&sq_a);
+	sq_free (&sq_b);
+	printf ("sq checks passed\n");
+}
+
+/*
+ * Time the search for holes in a window of count messages
+ */
+static void scan_benchmark (unsigned int count, unsigned int hole_ratio)
+{
+	struct timeval tv1;
+	unsigned int holes_scan = 0;
+	unsigned int holes_next = 0;
+	unsigned int seq;
+	unsigned int last;
+	unsigned int n;
+	double secs_scan, secs_next;
+
+	sq_init (&sq_a, QUEUE_SIZE, sizeof (struct bench_item), 1);
+	window_fill (&sq_a, 1, count, hole_ratio);
+	last = count;
+
+	gettimeofday (&tv1, NULL);
+	for (n = 0; n < iterations; n++) {
+		for (seq = 1; seq <= last; seq++) {
+			if (sq_item_inuse (&sq_a, seq) == 0) {
+				holes_scan++;
+			}
+		}
+	}
+	secs_scan = elapsed_secs (&tv1);
+
+	gettimeofday (&tv1, NULL);
+	for (n = 0; n < iterations; n++) {
+		for (seq = 1; seq <= last; seq++) {
+			seq = sq_item_next_missing (&sq_a, seq, last);
+			if (seq > last) {
+				break;
+			}
+			holes_next++;
+		}
+	}
+	secs_next = elapsed_secs (&tv1);
+
+	if (holes_scan != holes_next) {
+		fprintf (stderr, "FAIL: %u holes by item, %u by bitmap\n",
+			holes_scan, holes_next);
+		exit (1);
+	}
+
+	printf ("scan %5u items 1/%-5u holes: per item %8.2f us, bitmap %8.2f us\n",
+		count, hole_ratio, secs_scan * 1000000.0 / iterations,
+		secs_next * 1000000.0 / iterations);
+
+	sq_free (&sq_a);
+}
+
+/*
+ * Time a ring change after count messages were queued
+ */
+static void reinit_benchmark (unsigned int count)
+{
+	struct timeval tv1;
+	double secs;
+	unsigned int n;
+
+	sq_init (&sq_a, QUEUE_SIZE, sizeof (struct bench_item), 1);
+	sq_init (&sq_b, QUEUE_SIZE, sizeof (struct bench_item), 1);
+
+	secs = 0;
+	for (n = 0; n < iterations; n++) {
+		window_fill (&sq_a, 1, count, 1000000);
+		gettimeofday (&tv1, NULL);
+		sq_copy (&sq_b, &sq_a);
+		sq_reinit (&sq_a, 1);
+		secs += elapsed_secs (&tv1);
+	}
+
+	printf ("reinit and copy after %5u items: %8.2f us\n",
+		count, secs * 1000000.0 / iterations);
+
+	sq_free (&sq_a);
+	sq_free (&sq_b);
+}
+
+int main (int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt (argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi (optarg);
+			break;
+		default:
+			fprintf (stderr, "usage: %s [-n iterations]\n", argv[0]);
+			return (1);
+		}
+	}
+
+	srandom (1);
+	sq_check ();
+
+	scan_benchmark (1000, 1000000);
+	scan_benchmark (1000, 50);
+	scan_benchmark (16000, 1000000);
+	scan_benchmark (16000, 50);
+	scan_benchmark (16000, 2);
+
+	reinit_benchmark (10);
+	reinit_benchmark (1000);
+	reinit_benchmark (16000);
+
+	return (0);
+}
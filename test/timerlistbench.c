@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "../qdevices/timer-list.h"
+
+/*
+ * Measure operations/s of qdevices timer list add, reschedule, expire and
+ * delete with large number of timers (one per qnetd client heartbeat)
+ */
+
+#ifndef timersub
+#define timersub(a, b, result)						\
+	do {								\
+		(result)->tv_sec = (a)->tv_sec - (b)->tv_sec;		\
+		(result)->tv_usec = (a)->tv_usec - (b)->tv_usec;	\
+		if ((result)->tv_usec < 0) {				\
+			--(result)->tv_sec;				\
+			(result)->tv_usec += 1000000;			\
+		}							\
+	} while (0)
+#endif /* timersub */
+
+static size_t timers_count = 100000;
+static unsigned int rounds = 10;
+static size_t expired;
+
+static struct timeval tv_start;
+
+static int timer_cb (void *data1, void *data2)
+{
+	expired++;
+
+	return (0);
+}
+
+static void bench_start (void)
+{
+	gettimeofday (&tv_start, NULL);
+}
+
+static void bench_end (const char *op, size_t ops)
+{
+	struct timeval tv_end, tv_elapsed;
+	double secs;
+
+	gettimeofday (&tv_end, NULL);
+	timersub (&tv_end, &tv_start, &tv_elapsed);
+	secs = tv_elapsed.tv_sec + tv_elapsed.tv_usec / 1000000.0;
+
+	printf ("%-10s: %10zu ops in %7.3f s, %12.2f ops/s, %8.1f ns/op\n",
+		op, ops, secs, ops / secs, secs * 1000000000.0 / ops);
+}
+
+int main (int argc, char *argv[])
+{
+	struct timer_list tlist;
+	struct timer_list_entry **entries;
+	size_t i, j, tmp_idx;
+	size_t *order;
+	unsigned int r;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "n:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			timers_count = strtoul (optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = strtoul (optarg, NULL, 10);
+			break;
+		default:
+			fprintf (stderr, "usage: %s [-n timers] [-r reschedule_rounds]\n", argv[0]);
+			return (1);
+		}
+	}
+
+	if (timers_count == 0) {
+		fprintf (stderr, "Invalid number of timers\n");
+		return (1);
+	}
+
+	entries = malloc (timers_count * sizeof (*entries));
+	order = malloc (timers_count * sizeof (*order));
+	if (entries == NULL || order == NULL) {
+		fprintf (stderr, "Can't allocate memory\n");
+		return (1);
+	}
+
+	/*
+	 * Reschedule in random order, like heartbeats arriving from clients
+	 */
+	srand (1);
+	for (i = 0; i < timers_count; i++) {
+		order[i] = i;
+	}
+	for (i = timers_count - 1; i > 0; i--) {
+		j = rand () % (i + 1);
+		tmp_idx = order[i];
+		order[i] = order[j];
+		order[j] = tmp_idx;
+	}
+
+	timer_list_init (&tlist);
+
+	bench_start ();
+	for (i = 0; i < timers_count; i++) {
+		entries[i] = timer_list_add (&tlist, 1000 + rand () % 10000, timer_cb, NULL, NULL);
+		if (entries[i] == NULL) {
+			fprintf (stderr, "Can't add timer\n");
+			return (1);
+		}
+	}
+	bench_end ("add", timers_count);
+
+	bench_start ();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < timers_count; i++) {
+			timer_list_reschedule (&tlist, entries[order[i]]);
+		}
+	}
+	bench_end ("reschedule", timers_count * rounds);
+
+	bench_start ();
+	for (i = 0; i < timers_count; i++) {
+		timer_list_delete (&tlist, entries[order[i]]);
+	}
+	bench_end ("delete", timers_count);
+
+	for (i = 0; i < timers_count; i++) {
+		entries[i] = timer_list_add (&tlist, 1 + rand () % 10, timer_cb, NULL, NULL);
+		if (entries[i] == NULL) {
+			fprintf (stderr, "Can't add timer\n");
+			return (1);
+		}
+	}
+	usleep (20000);
+
+	bench_start ();
+	timer_list_expire (&tlist);
+	bench_end ("expire", expired);
+
+	if (expired != timers_count) {
+		fprintf (stderr, "Expired %zu timers, expected %zu\n", expired, timers_count);
+		return (1);
+	}
+
+	timer_list_free (&tlist);
+	free (order);
+	free (entries);
+
+	return (0);
+}
@@ -0,0 +1,785 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+#include <qb/qbutil.h>
+
+#include <corosync/totem/totem.h>
+#include <corosync/totem/totemip.h>
+#include "totemsrp.h"
+#include "totemloopback.h"
+
+/*
+ * Run a ring of totemsrp instances inside this process over the loopback
+ * transport and measure throughput, token rotation and delivery latency
+ */
+
+#define NODES_MAX		16
+#define SAMPLES_MAX		(1024 * 1024)
+#define FORM_TIMEOUT		30
+
+#define TOKEN_TIMEOUT				1000
+#define TOKEN_RETRANSMITS_BEFORE_LOSS_CONST	4
+#define JOIN_TIMEOUT				50
+#define MERGE_TIMEOUT				200
+#define DOWNCHECK_TIMEOUT			1000
+#define FAIL_TO_RECV_CONST			2500
+#define SEQNO_UNCHANGED_CONST			30
+#define MAX_NETWORK_DELAY			50
+#define WINDOW_SIZE				50
+#define MAX_MESSAGES				17
+#define MISS_COUNT_CONST			5
+
+struct bench_msg {
+	uint32_t node;
+	uint32_t probe;
+	uint64_t send_time;
+	uint64_t seq;
+} __attribute__((packed));
+
+struct bench_node {
+	unsigned int index;
+	void *srp_context;
+	struct totem_config totem_config;
+	struct totem_interface totem_interface;
+	totemmrp_stats_t stats;
+	void *token_handle;
+	size_t member_count;
+	uint64_t seq;
+	uint64_t own_delivered;
+	uint64_t delivered;
+	uint64_t delivered_bytes;
+	uint64_t last_token_time;
+	int probe_pending;
+};
+
+struct bench_samples {
+	uint64_t *values;
+	uint64_t count;
+	uint64_t seen;
+};
+
+enum bench_state {
+	BENCH_STATE_FORMING,
+	BENCH_STATE_RUNNING,
+	BENCH_STATE_DONE
+};
+
+static qb_loop_t *loop;
+static struct bench_node nodes[NODES_MAX];
+static unsigned int nodes_count = 3;
+static unsigned int senders_count = 0;
+static unsigned int msg_size = 1024;
+static unsigned int duration = 10;
+static unsigned int queue_depth = 256;
+static unsigned int window_size = WINDOW_SIZE;
+static unsigned int max_messages = MAX_MESSAGES;
+static const char *cipher = "none";
+static const char *hash = "none";
+static int verbose;
+static int fcc_adaptive;
+static int probe_lane = -1;
+static enum bench_state state = BENCH_STATE_FORMING;
+static uint64_t start_time;
+static uint64_t stop_time;
+static struct bench_samples latency_samples;
+static struct bench_samples rotation_samples;
+static struct bench_samples probe_samples;
+static qb_loop_timer_handle bench_timer;
+static char msg_buffer[FRAME_SIZE_MAX];
+static struct totemloopback_network_config network_config;
+static struct totemloopback_network_stats network_stats_start;
+
+static void bench_log_printf (
+	int level,
+	int subsys,
+	const char *function,
+	const char *file,
+	int line,
+	const char *format,
+	...) __attribute__((format(printf, 6, 7)));
+
+static void bench_log_printf (
+	int level,
+	int subsys,
+	const char *function,
+	const char *file,
+	int line,
+	const char *format,
+	...)
+{
+	va_list ap;
+
+	if (level > (verbose ? LOG_DEBUG : LOG_WARNING)) {
+		return;
+	}
+
+	va_start (ap, format);
+	vfprintf (stderr, format, ap);
+	va_end (ap);
+	fprintf (stderr, "\n");
+}
+
+static void samples_add (struct bench_samples *samples, uint64_t value)
+{
+	uint64_t pos;
+
+	/*
+	 * Reservoir sampling keeps a uniform sample of long runs
+	 */
+	samples->seen++;
+	if (samples->count < SAMPLES_MAX) {
+		samples->values[samples->count++] = value;
+		return;
+	}
+
+	pos = random () % samples->seen;
+	if (pos < SAMPLES_MAX) {
+		samples->values[pos] = value;
+	}
+}
+
+static int samples_compare (const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *)a;
+	uint64_t vb = *(const uint64_t *)b;
+
+	return ((va > vb) - (va < vb));
+}
+
+static double samples_percentile (struct bench_samples *samples, double percentile)
+{
+	uint64_t pos;
+
+	if (samples->count == 0) {
+		return (0);
+	}
+
+	pos = (uint64_t)(percentile / 100.0 * (samples->count - 1));
+
+	return (samples->values[pos] / 1000.0);
+}
+
+static double samples_mean (struct bench_samples *samples)
+{
+	uint64_t i;
+	double sum = 0;
+
+	if (samples->count == 0) {
+		return (0);
+	}
+
+	for (i = 0; i < samples->count; i++) {
+		sum += samples->values[i];
+	}
+
+	return (sum / samples->count / 1000.0);
+}
+
+static void samples_print (const char *name, struct bench_samples *samples)
+{
+	qsort (samples->values, samples->count, sizeof (uint64_t), samples_compare);
+
+	printf ("%-16s mean %9.1f  p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n",
+		name,
+		samples_mean (samples),
+		samples_percentile (samples, 50),
+		samples_percentile (samples, 90),
+		samples_percentile (samples, 99),
+		samples_percentile (samples, 99.9),
+		samples_percentile (samples, 100));
+}
+
+static void bench_deliver (
+	struct bench_node *node,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len)
+{
+	const struct bench_msg *bench_msg = (const struct bench_msg *)msg;
+
+	if (msg_len < sizeof (struct bench_msg)) {
+		return;
+	}
+
+	if (bench_msg->probe) {
+		if (bench_msg->node == node->index) {
+			node->probe_pending = 0;
+		}
+		if (state == BENCH_STATE_RUNNING && bench_msg->send_time >= start_time) {
+			samples_add (&probe_samples,
+				qb_util_nano_current_get () - bench_msg->send_time);
+		}
+		return;
+	}
+
+	if (bench_msg->node == node->index) {
+		node->own_delivered++;
+	}
+
+	if (state != BENCH_STATE_RUNNING || bench_msg->send_time < start_time) {
+		return;
+	}
+
+	node->delivered++;
+	node->delivered_bytes += msg_len;
+	samples_add (&latency_samples, qb_util_nano_current_get () - bench_msg->send_time);
+}
+
+static void trans_ack_job (void *data)
+{
+	struct bench_node *node = (struct bench_node *)data;
+
+	totemsrp_trans_ack (node->srp_context);
+}
+
+static void bench_confchg (
+	struct bench_node *node,
+	enum totem_configuration_type configuration_type,
+	size_t member_list_entries)
+{
+	if (configuration_type != TOTEM_CONFIGURATION_REGULAR) {
+		return;
+	}
+
+	node->member_count = member_list_entries;
+	if (verbose) {
+		printf ("node %u: regular configuration with %zu members\n",
+			node->index, member_list_entries);
+	}
+
+	qb_loop_job_add (loop, QB_LOOP_MED, node, trans_ack_job);
+}
+
+/*
+ * totemsrp callbacks carry no context, generate one entry point per node
+ */
+#define BENCH_NODE_CALLBACKS(n)						\
+static void deliver_fn_##n (						\
+	unsigned int nodeid,						\
+	const void *msg,						\
+	unsigned int msg_len,						\
+	int endian_conversion_required)					\
+{									\
+	bench_deliver (&nodes[n], nodeid, msg, msg_len);		\
+}									\
+static void confchg_fn_##n (						\
+	enum totem_configuration_type configuration_type,		\
+	const unsigned int *member_list, size_t member_list_entries,	\
+	const unsigned int *left_list, size_t left_list_entries,	\
+	const unsigned int *joined_list, size_t joined_list_entries,	\
+	const struct memb_ring_id *ring_id)				\
+{									\
+	bench_confchg (&nodes[n], configuration_type, member_list_entries); \
+}
+
+BENCH_NODE_CALLBACKS(0)
+BENCH_NODE_CALLBACKS(1)
+BENCH_NODE_CALLBACKS(2)
+BENCH_NODE_CALLBACKS(3)
+BENCH_NODE_CALLBACKS(4)
+BENCH_NODE_CALLBACKS(5)
+BENCH_NODE_CALLBACKS(6)
+BENCH_NODE_CALLBACKS(7)
+BENCH_NODE_CALLBACKS(8)
+BENCH_NODE_CALLBACKS(9)
+BENCH_NODE_CALLBACKS(10)
+BENCH_NODE_CALLBACKS(11)
+BENCH_NODE_CALLBACKS(12)
+BENCH_NODE_CALLBACKS(13)
+BENCH_NODE_CALLBACKS(14)
+BENCH_NODE_CALLBACKS(15)
+
+static void (*deliver_fns[NODES_MAX]) (unsigned int, const void *, unsigned int, int) = {
+	deliver_fn_0, deliver_fn_1, deliver_fn_2, deliver_fn_3,
+	deliver_fn_4, deliver_fn_5, deliver_fn_6, deliver_fn_7,
+	deliver_fn_8, deliver_fn_9, deliver_fn_10, deliver_fn_11,
+	deliver_fn_12, deliver_fn_13, deliver_fn_14, deliver_fn_15
+};
+
+static void (*confchg_fns[NODES_MAX]) (enum totem_configuration_type,
+	const unsigned int *, size_t, const unsigned int *, size_t,
+	const unsigned int *, size_t, const struct memb_ring_id *) = {
+	confchg_fn_0, confchg_fn_1, confchg_fn_2, confchg_fn_3,
+	confchg_fn_4, confchg_fn_5, confchg_fn_6, confchg_fn_7,
+	confchg_fn_8, confchg_fn_9, confchg_fn_10, confchg_fn_11,
+	confchg_fn_12, confchg_fn_13, confchg_fn_14, confchg_fn_15
+};
+
+static void waiting_trans_ack_fn (int waiting_trans_ack)
+{
+}
+
+static void memb_ring_id_create_or_load (
+	struct memb_ring_id *memb_ring_id,
+	const struct totem_ip_address *addr)
+{
+	totemip_copy (&memb_ring_id->rep, addr);
+	memb_ring_id->seq = 0;
+}
+
+static void memb_ring_id_store (
+	const struct memb_ring_id *memb_ring_id,
+	const struct totem_ip_address *addr)
+{
+}
+
+/*
+ * Keep up to queue_depth own messages in flight, refilled on every token
+ */
+static void bench_send (struct bench_node *node)
+{
+	struct bench_msg *bench_msg = (struct bench_msg *)msg_buffer;
+	struct iovec iov;
+
+	iov.iov_base = msg_buffer;
+	iov.iov_len = msg_size;
+
+	while (node->seq - node->own_delivered < queue_depth &&
+		totemsrp_avail (node->srp_context) > 0) {
+
+		bench_msg->node = node->index;
+		bench_msg->probe = 0;
+		bench_msg->send_time = qb_util_nano_current_get ();
+		bench_msg->seq = node->seq;
+
+		if (totemsrp_mcast (node->srp_context, &iov, 1, 0, TOTEM_LANE_BULK) != 0) {
+			break;
+		}
+		node->seq++;
+	}
+}
+
+/*
+ * Keep one small probe message in flight on probe_lane to measure the
+ * latency of control messages behind bulk traffic
+ */
+static void bench_probe_send (struct bench_node *node)
+{
+	struct bench_msg bench_msg;
+	struct iovec iov;
+
+	if (node->probe_pending ||
+		totemsrp_lane_avail (node->srp_context, probe_lane) == 0) {
+		return;
+	}
+
+	memset (&bench_msg, 0, sizeof (bench_msg));
+	bench_msg.node = node->index;
+	bench_msg.probe = 1;
+	bench_msg.send_time = qb_util_nano_current_get ();
+
+	iov.iov_base = &bench_msg;
+	iov.iov_len = sizeof (bench_msg);
+
+	if (totemsrp_mcast (node->srp_context, &iov, 1, 0, probe_lane) == 0) {
+		node->probe_pending = 1;
+	}
+}
+
+static int token_received_fn (enum totem_callback_token_type type, const void *data)
+{
+	struct bench_node *node = (struct bench_node *)data;
+	uint64_t now;
+
+	if (state != BENCH_STATE_RUNNING) {
+		return (0);
+	}
+
+	now = qb_util_nano_current_get ();
+	if (node->index == 0) {
+		if (node->last_token_time != 0) {
+			samples_add (&rotation_samples, now - node->last_token_time);
+		}
+		node->last_token_time = now;
+	}
+
+	if (node->index < senders_count) {
+		bench_send (node);
+	}
+	if (probe_lane != -1 && node->index == nodes_count - 1) {
+		bench_probe_send (node);
+	}
+
+	return (0);
+}
+
+static void bench_stop_fn (void *data)
+{
+	stop_time = qb_util_nano_current_get ();
+	state = BENCH_STATE_DONE;
+	qb_loop_stop (loop);
+}
+
+static void bench_form_check_fn (void *data)
+{
+	unsigned int i;
+	uint64_t *elapsed = (uint64_t *)data;
+
+	for (i = 0; i < nodes_count; i++) {
+		if (nodes[i].member_count != nodes_count) {
+			break;
+		}
+	}
+
+	if (i < nodes_count) {
+		*elapsed += 100;
+		if (*elapsed > FORM_TIMEOUT * 1000) {
+			fprintf (stderr, "Ring of %u nodes was not formed in %u s\n",
+				nodes_count, FORM_TIMEOUT);
+			exit (1);
+		}
+		qb_loop_timer_add (loop, QB_LOOP_MED, 100 * QB_TIME_NS_IN_MSEC,
+			data, bench_form_check_fn, &bench_timer);
+		return;
+	}
+
+	printf ("Ring of %u nodes formed, running for %u s\n", nodes_count, duration);
+
+	/*
+	 * The ring forms over a clean network, impairments apply to the run only
+	 */
+	totemloopback_network_config_set (&network_config);
+	totemloopback_network_stats_get (&network_stats_start);
+
+	state = BENCH_STATE_RUNNING;
+	start_time = qb_util_nano_current_get ();
+	for (i = 0; i < senders_count; i++) {
+		bench_send (&nodes[i]);
+	}
+
+	qb_loop_timer_add (loop, QB_LOOP_HIGH, (uint64_t)duration * QB_TIME_NS_IN_SEC,
+		NULL, bench_stop_fn, &bench_timer);
+}
+
+static void bench_node_init (struct bench_node *node, unsigned int index)
+{
+	struct totem_config *totem_config = &node->totem_config;
+	struct totem_interface *totem_interface = &node->totem_interface;
+
+	memset (node, 0, sizeof (*node));
+	node->index = index;
+
+	/*
+	 * Nodes are 127.0.1.x on the simulated network
+	 */
+	totem_interface->bindnet.family = AF_INET;
+	totem_interface->bindnet.addr[0] = 127;
+	totem_interface->bindnet.addr[1] = 0;
+	totem_interface->bindnet.addr[2] = 1;
+	totem_interface->bindnet.addr[3] = index + 1;
+	totem_interface->bindnet.nodeid = index + 1;
+	totem_interface->mcast_addr.family = AF_INET;
+	totem_interface->mcast_addr.addr[0] = 239;
+	totem_interface->mcast_addr.addr[1] = 192;
+	totem_interface->ip_port = 5405;
+	totem_interface->ttl = 1;
+
+	totem_config->interfaces = totem_interface;
+	totem_config->interface_count = 1;
+	totem_config->node_id = index + 1;
+	totem_config->transport_number = TOTEM_TRANSPORT_LOOPBACK;
+	strcpy (totem_config->rrp_mode, "none");
+
+	memset (totem_config->private_key, 0x5a, sizeof (totem_config->private_key));
+	totem_config->private_key_len = sizeof (totem_config->private_key);
+	totem_config->crypto_cipher_type = (char *)cipher;
+	totem_config->crypto_hash_type = (char *)hash;
+
+	totem_config->token_timeout = TOKEN_TIMEOUT;
+	totem_config->token_retransmits_before_loss_const = TOKEN_RETRANSMITS_BEFORE_LOSS_CONST;
+	totem_config->token_retransmit_timeout =
+		(int)(totem_config->token_timeout / (totem_config->token_retransmits_before_loss_const + 0.2));
+	totem_config->token_hold_timeout =
+		(int)(totem_config->token_retransmit_timeout * 0.8 - 10);
+	totem_config->join_timeout = JOIN_TIMEOUT;
+	totem_config->consensus_timeout = (int)(1.2 * totem_config->token_timeout);
+	totem_config->merge_timeout = MERGE_TIMEOUT;
+	totem_config->downcheck_timeout = DOWNCHECK_TIMEOUT;
+	totem_config->fail_to_recv_const = FAIL_TO_RECV_CONST;
+	totem_config->seqno_unchanged_const = SEQNO_UNCHANGED_CONST;
+	totem_config->max_network_delay = MAX_NETWORK_DELAY;
+	totem_config->window_size = window_size;
+	totem_config->max_messages = max_messages;
+	totem_config->fcc_adaptive = fcc_adaptive;
+	totem_config->miss_count_const = MISS_COUNT_CONST;
+	totem_config->rrp_token_expired_timeout = totem_config->token_retransmit_timeout;
+	totem_config->rrp_problem_count_timeout = 2000;
+	totem_config->rrp_problem_count_threshold = 10;
+	totem_config->rrp_problem_count_mcast_threshold = 100;
+	totem_config->rrp_autorecovery_check_timeout = 1000;
+	totem_config->net_mtu = 1500;
+	totem_config->ip_version = AF_INET;
+
+	totem_config->totem_logging_configuration.log_printf = bench_log_printf;
+	totem_config->totem_logging_configuration.log_level_security = LOG_WARNING;
+	totem_config->totem_logging_configuration.log_level_error = LOG_ERR;
+	totem_config->totem_logging_configuration.log_level_warning = LOG_WARNING;
+	totem_config->totem_logging_configuration.log_level_notice = LOG_NOTICE;
+	totem_config->totem_logging_configuration.log_level_debug = LOG_DEBUG;
+	totem_config->totem_logging_configuration.log_level_trace = LOG_DEBUG;
+
+	totem_config->totem_memb_ring_id_create_or_load = memb_ring_id_create_or_load;
+	totem_config->totem_memb_ring_id_store = memb_ring_id_store;
+
+	totemsrp_net_mtu_adjust (totem_config);
+
+	if (totemsrp_initialize (loop, &node->srp_context, totem_config, &node->stats,
+		deliver_fns[index], confchg_fns[index], waiting_trans_ack_fn) != 0) {
+
+		fprintf (stderr, "Can't initialize totemsrp instance %u\n", index);
+		exit (1);
+	}
+
+	totemsrp_callback_token_create (node->srp_context, &node->token_handle,
+		TOTEM_CALLBACK_TOKEN_RECEIVED, 0, token_received_fn, node);
+}
+
+static void bench_report (void)
+{
+	struct totemloopback_network_stats network_stats;
+	uint64_t delivered = 0;
+	uint64_t delivered_bytes = 0;
+	uint64_t retx = 0;
+	uint64_t token_lost = 0;
+	unsigned int i;
+	double secs;
+
+	secs = (stop_time - start_time) / (double)QB_TIME_NS_IN_SEC;
+
+	for (i = 0; i < nodes_count; i++) {
+		delivered += nodes[i].delivered;
+		delivered_bytes += nodes[i].delivered_bytes;
+		retx += nodes[i].stats.srp->mcast_retx;
+		token_lost += nodes[i].stats.srp->operational_token_lost;
+	}
+
+	totemloopback_network_stats_get (&network_stats);
+
+	printf ("nodes %u senders %u msg_size %u window_size %u max_messages %u crypto %s/%s\n",
+		nodes_count, senders_count, msg_size, window_size, max_messages, cipher, hash);
+	printf ("network loss %.4f%% reorder %.4f%% (+%u us) latency %u us\n",
+		network_config.loss_ppm / 10000.0,
+		network_config.reorder_ppm / 10000.0,
+		network_config.reorder_delay_usec,
+		network_config.latency_usec);
+	printf ("delivered %12.2f msgs/s %10.2f MB/s per node\n",
+		delivered / secs / nodes_count,
+		delivered_bytes / secs / nodes_count / (1024.0 * 1024.0));
+	printf ("token rotations %"PRIu64" (%.2f/s)\n",
+		rotation_samples.seen, rotation_samples.seen / secs);
+	samples_print ("token rotation", &rotation_samples);
+	samples_print ("delivery latency", &latency_samples);
+	if (probe_lane != -1) {
+		samples_print (probe_lane == TOTEM_LANE_CONTROL ?
+			"probe (control)" : "probe (bulk)", &probe_samples);
+	}
+	printf ("frames sent %"PRIu64" delivered %"PRIu64" lost %"PRIu64" reordered %"PRIu64"\n",
+		network_stats.frames_sent - network_stats_start.frames_sent,
+		network_stats.frames_delivered - network_stats_start.frames_delivered,
+		network_stats.frames_lost - network_stats_start.frames_lost,
+		network_stats.frames_reordered - network_stats_start.frames_reordered);
+	printf ("mcast retransmits %"PRIu64" operational token lost %"PRIu64"\n",
+		retx, token_lost);
+	printf ("node 0 flow control window_size %u max_messages %u decreases %"PRIu64"\n",
+		nodes[0].stats.srp->fcc_window_size,
+		nodes[0].stats.srp->fcc_max_messages,
+		nodes[0].stats.srp->fcc_decreases);
+	printf ("node 0 frame pool size %u (%"PRIu64" bytes) in use max %u "
+		"(%"PRIu64" bytes) overflow %"PRIu64"\n",
+		nodes[0].stats.srp->frame_pool_size,
+		nodes[0].stats.srp->frame_pool_bytes,
+		nodes[0].stats.srp->frame_pool_in_use_max,
+		nodes[0].stats.srp->frame_pool_bytes_in_use_max,
+		nodes[0].stats.srp->frame_pool_overflow);
+	printf ("node 0 token rotation p50 %"PRIu64" p99 %"PRIu64" us, "
+		"hold p50 %"PRIu64" p99 %"PRIu64" us\n",
+		totem_histogram_percentile (&nodes[0].stats.srp->token_rotation_hist, 500),
+		totem_histogram_percentile (&nodes[0].stats.srp->token_rotation_hist, 990),
+		totem_histogram_percentile (&nodes[0].stats.srp->token_hold_hist, 500),
+		totem_histogram_percentile (&nodes[0].stats.srp->token_hold_hist, 990));
+	printf ("node 0 mcast delivery latency p50 %"PRIu64" p99 %"PRIu64" p99.9 %"PRIu64" us\n",
+		totem_histogram_percentile (&nodes[0].stats.srp->mcast_latency_hist, 500),
+		totem_histogram_percentile (&nodes[0].stats.srp->mcast_latency_hist, 990),
+		totem_histogram_percentile (&nodes[0].stats.srp->mcast_latency_hist, 999));
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [options]\n", name);
+	printf ("  -n nodes         number of totemsrp instances (1-%u, default 3)\n", NODES_MAX);
+	printf ("  -S senders       number of sending nodes (default all)\n");
+	printf ("  -s size          message size in bytes (default 1024)\n");
+	printf ("  -t seconds       measurement duration (default 10)\n");
+	printf ("  -q depth         own messages in flight per sender (default 256)\n");
+	printf ("  -w window_size   totem window_size (default %u)\n", WINDOW_SIZE);
+	printf ("  -m max_messages  totem max_messages (default %u)\n", MAX_MESSAGES);
+	printf ("  -a               adaptive flow control\n");
+	printf ("  -p lane          keep a probe message in flight from the last node on\n"
+		"                   the bulk (0) or control (1) lane\n");
+	printf ("  -l percent       frame loss probability\n");
+	printf ("  -r percent       frame reorder probability\n");
+	printf ("  -R usec          extra delay of reordered frames (default 1000)\n");
+	printf ("  -d usec          one way network latency\n");
+	printf ("  -c cipher        crypto_cipher (default none)\n");
+	printf ("  -h hash          crypto_hash (default none)\n");
+	printf ("  -v               verbose\n");
+}
+
+int main (int argc, char *argv[])
+{
+	uint64_t form_elapsed = 0;
+	unsigned int i;
+	int opt;
+
+	memset (&network_config, 0, sizeof (network_config));
+	network_config.reorder_delay_usec = 1000;
+
+	while ((opt = getopt (argc, argv, "n:S:s:t:q:w:m:ap:l:r:R:d:c:h:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			nodes_count = atoi (optarg);
+			break;
+		case 'S':
+			senders_count = atoi (optarg);
+			break;
+		case 's':
+			msg_size = atoi (optarg);
+			break;
+		case 't':
+			duration = atoi (optarg);
+			break;
+		case 'q':
+			queue_depth = atoi (optarg);
+			break;
+		case 'w':
+			window_size = atoi (optarg);
+			break;
+		case 'm':
+			max_messages = atoi (optarg);
+			break;
+		case 'a':
+			fcc_adaptive = 1;
+			break;
+		case 'p':
+			probe_lane = atoi (optarg);
+			break;
+		case 'l':
+			network_config.loss_ppm = atof (optarg) * 10000;
+			break;
+		case 'r':
+			network_config.reorder_ppm = atof (optarg) * 10000;
+			break;
+		case 'R':
+			network_config.reorder_delay_usec = atoi (optarg);
+			break;
+		case 'd':
+			network_config.latency_usec = atoi (optarg);
+			break;
+		case 'c':
+			cipher = optarg;
+			break;
+		case 'h':
+			hash = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage (argv[0]);
+			return (1);
+		}
+	}
+
+	if (nodes_count < 1 || nodes_count > NODES_MAX) {
+		fprintf (stderr, "Number of nodes must be between 1 and %u\n", NODES_MAX);
+		return (1);
+	}
+	if (senders_count == 0 || senders_count > nodes_count) {
+		senders_count = nodes_count;
+	}
+	if (probe_lane != -1 && probe_lane != TOTEM_LANE_BULK &&
+		probe_lane != TOTEM_LANE_CONTROL) {
+		fprintf (stderr, "Probe lane must be %u or %u\n",
+			TOTEM_LANE_BULK, TOTEM_LANE_CONTROL);
+		return (1);
+	}
+	if (msg_size < sizeof (struct bench_msg) || msg_size > 1024) {
+		/*
+		 * Larger messages would need totempg fragmentation
+		 */
+		fprintf (stderr, "Message size must be between %zu and 1024\n",
+			sizeof (struct bench_msg));
+		return (1);
+	}
+
+	latency_samples.values = malloc (SAMPLES_MAX * sizeof (uint64_t));
+	rotation_samples.values = malloc (SAMPLES_MAX * sizeof (uint64_t));
+	probe_samples.values = malloc (SAMPLES_MAX * sizeof (uint64_t));
+	if (latency_samples.values == NULL || rotation_samples.values == NULL ||
+		probe_samples.values == NULL) {
+		fprintf (stderr, "Can't allocate sample buffers\n");
+		return (1);
+	}
+
+	srandom (time (NULL));
+
+	loop = qb_loop_create ();
+
+	for (i = 0; i < nodes_count; i++) {
+		bench_node_init (&nodes[i], i);
+	}
+
+	qb_loop_timer_add (loop, QB_LOOP_MED, 100 * QB_TIME_NS_IN_MSEC,
+		&form_elapsed, bench_form_check_fn, &bench_timer);
+
+	qb_loop_run (loop);
+
+	bench_report ();
+
+	return (0);
+}
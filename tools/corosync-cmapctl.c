@@ -57,6 +57,7 @@ enum user_action {
 	ACTION_PRINT_PREFIX,
 	ACTION_TRACK,
 	ACTION_LOAD,
+	ACTION_LATENCY,
 };
 
 struct name_to_type_item {
@@ -96,7 +97,7 @@ static int convert_name_to_type(const char *name)
 static int print_help(void)
 {
 	printf("\n");
-	printf("usage:  corosync-cmapctl [-b] [-dghsTtp] [params...]\n");
+	printf("usage:  corosync-cmapctl [-b] [-dghLsTtp] [params...]\n");
 	printf("\n");
 	printf("    -b show binary values\n");
 	printf("\n");
@@ -137,6 +138,9 @@ static int print_help(void)
 	printf("Track changes on keys with key prefix:\n");
 	printf("    corosync-cmapctl [-b] -T key_prefix\n");
 	printf("\n");
+	printf("Display latency histograms (in microseconds) with key prefix:\n");
+	printf("    corosync-cmapctl -L [key_prefix...]\n");
+	printf("\n");
 
 	return (0);
 }
@@ -362,6 +366,19 @@ static void print_key(cmap_handle_t handle,
 	printf("\n");
 }
 
+static void print_dump_fn(cmap_handle_t handle,
+		const char *key_name,
+		const void *value,
+		size_t value_len,
+		cmap_value_types_t type,
+		void *user_data)
+{
+	int *printed = (int *)user_data;
+
+	(*printed)++;
+	print_key(handle, key_name, value_len, value, type);
+}
+
 static void print_iter(cmap_handle_t handle, const char *prefix)
 {
 	cmap_iter_handle_t iter_handle;
@@ -369,7 +386,24 @@ static void print_iter(cmap_handle_t handle, const char *prefix)
 	size_t value_len;
 	cmap_value_types_t type;
 	cs_error_t err;
+	int printed = 0;
+
+	err = cmap_dump_prefix(handle, prefix, print_dump_fn, &printed);
+	if (err == CS_OK) {
+		return ;
+	}
 
+	/*
+	 * Keys printed before a failure would be printed again by iteration
+	 */
+	if (err != CS_ERR_NOT_SUPPORTED || printed > 0) {
+		fprintf (stderr, "Failed to dump keys. Error %s\n", cs_strerror(err));
+		exit (EXIT_FAILURE);
+	}
+
+	/*
+	 * Older corosync doesn't know dump_prefix, fall back to iteration
+	 */
 	err = cmap_iter_init(handle, prefix, &iter_handle);
 	if (err != CS_OK) {
 		fprintf (stderr, "Failed to initialize iteration. Error %s\n", cs_strerror(err));
@@ -382,6 +416,54 @@ static void print_iter(cmap_handle_t handle, const char *prefix)
 	cmap_iter_finalize(handle, iter_handle);
 }
 
+static const char *latency_fields[] = {
+	"count", "mean", "p50", "p90", "p99", "p999", "max"
+};
+
+/*
+ * Print one line per latency histogram (set of <name>.count, .mean, .p50,
+ * ... keys) found under prefix
+ */
+static void print_latency(cmap_handle_t handle, const char *prefix)
+{
+	cmap_iter_handle_t iter_handle;
+	char key_name[CMAP_KEYNAME_MAXLEN + 1];
+	char field_key_name[CMAP_KEYNAME_MAXLEN + 1];
+	size_t value_len;
+	size_t name_len;
+	cmap_value_types_t type;
+	cs_error_t err;
+	uint64_t u64;
+	int i;
+
+	err = cmap_iter_init(handle, prefix, &iter_handle);
+	if (err != CS_OK) {
+		fprintf (stderr, "Failed to initialize iteration. Error %s\n", cs_strerror(err));
+		exit (EXIT_FAILURE);
+	}
+
+	while ((err = cmap_iter_next(handle, iter_handle, key_name, &value_len, &type)) == CS_OK) {
+		name_len = strlen(key_name);
+		if (type != CMAP_VALUETYPE_UINT64 || name_len < 4 ||
+		    strcmp(key_name + name_len - 4, ".p50") != 0) {
+			continue;
+		}
+		key_name[name_len - 4] = '\0';
+
+		printf("%-56s", key_name);
+		for (i = 0; i < sizeof(latency_fields) / sizeof(*latency_fields); i++) {
+			snprintf(field_key_name, sizeof(field_key_name), "%s.%s", key_name, latency_fields[i]);
+			if (cmap_get_uint64(handle, field_key_name, &u64) == CS_OK) {
+				printf(" %9"PRIu64, u64);
+			} else {
+				printf(" %9s", "-");
+			}
+		}
+		printf("\n");
+	}
+	cmap_iter_finalize(handle, iter_handle);
+}
+
 static void delete_with_prefix(cmap_handle_t handle, const char *prefix)
 {
 	cmap_iter_handle_t iter_handle;
@@ -752,7 +834,7 @@ int main(int argc, char *argv[])
 	action = ACTION_PRINT_PREFIX;
 	track_prefix = 1;
 
-	while ((c = getopt(argc, argv, "hgsdDtTbp:")) != -1) {
+	while ((c = getopt(argc, argv, "hgsdDtTbLp:")) != -1) {
 		switch (c) {
 		case 'h':
 			return print_help();
@@ -783,6 +865,9 @@ int main(int argc, char *argv[])
 		case 'T':
 			action = ACTION_TRACK;
 			break;
+		case 'L':
+			action = ACTION_LATENCY;
+			break;
 		case '?':
 			return (EXIT_FAILURE);
 			break;
@@ -801,6 +886,7 @@ int main(int argc, char *argv[])
 
 	if (argc == 0 &&
 	    action != ACTION_LOAD &&
+	    action != ACTION_LATENCY &&
 	    action != ACTION_PRINT_ALL) {
 		fprintf(stderr, "Expected key after options\n");
 		return (EXIT_FAILURE);
@@ -851,6 +937,19 @@ int main(int argc, char *argv[])
 	case ACTION_LOAD:
 		read_in_config_file(handle, settings_file);
 		break;
+	case ACTION_LATENCY:
+		printf("%-56s", "histogram");
+		for (i = 0; i < sizeof(latency_fields) / sizeof(*latency_fields); i++) {
+			printf(" %9s", latency_fields[i]);
+		}
+		printf("\n");
+		if (argc == 0) {
+			print_latency(handle, "runtime.");
+		}
+		for (i = 0; i < argc; i++) {
+			print_latency(handle, argv[i]);
+		}
+		break;
 	case ACTION_TRACK:
 		for (i = 0; i < argc; i++) {
 			add_track(handle, argv[i], track_prefix);